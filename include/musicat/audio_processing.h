@@ -36,9 +36,13 @@ struct processor_states_t
     int ppipefd[2];
     int cpipefd[2];
     /* int rpipefd[2]; */
+    // partial file follower to ffmpeg input
+    int fpipefd[2];
 
     pid_t cpid;
     /* pid_t rpid; */
+    // partial file follower, -1 when not progressive
+    pid_t fpid;
 };
 
 enum run_processor_error_t
@@ -73,6 +77,8 @@ struct processor_options_t
 {
     // static options
     std::string file_path;
+    // file_path is still being downloaded
+    bool progressive;
 
     // settings
     bool debug;
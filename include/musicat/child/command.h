@@ -53,6 +53,17 @@ inline const struct
      * and ytdlp_util_exe (the path/cmd to invoke yt-dlp)
      */
     const std::string dl_music = "dlm";
+
+    /**
+     * Start long lived yt-dlp resolver listening on a unix socket
+     *
+     * Requires file_path (socket path to listen on), ytdlp_util_exe
+     * and optionally ytdlp_lib_path
+     *
+     * Runs until exit command, caller connects to the socket
+     * and sends queries
+     */
+    const std::string ytdlp_resolver = "ytdr";
 } command_execute_commands_t;
 
 // update set_option impl in child/command.cpp when changing this
@@ -77,6 +88,8 @@ inline const struct
      */
     const std::string helper_chain = "ehl"; // str
     const std::string force = "frc";        // bool
+    // audio processor input is a file still being downloaded
+    const std::string progressive = "prg"; // bool
 
     const std::string ytdlp_util_exe = "ytdex";    // str
     const std::string ytdlp_query = "ytdq";        // str
@@ -142,6 +155,12 @@ struct command_options_t
 
     // only for queue stuff like the shutdown queue
     time_t ts_queued;
+
+    /**
+     * file_path is still being downloaded, read its partial file
+     * and follow it until complete
+     */
+    bool progressive;
 };
 
 inline command_options_t
@@ -149,7 +168,7 @@ create_command_options ()
 {
     return { "", "",    false, "", -1,    -1,    -1,    -1,    -1, "",
              "", false, "",    "", "",    100,   "",    false, "", "",
-             -1, "",    "",    "", 10000, false, false, 0 };
+             -1, "",    "",    "", 10000, false, false, 0, false };
 }
 
 inline int
@@ -201,6 +220,10 @@ assign_command_option_key_value (command_options_t &options,
         {
             options.force = value == "1";
         }
+    else if (opt == command_options_keys_t.progressive)
+        {
+            options.progressive = value == "1";
+        }
     else if (opt == command_options_keys_t.ytdlp_util_exe)
         {
             options.ytdlp_util_exe = value;
@@ -6,8 +6,53 @@
 namespace musicat::child::dl_music
 {
 
+// partial file must have at least this many bytes before playback can start
+// from it, enough for ogg headers and a few seconds of audio
+inline constexpr const long PROGRESSIVE_MIN_SIZE = 65536;
+
 std::string get_download_music_fifo_path (const std::string &id);
 
+/**
+ * @brief Path of the file being written while downloading `file_path`,
+ *        renamed to `file_path` once download is complete
+ */
+std::string get_partial_file_path (const std::string &file_path);
+
+/**
+ * @brief Download `url` audio into `file_path` while writing it as a
+ *        playable ogg stream to its partial file. Best opus stream is copied
+ *        as is, best audio stream is transcoded when there's none. Must be
+ *        run in a forked child, forks yt-dlp and ffmpeg and waits for both.
+ *
+ * @return int 0 when `file_path` is complete, partial file is kept
+ *         otherwise for download_converted() to remove
+ */
+int download_progressive (const char *yt_dlp, const char *url,
+                          const std::string &file_path);
+
+/**
+ * @brief Download `url` audio into `file_path` converting it to opus, then
+ *        remove its partial file. Fallback of download_progressive(), its
+ *        follower keeps waiting until the partial file is removed. Must be
+ *        run in a forked child.
+ *
+ * @return int yt-dlp exit status
+ */
+int download_converted (const char *yt_dlp, const char *url,
+                        const std::string &file_path);
+
+/**
+ * @brief Copy `file_path` partial file to `out_fd` following its growth
+ *        until download is complete. Blocks while caught up with the
+ *        writer. When progressive download fails, continues with the ogg
+ *        pages of the complete file the fallback download wrote that come
+ *        after what has been copied. Must be run in a forked child.
+ *
+ * @return int 0 when the whole file has been copied, 1 when download failed
+ *         or `out_fd` closed
+ */
+int follow_partial_file (const std::string &file_path, int out_fd);
+
 } // musicat::child::dl_music
 
 #endif // MUSICAT_CHILD_DL_MUSIC_H
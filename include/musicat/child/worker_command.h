@@ -14,6 +14,8 @@ int call_system (command::command_options_t &options);
 
 int download_music (command::command_options_t &options);
 
+int start_ytdlp_resolver (command::command_options_t &options);
+
 } // musicat::child::worker_command
 
 #endif // MUSICAT_CHILD_WORKER_COMMAND_H
@@ -12,11 +12,19 @@ std::string get_ytdout_fifo_path (const std::string &id);
 
 std::string get_ytdout_json_out_filename (const std::string &id);
 
+std::string get_resolver_socket_path (const std::string &id);
+
 int has_python ();
 
 int run (const command::command_options_t &options, sem_t *sem,
          const std::string &sem_full_key);
 
+/**
+ * @brief Replace current process with yt-dlp resolver serving on
+ *        options.file_path socket, only returns on error
+ */
+int run_resolver (const command::command_options_t &options);
+
 } // musicat::child::ytdlp
 
 #endif // MUSICAT_CHILD_YTDLP_H
@@ -4,13 +4,18 @@
 #include "musicat/player.h"
 #include <libpq-fe.h>
 #include <string>
+#include <vector>
 
 #define ERRBUFSIZE 256
 
+// latency histogram buckets, see get_latency_bucket_bound()
+#define DB_LATENCY_BUCKETS 16
+
 namespace musicat
 {
 /**
- * @brief Almost every function call locks and unlock a single mutex.
+ * @brief Every function call leases a connection from a pool of
+ * get_db_pool_size() connections, waiting when every connection is busy.
  *
  */
 namespace database
@@ -24,6 +29,104 @@ enum get_user_playlist_type : uint8_t
     gup_ts_only,
 };
 
+struct spotify_track_mapping_t
+{
+    std::string spotify_id;
+    std::string youtube_id;
+    // yt-dlp entry of the youtube track
+    nlohmann::json raw;
+};
+
+enum query_error_e
+{
+    // lost or refused connection, server shutting down
+    QUERY_ERROR_CONNECTION,
+    // canceled by cancel() or statement timeout
+    QUERY_ERROR_CANCELED,
+    // unique, foreign key, not null and check violations
+    QUERY_ERROR_CONSTRAINT,
+    QUERY_ERROR_OTHER,
+    QUERY_ERROR_MAX,
+};
+
+struct query_stats_t
+{
+    // statement name, "(raw)" for plain queries and "(pipeline)" for write
+    // behind batches sent at once
+    const char *name;
+    uint64_t calls;
+    // round trip time, in microseconds
+    uint64_t us_total;
+    uint64_t us_max;
+    // rows returned or affected
+    uint64_t rows;
+    uint64_t errors[QUERY_ERROR_MAX];
+    uint64_t histogram[DB_LATENCY_BUCKETS];
+};
+
+struct pool_stats_t
+{
+    size_t size;
+    size_t idle;
+    size_t waiting;
+    // connections currently not CONNECTION_OK
+    size_t bad;
+    uint64_t leases;
+    // time spent waiting for a free connection, in microseconds
+    uint64_t wait_us_total;
+    uint64_t wait_us_max;
+    uint64_t wait_histogram[DB_LATENCY_BUCKETS];
+    uint64_t queries;
+    uint64_t failed_queries;
+    // query round trip time, in microseconds
+    uint64_t query_us_total;
+    uint64_t query_us_max;
+    uint64_t resets;
+};
+
+struct playlist_info_t
+{
+    size_t track_count;
+    // sum of every track duration, in ms
+    uint64_t duration;
+};
+
+struct write_behind_stats_t
+{
+    // guilds with unwritten changes
+    size_t pending;
+    // updates merged into a still pending write
+    uint64_t coalesced;
+    uint64_t written;
+    // writes dropped after failing too many times
+    uint64_t failed;
+    // flush round trips
+    uint64_t batches;
+};
+
+/**
+ * @brief Scoped connection from pool, connection is given back on
+ * destruction. Waits until a connection is free. Connection is null when
+ * database isn't initialized.
+ */
+class ConnLease
+{
+    size_t slot;
+    PGconn *conn;
+
+  public:
+    ConnLease ();
+    ~ConnLease ();
+
+    ConnLease (const ConnLease &) = delete;
+    ConnLease &operator= (const ConnLease &) = delete;
+
+    PGconn *get () const;
+
+    // index of leased connection in pool
+    size_t get_slot () const;
+};
+
 struct player_config
 {
     bool autoplay_state;
@@ -37,7 +140,8 @@ struct player_config
 // -----------------------------------------------------------------------
 
 /**
- * @brief Initialize database, load config and connecting to server
+ * @brief Initialize database, open every pooled connection and create
+ * tables
  *
  * @param _conninfo Connection param
  * @return ConnStatusType Return conn status, 0 (CONNECTION_OK) on sucess
@@ -45,9 +149,18 @@ struct player_config
 ConnStatusType init (const std::string &_conninfo);
 
 /**
- * @brief Cancel currently running query
+ * @brief Initialize database on the embedded store at path instead of a
+ * Postgres server, does nothing when the pool is already connected
+ *
+ * @param path Log file, created when it doesn't exist
+ * @return ConnStatusType CONNECTION_OK on success
+ */
+ConnStatusType init_local (const std::string &path);
+
+/**
+ * @brief Cancel every currently running query
  *
- * @return int 1 on success, else 0
+ * @return int 1 when any query got cancelled, else 0
  */
 int cancel ();
 
@@ -58,18 +171,46 @@ int cancel ();
  */
 void shutdown ();
 
+/**
+ * @brief Doesn't query the server, only reports the last known state
+ *
+ * @return ConnStatusType CONNECTION_OK when at least one pooled connection is
+ * usable
+ */
 ConnStatusType get_conn_status ();
 
 /**
- * @brief Reconnect database, setting the conninfo with new one if provided
+ * @brief Ping idle connections that haven't been used for a while and reset
+ * broken ones, initializes the pool when it hasn't been yet. Meant to be
+ * called periodically.
+ *
+ * @param _conninfo Conn param, replaces current one if provided
+ * @return ConnStatusType Return CONNECTION_OK when at least one connection is
+ * usable
+ */
+ConnStatusType health_check (const std::string &_conninfo = "");
+
+pool_stats_t get_pool_stats ();
+
+/**
+ * @brief Latency stats of every statement, including the ones never run
+ */
+std::vector<query_stats_t> get_query_stats ();
+
+/**
+ * @brief Upper bound of a latency histogram bucket, each bucket doubles the
+ *        previous one starting at 250us
+ *
+ * @return uint64_t microseconds, UINT64_MAX for the last bucket
+ */
+uint64_t get_latency_bucket_bound (size_t bucket);
+
+/**
+ * @brief Storage the database functions currently run on
  *
- * @param force Whether to force even it's not needed to reconnect
- * @param _conninfo Conn param
- * @return ConnStatusType Return CONNECTION_OK on success or not needing to
- * reconnect
+ * @return const char* "postgres", "local" or "none"
  */
-ConnStatusType reconnect (bool force = false,
-                          const std::string &_conninfo = "");
+const char *get_backend_name ();
 
 /**
  * @brief Get current connect param
@@ -145,11 +286,41 @@ get_user_playlist (const dpp::snowflake &user_id, const std::string &name,
  *
  * @param res PGresult object
  * @return std::pair<std::deque<player::MCTrack>, int> code -1 if json is null,
- * -2 if no row found in the table else 0
+ * -2 if no row found in the table, -3 if the stored tracks can't be decoded
+ * else 0
  */
 std::pair<std::deque<player::MCTrack>, int>
 get_playlist_from_PGresult (PGresult *res);
 
+/**
+ * @brief Get tracks [start, start + count) of user playlist with id `name`,
+ * to be parsed by get_playlist_from_PGresult(). Only rows of the requested
+ * tracks are read. PGresult pointer must be freed using finish_res()
+ *
+ * @param user_id
+ * @param name
+ * @param start Position of first track, 0 based
+ * @param count
+ * @return std::pair<PGresult*, ExecStatusType> Return code -1 if user_id is 0,
+ * -3 if name is empty
+ */
+std::pair<PGresult *, ExecStatusType>
+get_user_playlist_page (const dpp::snowflake &user_id,
+                        const std::string &name, size_t start, size_t count);
+
+/**
+ * @brief Get track count and total duration of user playlist with id `name`.
+ * Playlist saved by an older version is rewritten into track rows first.
+ *
+ * @param user_id
+ * @param name
+ * @return std::pair<playlist_info_t, int> code -1 if user_id is 0, -2 if
+ * playlist not found, -3 on database or decode error else 0
+ */
+std::pair<playlist_info_t, int>
+get_user_playlist_info (const dpp::snowflake &user_id,
+                        const std::string &name);
+
 /**
  * @brief Update user playlist with id `name`, can be insertion or an update
  *
@@ -174,20 +345,21 @@ ExecStatusType delete_user_playlist (const dpp::snowflake &user_id,
                                      const std::string &name);
 
 /**
- * @brief Update guild current queue in table
+ * @brief Update guild current queue in table and wait for it. Queue is saved
+ * as one row per track, only rows of changed tracks are written.
  *
  * @param guild_id
  * @param playlist New queue
- * @return ExecStatusType -1 if guild_id is 0, -2 if playlist have no size
- * 			-3 if failed to create new table, PGRES_COMMAND_OK on
- * success
+ * @return ExecStatusType -1 if guild_id is 0, -2 if playlist have no size,
+ * PGRES_COMMAND_OK on success
  */
 ExecStatusType
 update_guild_current_queue (const dpp::snowflake &guild_id,
                             const std::deque<player::MCTrack> &playlist);
 
 /**
- * @brief Get saved guild playback, PGresult pointer must be freed using
+ * @brief Get saved guild playback, to be parsed by
+ * get_playlist_from_PGresult(). PGresult pointer must be freed using
  * finish_res()
  *
  * @param guild_id
@@ -198,11 +370,11 @@ std::pair<PGresult *, ExecStatusType>
 get_guild_current_queue (const dpp::snowflake &guild_id);
 
 /**
- * @brief Delete guild current queue row from table
+ * @brief Delete every saved track of guild current queue and wait for it
  *
  * @param guild_id
- * @return ExecStatusType PGRES_FATAL_ERROR if row not found in table, -1 if
- * guild_id is 0 else PGRES_TUPLES_OK
+ * @return ExecStatusType -1 if guild_id is 0, PGRES_FATAL_ERROR on failure
+ * else PGRES_COMMAND_OK
  */
 ExecStatusType delete_guild_current_queue (const dpp::snowflake &guild_id);
 
@@ -261,6 +433,148 @@ get_equalizer_preset (const std::string &name);
 ExecStatusType create_equalizer_preset (const std::string &name,
                                         const std::string &value,
                                         const dpp::snowflake &user_id);
+
+/**
+ * @brief Get known youtube tracks of spotify track ids in a single query,
+ * ids without mapping are simply missing from the result
+ *
+ * @param spotify_ids
+ * @return std::pair<std::vector<spotify_track_mapping_t>, ExecStatusType>
+ * status -1 if spotify_ids is empty, else PGRES_TUPLES_OK on success
+ */
+std::pair<std::vector<spotify_track_mapping_t>, ExecStatusType>
+get_spotify_track_mappings (const std::vector<std::string> &spotify_ids);
+
+/**
+ * @brief Insert or replace spotify to youtube track mappings in a single
+ * query
+ *
+ * @param mappings
+ * @return ExecStatusType -1 if mappings is empty, else PGRES_COMMAND_OK on
+ * success
+ */
+ExecStatusType update_spotify_track_mappings (
+    const std::vector<spotify_track_mapping_t> &mappings);
+
+// -----------------------------------------------------------------------
+// WRITE BEHIND
+// -----------------------------------------------------------------------
+
+/**
+ * @brief Schedule update_guild_current_queue() without waiting for it.
+ * playlist is diffed against the last saved one, only inserted and removed
+ * tracks are queued as row operations. Operations of the same guild within a
+ * short window are coalesced, many guilds are flushed in a single round
+ * trip. Pending writes are flushed by shutdown().
+ *
+ * @param guild_id
+ * @param playlist Changed tracks are copied before returning
+ * @return bool false if database isn't initialized or nothing to write
+ */
+bool
+defer_update_guild_current_queue (const dpp::snowflake &guild_id,
+                                  const std::deque<player::MCTrack> &playlist);
+
+/**
+ * @brief Schedule delete_guild_current_queue(), replaces any pending queue
+ * update of the guild
+ */
+bool defer_delete_guild_current_queue (const dpp::snowflake &guild_id);
+
+/**
+ * @brief Schedule update_guild_player_config(), merged with any pending
+ * config update of the guild, null params keep the pending value
+ */
+bool defer_update_guild_player_config (
+    const dpp::snowflake &guild_id, const bool *autoplay_state,
+    const int *autoplay_threshold, const player::loop_mode_t *loop_mode,
+    const nlohmann::json &fx_states = nullptr);
+
+/**
+ * @brief Write pending deferred updates now, blocks until done
+ *
+ * @param guild_id Only flush this guild, 0 for all
+ * @return size_t Number of guild written
+ */
+size_t flush_deferred (const dpp::snowflake &guild_id = 0);
+
+write_behind_stats_t get_write_behind_stats ();
+
+// -----------------------------------------------------------------------
+// PRELOAD
+// -----------------------------------------------------------------------
+
+/**
+ * @brief Read every saved player config and the ids of guilds with a saved
+ * queue, rows are streamed instead of buffered. Meant to be called once on
+ * boot before connecting to Discord.
+ *
+ * @return int Number of config preloaded, -1 on error
+ */
+int preload_guild_states ();
+
+/**
+ * @brief Queue guild saved queue to be read by the next
+ * preload_requested_guild_current_queues() call, does nothing when guild
+ * has none saved
+ */
+void request_guild_current_queue_preload (const dpp::snowflake &guild_id);
+
+/**
+ * @brief Read queued saved queues, many guilds per query. Blocks until
+ * done.
+ *
+ * @return size_t Number of queue preloaded
+ */
+size_t preload_requested_guild_current_queues ();
+
+/**
+ * @brief Take guild config read by preload_guild_states(), later calls for
+ * the same guild return -1
+ *
+ * @return int 0 when out is set, 1 if guild has no saved config, -1 when not
+ * preloaded and database needs to be queried
+ */
+int take_preloaded_guild_player_config (const dpp::snowflake &guild_id,
+                                        player_config &out);
+
+/**
+ * @brief Take guild queue read by preload_requested_guild_current_queues(),
+ * later calls for the same guild return -1
+ *
+ * @return int 0 when out is set, 1 if guild has no saved queue, -1 when not
+ * preloaded and database needs to be queried
+ */
+int take_preloaded_guild_current_queue (const dpp::snowflake &guild_id,
+                                        std::deque<player::MCTrack> &out);
+
+// -----------------------------------------------------------------------
+// NAME INDEX
+// -----------------------------------------------------------------------
+
+/**
+ * @brief Search user playlist names in memory, every name of the user is
+ * read from database on first search and kept in sync by
+ * update_user_playlist() and delete_user_playlist()
+ *
+ * @param query trimmed and matched case insensitively, empty matches every
+ * name
+ * @param fuzzy match query as subsequence instead of substring
+ * @return std::vector<std::string> at most limit names sorted by name, empty
+ * when database can't be read
+ */
+std::vector<std::string>
+search_user_playlist_names (const dpp::snowflake &user_id,
+                            const std::string &query, size_t limit = 25,
+                            bool fuzzy = false);
+
+/**
+ * @brief Same as search_user_playlist_names() for every equalizer preset,
+ * kept in sync by create_equalizer_preset()
+ */
+std::vector<std::string>
+search_equalizer_preset_names (const std::string &query, size_t limit = 25,
+                               bool fuzzy = false);
 } // database
 } // nusicat
 
@@ -0,0 +1,58 @@
+#ifndef MUSICAT_DB_LOCAL_H
+#define MUSICAT_DB_LOCAL_H
+
+#include <cstdint>
+#include <libpq-fe.h>
+#include <string>
+
+/**
+ * @brief Embedded storage backend used when no Postgres server is available.
+ *        Every table lives in memory and each change is appended to a log
+ *        file, which is replayed on open and rewritten with only live
+ *        records once it grows too much. Runs the same named statements as
+ *        the Postgres backend and answers with PGresult built on the client,
+ *        so callers can't tell the two apart.
+ */
+namespace musicat::database::local
+{
+
+struct stats_t
+{
+    // live records in every table
+    size_t records;
+    // bytes, including overwritten and deleted records
+    uint64_t log_size;
+    // bytes the log would take after compaction
+    uint64_t live_size;
+    uint64_t compactions;
+};
+
+/**
+ * @brief Open log file at path, creating it when it doesn't exist, and
+ *        replay it. A torn record at the end of the log is truncated away.
+ *
+ * @return int 0 on success, -1 when the file can't be opened or isn't a log
+ */
+int init (const std::string &path);
+
+/**
+ * @brief Flush and close the log, every table is emptied
+ */
+void shutdown ();
+
+bool is_open ();
+
+/**
+ * @brief Run statement name of the database statement registry. Thread safe,
+ *        a change is logged and applied as a whole or not at all.
+ *
+ * @param params statement parameters as text, NULL for SQL NULL
+ * @return PGresult* must be freed with PQclear(), NULL when not open
+ */
+PGresult *exec (const char *name, int nparams, const char *const *params);
+
+stats_t get_stats ();
+
+} // musicat::database::local
+
+#endif // MUSICAT_DB_LOCAL_H
@@ -0,0 +1,64 @@
+#ifndef MUSICAT_DOWNLOAD_SCHEDULER_H
+#define MUSICAT_DOWNLOAD_SCHEDULER_H
+
+#include <dpp/dpp.h>
+#include <string>
+
+/**
+ * @brief Queue of track downloads run by at most
+ *        get_max_concurrent_downloads() workers, highest priority first.
+ *        A file is only ever downloaded once at a time.
+ */
+namespace musicat::download_scheduler
+{
+
+// lower value runs first
+enum priority_e
+{
+    PRIORITY_NOW_PLAYING,
+    PRIORITY_NEXT_UP,
+    PRIORITY_QUEUED,
+    PRIORITY_PREFETCH,
+};
+
+enum enqueue_status_e
+{
+    ENQUEUE_STATUS_QUEUED,
+    // already waiting, priority raised if the new one is higher
+    ENQUEUE_STATUS_PENDING,
+    ENQUEUE_STATUS_RUNNING,
+};
+
+struct stats_t
+{
+    size_t pending;
+    size_t running;
+    size_t workers;
+    uint64_t completed;
+    uint64_t cancelled;
+};
+
+/**
+ * @brief Schedule download, starts a worker if under concurrency limit.
+ *        Worker calls Manager::run_download.
+ */
+enqueue_status_e enqueue (const std::string &fname, const std::string &url,
+                          const dpp::snowflake &guild_id,
+                          priority_e priority);
+
+/**
+ * @brief Drop `guild_id` interest in a pending download, the download is
+ *        removed once no guild wants it anymore. Running download can't be
+ *        cancelled and will finish.
+ *
+ * @return bool true when download has been removed
+ */
+bool cancel (const std::string &fname, const dpp::snowflake &guild_id);
+
+bool is_scheduled (const std::string &fname);
+
+stats_t get_stats ();
+
+} // musicat::download_scheduler
+
+#endif // MUSICAT_DOWNLOAD_SCHEDULER_H
@@ -0,0 +1,13 @@
+#ifndef MUSICAT_EVENTS_ON_GUILD_MEMBER_ADD_H
+#define MUSICAT_EVENTS_ON_GUILD_MEMBER_ADD_H
+
+#include <dpp/dpp.h>
+
+namespace musicat::events
+{
+
+void on_guild_member_add (dpp::cluster *client);
+
+} // musicat::events
+
+#endif // MUSICAT_EVENTS_ON_GUILD_MEMBER_ADD_H
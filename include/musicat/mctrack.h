@@ -67,8 +67,10 @@ bool is_short (const player::MCTrack &track);
  *        or get the detail of a track
  *        This is blocking call that WILL block your thread
  *        for a good amount of time (it uses python!)
+ *
+ * @return Result shared with the resolver cache, nullptr on failure
  */
-nlohmann::json fetch (const search_option_t &options);
+std::shared_ptr<const nlohmann::json> fetch (const search_option_t &options);
 
 } // musicat::mctrack
 
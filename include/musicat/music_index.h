@@ -0,0 +1,122 @@
+#ifndef MUSICAT_MUSIC_INDEX_H
+#define MUSICAT_MUSIC_INDEX_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Index of every cached track in music folder, kept in memory and
+ *        persisted to a file in music folder so the folder never has to be
+ *        scanned again after the first startup.
+ */
+namespace musicat::music_index
+{
+
+struct entry_t
+{
+    // unique for the lifetime of the index file
+    uint64_t id;
+    // file name with .opus extension
+    std::string filename;
+    // file size in bytes
+    size_t size;
+    // last time this track was downloaded or played
+    time_t atime;
+    // in ms, 0 when it never been played
+    uint64_t duration;
+    uint64_t play_count;
+    // GDSF eviction priority, lowest is evicted first
+    double priority;
+};
+
+/**
+ * @brief Load index file and reconcile it with music folder content, build
+ *        it from music folder when it doesn't exist. Should be called once on
+ *        startup before any other function.
+ *
+ * @return int 0 on success, 1 when music folder isn't configured, -1 when
+ *         index file can't be read and folder can't be scanned
+ */
+int load ();
+
+/**
+ * @brief Write index to disk if it changed since last save. Thread safe,
+ *        can be called periodically.
+ *
+ * @return int 0 on success or nothing to save, -1 on write error
+ */
+int save ();
+
+/**
+ * @brief Add or update file entry, call after a file finished downloading
+ */
+void add (const std::string &filename, size_t size, time_t atime);
+
+/**
+ * @brief Update file size keeping its stats, adds it if not indexed yet.
+ *        Used for changes made outside of the bot
+ */
+void update (const std::string &filename, size_t size);
+
+/**
+ * @brief Reconcile index with music folder content, only needed when
+ *        changes might have been missed
+ *
+ * @return int 0 on success, 1 when music folder isn't configured, -1 when
+ *         folder can't be read
+ */
+int rescan ();
+
+/**
+ * @brief Bump play count and access time of file, adds it if not indexed yet
+ *
+ * @param size 0 to keep the known one, eg. when still downloading
+ * @param duration track duration in ms, 0 to keep the known one
+ */
+void on_play (const std::string &filename, size_t size, uint64_t duration);
+
+/**
+ * @brief Remove file entry, call after the file has been unlinked
+ *
+ * @return bool false when file isn't indexed
+ */
+bool remove (const std::string &filename);
+
+/**
+ * @brief Remove file entry after it has been unlinked to free space, ages
+ *        every other entry by raising the priority future hits start from
+ *
+ * @return bool false when file isn't indexed
+ */
+bool evict (const std::string &filename);
+
+/**
+ * @brief Lowest priority entries first
+ *
+ * @param amount maximum entries to return
+ * @param skip file names to leave out, eg. queued or currently playing
+ */
+std::vector<entry_t>
+get_eviction_candidates (size_t amount,
+                         const std::unordered_set<std::string> &skip);
+
+bool exists (const std::string &filename);
+
+/**
+ * @brief Copy of indexed entries in no particular order
+ *
+ * @param amount maximum entries to return, 0 for all
+ */
+std::vector<entry_t> list (size_t amount = 0);
+
+// sum of every indexed file size in bytes
+size_t get_total_size ();
+
+size_t get_count ();
+
+} // musicat::music_index
+
+#endif // MUSICAT_MUSIC_INDEX_H
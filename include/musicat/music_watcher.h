@@ -0,0 +1,22 @@
+#ifndef MUSICAT_MUSIC_WATCHER_H
+#define MUSICAT_MUSIC_WATCHER_H
+
+/**
+ * @brief Watch music folder with inotify and apply every change to music
+ *        index as it happens, including changes made outside of the bot.
+ */
+namespace musicat::music_watcher
+{
+
+/**
+ * @brief Start watcher thread, it exits by itself once running state is
+ *        false. Must be called after music_index::load.
+ *
+ * @return int 0 on success, 1 when music folder isn't configured, -1 when
+ *         inotify can't be initialized
+ */
+int init ();
+
+} // musicat::music_watcher
+
+#endif // MUSICAT_MUSIC_WATCHER_H
@@ -371,6 +371,46 @@ void set_should_check_music_cache (bool v);
 
 size_t get_max_music_cache_size ();
 
+/**
+ * @brief Approximate memory limit of server response cache in bytes,
+ *        least recently used entries are evicted to stay under this limit
+ */
+size_t get_max_service_cache_size ();
+
+/**
+ * @brief Maximum yt-dlp downloads running at once, at least 1
+ */
+size_t get_max_concurrent_downloads ();
+
+/**
+ * @brief Database connections opened at once, at least 1
+ */
+size_t get_db_pool_size ();
+
+/**
+ * @brief Queries and connection waits taking longer than this are logged,
+ *        0 disables the log
+ */
+uint64_t get_db_slow_query_ms ();
+
+/**
+ * @brief How many upcoming queue entries to download ahead of time,
+ *        0 disables prefetch
+ */
+size_t get_download_prefetch_count ();
+
+/**
+ * @brief Approximate memory limit of search result cache in bytes,
+ *        least recently used entries are evicted to stay under this limit
+ */
+size_t get_max_search_cache_size ();
+
+/**
+ * @brief Whether search result cache is written to music folder on shutdown
+ *        and loaded back on startup
+ */
+bool get_search_cache_snapshot ();
+
 } // musicat
 
 #endif
@@ -3,6 +3,7 @@
 
 #include "musicat/player.h"
 #include <any>
+#include <functional>
 #include <memory>
 #include <string>
 
@@ -10,11 +11,29 @@ namespace musicat
 {
 namespace paginate
 {
+/**
+ * @brief Render page at index into embed
+ *
+ * @return false if the page can't be rendered
+ */
+using page_renderer_t = std::function<bool (size_t page, dpp::embed &embed)>;
+
+/**
+ * @brief Fetch at most count tracks of a list starting at index start
+ *
+ * @return false on error
+ */
+using track_loader_t = std::function<bool (
+    size_t start, size_t count, std::deque<player::MCTrack> &tracks)>;
+
 struct pages_t
 {
     dpp::cluster *client;
     std::shared_ptr<dpp::message> message;
     std::vector<dpp::embed> pages;
+    // when set, pages are rendered on demand instead of read from pages
+    page_renderer_t renderer;
+    size_t page_count;
     size_t current;
     bool has_storage_data;
 
@@ -26,6 +45,8 @@ struct pages_t
              bool has_storage_data = false);
     ~pages_t ();
 
+    size_t size () const;
+
     /**
      * @brief Edit callback, call inside callback lambda
      *
@@ -57,6 +78,14 @@ dpp::command_completion_event_t
 get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
                     dpp::cluster *client, std::vector<dpp::embed> embeds,
                     std::any storage_data = std::any ());
+
+/**
+ * @brief Same as above but every page is rendered on demand by renderer
+ */
+dpp::command_completion_event_t
+get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
+                    dpp::cluster *client, page_renderer_t renderer,
+                    size_t page_count);
 void add_pagination_buttons (dpp::message *msg);
 
 void handle_on_message_delete (const dpp::message_delete_t &event);
@@ -74,6 +103,23 @@ void reply_paginated_playlist (const dpp::interaction_create_t &event,
                                std::deque<player::MCTrack> queue,
                                const std::string &title = "Queue",
                                const bool edit_response = false);
+
+/**
+ * @brief Same as above but only tracks of the shown page are fetched with
+ * loader, every time the page is shown
+ *
+ * @param event
+ * @param loader
+ * @param track_count
+ * @param total_duration Sum of every track duration in ms
+ * @param title
+ * @param edit_response edit
+ */
+void reply_paginated_playlist (const dpp::interaction_create_t &event,
+                               track_loader_t loader, size_t track_count,
+                               uint64_t total_duration,
+                               const std::string &title = "Queue",
+                               const bool edit_response = false);
 }
 }
 
@@ -2,6 +2,7 @@
 #define SHA_PLAYER_H
 
 #include "musicat/config.h"
+#include "musicat/download_scheduler.h"
 #include "yt-search/yt-search.h"
 #include "yt-search/yt-track-info.h"
 #include <deque>
@@ -10,6 +11,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace musicat
@@ -129,10 +131,8 @@ struct gat_t
     std::string fullname;
     std::string fullpath;
     // File size in bytes
-    // Will be 0 with with_size = false
     size_t size;
-    // Timestamp when file last accessed
-    // Will be 0 with with_size = false
+    // Timestamp when file last downloaded or played
     time_t last_access;
 };
 
@@ -382,6 +382,12 @@ class Player
 
     size_t remove_track_by_user (const dpp::snowflake &user_id);
 
+    /**
+     * @brief Cancel scheduled downloads of removed tracks which aren't in
+     *        the queue anymore. Must be called after they're removed
+     */
+    void cancel_downloads (const std::deque<MCTrack> &removed);
+
     bool pause (dpp::discord_client *from, const dpp::snowflake &user_id);
 
     bool shuffle (bool update_info_embed = true);
@@ -614,13 +620,57 @@ class Manager
                                               const int64_t &amount = 1,
                                               const bool remove = false);
 
+    /**
+     * @brief Schedule track download, marks it as waiting right away.
+     *        Duplicate request only raises the scheduled priority.
+     */
     void download (const std::string &fname, const std::string &url,
-                   const dpp::snowflake &guild_id);
+                   const dpp::snowflake &guild_id,
+                   download_scheduler::priority_e priority
+                   = download_scheduler::PRIORITY_QUEUED);
+
+    /**
+     * @brief Download track and wait until it's done, called by download
+     *        scheduler worker
+     */
+    void run_download (const std::string &fname, const std::string &url,
+                       const dpp::snowflake &guild_id);
+
+    /**
+     * @brief Cancel scheduled download of a track removed from guild queue,
+     *        waiters are notified when cancelled
+     *
+     * @return bool false when it's still wanted by other guild or already
+     *         running
+     */
+    bool cancel_download (const std::string &fname,
+                          const dpp::snowflake &guild_id);
+
+    /**
+     * @brief Schedule download of the next few queue entries that aren't
+     *        cached yet. Must lock `guild_player->t_mutex`
+     */
+    void prefetch_queue (std::shared_ptr<Player> guild_player);
 
     void wait_for_download (const std::string &file_name);
 
+    /**
+     * @brief Wait until file is either done downloading or has enough of its
+     *        partial file written to start playing it while downloading
+     *
+     * @return bool true when file can be played progressively, false when
+     *         it isn't downloading anymore
+     */
+    bool wait_for_playable (const std::string &file_name);
+
     bool is_waiting_file_download (const std::string &file_name);
 
+    /**
+     * @brief File names currently playing, queued, waiting to be played or
+     *        downloading in any guild. These must not be evicted
+     */
+    std::unordered_set<std::string> get_in_use_files ();
+
     void stream (const dpp::snowflake &guild_id, player::MCTrack &track);
 
     void prepare_play_stage_channel_routine (
@@ -843,16 +893,19 @@ effect_states_list_t *get_effect_states_list ();
 // ================================================================================
 
 /**
- * @brief Get all available track to use, locks a mutex since readdir is
- *        not thread safe
+ * @brief Get all available track to use from music index, never touches
+ *        the filesystem
  * @param amount Amount of track to return
- * @param with_stat Stat the file
  *
  * @return std::vector<gat_t>
  */
-std::vector<gat_t> get_available_tracks (const size_t &amount = 0,
-                                         bool with_stat = false);
+std::vector<gat_t> get_available_tracks (const size_t &amount = 0);
 
+/**
+ * @brief Start evicting lowest priority cached music in batches on a
+ *        background thread until total size goes under `size_limit`. Files
+ *        in use are never evicted. Does nothing if already evicting.
+ */
 void control_music_cache (const size_t size_limit);
 
 // ================================================================================
@@ -875,7 +928,9 @@ std::pair<bool, int> track_exist (const std::string &fname,
                                   player::player_manager_ptr_t player_manager,
                                   bool from_interaction,
                                   dpp::snowflake guild_id,
-                                  bool no_download = false);
+                                  bool no_download = false,
+                                  download_scheduler::priority_e priority
+                                  = download_scheduler::PRIORITY_QUEUED);
 
 /**
  * @brief Search and add track to guild queue, can be used for interaction and
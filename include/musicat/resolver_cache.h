@@ -0,0 +1,93 @@
+#ifndef MUSICAT_RESOLVER_CACHE_H
+#define MUSICAT_RESOLVER_CACHE_H
+
+#include "nlohmann/json.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Parsed yt-dlp resolver results kept in memory, least recently used
+ *        are dropped past the size limit. Stale entries are still served
+ *        while being refreshed in the background. Persisted to a file in
+ *        music folder so they survive restarts.
+ */
+namespace musicat::resolver_cache
+{
+
+// seconds a result is served without refreshing
+inline constexpr const long long SEARCH_FRESH_TTL = 60 * 60;
+inline constexpr const long long URL_FRESH_TTL = 6 * 60 * 60;
+
+// seconds past fresh ttl a result is still served while refreshing,
+// it's treated as a miss after this
+inline constexpr const long long STALE_TTL = 7 * 24 * 60 * 60;
+
+struct stats_t
+{
+    uint64_t hits;
+    // served while refreshed in background
+    uint64_t stale_hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    // approximate, in bytes
+    size_t size;
+    size_t max_size;
+};
+
+/**
+ * @brief Cache key of a query, search query is case and whitespace
+ *        insensitive while url is kept as is
+ */
+std::string create_key (const std::string &query, int max_entries,
+                        bool is_url);
+
+/**
+ * @brief Get cached result, shared with the cache so it's never copied
+ *
+ * @param stale set to true when result should be refreshed
+ *
+ * @return nullptr on miss or expired
+ */
+std::shared_ptr<const nlohmann::json> get (const std::string &key,
+                                           bool &stale);
+
+/**
+ * @brief Store result, replacing existing one. Null result is ignored
+ *
+ * @param fresh_ttl seconds until stale
+ */
+void set (const std::string &key, std::shared_ptr<const nlohmann::json> result,
+          long long fresh_ttl);
+
+/**
+ * @brief Claim background refresh of `key`
+ *
+ * @return bool false when it's already being refreshed
+ */
+bool begin_refresh (const std::string &key);
+
+void end_refresh (const std::string &key);
+
+/**
+ * @brief Load persisted entries, should be called once on startup
+ *
+ * @return int 0 on success or no file yet, 1 when music folder isn't
+ *         configured, -1 when the file exists but can't be read
+ */
+int load ();
+
+/**
+ * @brief Persist entries if changed, at most once every few minutes unless
+ *        `force`
+ *
+ * @return int 0 on success or nothing to save, -1 on write error
+ */
+int save (bool force = false);
+
+stats_t get_stats ();
+
+} // musicat::resolver_cache
+
+#endif // MUSICAT_RESOLVER_CACHE_H
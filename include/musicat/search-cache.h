@@ -1,5 +1,8 @@
-#include "yt-search/yt-search.h"
-#include <map>
+#ifndef MUSICAT_SEARCH_CACHE_H
+#define MUSICAT_SEARCH_CACHE_H
+
+#include "musicat/player.h"
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -7,14 +10,61 @@ namespace musicat
 {
 namespace search_cache
 {
-using track_v_t = std::vector<yt_search::YTrack>;
-using search_cache_map_t = std::map<std::string, track_v_t>;
+using track_v_t = std::vector<player::MCTrack>;
+
+// cached results are shared and never modified, copy it before modifying
+using value_t = std::shared_ptr<const track_v_t>;
+
+struct stats_t
+{
+    uint64_t hits;
+    uint64_t misses;
+    // entries removed to stay under memory limit
+    uint64_t evictions;
+    size_t entries;
+    // approximate, in bytes
+    size_t size;
+    size_t max_size;
+};
+
+/**
+ * @brief Returns null when there's no entry
+ */
+value_t get (const std::string &id);
 
-track_v_t get (const std::string &id);
+/**
+ * @brief Store results, replacing existing one. Evicts least recently used
+ *        entries when memory limit is exceeded.
+ *
+ * @return value_t stored results, can be set to other id without copying
+ */
+value_t set (const std::string &id, track_v_t val);
 
-int set (const std::string &id, const track_v_t &val);
+/**
+ * @brief Store already cached results under another id
+ */
+void set (const std::string &id, const value_t &val);
 
 size_t remove (const std::string &id);
 
+stats_t get_stats ();
+
+/**
+ * @brief Load snapshot from music folder when enabled, should be called
+ *        once on startup
+ *
+ * @return int 0 on success, disabled or no snapshot yet
+ */
+int load ();
+
+/**
+ * @brief Write snapshot to music folder when enabled, call on shutdown
+ *
+ * @return int 0 on success or disabled, -1 on write error
+ */
+int save ();
+
 } // search_cache
 } // musicat
+
+#endif // MUSICAT_SEARCH_CACHE_H
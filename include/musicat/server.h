@@ -29,6 +29,8 @@ inline constexpr const struct
     const char *UNAUTHORIZED_401 = "401 Unauthorized";
     const char *FORBIDDEN_403 = "403 Forbidden";
     const char *NOT_FOUND_404 = "404 Not Found";
+    const char *REQUEST_TIMEOUT_408 = "408 Request Timeout";
+    const char *PAYLOAD_TOO_LARGE_413 = "413 Payload Too Large";
     const char *INTERNAL_SERVER_ERROR_500 = "500 Internal Server Error";
 } http_status_t;
 
@@ -63,9 +65,6 @@ int shutdown ();
 
 int run ();
 
-// should call this in main loop to keep states in check
-void main_loop_routine ();
-
 } // musicat::server
 
 #endif // MUSICAT_SERVER_H
@@ -0,0 +1,110 @@
+#ifndef MUSICAT_SERVER_BODY_PARSER_H
+#define MUSICAT_SERVER_BODY_PARSER_H
+
+#include "nlohmann/json.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace musicat::server::body_parser
+{
+
+enum parse_status_e
+{
+    PARSE_STATUS_OK,
+    // need more chunk to complete the document
+    PARSE_STATUS_INCOMPLETE,
+    PARSE_STATUS_ERROR_SYNTAX,
+    PARSE_STATUS_ERROR_TOO_LARGE,
+    PARSE_STATUS_ERROR_TOO_DEEP,
+};
+
+/**
+ * @brief Push parser building a json document from request body chunks as
+ *        they arrive, so the raw body never has to be buffered whole and
+ *        invalid or oversized body is rejected on the first offending chunk.
+ *
+ *        Once an error is returned every subsequent call returns the same
+ *        error.
+ */
+struct json_parser_t
+{
+    json_parser_t (size_t _max_size, size_t _max_depth);
+
+    /**
+     * @brief Consume next body chunk
+     *
+     * @return PARSE_STATUS_INCOMPLETE while the document isn't complete yet,
+     *         PARSE_STATUS_OK when a complete document has been parsed,
+     *         error status otherwise
+     */
+    parse_status_e feed (std::string_view chunk);
+
+    /**
+     * @brief Call after the last chunk has been fed
+     *
+     * @return PARSE_STATUS_OK when body is a single complete document, error
+     *         status otherwise
+     */
+    parse_status_e finish ();
+
+    // the parsed document, only complete when finish() returns OK
+    nlohmann::json &get ();
+
+    size_t get_size () const;
+
+  private:
+    enum state_e
+    {
+        STATE_VALUE,
+        STATE_ARRAY_VALUE_OR_END,
+        STATE_OBJECT_KEY_OR_END,
+        STATE_OBJECT_KEY,
+        STATE_COLON,
+        STATE_AFTER_VALUE,
+        STATE_STRING,
+        STATE_STRING_ESCAPE,
+        STATE_STRING_UNICODE,
+        STATE_NUMBER,
+        STATE_LITERAL,
+        STATE_DONE,
+    };
+
+    size_t max_size;
+    size_t max_depth;
+    size_t size;
+
+    parse_status_e status;
+    state_e state;
+
+    nlohmann::json root;
+    // open containers, innermost at back. Ancestors are never modified while
+    // a child is open so these pointers stay valid
+    std::vector<nlohmann::json *> stack;
+
+    // string or number being read, or pending object key
+    std::string buf;
+    std::string key;
+    bool string_is_key;
+
+    // \uXXXX escape
+    unsigned int unicode_cp;
+    int unicode_digits;
+    unsigned int high_surrogate;
+
+    const char *literal;
+    size_t literal_i;
+
+    parse_status_e fail (parse_status_e s);
+    bool consume (char c);
+    bool begin_value (char c);
+    bool emit (nlohmann::json &&v);
+    bool open_container (nlohmann::json &&v, state_e next);
+    bool close_container (bool is_object);
+    bool end_number ();
+    void append_codepoint (unsigned int cp);
+};
+
+} // musicat::server::body_parser
+
+#endif // MUSICAT_SERVER_BODY_PARSER_H
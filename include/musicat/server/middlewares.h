@@ -12,7 +12,7 @@ void load_cors_enabled_origin ();
 header_v_t cors (APIResponse *res, APIRequest *req,
                  const header_v_t &additional_headers
                  = { { "Access-Control-Expose-Headers",
-                       "Content-Length,Content-Range" } });
+                       "Content-Length,Content-Range,ETag" } });
 
 void set_content_type_json (APIResponse *res);
 
@@ -29,6 +29,12 @@ process_curlpp_response_t (const services::curlpp_response_t &resp,
 
 void set_guild_is_mutual (const std::string &user_id, nlohmann::json &guild);
 
+/**
+ * @brief Whether request `If-None-Match` header matches `etag`. Doesn't
+ *        respond, caller should reply with 304 Not Modified when true
+ */
+bool etag_match (APIRequest *req, std::string_view etag);
+
 } // musicat::server::middlewares
 
 #endif // MUSICAT_SERVER_MIDDLEWARES_H
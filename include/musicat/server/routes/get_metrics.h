@@ -0,0 +1,13 @@
+#ifndef MUSICAT_SERVER_ROUTES_GET_METRICS_H
+#define MUSICAT_SERVER_ROUTES_GET_METRICS_H
+
+#include "musicat/server.h"
+
+namespace musicat::server::routes
+{
+
+void get_metrics (APIResponse *res, APIRequest *req);
+
+} // musicat::server::routes
+
+#endif // MUSICAT_SERVER_ROUTES_GET_METRICS_H
@@ -3,34 +3,90 @@
 
 #include "nlohmann/json.hpp"
 #include <dpp/dpp.h>
-#include <mutex>
+#include <memory>
 
 namespace musicat::server::service_cache
 {
 
-/* extern std::mutex cache_m; // EXTERN_VARIABLE */
+// cached values are shared and never modified, copy it before modifying
+using value_t = std::shared_ptr<const nlohmann::json>;
 
-void set (const std::string &key, const nlohmann::json &value);
+// serialized response body ready to be written as is
+struct cached_response_t
+{
+    std::string body;
+    // quoted strong ETag of body
+    std::string etag;
+};
+
+using response_t = std::shared_ptr<const cached_response_t>;
 
-nlohmann::json get (const std::string &key);
+struct stats_t
+{
+    uint64_t hits;
+    uint64_t misses;
+    // entries removed to stay under memory limit
+    uint64_t evictions;
+    uint64_t expirations;
+    size_t entries;
+    // approximate, in bytes
+    size_t size;
+    size_t max_size;
+};
+
+/**
+ * @brief Store value, replacing existing one. Evicts least recently used
+ *        entries when memory limit is exceeded.
+ *
+ * @param second_max_age seconds until expired, 0 to never expire
+ */
+void set (const std::string &key, const nlohmann::json &value,
+          int second_max_age);
+
+/**
+ * @brief Returns null when there's no entry or it has expired
+ */
+value_t get (const std::string &key);
+
+/**
+ * @brief Store serialized response body under `key`, its ETag is computed
+ *        once here. Shares the same storage and memory limit with json
+ *        values, setting a key replaces any value previously stored with it.
+ *
+ * @param second_max_age seconds until expired, 0 to never expire
+ */
+void set_response (const std::string &key, std::string body,
+                   int second_max_age);
+
+/**
+ * @brief Returns null when there's no response stored or it has expired
+ */
+response_t get_response (const std::string &key);
 
 void remove (const std::string &key);
 
-void create_invalidate_timer (const std::string &key, int second_max_age);
-void check_timers ();
-void remove_invalidate_timer (const std::string &key);
+stats_t get_stats ();
 
-nlohmann::json get_cached_user_auth (const std::string &user_id);
+value_t get_cached_user_auth (const std::string &user_id);
 
 void set_cached_user_auth (const std::string &user_id,
                            const nlohmann::json &data);
 
-nlohmann::json get_cached_user_guilds (const std::string &user_id);
+value_t get_cached_user_guilds (const std::string &user_id);
 
 void set_cached_user_guilds (const std::string &user_id,
                              const nlohmann::json &data);
 
-nlohmann::json get_cached_musicat_detailed_user ();
+/**
+ * @brief Final GET /guilds response body of this user, invalidated together
+ *        with the cached guild list
+ */
+response_t get_cached_user_guilds_response (const std::string &user_id);
+
+void set_cached_user_guilds_response (const std::string &user_id,
+                                      std::string body);
+
+value_t get_cached_musicat_detailed_user ();
 
 void set_cached_musicat_detailed_user (const nlohmann::json &data);
 
@@ -38,6 +94,10 @@ void handle_guild_create (const dpp::guild_create_t &e);
 
 void handle_guild_delete (const dpp::guild_delete_t &e);
 
+void handle_guild_member_add (const dpp::guild_member_add_t &e);
+
+void handle_guild_member_remove (const dpp::guild_member_remove_t &e);
+
 } // musicat::server::service_cache
 
 #endif // MUSICAT_SERVER_SERVICE_CACHE_H
@@ -3,58 +3,62 @@
 
 #include "musicat/server.h"
 #include "musicat/server/auth.h"
+#include "musicat/server/body_parser.h"
 #include "musicat/server/middlewares.h"
+#include "musicat/server/timer_wheel.h"
 #include <mutex>
 #include <string>
 
 namespace musicat::server::states
 {
 
+// in-flight request body, lives from route handler until its last chunk is
+// consumed or the request is aborted
 struct recv_body_t
 {
+    uint64_t rid;
     long long ts;
     const char *endpoint;
     std::string id;
-    std::string body;
+    body_parser::json_parser_t parser;
     APIResponse *res;
-    APIRequest *req;
     header_v_t cors_headers;
-};
-
-struct oauth_timer_t
-{
-    long long ts;
-    int second_sleep;
-    std::string val;
-    int (*remove_fn) (const std::string &, std::string *);
-    bool (*should_break) (const std::string &);
+    // rejects the request when body doesn't complete in time
+    timer_wheel::timer_id_t timer;
 };
 
 extern std::mutex recv_body_cache_m; // EXTERN_VARIABLE
 
-extern std::mutex oauth_timers_m; // EXTERN_VARIABLE
-
 std::string generate_oauth_state (const std::string &redirect = "");
 
 int remove_oauth_state (const std::string &state,
                         std::string *redirect = NULL);
 
-recv_body_t create_recv_body_t (const char *endpoint, const std::string &id,
-                                APIResponse *res, APIRequest *req,
-                                const header_v_t &cors_headers);
+/**
+ * @brief Should acquire recv_body_cache_m lock before calling. Body is
+ *        parsed as json as it arrives, limited to `max_size` bytes and
+ *        `max_depth` nesting. Request is rejected with 408 and the entry
+ *        deleted when the body doesn't complete within RECV_BODY_TIMEOUT
+ *
+ * @return uint64_t unique id of the stored entry
+ */
+uint64_t store_recv_body_cache (const char *endpoint, const std::string &id,
+                                APIResponse *res,
+                                const header_v_t &cors_headers,
+                                size_t max_size, size_t max_depth);
 
 /**
  * @brief Should acquire recv_body_cache_m lock before calling
- * keep holding the lock until done with the returned iterator
+ * keep holding the lock until done with the returned pointer
+ *
+ * @return recv_body_t* null if not found, eg. request was aborted
  */
-std::vector<recv_body_t>::iterator
-get_recv_body_cache (const recv_body_t &struct_body);
-
-bool is_recv_body_cache_end_iterator (std::vector<recv_body_t>::iterator i);
-
-int store_recv_body_cache (const recv_body_t &struct_body);
+recv_body_t *get_recv_body_cache (uint64_t rid);
 
-void delete_recv_body_cache (std::vector<recv_body_t>::iterator i);
+/**
+ * @brief Should acquire recv_body_cache_m lock before calling
+ */
+void delete_recv_body_cache (uint64_t rid);
 
 void reserve_recv_body_cache (size_t siz);
 
@@ -64,12 +68,7 @@ void set_jwt_verifier_ptr (auth::jwt_verifier_t *ptr);
 
 auth::jwt_verifier_t *get_jwt_verifier_ptr ();
 
-bool oauth_timer_t_is (const oauth_timer_t &t1, const oauth_timer_t &t2);
-int register_timer (const oauth_timer_t &t);
-int remove_timer (const oauth_timer_t &t);
-int check_timers ();
-int remove_all_timers ();
-oauth_timer_t get_oauth_timer (const std::string &val);
+size_t get_oauth_state_count ();
 
 } // musicat::server::states
 
@@ -0,0 +1,65 @@
+#ifndef MUSICAT_SERVER_STATIC_FILES_H
+#define MUSICAT_SERVER_STATIC_FILES_H
+
+#include "musicat/server.h"
+#include <string>
+
+namespace musicat::server::static_files
+{
+
+enum encoding_e
+{
+    ENCODING_IDENTITY,
+    ENCODING_GZIP,
+    ENCODING_BR,
+    ENCODING_MAX,
+};
+
+// a memory mapped file, never modified after load
+struct mapped_file_t
+{
+    const char *data;
+    size_t size;
+    // strong ETag, already quoted
+    std::string etag;
+};
+
+struct file_entry_t
+{
+    const char *content_type;
+    // identity variant is always mapped, others have null data
+    // and zero size when no precompressed file exists
+    mapped_file_t variants[ENCODING_MAX];
+};
+
+/**
+ * @brief Scan `dir` recursively and memory map every file in it.
+ *        Files ending with `.br` or `.gz` are registered as precompressed
+ *        variants of their uncompressed sibling.
+ *
+ *        Must be called before the server starts accepting request and
+ *        never while a response is still streaming a mapped file.
+ *
+ * @return int 0 on success, -1 when dir can't be read
+ */
+int load (const std::string &dir);
+
+/**
+ * @brief Unmap every loaded file. Only call this after the server loop exits.
+ */
+void unload ();
+
+/**
+ * @brief Serve a loaded file matching request url. Unknown path without file
+ *        extension is served with `/index.html` for client side routing.
+ *
+ *        Chooses the smallest variant accepted by the request
+ *        `Accept-Encoding` header, responds 304 when `If-None-Match` matches
+ *        and streams the mapped memory straight to the socket with
+ *        backpressure handling.
+ */
+void handle (APIResponse *res, APIRequest *req);
+
+} // musicat::server::static_files
+
+#endif // MUSICAT_SERVER_STATIC_FILES_H
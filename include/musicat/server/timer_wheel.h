@@ -0,0 +1,49 @@
+#ifndef MUSICAT_SERVER_TIMER_WHEEL_H
+#define MUSICAT_SERVER_TIMER_WHEEL_H
+
+#include <cstdint>
+#include <functional>
+#include <uWebSockets/src/App.h>
+
+namespace musicat::server::timer_wheel
+{
+
+using timer_id_t = uint64_t;
+
+// resolution of every timer in ms
+inline constexpr const uint64_t TICK_MS = 100;
+
+/**
+ * @brief Start ticking on `loop`, must be called on the loop thread.
+ *        Timers scheduled before this are kept and fire once it ticks.
+ *
+ * @return int 0 on success, 1 if already running
+ */
+int init (uWS::Loop *loop);
+
+/**
+ * @brief Stop ticking and drop every pending timer without calling it.
+ *        Must be called on the loop thread before the loop exits.
+ */
+void shutdown ();
+
+/**
+ * @brief Call `cb` on the loop thread once `ms` has passed. Thread safe,
+ *        O(1).
+ *
+ * @return timer_id_t never 0
+ */
+timer_id_t schedule (uint64_t ms, std::function<void ()> cb);
+
+/**
+ * @brief Cancel pending timer. Thread safe, O(1).
+ *
+ * @return bool false if timer already fired or doesn't exist
+ */
+bool cancel (timer_id_t id);
+
+size_t get_pending_count ();
+
+} // musicat::server::timer_wheel
+
+#endif // MUSICAT_SERVER_TIMER_WHEEL_H
@@ -0,0 +1,29 @@
+#ifndef MUSICAT_SPOTIFY_RESOLVER_H
+#define MUSICAT_SPOTIFY_RESOLVER_H
+
+#include "musicat/player.h"
+#include <string>
+#include <vector>
+
+/**
+ * @brief Resolve Spotify tracks to youtube tracks. Mappings are stored in
+ *        database so every track is only ever searched once.
+ */
+namespace musicat::spotify_resolver
+{
+
+/**
+ * @brief Fetch Spotify track or playlist and resolve every track to its
+ *        youtube track. Tracks without known mapping are searched
+ *        concurrently. Blocks until every track is resolved.
+ *
+ * @return std::vector<player::MCTrack> resolved tracks in playlist order,
+ *         tracks without any search result are left out
+ */
+std::vector<player::MCTrack> resolve (const std::string &url,
+                                      const std::string &client_id,
+                                      const std::string &client_secret);
+
+} // musicat::spotify_resolver
+
+#endif // MUSICAT_SPOTIFY_RESOLVER_H
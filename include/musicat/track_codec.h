@@ -0,0 +1,45 @@
+#ifndef MUSICAT_TRACK_CODEC_H
+#define MUSICAT_TRACK_CODEC_H
+
+#include "musicat/player.h"
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Compact versioned binary encoding of tracks for database storage.
+ *        Blob is a header, a table of every distinct string and a record
+ *        per track referencing strings by index. yt-dlp tracks keep only
+ *        the fields read by mctrack accessors, any other track is kept as
+ *        its full json.
+ */
+namespace musicat::track_codec
+{
+
+// first bytes of every blob
+inline constexpr const char MAGIC[] = "MCT";
+inline constexpr const uint8_t VERSION = 1;
+
+std::string encode (const std::deque<player::MCTrack> &tracks);
+
+std::string encode (const player::MCTrack &track);
+
+/**
+ * @brief Append every track in data to out, data can be several blobs
+ *        concatenated
+ *
+ * @return int 0 on success, -1 if data is malformed, -2 if encoded by an
+ *         unsupported version
+ */
+int decode (std::string_view data, std::deque<player::MCTrack> &out);
+
+/**
+ * @brief Same as decode() but only reads filename of each track, without
+ *        building any json
+ */
+int decode_filenames (std::string_view data, std::vector<std::string> &out);
+
+} // musicat::track_codec
+
+#endif // MUSICAT_TRACK_CODEC_H
@@ -0,0 +1,23 @@
+#ifndef MUSICAT_UTIL_HASH_H
+#define MUSICAT_UTIL_HASH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace musicat::util::hash
+{
+/**
+ * @brief 64 bit FNV-1a, fast non cryptographic hash suitable for content
+ *        addressing
+ */
+uint64_t fnv1a_64 (std::string_view data);
+
+/**
+ * @brief Quoted strong ETag of `data`, `suffix` is appended to the hash to
+ *        tell apart different representation of the same content
+ */
+std::string create_etag (std::string_view data, std::string_view suffix = "");
+} // musicat::util::hash
+
+#endif // MUSICAT_UTIL_HASH_H
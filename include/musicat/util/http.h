@@ -0,0 +1,87 @@
+#ifndef MUSICAT_UTIL_HTTP_H
+#define MUSICAT_UTIL_HTTP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Shared HTTP client. Every request goes through one curl share handle
+ *        so DNS lookups and TLS sessions are reused between requests and
+ *        threads, connections are reused by the pooled handle that opened
+ *        them. HTTP/2 is used whenever the server supports it.
+ *        Concurrent requests to the same host are limited, extra requests
+ *        wait for a free slot.
+ */
+namespace musicat::util::http
+{
+
+struct request_t
+{
+    std::string url;
+    // empty for GET, or POST when body isn't empty
+    std::string method;
+    std::vector<std::string> headers;
+    std::string body;
+    // prepend response header to response body, see response_t::header_size
+    bool include_header;
+    // whole transfer timeout, 0 for default
+    long timeout_ms;
+};
+
+struct response_t
+{
+    // false when transfer failed, status is 0
+    bool success;
+    long status;
+    // size of header prepended to response when include_header is set
+    long header_size;
+    std::string response;
+    // curl error message when transfer failed
+    std::string error;
+};
+
+struct host_stats_t
+{
+    std::string host;
+    uint64_t requests;
+    uint64_t failures;
+    // requests sent over an already open connection
+    uint64_t reused;
+    // transfer time sum and max in ms, not counting time waiting for a slot
+    uint64_t total_ms;
+    uint64_t max_ms;
+    size_t active;
+    size_t waiting;
+};
+
+/**
+ * @brief Initialize curl and share handle, must be called once on startup
+ *        before any thread is started
+ *
+ * @return int 0 on success, -1 when curl can't be initialized
+ */
+int init ();
+
+/**
+ * @brief Free pooled handles and share handle, call once on shutdown after
+ *        every thread using it has exited
+ */
+void shutdown ();
+
+/**
+ * @brief Blocking request, thread safe
+ */
+response_t perform (const request_t &req);
+
+response_t get (const std::string &url,
+                const std::vector<std::string> &headers = {});
+
+response_t post (const std::string &url, const std::string &body,
+                 const std::vector<std::string> &headers = {});
+
+std::vector<host_stats_t> get_stats ();
+
+} // musicat::util::http
+
+#endif // MUSICAT_UTIL_HTTP_H
@@ -0,0 +1,17 @@
+#ifndef MUSICAT_UTIL_JSON_H
+#define MUSICAT_UTIL_JSON_H
+
+#include "nlohmann/json.hpp"
+#include <cstddef>
+
+namespace musicat::util::json
+{
+/**
+ * @brief Approximate serialized size of `j` in bytes, walks the value
+ *        instead of serializing it. Numbers count as 8 bytes and string
+ *        escapes are ignored.
+ */
+size_t estimate_size (const nlohmann::json &j);
+} // musicat::util::json
+
+#endif // MUSICAT_UTIL_JSON_H
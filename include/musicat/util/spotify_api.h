@@ -7,6 +7,8 @@
 namespace musicat::util::spotify_api {
 
 struct Track {
+    // Spotify track id, empty for local files
+    std::string id;
     std::string artist;
     std::string title;
 };
@@ -14,6 +16,19 @@ struct Track {
 std::string authenticate(const std::string &client_id,
                          const std::string &client_secret);
 
+/**
+ * @brief Client credentials token, reused until shortly before it expires.
+ *        Thread safe.
+ *
+ * @param refresh Drop cached token and request a new one
+ */
+std::string get_access_token(const std::string &client_id,
+                             const std::string &client_secret,
+                             bool refresh = false);
+
+/**
+ * @brief Fetch a track, or every track of a playlist following pagination
+ */
 std::vector<Track> fetch_tracks(const std::string &url_or_id,
                                 const std::string &access_token);
 std::vector<Track> fetch_tracks(const std::string &url_or_id,
@@ -0,0 +1,42 @@
+#ifndef MUSICAT_YTDLP_RESOLVER_H
+#define MUSICAT_YTDLP_RESOLVER_H
+
+#include "nlohmann/json.hpp"
+#include <string>
+
+/**
+ * @brief Long lived yt-dlp helper process (ytdlp.py --serve) started through
+ *        child worker, keeps yt-dlp imported between queries. Queries are
+ *        sent over a unix socket with request ids and resolved concurrently.
+ */
+namespace musicat::ytdlp_resolver
+{
+
+/**
+ * @brief Start resolver thread, it starts the helper process and restarts it
+ *        whenever it exits. Thread exits by itself once running state is
+ *        false. Must be called after child::init.
+ *
+ * @return int 0 on success, 1 when yt-dlp util exe isn't configured
+ */
+int init ();
+
+bool is_ready ();
+
+/**
+ * @brief Resolve query the same way ytdlp.py does, blocks until reply
+ *
+ * @param query url or ytsearchN: query
+ * @param max_entries maximum playlist entries, 0 for default
+ * @param result parsed json output
+ *
+ * @return int 0 on success, 1 when resolver isn't available and caller should
+ *         fall back to one off ytdlp.py process, -1 when query failed or
+ *         timed out
+ */
+int resolve (const std::string &query, int max_entries,
+             nlohmann::json &result);
+
+} // musicat::ytdlp_resolver
+
+#endif // MUSICAT_YTDLP_RESOLVER_H
@@ -0,0 +1,5 @@
+CREATE TABLE IF NOT EXISTS "guilds_current_queue_tracks" ( "gid" VARCHAR(24) NOT NULL, "seq" BIGINT NOT NULL, "data" BYTEA, "raw" JSON, "ts" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL, PRIMARY KEY ("gid", "seq") );
+ALTER TABLE "guilds_current_queue_tracks" ADD COLUMN IF NOT EXISTS "data" BYTEA, ALTER COLUMN "raw" DROP NOT NULL;
+ALTER TABLE "playlists" ADD COLUMN IF NOT EXISTS "data" BYTEA, ALTER COLUMN "raw" DROP NOT NULL, ADD COLUMN IF NOT EXISTS "track_count" INT, ADD COLUMN IF NOT EXISTS "duration" BIGINT;
+CREATE TABLE IF NOT EXISTS "playlists_tracks" ( "uid" VARCHAR(24) NOT NULL, "name" VARCHAR(100) NOT NULL, "pos" INT NOT NULL, "data" BYTEA NOT NULL, PRIMARY KEY ("uid", "name", "pos") );
+CREATE TABLE IF NOT EXISTS "spotify_track_mappings" ( "sid" VARCHAR(32) UNIQUE PRIMARY KEY NOT NULL, "yid" VARCHAR(32) NOT NULL, "raw" JSON NOT NULL, "ts" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL, "uts" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL );
@@ -0,0 +1,2 @@
+DELETE FROM "playlists" "a" USING "playlists" "b" WHERE "a"."uid" = "b"."uid" AND "a"."name" = "b"."name" AND ("a"."uts" < "b"."uts" OR ("a"."uts" = "b"."uts" AND "a"."ctid" < "b"."ctid"));
+ALTER TABLE "playlists" ADD CONSTRAINT "playlists_uid_name_key" UNIQUE ("uid", "name");
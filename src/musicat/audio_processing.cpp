@@ -2,6 +2,7 @@
 #include "musicat/audio_config.h"
 #include "musicat/child.h"
 #include "musicat/child/command.h"
+#include "musicat/child/dl_music.h"
 #include "musicat/config.h"
 #include "musicat/helper_processor.h"
 #include "musicat/mctrack.h"
@@ -34,6 +35,8 @@ int write_fifo = -1,
     cwritefd = -1,
     // standalone ffmpeg stdin read end
     creadfd = -1,
+    // standalone ffmpeg input read end when progressive
+    freadfd = -1,
     // standalone ffmpeg exit status/signal
     cstatus = 0;
 
@@ -165,7 +168,10 @@ run_standalone (const processor_options_t &options,
             close_valid_fd (&dnull);
         }
 
-    const std::string file_path = options.file_path;
+    // follower writes partial file content to this pipe
+    const std::string file_path
+        = options.progressive ? "pipe:" + std::to_string (freadfd)
+                              : options.file_path;
 
     const bool need_seek = !options.seek_to.empty ();
 
@@ -250,6 +256,68 @@ handle_helper_fork ()
     close_valid_fd (&pwritefd);
 }
 
+// forked before ffmpeg pipes are created so it never holds them open
+static int
+init_follower (processor_states_t &p_info, const processor_options_t &options)
+{
+    p_info.fpid = -1;
+
+    if (!options.progressive)
+        return 0;
+
+    if (pipe (p_info.fpipefd) == -1)
+        {
+            perror ("fpipe");
+            return -1;
+        }
+    freadfd = p_info.fpipefd[0];
+    int fwritefd = p_info.fpipefd[1];
+
+    const std::string fdbg = "follow_partial_file:" + options.id;
+
+    p_info.fpid = child::worker::call_fork (fdbg.c_str ());
+    if (p_info.fpid == -1)
+        {
+            perror ("follower fork");
+            close_valid_fd (&freadfd);
+            close_valid_fd (&fwritefd);
+
+            return -1;
+        }
+
+    if (p_info.fpid == 0)
+        {
+            handle_helper_fork ();
+            close_valid_fd (&freadfd);
+
+            if (prctl (PR_SET_PDEATHSIG, SIGTERM) == -1)
+                {
+                    perror ("child follower prctl");
+                    _exit (EXIT_FAILURE);
+                }
+
+            const int status = child::dl_music::follow_partial_file (
+                options.file_path, fwritefd);
+
+            close_valid_fd (&fwritefd);
+            _exit (status);
+        }
+
+    close_valid_fd (&fwritefd);
+
+    return 0;
+}
+
+static void
+wait_follower (processor_states_t &p_info)
+{
+    if (p_info.fpid <= 0)
+        return;
+
+    child::worker::call_waitpid (p_info.fpid);
+    p_info.fpid = -1;
+}
+
 int
 init_standalone (processor_states_t &p_info,
                  const processor_options_t &options)
@@ -261,6 +329,12 @@ init_standalone (processor_states_t &p_info,
     sem_t *sem;
     std::string sem_full_key;
 
+    if (init_follower (p_info, options) != 0)
+        {
+            init_error = ERR_INPUT;
+            goto err;
+        }
+
     if (pipe (p_info.ppipefd) == -1)
         {
             perror ("ppipe");
@@ -304,6 +378,7 @@ init_standalone (processor_states_t &p_info,
 
     close_valid_fd (&cwritefd); /* Close unused write end */
     close_valid_fd (&creadfd);  /* Close unused read end */
+    close_valid_fd (&freadfd);  /* Only ffmpeg reads follower output */
 
     child::do_sem_wait (sem, sem_full_key);
     sem = SEM_FAILED;
@@ -315,6 +390,7 @@ err:
     close_valid_fd (&creadfd);
     close_valid_fd (&preadfd);
     close_valid_fd (&cwritefd);
+    close_valid_fd (&freadfd);
 
     return init_error;
 }
@@ -601,7 +677,7 @@ notify_seek_done ()
 processor_options_t
 create_options ()
 {
-    return { "", false, false, "", 100, "", "", {} };
+    return { "", false, false, false, "", 100, "", "", {} };
 }
 
 processor_options_t
@@ -624,6 +700,7 @@ run_processor (child::command::command_options_t &process_options)
 
     processor_options_t options = create_options ();
     options.file_path = process_options.file_path;
+    options.progressive = process_options.progressive;
     /* options.debug = process_options.debug; */
     options.id = process_options.id;
     options.guild_id = process_options.guild_id;
@@ -738,6 +815,9 @@ run_processor (child::command::command_options_t &process_options)
                         fprintf (stderr, "processor child status: %d\n",
                                  cstatus);
 
+                    // exits once ffmpeg closed its input
+                    wait_follower (p_info);
+
                     cstatus = 0;
 
                     // do the same setup routine as startup
@@ -801,6 +881,8 @@ run_processor (child::command::command_options_t &process_options)
     if (debug)
         fprintf (stderr, "processor child status: %d\n", cstatus);
 
+    wait_follower (p_info);
+
     helper_processor::shutdown_chain (write_stdout_err);
 
     if (debug)
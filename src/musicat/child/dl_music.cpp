@@ -1,12 +1,518 @@
 #include "musicat/child/dl_music.h"
+#include "musicat/child/worker.h"
+#include "musicat/musicat.h"
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/inotify.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FOLLOW_POLL_TIMEOUT_MS 500
+// used when the best audio stream isn't opus
+#define PROGRESSIVE_TRANSCODE_BITRATE "128k"
+
+// ogg page layout, see RFC 3533
+#define OGG_HEADER_SIZE 27
+#define OGG_FLAG_CONTINUED 0x01
+#define OGG_FLAG_BOS 0x02
 
 namespace musicat::child::dl_music
 {
 
+struct follow_state_t
+{
+    // read but not forwarded yet, incomplete page
+    std::string pending;
+    // of the partial file stream, pages of the complete file are stamped
+    // with them when splicing
+    uint32_t serial;
+    uint32_t seq;
+    int64_t granule;
+    bool started;
+    // copying complete file after progressive download failed
+    bool splicing;
+    // first page of the complete file has been forwarded
+    bool resumed;
+};
+
 std::string
 get_download_music_fifo_path (const std::string &id)
 {
     return std::string ("/tmp/musicat.") + id + ".dlnotif";
 }
 
+std::string
+get_partial_file_path (const std::string &file_path)
+{
+    // must not end with .opus to stay out of music index
+    return file_path + ".dl";
+}
+
+/**
+ * @brief Pipe yt-dlp `format` into ffmpeg writing ogg to partial_path. Audio
+ *        is copied as is unless `transcode`, copying only works for opus.
+ *
+ * @return int 0 when both exited successfully
+ */
+static int
+run_progressive (const char *yt_dlp, const char *url,
+                 const std::string &partial_path, const char *format,
+                 bool transcode)
+{
+    int pfds[2];
+    if (pipe (pfds) == -1)
+        {
+            perror ("dl_music::download_progressive pipe");
+            return -1;
+        }
+
+    pid_t ytdlp_pid = worker::call_fork ();
+    if (ytdlp_pid == 0)
+        {
+            prctl (PR_SET_PDEATHSIG, SIGTERM);
+
+            close_valid_fd (&pfds[0]);
+            dup2 (pfds[1], STDOUT_FILENO);
+            close_valid_fd (&pfds[1]);
+
+            char *args[] = { (char *)yt_dlp,
+                             "-f",
+                             (char *)format,
+                             "--http-chunk-size",
+                             "2M",
+                             (char *)url,
+                             "-o",
+                             "-",
+                             (char *)NULL };
+
+            execvp (yt_dlp, args);
+
+            perror ("dl_music::download_progressive yt-dlp exit");
+            _exit (EXIT_FAILURE);
+        }
+
+    pid_t ffmpeg_pid = ytdlp_pid < 0 ? -1 : worker::call_fork ();
+    if (ffmpeg_pid == 0)
+        {
+            prctl (PR_SET_PDEATHSIG, SIGTERM);
+
+            close_valid_fd (&pfds[1]);
+            dup2 (pfds[0], STDIN_FILENO);
+            close_valid_fd (&pfds[0]);
+
+            char *args[] = { "ffmpeg",
+                             "-v",
+                             "error",
+                             "-i",
+                             "pipe:0",
+                             "-vn",
+                             "-c:a",
+                             (char *)(transcode ? "libopus" : "copy"),
+                             // unused when copying
+                             "-b:a",
+                             PROGRESSIVE_TRANSCODE_BITRATE,
+                             "-f",
+                             "ogg",
+                             "-y",
+                             (char *)partial_path.c_str (),
+                             (char *)NULL };
+
+            execvp ("ffmpeg", args);
+
+            perror ("dl_music::download_progressive ffmpeg exit");
+            _exit (EXIT_FAILURE);
+        }
+
+    close_valid_fd (&pfds[0]);
+    close_valid_fd (&pfds[1]);
+
+    int ytdlp_status = ytdlp_pid < 0 ? -1 : worker::call_waitpid (ytdlp_pid);
+    int ffmpeg_status
+        = ffmpeg_pid < 0 ? -1 : worker::call_waitpid (ffmpeg_pid);
+
+    if (ytdlp_status == 0 && ffmpeg_status == 0)
+        return 0;
+
+    fprintf (stderr,
+             "[dl_music::download_progressive ERROR] Failed downloading "
+             "'%s' with format '%s', yt-dlp: %d, ffmpeg: %d\n",
+             url, format, ytdlp_status, ffmpeg_status);
+
+    return 1;
+}
+
+int
+download_progressive (const char *yt_dlp, const char *url,
+                      const std::string &file_path)
+{
+    const std::string partial_path = get_partial_file_path (file_path);
+
+    // same preference as the converting download: opus is remuxed from
+    // webm to ogg as is, anything else is transcoded while streaming
+    int status = run_progressive (yt_dlp, url, partial_path,
+                                  "bestaudio[acodec=opus]", false);
+
+    struct stat st;
+
+    // nothing has been written for the follower yet, no opus stream
+    if (status != 0
+        && (stat (partial_path.c_str (), &st) != 0 || st.st_size == 0))
+        status = run_progressive (yt_dlp, url, partial_path, "bestaudio",
+                                  true);
+
+    if (status == 0 && stat (partial_path.c_str (), &st) == 0
+        && st.st_size > 0
+        && rename (partial_path.c_str (), file_path.c_str ()) == 0)
+        {
+            // stdout is download notif fifo
+            fprintf (stdout,
+                     "[dl_music] Progressive download complete: '%s'\n",
+                     file_path.c_str ());
+            return 0;
+        }
+
+    return 1;
+}
+
+int
+download_converted (const char *yt_dlp, const char *url,
+                    const std::string &file_path)
+{
+    /*
+       strictly opus, fail if missing:
+        yt_dlp -f 251 --http-chunk-size 2M $URL -x
+        --audio-format opus --audio-quality 0 -o $FILEPATH
+
+       allow to convert other audio format to opus:
+        yt-dlp -f bestaudio --http-chunk-size 2M $URL -x
+        --audio-format opus --audio-quality 0 -o $FILEPATH
+    */
+
+    int status = -1;
+
+    pid_t pid = worker::call_fork ();
+    if (pid == 0)
+        {
+            prctl (PR_SET_PDEATHSIG, SIGTERM);
+
+            char *args[] = { (char *)yt_dlp,
+                             "-f",
+                             "bestaudio",
+                             "--http-chunk-size",
+                             "2M",
+                             (char *)url,
+                             "-x",
+                             "--audio-format",
+                             "opus",
+                             "--audio-quality",
+                             "0",
+                             "-o",
+                             (char *)file_path.c_str (),
+                             (char *)NULL };
+
+            execvp (yt_dlp, args);
+
+            perror ("dl_music::download_converted exit");
+            _exit (EXIT_FAILURE);
+        }
+
+    if (pid > 0)
+        status = worker::call_waitpid (pid);
+
+    // follower of a failed progressive download waits for this to switch
+    // to the complete file
+    unlink (get_partial_file_path (file_path).c_str ());
+
+    return status;
+}
+
+// returns false when out_fd is closed
+static bool
+write_all (int out_fd, const char *buf, ssize_t size)
+{
+    while (size > 0)
+        {
+            ssize_t w = write (out_fd, buf, size);
+            if (w < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    return false;
+                }
+
+            buf += w;
+            size -= w;
+        }
+
+    return true;
+}
+
+static uint32_t
+get_le32 (const unsigned char *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+           | (uint32_t)p[3] << 24;
+}
+
+static void
+put_le32 (unsigned char *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (v >> (i * 8)) & 0xff;
+}
+
+static int64_t
+get_le64 (const unsigned char *p)
+{
+    return (int64_t)((uint64_t)get_le32 (p)
+                     | (uint64_t)get_le32 (p + 4) << 32);
+}
+
+// ogg page checksum, crc32 with polynomial 0x04c11db7 and no reflection
+static uint32_t
+ogg_crc (const unsigned char *p, size_t size)
+{
+    uint32_t crc = 0;
+
+    for (size_t i = 0; i < size; i++)
+        {
+            crc ^= (uint32_t)p[i] << 24;
+
+            for (int b = 0; b < 8; b++)
+                crc = crc & 0x80000000 ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+
+    return crc;
+}
+
+// size of the page at the front of data, 0 when not complete yet
+static size_t
+ogg_page_size (const unsigned char *p, size_t size)
+{
+    if (size < OGG_HEADER_SIZE)
+        return 0;
+
+    const size_t segments = p[26];
+    size_t page_size = OGG_HEADER_SIZE + segments;
+
+    if (size < page_size)
+        return 0;
+
+    for (size_t i = 0; i < segments; i++)
+        page_size += p[OGG_HEADER_SIZE + i];
+
+    return size >= page_size ? page_size : 0;
+}
+
+/**
+ * @brief Write every complete page in s.pending to out_fd. While splicing,
+ *        pages of the complete file already played are skipped and the rest
+ *        are renumbered to continue the partial file stream.
+ *
+ *        Splicing relies on both files being a single Ogg Opus stream of the
+ *        same source audio: granule positions count 48kHz samples from the
+ *        same start in both, so they're compared and kept as is. Header
+ *        pages were already sent and are skipped with every page not
+ *        starting a packet, the decoder never gets half a packet. Only
+ *        serial, page sequence and checksum are restamped, the checksum is
+ *        computed with its own field zeroed as RFC 3533 requires.
+ *
+ * @return bool false when out_fd is closed
+ */
+static bool
+forward_pages (follow_state_t &s, int out_fd)
+{
+    size_t off = 0;
+    bool ok = true;
+
+    while (ok)
+        {
+            // resync on capture pattern, a torn page is dropped
+            const size_t start = s.pending.find ("OggS", off);
+            if (start == std::string::npos)
+                {
+                    // capture pattern might be split across reads
+                    if (s.pending.size () > 3)
+                        off = s.pending.size () - 3;
+
+                    break;
+                }
+
+            off = start;
+
+            unsigned char *p = (unsigned char *)s.pending.data () + off;
+            const size_t size = ogg_page_size (p, s.pending.size () - off);
+            if (!size)
+                break;
+
+            const int64_t granule = get_le64 (p + 6);
+
+            if (!s.splicing)
+                {
+                    if (!s.started)
+                        {
+                            s.serial = get_le32 (p + 14);
+                            s.started = true;
+                        }
+
+                    s.seq = get_le32 (p + 18);
+                    if (granule != -1)
+                        s.granule = granule;
+
+                    ok = write_all (out_fd, (const char *)p, size);
+                    off += size;
+
+                    continue;
+                }
+
+            // headers were already sent, resume on the first page starting
+            // a packet past what's been played
+            if (!s.resumed
+                && (p[5] & (OGG_FLAG_CONTINUED | OGG_FLAG_BOS)
+                    || granule == -1 || granule <= s.granule))
+                {
+                    off += size;
+                    continue;
+                }
+
+            s.resumed = true;
+
+            p[5] &= ~OGG_FLAG_BOS;
+            put_le32 (p + 14, s.serial);
+            put_le32 (p + 18, ++s.seq);
+            put_le32 (p + 22, 0);
+            put_le32 (p + 22, ogg_crc (p, size));
+
+            ok = write_all (out_fd, (const char *)p, size);
+            off += size;
+        }
+
+    s.pending.erase (0, off);
+
+    return ok;
+}
+
+static bool
+is_same_file (int fd, const std::string &path)
+{
+    struct stat fst, pst;
+
+    return fstat (fd, &fst) == 0 && stat (path.c_str (), &pst) == 0
+           && fst.st_dev == pst.st_dev && fst.st_ino == pst.st_ino;
+}
+
+int
+follow_partial_file (const std::string &file_path, int out_fd)
+{
+    const std::string partial_path = get_partial_file_path (file_path);
+
+    // opened fd keeps reading the same file after it's renamed
+    int fd = open (partial_path.c_str (), O_RDONLY);
+    if (fd < 0)
+        // already complete
+        fd = open (file_path.c_str (), O_RDONLY);
+
+    if (fd < 0)
+        {
+            perror ("dl_music::follow_partial_file open");
+            return 1;
+        }
+
+    int ifd = inotify_init1 (IN_CLOEXEC | IN_NONBLOCK);
+    if (ifd >= 0
+        && inotify_add_watch (ifd, partial_path.c_str (),
+                              IN_MODIFY | IN_CLOSE_WRITE | IN_MOVE_SELF
+                                  | IN_DELETE_SELF)
+               < 0)
+        close_valid_fd (&ifd);
+
+    char buf[BUFSIZ * 4];
+    int ret = 1;
+    // writer is done when partial file is gone, either renamed to file_path
+    // or removed after the fallback download
+    bool writer_done = false;
+    follow_state_t s = {};
+
+    while (true)
+        {
+            const ssize_t r = read (fd, buf, sizeof (buf));
+
+            if (r > 0)
+                {
+                    s.pending.append (buf, r);
+
+                    if (!forward_pages (s, out_fd))
+                        break;
+
+                    continue;
+                }
+
+            if (r < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    perror ("dl_music::follow_partial_file read");
+                    break;
+                }
+
+            // caught up, anything written before the rename has been read
+            if (writer_done)
+                {
+                    if (s.splicing || is_same_file (fd, file_path))
+                        {
+                            ret = 0;
+                            break;
+                        }
+
+                    // progressive download failed, continue from the file
+                    // the fallback download wrote when it succeeded
+                    close_valid_fd (&fd);
+
+                    fd = open (file_path.c_str (), O_RDONLY);
+                    if (fd < 0)
+                        break;
+
+                    s.splicing = true;
+                    s.pending.clear ();
+
+                    continue;
+                }
+
+            if (access (partial_path.c_str (), F_OK) != 0)
+                {
+                    writer_done = true;
+                    continue;
+                }
+
+            // stall until writer appends more, reader closing out_fd
+            // shows up as POLLERR
+            struct pollfd pfds[2] = { { ifd, POLLIN, 0 }, { out_fd, 0, 0 } };
+
+            if (poll (pfds, 2, FOLLOW_POLL_TIMEOUT_MS) < 0 && errno != EINTR)
+                break;
+
+            if (pfds[1].revents & (POLLERR | POLLHUP))
+                break;
+
+            if (pfds[0].revents & POLLIN)
+                {
+                    char ebuf[4096];
+                    while (read (ifd, ebuf, sizeof (ebuf)) > 0)
+                        ;
+                }
+        }
+
+    close_valid_fd (&ifd);
+    close_valid_fd (&fd);
+
+    return ret;
+}
+
 } // musicat::child::dl_music
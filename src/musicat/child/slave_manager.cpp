@@ -76,6 +76,11 @@ shutdown_routine (command::command_options_t &options)
         {
             return 0;
         }
+    if (child_type == command::command_execute_commands_t.ytdlp_resolver)
+        {
+            // serves forever, nothing else tells it to stop
+            return kill (options.pid, SIGTERM);
+        }
 
     return 1;
 }
@@ -145,6 +150,11 @@ clean_up_routine (command::command_options_t &options)
             unlink (as_fp.c_str ());
             return 0;
         }
+    if (child_type == command::command_execute_commands_t.ytdlp_resolver)
+        {
+            unlink (options.file_path.c_str ());
+            return 0;
+        }
 
     return 0;
 }
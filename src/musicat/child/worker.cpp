@@ -71,6 +71,11 @@ execute (command::command_options_t &options)
         {
             status = worker_command::download_music (options);
         }
+    else if (options.command
+             == command::command_execute_commands_t.ytdlp_resolver)
+        {
+            status = worker_command::start_ytdlp_resolver (options);
+        }
 
     if (status == 0)
         {
@@ -612,6 +612,45 @@ err1:
     return status;
 }
 
+int
+start_ytdlp_resolver (command::command_options_t &options)
+{
+    unlink (options.file_path.c_str ());
+
+    pid_t status = child::worker::call_fork ();
+
+    if (status < 0)
+        {
+            perror ("worker_command::start_ytdlp_resolver fork");
+            return status;
+        }
+
+    if (status == 0)
+        {
+            worker::handle_worker_fork ();
+
+            if (prctl (PR_SET_PDEATHSIG, SIGTERM) == -1)
+                {
+                    perror ("start_ytdlp_resolver prctl");
+                    _exit (EXIT_FAILURE);
+                }
+
+            if (!options.debug)
+                {
+                    // redirect yt-dlp logs to /dev/null
+                    int dnull = open ("/dev/null", O_WRONLY);
+                    dup2 (dnull, STDERR_FILENO);
+                    close_valid_fd (&dnull);
+                }
+
+            _exit (ytdlp::run_resolver (options));
+        }
+
+    options.pid = status;
+
+    return 0;
+}
+
 int
 download_music (command::command_options_t &options)
 {
@@ -687,38 +726,18 @@ download_music (command::command_options_t &options)
                 }
             close_valid_fd (&notif_fifo);
 
-            /*
-               strictly opus, fail if missing:
-                yt_dlp -f 251 --http-chunk-size 2M $URL -x
-                --audio-format opus --audio-quality 0 -o $FILEPATH
-
-                allow to convert other audio format to opus:
-                yt-dlp -f bestaudio --http-chunk-size 2M $URL -x
-                --audio-format opus --audio-quality 0 -o $FILEPATH
-            */
-
             const char *yt_dlp = options.ytdlp_util_exe.c_str ();
             const char *url = options.ytdlp_query.c_str ();
-            const char *fpath = options.file_path.c_str ();
-            char *args[] = { (char *)yt_dlp,
-                             "-f",
-                             "bestaudio",
-                             "--http-chunk-size",
-                             "2M",
-                             (char *)url,
-                             "-x",
-                             "--audio-format",
-                             "opus",
-                             "--audio-quality",
-                             "0",
-                             "-o",
-                             (char *)fpath,
-                             (char *)NULL };
-
-            int cmd_status = execvp (yt_dlp, args);
-
-            perror ("worker_command::download_music::child exit");
-            _exit (cmd_status);
+
+            // playable while downloading, needs opus source to remux
+            // without transcoding
+            if (dl_music::download_progressive (yt_dlp, url,
+                                                options.file_path)
+                == 0)
+                _exit (EXIT_SUCCESS);
+
+            _exit (dl_music::download_converted (yt_dlp, url,
+                                                 options.file_path));
         }
 
     child::do_sem_wait (sem, sem_full_key);
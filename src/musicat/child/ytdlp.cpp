@@ -21,6 +21,12 @@ get_ytdout_json_out_filename (const std::string &id)
     return std::string ("/tmp/musicat.") + id + ".ytdres.json";
 }
 
+std::string
+get_resolver_socket_path (const std::string &id)
+{
+    return std::string ("/tmp/musicat.") + id + ".ytdr.sock";
+}
+
 int
 has_python ()
 {
@@ -60,9 +66,6 @@ run (const command::command_options_t &options, sem_t *sem,
     // notification fifo path
     std::string as_fp = get_ytdout_fifo_path (options.id);
 
-    // check if outname already exists
-    struct stat filestat;
-
     write_fifo = open (as_fp.c_str (), O_WRONLY);
     if (write_fifo < 0)
         {
@@ -71,13 +74,6 @@ run (const command::command_options_t &options, sem_t *sem,
             goto exit_failure;
         }
 
-    if (stat (outfname.c_str (), &filestat) == 0
-        && (filestat.st_mode & S_IFREG))
-        {
-            jsonout_status = 0;
-            goto write_res;
-        }
-
     // create pipe to get call output
     ppfds = worker::create_pipe ();
 
@@ -169,7 +165,7 @@ run (const command::command_options_t &options, sem_t *sem,
 
     child::do_sem_wait (sem, sem_full_key);
 
-    // open out json file, no need to delete it for cache!
+    // open out json file, caller deletes it after reading
     jsonout = fopen (outfname.c_str (), "w");
 
     // read and write output to file
@@ -193,7 +189,6 @@ run (const command::command_options_t &options, sem_t *sem,
 
     child::worker::call_waitpid (status);
 
-write_res:
     // write output fp to write_fifo
     resopt
         += command::command_options_keys_t.id + '='
@@ -215,4 +210,32 @@ exit_failure:
     return status;
 }
 
+int
+run_resolver (const command::command_options_t &options)
+{
+    const char *exe = options.ytdlp_util_exe.c_str ();
+    const char *socket_path = options.file_path.c_str ();
+
+    char *args[16] = {
+        "python3",
+        (char *)exe,
+        "--serve",
+        (char *)socket_path,
+    };
+    int args_idx = 4;
+
+    if (!options.ytdlp_lib_path.empty ())
+        {
+            args[args_idx++] = "--ytdlp-dir";
+            args[args_idx++] = (char *)options.ytdlp_lib_path.c_str ();
+        }
+
+    args[args_idx++] = (char *)NULL;
+
+    execvp ("python3", args);
+
+    perror ("ytdlp::run_resolver exit");
+    return EXIT_FAILURE;
+}
+
 } // musicat::child::ytdlp
@@ -15,29 +15,11 @@ namespace autocomplete
 void
 name (const dpp::autocomplete_t &event, const std::string &param)
 {
-    std::pair<PGresult *, ExecStatusType> res
-        = database::get_all_equalizer_preset_name ();
-
     std::vector<std::pair<std::string, std::string> > response = {};
 
-    if (res.second == PGRES_TUPLES_OK)
-        {
-            int rn = 0;
-            while (true)
-                {
-                    if (PQgetisnull (res.first, rn, 0))
-                        break;
-
-                    std::string val
-                        = std::string (PQgetvalue (res.first, rn, 0));
-
-                    response.push_back (std::make_pair (val, val));
-                    rn++;
-                }
-        }
-
-    database::finish_res (res.first);
-    res.first = nullptr;
+    for (const std::string &name :
+         database::search_equalizer_preset_names (param))
+        response.push_back (std::make_pair (name, name));
 
     musicat::autocomplete::create_response (
         musicat::autocomplete::filter_candidates (response, param), event);
@@ -2,7 +2,7 @@
 #include "musicat/musicat.h"
 #include "musicat/thread_manager.h"
 #include "musicat/util/base64.h"
-#include <curlpp/Infos.hpp>
+#include "musicat/util/http.h"
 
 inline constexpr size_t max_avatar_upload_size = 10240 * 1000;
 #define MAX_IMG_SIZE max_avatar_upload_size
@@ -67,32 +67,19 @@ slash_run (const dpp::slashcommand_t &event)
                     "Valid avatar image format are only JPEG, PNG and GIF");
             }
 
-        std::ostringstream os;
-        curlpp::Easy req;
-        req.setOpt (curlpp::options::Url (att.url));
+        util::http::response_t att_res
+            = util::http::perform ({ att.url, "", {}, "", true, 0 });
 
-        req.setOpt (curlpp::options::Header (1L));
-        req.setOpt (curlpp::options::WriteStream (&os));
-
-        try
-            {
-                req.perform ();
-            }
-        catch (const curlpp::LibcurlRuntimeError &e)
+        if (!att_res.success)
             {
-                fprintf (stderr,
-                         "[ERROR] "
-                         "LibcurlRuntimeError(%d): %s\n",
-                         e.whatCode (), e.what ());
-
                 event.edit_response ("`[ERROR]` Unable to fetch attachment");
 
                 return;
             }
 
-        std::string res_str = os.str ();
+        const std::string &res_str = att_res.response;
 
-        long hsiz = curlpp::Infos::HeaderSize::get (req);
+        long hsiz = att_res.header_size;
 
         std::string header_str = res_str.substr (0, hsiz);
         std::string res_body = res_str.substr (hsiz);
@@ -125,23 +112,8 @@ slash_run (const dpp::slashcommand_t &event)
                     "File cannot be larger than 10240.0 kb.");
             }
 
-        os.str ("");
-        os.clear ();
-        req.reset ();
-
-        req.setOpt (curlpp::options::Url (DISCORD_API_URL "/users/@me"));
-
         std::string auth_header = "Authorization: Bot " + get_sha_token ();
         std::string header = "Content-Type: application/json";
-        req.setOpt (curlpp::options::HttpHeader ({
-            auth_header.c_str (),
-            header.c_str (),
-        }));
-
-        // req.setOpt (curlpp::options::Verbose (1L));
-
-        req.setOpt (curlpp::options::Header (1L));
-        req.setOpt (curlpp::options::WriteStream (&os));
 
         std::string body
             = nlohmann::json ({ { "username", musicat_username },
@@ -156,32 +128,23 @@ slash_run (const dpp::slashcommand_t &event)
                                       + base64_data } })
                   .dump ();
 
-        req.setOpt (curlpp::options::CustomRequest{ "PATCH" });
-        req.setOpt (curlpp::options::PostFields (body));
-        req.setOpt (curlpp::options::PostFieldSize (body.length ()));
+        util::http::response_t patch_res = util::http::perform (
+            { DISCORD_API_URL "/users/@me", "PATCH",
+              { auth_header, header }, body, true, 0 });
 
-        try
+        if (!patch_res.success)
             {
-                req.perform ();
-            }
-        catch (const curlpp::LibcurlRuntimeError &e)
-            {
-                fprintf (stderr,
-                         "[ERROR] "
-                         "LibcurlRuntimeError(%d): %s\n",
-                         e.whatCode (), e.what ());
-
                 event.edit_response ("`[ERROR]` Failed to upload attachment");
 
                 return;
             }
 
-        long s_code = curlpp::Infos::ResponseCode::get (req);
+        long s_code = patch_res.status;
         bool patch_err = s_code != 200;
 
         if (patch_err || debug)
             {
-                std::cerr << "PATCH AVATAR:\n" << os.str () << '\n';
+                std::cerr << "PATCH AVATAR:\n" << patch_res.response << '\n';
             }
 
         if (patch_err)
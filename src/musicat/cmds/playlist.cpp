@@ -57,30 +57,11 @@ namespace autocomplete
 void
 id (const dpp::autocomplete_t &event, const std::string &param)
 {
-    std::pair<PGresult *, ExecStatusType> res
-        = database::get_all_user_playlist (event.command.usr.id,
-                                           database::gup_name_only);
-
     std::vector<std::pair<std::string, std::string> > response = {};
 
-    if (res.second == PGRES_TUPLES_OK)
-        {
-            int rn = 0;
-            while (true)
-                {
-                    if (PQgetisnull (res.first, rn, 0))
-                        break;
-
-                    std::string val
-                        = std::string (PQgetvalue (res.first, rn, 0));
-
-                    response.push_back (std::make_pair (val, val));
-                    rn++;
-                }
-        }
-
-    database::finish_res (res.first);
-    res.first = nullptr;
+    for (const std::string &name :
+         database::search_user_playlist_names (event.command.usr.id, param))
+        response.push_back (std::make_pair (name, name));
 
     musicat::autocomplete::create_response (
         musicat::autocomplete::filter_candidates (response, param), event);
@@ -173,10 +154,6 @@ slash_run (const dpp::slashcommand_t &event)
 
         event.thinking ();
 
-        const bool view
-            = event.command.get_command_interaction ().options.at (0).name
-              == "view";
-
         std::pair<PGresult *, ExecStatusType> res
             = database::get_user_playlist (event.command.usr.id, p_id,
                                            database::gup_raw_only);
@@ -226,17 +203,11 @@ slash_run (const dpp::slashcommand_t &event)
         if (retnow)
             return;
 
-        std::shared_ptr<player::Player> guild_player;
         size_t count = 0;
 
-        std::deque<player::MCTrack> q = {};
-
-        if (view != true)
-            {
-                guild_player
-                    = player_manager->create_player (event.command.guild_id);
-                guild_player->from = event.from;
-            }
+        std::shared_ptr<player::Player> guild_player
+            = player_manager->create_player (event.command.guild_id);
+        guild_player->from = event.from;
 
         const bool add_to_top = arg_top ? true : false;
         const bool debug = get_debug_state ();
@@ -268,82 +239,71 @@ slash_run (const dpp::slashcommand_t &event)
         for (auto &t : to_iter)
             {
                 t.user_id = event.command.usr.id;
-                if (view)
-                    q.push_back (t);
-                else
-                    {
-                        guild_player->add_track (
-                            t, add_to_top, event.command.guild_id, false);
-                        count++;
-                    }
+                guild_player->add_track (t, add_to_top, event.command.guild_id,
+                                         false);
+                count++;
             }
 
-        if (view)
-            paginate::reply_paginated_playlist (event, q, p_id, true);
-        else
-            {
-                if (count)
-                    try
-                        {
-                            player_manager->update_info_embed (
-                                event.command.guild_id);
-                        }
-                    catch (...)
-                        {
-                        }
-
-                event.edit_response (util::response::reply_added_playlist (
-                    p_id, arg_top, count));
-
-                // !TODO: this is probably for connect and play when adding
-                // playlist but bot isn't in user vc
-                //
-                // std::pair<dpp::channel*, std::map<dpp::snowflake,
-                // dpp::voicestate>> c; bool has_c = false; bool no_vc = false;
-                // try
-                // {
-                //     c = get_voice_from_gid(event.command.guild_id,
-                //     event.command.usr.id); has_c = true;
-                // }
-                // catch (...) {}
-
-                // try
-                // {
-                //     get_voice_from_gid(event.command.guild_id,
-                //     event.from->creator->me.id);
-                // }
-                // catch (...)
-                // {
-                //     no_vc = true;
-                // }
-
-                // if (has_c && no_vc && c.first &&
-                // has_permissions_from_ids(event.command.guild_id,
-                //                                                           event.from->creator->me.id,
-                //                                                           c.first->id,
-                //                                                           {
-                //                                                           dpp::p_view_channel,dpp::p_connect
-                //                                                           }))
-                // {
-                //     guild_player->set_channel(event.command.channel_id);
-
-                //     {
-                //         std::lock_guard lk(player_manager->c_m);
-                //         std::lock_guard
-                //         lk2(player_manager->wd_m);
-                //         player_manager->connecting.insert_or_assign(event.command.guild_id,
-                //         c.first->id);
-                //         player_manager->waiting_vc_ready.insert_or_assign(event.command.guild_id,
-                //         "2");
-                //     }
-
-                //     std::thread t([player_manager, event]() {
-                //                       player_manager->reconnect(event.from,
-                //                       event.command.guild_id);
-                //                   });
-                //     t.detach();
-                // }
-            }
+        if (count)
+            try
+                {
+                    player_manager->update_info_embed (event.command.guild_id);
+                }
+            catch (...)
+                {
+                }
+
+        event.edit_response (
+            util::response::reply_added_playlist (p_id, arg_top, count));
+
+        // !TODO: this is probably for connect and play when adding
+        // playlist but bot isn't in user vc
+        //
+        // std::pair<dpp::channel*, std::map<dpp::snowflake,
+        // dpp::voicestate>> c; bool has_c = false; bool no_vc = false;
+        // try
+        // {
+        //     c = get_voice_from_gid(event.command.guild_id,
+        //     event.command.usr.id); has_c = true;
+        // }
+        // catch (...) {}
+
+        // try
+        // {
+        //     get_voice_from_gid(event.command.guild_id,
+        //     event.from->creator->me.id);
+        // }
+        // catch (...)
+        // {
+        //     no_vc = true;
+        // }
+
+        // if (has_c && no_vc && c.first &&
+        // has_permissions_from_ids(event.command.guild_id,
+        //                                                           event.from->creator->me.id,
+        //                                                           c.first->id,
+        //                                                           {
+        //                                                           dpp::p_view_channel,dpp::p_connect
+        //                                                           }))
+        // {
+        //     guild_player->set_channel(event.command.channel_id);
+
+        //     {
+        //         std::lock_guard lk(player_manager->c_m);
+        //         std::lock_guard
+        //         lk2(player_manager->wd_m);
+        //         player_manager->connecting.insert_or_assign(event.command.guild_id,
+        //         c.first->id);
+        //         player_manager->waiting_vc_ready.insert_or_assign(event.command.guild_id,
+        //         "2");
+        //     }
+
+        //     std::thread t([player_manager, event]() {
+        //                       player_manager->reconnect(event.from,
+        //                       event.command.guild_id);
+        //                   });
+        //     t.detach();
+        // }
     });
 
     thread_manager::dispatch (rt);
@@ -365,7 +325,86 @@ get_option_obj ()
 void
 slash_run (const dpp::slashcommand_t &event)
 {
-    load::slash_run (event);
+    std::thread rt ([event] () {
+        thread_manager::DoneSetter tmds;
+
+        const std::string p_id = _get_id_arg (event);
+        const dpp::snowflake user_id = event.command.usr.id;
+
+        event.thinking ();
+
+        // only count and duration, tracks are fetched per shown page
+        std::pair<database::playlist_info_t, int> info
+            = database::get_user_playlist_info (user_id, p_id);
+
+        if (info.second == -2)
+            {
+                event.edit_response ("Unknown playlist");
+                return;
+            }
+
+        if (info.second != 0)
+            {
+                event.edit_response (
+                    std::string ("`[ERROR]` Unexpected error getting user "
+                                 "playlist with code: ")
+                    + std::to_string (info.second));
+                fprintf (stderr,
+                         "[CMD_PLAYLIST_ERROR] Unexpected error "
+                         "database::get_user_playlist_info with code: %d\n",
+                         info.second);
+                return;
+            }
+
+        if (!info.first.track_count)
+            {
+                event.edit_response (
+                    "This playlist is empty, save a new one with "
+                    "the same Id to overwrite it");
+                return;
+            }
+
+        paginate::reply_paginated_playlist (
+            event,
+            [user_id, p_id] (size_t start, size_t count,
+                             std::deque<player::MCTrack> &tracks) {
+                std::pair<PGresult *, ExecStatusType> res
+                    = database::get_user_playlist_page (user_id, p_id, start,
+                                                        count);
+
+                if (res.second != PGRES_TUPLES_OK)
+                    {
+                        fprintf (stderr,
+                                 "[CMD_PLAYLIST_ERROR] Unexpected error "
+                                 "database::get_user_playlist_page with "
+                                 "code: %d\n",
+                                 res.second);
+
+                        database::finish_res (res.first);
+                        return false;
+                    }
+
+                std::pair<std::deque<player::MCTrack>, int> page
+                    = database::get_playlist_from_PGresult (res.first);
+
+                database::finish_res (res.first);
+
+                // -2 is a page past the end, playlist was overwritten
+                if (page.second != 0 && page.second != -2)
+                    return false;
+
+                for (player::MCTrack &t : page.first)
+                    {
+                        t.user_id = user_id;
+                        tracks.push_back (std::move (t));
+                    }
+
+                return true;
+            },
+            info.first.track_count, info.first.duration, p_id, true);
+    });
+
+    thread_manager::dispatch (rt);
 }
 } // view
 
@@ -32,8 +32,14 @@ handle_option (int64_t &qarg, const dpp::interaction_create_t &event,
 
                 {
                     player::MCTrack t = guild_player->queue.at (0);
+                    std::deque<player::MCTrack> removed
+                        = std::move (guild_player->queue);
+
                     guild_player->queue.clear ();
                     guild_player->queue.push_back (t);
+                    removed.pop_front ();
+
+                    guild_player->cancel_downloads (removed);
                 }
 
                 player_manager->update_info_embed (event.command.guild_id);
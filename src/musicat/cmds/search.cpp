@@ -79,7 +79,7 @@ slash_run (const dpp::slashcommand_t &event)
             return event.reply ("No query?");
 
         event.thinking ();
-        nlohmann::json res;
+        std::shared_ptr<const nlohmann::json> res;
 
         try
             {
@@ -98,7 +98,13 @@ slash_run (const dpp::slashcommand_t &event)
                 return;
             }
 
-        auto tracks = YTDLPTrack::get_playlist_entries (res);
+        if (!res)
+            {
+                event.edit_response ("No result found");
+                return;
+            }
+
+        auto tracks = YTDLPTrack::get_playlist_entries (*res);
 
         size_t pl_siz = tracks.size ();
         if (!pl_siz)
@@ -1,96 +1,849 @@
 #include "musicat/db.h"
+#include "musicat/db_local.h"
+#include "musicat/mctrack.h"
 #include "musicat/musicat.h"
 #include "musicat/player.h"
+#include "musicat/track_codec.h"
+#include "musicat/util.h"
 #include "nlohmann/json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
 #include <dpp/dpp.h>
 #include <dpp/nlohmann/json_fwd.hpp>
 #include <dpp/snowflake.h>
+#include <functional>
 #include <libpq-fe.h>
+#include <map>
 #include <mutex>
+#include <optional>
 #include <regex>
+#include <set>
 #include <string.h>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+// idle connection is pinged by health_check after this many seconds
+#define IDLE_PING_INTERVAL 30
+
+// deferred writes wait this long for more updates of the same guild
+#define WB_WINDOW_MS 1000
+// guilds written per pipeline round trip
+#define WB_MAX_BATCH 64
+// failed deferred write is dropped after this many flushes
+#define WB_MAX_ATTEMPTS 3
+// distance between neighbour queue rows, leaves room for inserting between
+#define QUEUE_SEQ_STEP (1LL << 20)
+
+// guilds whose saved queue is read ahead in a single query
+#define PRELOAD_QUEUE_BATCH 64
+
+// every track row of playlist "p" concatenated, else blob saved before
+// playlists were split into rows
+#define PLAYLIST_DATA_COLUMN                                                 \
+    "COALESCE ((SELECT STRING_AGG (\"t\".\"data\", ''::BYTEA ORDER BY "      \
+    "\"t\".\"pos\") FROM \"playlists_tracks\" AS \"t\" WHERE \"t\".\"uid\" " \
+    "= \"p\".\"uid\" AND \"t\".\"name\" = \"p\".\"name\"), \"p\".\"data\")"
+
 namespace musicat
 {
 // make this a class? add manager too
 namespace database
 {
+struct conn_slot_t
+{
+    PGconn *conn;
+    // last known status, updated whenever connection is given back
+    ConnStatusType status;
+    // last time connection was used or pinged
+    time_t last_used;
+    // bit per statement_e already prepared on this connection, prepared
+    // statements are gone once connection is reset
+    uint64_t prepared;
+    // cancel handle made while the slot was owned, replaced on reset under
+    // pool_m so cancel () never reads a connection leased to another thread
+    PGcancel *cancel;
+};
+
+enum statement_e
+{
+    // variants ordered the same as get_user_playlist_type
+    STMT_GET_ALL_USER_PLAYLIST_ALL,
+    STMT_GET_ALL_USER_PLAYLIST_NAME,
+    STMT_GET_ALL_USER_PLAYLIST_RAW,
+    STMT_GET_ALL_USER_PLAYLIST_TS,
+    STMT_GET_USER_PLAYLIST_ALL,
+    STMT_GET_USER_PLAYLIST_NAME,
+    STMT_GET_USER_PLAYLIST_RAW,
+    STMT_GET_USER_PLAYLIST_TS,
+    STMT_GET_USER_PLAYLIST_PAGE,
+    STMT_GET_USER_PLAYLIST_INFO,
+    STMT_UPDATE_USER_PLAYLIST,
+    STMT_DELETE_USER_PLAYLIST,
+    STMT_GET_GUILD_CURRENT_QUEUE,
+    STMT_DELETE_GUILD_CURRENT_QUEUE,
+    STMT_GET_GUILD_QUEUE_TRACKS,
+    STMT_GET_GUILDS_QUEUE_TRACKS,
+    STMT_GET_SAVED_QUEUE_GUILDS,
+    STMT_CLEAR_GUILD_QUEUE_TRACKS,
+    STMT_DELETE_GUILD_QUEUE_TRACKS,
+    STMT_INSERT_GUILD_QUEUE_TRACKS,
+    STMT_UPDATE_GUILD_PLAYER_CONFIG,
+    STMT_GET_GUILD_PLAYER_CONFIG,
+    STMT_GET_ALL_GUILD_PLAYER_CONFIG,
+    STMT_GET_USER_AUTH,
+    STMT_UPDATE_USER_AUTH,
+    STMT_GET_ALL_EQUALIZER_PRESET_NAME,
+    STMT_GET_EQUALIZER_PRESET,
+    STMT_CREATE_EQUALIZER_PRESET,
+    STMT_GET_SPOTIFY_TRACK_MAPPINGS,
+    STMT_UPDATE_SPOTIFY_TRACK_MAPPINGS,
+    STMT_MAX,
+};
+
+struct statement_t
+{
+    const char *name;
+    const char *query;
+    int nparams;
+};
+
+// every parameter is sent as text, server infers its type from the column
+// it's compared to or inserted into
+static const statement_t statements[STMT_MAX] = {
+    { "get_all_user_playlist_all",
+      "SELECT * FROM \"playlists\" WHERE \"uid\" = $1;", 1 },
+    { "get_all_user_playlist_name",
+      "SELECT \"name\" FROM \"playlists\" WHERE \"uid\" = $1;", 1 },
+    { "get_all_user_playlist_raw",
+      "SELECT \"raw\", " PLAYLIST_DATA_COLUMN " FROM \"playlists\" AS \"p\" "
+      "WHERE \"uid\" = $1;",
+      1 },
+    { "get_all_user_playlist_ts",
+      "SELECT \"ts\" FROM \"playlists\" WHERE \"uid\" = $1;", 1 },
+    { "get_user_playlist_all",
+      "SELECT * FROM \"playlists\" WHERE \"uid\" = $1 AND \"name\" = $2;",
+      2 },
+    { "get_user_playlist_name",
+      "SELECT \"name\" FROM \"playlists\" WHERE \"uid\" = $1 AND "
+      "\"name\" = $2;",
+      2 },
+    // "raw" is only set on rows saved before binary encoding
+    { "get_user_playlist_raw",
+      "SELECT \"raw\", " PLAYLIST_DATA_COLUMN " FROM \"playlists\" AS \"p\" "
+      "WHERE \"uid\" = $1 AND \"name\" = $2;",
+      2 },
+    { "get_user_playlist_ts",
+      "SELECT \"ts\" FROM \"playlists\" WHERE \"uid\" = $1 AND "
+      "\"name\" = $2;",
+      2 },
+    // same shape as get_user_playlist_raw, tracks [$3, $3 + $4)
+    { "get_user_playlist_page",
+      "SELECT NULL::JSON, STRING_AGG (\"data\", ''::BYTEA ORDER BY \"pos\") "
+      "FROM (SELECT \"pos\", \"data\" FROM \"playlists_tracks\" WHERE "
+      "\"uid\" = $1 AND \"name\" = $2 AND \"pos\" >= $3 ORDER BY \"pos\" "
+      "LIMIT $4) AS \"t\";",
+      4 },
+    { "get_user_playlist_info",
+      "SELECT \"track_count\", \"duration\" FROM \"playlists\" WHERE "
+      "\"uid\" = $1 AND \"name\" = $2;",
+      2 },
+    // track rows and playlist row in one statement, so they're written or
+    // rolled back together and concurrent first saves can't both insert
+    { "update_user_playlist",
+      "WITH \"ins\" AS (INSERT INTO \"playlists_tracks\" (\"uid\", "
+      "\"name\", \"pos\", \"data\") SELECT $1, $2, \"pos\" - 1, \"data\" "
+      "FROM UNNEST ($3::BYTEA[]) WITH ORDINALITY AS \"t\" (\"data\", "
+      "\"pos\") ON CONFLICT (\"uid\", \"name\", \"pos\") DO UPDATE SET "
+      "\"data\" = EXCLUDED.\"data\"), \"del\" AS (DELETE FROM "
+      "\"playlists_tracks\" WHERE \"uid\" = $1 AND \"name\" = $2 AND "
+      "\"pos\" >= CARDINALITY ($3::BYTEA[])) INSERT INTO \"playlists\" "
+      "(\"uid\", \"name\", \"track_count\", \"duration\") VALUES ($1, $2, "
+      "CARDINALITY ($3::BYTEA[]), $4) ON CONFLICT (\"uid\", \"name\") DO "
+      "UPDATE SET \"data\" = NULL, \"raw\" = NULL, \"track_count\" = "
+      "EXCLUDED.\"track_count\", \"duration\" = EXCLUDED.\"duration\", "
+      "\"uts\" = CURRENT_TIMESTAMP RETURNING \"name\";",
+      4 },
+    { "delete_user_playlist",
+      "WITH \"del\" AS (DELETE FROM \"playlists_tracks\" WHERE \"uid\" = "
+      "$1 AND \"name\" = $2) DELETE FROM \"playlists\" WHERE \"uid\" = $1 "
+      "AND \"name\" = $2 RETURNING \"name\";",
+      2 },
+    // legacy whole queue blob, only read when guild has no queue rows yet
+    { "get_guild_current_queue",
+      "SELECT \"raw\" FROM \"guilds_current_queue\" WHERE \"gid\" = $1;", 1 },
+    { "delete_guild_current_queue",
+      "DELETE FROM \"guilds_current_queue\" WHERE \"gid\" = $1 RETURNING "
+      "\"gid\";",
+      1 },
+    // json rows written before binary encoding, concatenated binary rows,
+    // seq of every row
+    { "get_guild_queue_tracks",
+      "SELECT JSON_AGG (\"raw\" ORDER BY \"seq\") FILTER (WHERE \"raw\" IS "
+      "NOT NULL), STRING_AGG (\"data\", ''::BYTEA ORDER BY \"seq\"), "
+      "JSON_AGG (\"seq\" ORDER BY \"seq\") FROM "
+      "\"guilds_current_queue_tracks\" WHERE \"gid\" = $1;",
+      1 },
+    // same as get_guild_queue_tracks with gid last, a row per guild in $1
+    // that has queue rows
+    { "get_guilds_queue_tracks",
+      "SELECT JSON_AGG (\"raw\" ORDER BY \"seq\") FILTER (WHERE \"raw\" IS "
+      "NOT NULL), STRING_AGG (\"data\", ''::BYTEA ORDER BY \"seq\"), "
+      "JSON_AGG (\"seq\" ORDER BY \"seq\"), \"gid\" FROM "
+      "\"guilds_current_queue_tracks\" WHERE \"gid\" = ANY "
+      "($1::VARCHAR[]) GROUP BY \"gid\";",
+      1 },
+    // every guild with a saved queue, in either format
+    { "get_saved_queue_guilds",
+      "SELECT \"gid\" FROM \"guilds_current_queue_tracks\" UNION SELECT "
+      "\"gid\" FROM \"guilds_current_queue\";",
+      0 },
+    { "clear_guild_queue_tracks",
+      "DELETE FROM \"guilds_current_queue_tracks\" WHERE \"gid\" = $1;", 1 },
+    { "delete_guild_queue_tracks",
+      "DELETE FROM \"guilds_current_queue_tracks\" WHERE \"gid\" = $1 AND "
+      "\"seq\" = ANY ($2::BIGINT[]);",
+      2 },
+    { "insert_guild_queue_tracks",
+      "INSERT INTO \"guilds_current_queue_tracks\" (\"gid\", \"seq\", "
+      "\"data\") SELECT $1, * FROM UNNEST ($2::BIGINT[], $3::BYTEA[]) ON "
+      "CONFLICT (\"gid\", \"seq\") DO UPDATE SET \"data\" = "
+      "EXCLUDED.\"data\", \"raw\" = NULL;",
+      3 },
+    // NULL param keeps current value, or column default on insert
+    { "update_guild_player_config",
+      "INSERT INTO \"guilds_player_config\" (\"gid\", \"autoplay_state\", "
+      "\"autoplay_threshold\", \"loop_mode\", \"fx_states\") VALUES ($1, "
+      "COALESCE($2::BOOL, FALSE), COALESCE($3::INT, 0), "
+      "COALESCE($4::SMALLINT, 0), $5::JSON) ON CONFLICT (\"gid\") DO UPDATE "
+      "SET \"autoplay_state\" = COALESCE($2::BOOL, "
+      "\"guilds_player_config\".\"autoplay_state\"), "
+      "\"autoplay_threshold\" = COALESCE($3::INT, "
+      "\"guilds_player_config\".\"autoplay_threshold\"), "
+      "\"loop_mode\" = COALESCE($4::SMALLINT, "
+      "\"guilds_player_config\".\"loop_mode\"), "
+      "\"fx_states\" = COALESCE($5::JSON, "
+      "\"guilds_player_config\".\"fx_states\"), "
+      "\"uts\" = CURRENT_TIMESTAMP;",
+      5 },
+    { "get_guild_player_config",
+      "SELECT \"autoplay_state\", \"autoplay_threshold\", \"loop_mode\", "
+      "\"fx_states\" FROM \"guilds_player_config\" WHERE \"gid\" = $1;",
+      1 },
+    // same columns as get_guild_player_config with gid last
+    { "get_all_guild_player_config",
+      "SELECT \"autoplay_state\", \"autoplay_threshold\", \"loop_mode\", "
+      "\"fx_states\", \"gid\" FROM \"guilds_player_config\";",
+      0 },
+    { "get_user_auth", "SELECT \"raw\" FROM \"auths\" WHERE \"uid\" = $1;",
+      1 },
+    { "update_user_auth",
+      "INSERT INTO \"auths\" (\"uid\", \"raw\") VALUES ($1, $2) ON CONFLICT "
+      "(\"uid\") DO UPDATE SET \"raw\" = EXCLUDED.\"raw\", \"uts\" = "
+      "CURRENT_TIMESTAMP;",
+      2 },
+    { "get_all_equalizer_preset_name",
+      "SELECT \"name\" FROM \"equalizer_presets\";", 0 },
+    { "get_equalizer_preset",
+      "SELECT \"value\", \"name\" FROM \"equalizer_presets\" WHERE "
+      "\"name\" = $1;",
+      1 },
+    { "create_equalizer_preset",
+      "INSERT INTO \"equalizer_presets\" (\"uid\", \"value\", \"name\") "
+      "VALUES ($1, $2, $3);",
+      3 },
+    { "get_spotify_track_mappings",
+      "SELECT \"sid\", \"yid\", \"raw\" FROM \"spotify_track_mappings\" "
+      "WHERE \"sid\" = ANY ($1::VARCHAR[]);",
+      1 },
+    { "update_spotify_track_mappings",
+      "INSERT INTO \"spotify_track_mappings\" (\"sid\", \"yid\", \"raw\") "
+      "SELECT * FROM UNNEST ($1::VARCHAR[], $2::VARCHAR[], $3::JSON[]) ON "
+      "CONFLICT (\"sid\") DO UPDATE SET \"yid\" = EXCLUDED.\"yid\", "
+      "\"raw\" = EXCLUDED.\"raw\", \"uts\" = CURRENT_TIMESTAMP;",
+      3 },
+};
+
+static_assert (STMT_MAX <= 64, "prepared mask only holds 64 statements");
+
+// query stats slots after every statement
+#define QUERY_STATS_RAW STMT_MAX
+#define QUERY_STATS_PIPELINE (STMT_MAX + 1)
+#define QUERY_STATS_MAX (STMT_MAX + 2)
+
 std::string conninfo;
-std::mutex conn_mutex;
-PGconn *conn;
+
+static std::mutex pool_m;
+static std::condition_variable pool_cv;
+static std::vector<conn_slot_t> pool;
+// index of slots not leased
+static std::vector<size_t> pool_idle;
+static size_t pool_waiting = 0;
+// set while shutting down, no new lease is given
+static bool pool_closing = false;
+// lease fields guarded by pool_m, query fields by query_stats_m
+static pool_stats_t stats = {};
+// taken after every query, kept apart from pool_m so recording never holds
+// up a lease. Lock after pool_m when both are needed
+static std::mutex query_stats_m;
+// per statement, indexed by statement_e
+static query_stats_t query_stats[QUERY_STATS_MAX] = {};
+// 0 disables slow query log, set on init
+static std::atomic<uint64_t> slow_query_us (0);
+// statements run on the embedded store instead of the pool, set by
+// init_local and kept until shutdown
+static std::atomic<bool> local_backend (false);
+
+// a saved queue row, key identifies the track to diff against
+struct queue_row_t
+{
+    int64_t seq;
+    std::string key;
+};
+
+// not yet written changes of a guild
+struct wb_pending_t
+{
+    // every queue row is deleted before applying the ops below
+    bool queue_reset;
+    std::vector<int64_t> queue_deletes;
+    // seq, track_codec blob in bytea hex
+    std::vector<std::pair<int64_t, std::string>> queue_inserts;
+
+    // unset fields keep what's in the table
+    std::optional<bool> autoplay_state;
+    std::optional<int> autoplay_threshold;
+    std::optional<player::loop_mode_t> loop_mode;
+    nlohmann::json fx_states;
+
+    int attempts;
+};
+
+static std::mutex wb_m;
+static std::condition_variable wb_cv;
+static std::map<dpp::snowflake, wb_pending_t> wb_pending;
+// queue rows each guild has once every pending op is written, guild missing
+// here gets its whole queue rewritten on next update
+static std::map<dpp::snowflake, std::vector<queue_row_t>> wb_known;
+static bool wb_running = false;
+static std::thread wb_thread;
+static write_behind_stats_t wb_stats = {};
+// guilds taken by a flush and not written yet, writes of the same guild must
+// never overtake each other while other guilds don't wait on them
+static std::set<dpp::snowflake> wb_in_flight;
+static std::condition_variable wb_flight_cv;
+
+// guild state read ahead of first use, each entry is taken by the guild's
+// first load
+static std::mutex preload_m;
+static std::map<dpp::snowflake, player_config> preloaded_configs;
+static std::map<dpp::snowflake, std::deque<player::MCTrack>> preloaded_queues;
+// guilds with a saved queue not read yet
+static std::set<dpp::snowflake> preload_queue_saved;
+// guilds waiting for the next batch read
+static std::vector<dpp::snowflake> preload_queue_requested;
+// set once every saved config or every guild with saved queue is known, a
+// guild missing from them has nothing saved
+static bool preload_configs_done = false;
+static bool preload_queues_done = false;
+// read or written on their own after preload, what was preloaded of them
+// must not be used
+static std::set<dpp::snowflake> preload_config_dropped;
+static std::set<dpp::snowflake> preload_queue_dropped;
+
+// users with the most recently searched playlist names kept in index
+#define NAME_INDEX_MAX_USERS 4096
+
+struct name_entry_t
+{
+    std::string name;
+    // so a search doesn't convert every candidate
+    std::string lower;
+};
+
+struct name_index_t
+{
+    // sorted by name
+    std::vector<name_entry_t> entries;
+    time_t last_used;
+};
+
+// names for autocomplete, read from database on first search and kept in
+// sync by every function creating or deleting them
+static std::mutex name_index_m;
+static std::map<dpp::snowflake, name_index_t> playlist_names;
+static std::optional<name_index_t> preset_names;
+// bumped on every change, a load that raced one isn't kept
+static uint64_t name_index_gen = 0;
 
 // -----------------------------------------------------------------------
 // INTERNAL USE ONLY
 // -----------------------------------------------------------------------
 
+static void _wb_start ();
+static void _wb_stop ();
+static size_t _wb_flush (const dpp::snowflake &guild_id);
+static bool _wb_is_pending (const dpp::snowflake &guild_id);
+static void _wb_set_known (const dpp::snowflake &guild_id, PGresult *res,
+                           int row = 0);
+static void _preload_drop_config (const dpp::snowflake &guild_id);
+static void _preload_drop_queue (const dpp::snowflake &guild_id);
+static void _preload_clear ();
+static void _name_index_playlist_add (const dpp::snowflake &user_id,
+                                     const std::string &name);
+static void _name_index_playlist_remove (const dpp::snowflake &user_id,
+                                        const std::string &name);
+static void _name_index_preset_add (const std::string &name);
+static void _name_index_clear ();
+
+static uint64_t
+_elapsed_us (const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds> (
+               std::chrono::steady_clock::now () - start)
+        .count ();
+}
+
+// reconnect a single broken connection, doesn't touch the others. Caller
+// must own the slot, either leased or taken out of idle list
+static void
+_reset_conn (conn_slot_t &slot)
+{
+    PGconn *conn = slot.conn;
+
+    fprintf (stderr, "[DB ERROR] Connection BAD. Reconnecting...\n");
+
+    PQreset (conn);
+    slot.prepared = 0;
+
+    const bool ok = PQstatus (conn) == CONNECTION_OK;
+
+    if (!ok)
+        fprintf (stderr, "[DB_ERROR] Reconnect failed: %s\n",
+                 PQerrorMessage (conn));
+
+    // backend pid and key changed with the new backend
+    PGcancel *cobj = ok ? PQgetCancel (conn) : nullptr;
+
+    {
+        std::lock_guard lk (pool_m);
+        std::swap (slot.cancel, cobj);
+        stats.resets++;
+    }
+
+    if (cobj)
+        PQfreeCancel (cobj);
+}
+
+static size_t
+_latency_bucket (uint64_t us)
+{
+    size_t i = 0;
+
+    while (i < DB_LATENCY_BUCKETS - 1 && us >= get_latency_bucket_bound (i))
+        i++;
+
+    return i;
+}
+
+static query_error_e
+_classify_error (PGresult *res)
+{
+    const char *state
+        = res ? PQresultErrorField (res, PG_DIAG_SQLSTATE) : NULL;
+
+    // local store doesn't set one, libpq doesn't either for client side
+    // failures which are mostly a lost connection
+    if (!state)
+        return local_backend && res ? QUERY_ERROR_OTHER
+                                    : QUERY_ERROR_CONNECTION;
+
+    // connection exception and operator intervention
+    if (strncmp (state, "08", 2) == 0 || strncmp (state, "57P", 3) == 0)
+        return QUERY_ERROR_CONNECTION;
+
+    if (strcmp (state, "57014") == 0)
+        return QUERY_ERROR_CANCELED;
+
+    // integrity constraint violation
+    if (strncmp (state, "23", 2) == 0)
+        return QUERY_ERROR_CONSTRAINT;
+
+    return QUERY_ERROR_OTHER;
+}
+
+static uint64_t
+_result_rows (PGresult *res)
+{
+    if (PQresultStatus (res) == PGRES_TUPLES_OK)
+        return PQntuples (res);
+
+    // empty for commands that don't report it
+    return strtoull (PQcmdTuples (res), NULL, 10);
+}
+
+/**
+ * @brief Add one query to pool and statement stats, log it when slow
+ *
+ * @param stat statement_e, QUERY_STATS_RAW or QUERY_STATS_PIPELINE
+ * @param what statement name or query, printed in slow query log
+ * @param error query_error_e, -1 when succeeded
+ */
+static void
+_record_query_stats (size_t stat, const char *what, uint64_t us,
+                     uint64_t rows, int error)
+{
+    {
+        std::lock_guard lk (query_stats_m);
+
+        stats.queries++;
+        stats.query_us_total += us;
+        if (us > stats.query_us_max)
+            stats.query_us_max = us;
+
+        if (error != -1)
+            stats.failed_queries++;
+
+        query_stats_t &q = query_stats[stat];
+
+        q.calls++;
+        q.us_total += us;
+        if (us > q.us_max)
+            q.us_max = us;
+
+        q.rows += rows;
+        q.histogram[_latency_bucket (us)]++;
+
+        if (error != -1)
+            q.errors[error]++;
+    }
+
+    const uint64_t slow_us = slow_query_us;
+
+    if (slow_us && us >= slow_us)
+        fprintf (stderr, "[DB_SLOW] %.80s: %lu ms, %lu rows%s\n", what,
+                 (unsigned long)(us / 1000), (unsigned long)rows,
+                 error != -1 ? ", failed" : "");
+}
+
+/**
+ * @param rows rows handled, counted from res when -1
+ */
+static void
+_record_query (size_t stat, const char *what,
+               const std::chrono::steady_clock::time_point &start,
+               PGresult *res, int64_t rows = -1)
+{
+    const uint64_t us = _elapsed_us (start);
+    const ExecStatusType status = PQresultStatus (res);
+
+    const bool failed
+        = status == PGRES_FATAL_ERROR || status == PGRES_BAD_RESPONSE;
+
+    _record_query_stats (stat, what, us,
+                         rows == -1 ? _result_rows (res) : (uint64_t)rows,
+                         failed ? _classify_error (res) : -1);
+}
+
 // STATES
 
 PGresult *
-_db_exec (const char *query, bool debug = false)
+_db_exec (const ConnLease &conn, const char *query, bool debug = false)
 {
     if (debug)
         fprintf (stderr, "[DB_EXEC] %s\n", query);
 
-    return PQexec (conn, query);
+    const auto start = std::chrono::steady_clock::now ();
+
+    PGresult *res = PQexec (conn.get (), query);
+
+    _record_query (QUERY_STATS_RAW, query, start, res);
+
+    return res;
 }
 
-void
-_describe_result_status (ExecStatusType status)
+static bool
+_prepare (const ConnLease &conn, const statement_e stmt)
 {
-    fprintf (stderr, "[DB_RES_STATUS] %s\n", PQresStatus (status));
+    conn_slot_t &slot = pool[conn.get_slot ()];
+    const uint64_t bit = 1ULL << stmt;
+
+    if (slot.prepared & bit)
+        return true;
+
+    const statement_t &s = statements[stmt];
+
+    PGresult *res = PQprepare (conn.get (), s.name, s.query, s.nparams, NULL);
+
+    const ExecStatusType status = PQresultStatus (res);
+    PQclear (res);
+
+    if (status != PGRES_COMMAND_OK)
+        {
+            fprintf (stderr, "[DB_ERROR] Failed preparing %s: %s\n", s.name,
+                     PQerrorMessage (conn.get ()));
+
+            return false;
+        }
+
+    slot.prepared |= bit;
+
+    return true;
 }
 
-void
-_print_conn_error (const char *fn)
+/**
+ * @brief Execute prepared statement, preparing it first when this connection
+ * hasn't yet
+ *
+ * @param params statement parameters as text, NULL for SQL NULL, must hold
+ * exactly the statement's nparams entries
+ */
+PGresult *
+_db_exec (const ConnLease &conn, const statement_e stmt,
+          const char *const *params, bool debug = false)
 {
-    fprintf (stderr, "[DB_ERROR] %s: %s\n", fn, PQerrorMessage (conn));
+    if (!conn.get () && !local_backend)
+        return NULL;
+
+    const statement_t &s = statements[stmt];
+
+    if (debug)
+        fprintf (stderr, "[DB_EXEC] %s\n", s.name);
+
+    const auto start = std::chrono::steady_clock::now ();
+
+    PGresult *res = NULL;
+
+    if (!conn.get ())
+        res = local::exec (s.name, s.nparams, params);
+    else if (_prepare (conn, stmt))
+        {
+            res = PQexecPrepared (conn.get (), s.name, s.nparams, params,
+                                  NULL, NULL, 0);
+
+            const char *state = PQresultErrorField (res, PG_DIAG_SQLSTATE);
+
+            // deallocated behind our back, prepare it again once
+            if (state && strcmp (state, "26000") == 0)
+                {
+                    PQclear (res);
+                    pool[conn.get_slot ()].prepared &= ~(1ULL << stmt);
+
+                    res = _prepare (conn, stmt)
+                              ? PQexecPrepared (conn.get (), s.name,
+                                                s.nparams, params, NULL,
+                                                NULL, 0)
+                              : NULL;
+                }
+        }
+
+    _record_query (stmt, s.name, start, res);
+
+    return res;
 }
 
-ExecStatusType
-_check_status (PGresult *res, const char *fn = "",
-               const ExecStatusType status = PGRES_COMMAND_OK)
+/**
+ * @brief Execute prepared statement in single row mode, handler is called
+ * for every row as it arrives instead of after the whole result is buffered
+ *
+ * @return int rows handled, -1 on error
+ */
+static int
+_db_stream (const statement_e stmt, const char *const *params,
+            const std::function<void (PGresult *, int)> &handler)
 {
+    ConnLease conn;
 
-    ExecStatusType ret = PQresultStatus (res);
+    const statement_t &s = statements[stmt];
 
-    if (ret != status)
+    // local store already holds every row in memory
+    if (!conn.get ())
         {
-            _describe_result_status (ret);
-            _print_conn_error (fn);
+            PGresult *res = _db_exec (conn, stmt, params);
+
+            if (PQresultStatus (res) != PGRES_TUPLES_OK)
+                {
+                    PQclear (res);
+                    return -1;
+                }
+
+            const int rows = PQntuples (res);
+            for (int i = 0; i < rows; i++)
+                handler (res, i);
+
+            PQclear (res);
+
+            return rows;
+        }
+
+    if (!_prepare (conn, stmt))
+        return -1;
+
+    const auto start = std::chrono::steady_clock::now ();
+
+    PGconn *c = conn.get ();
+
+    if (!PQsendQueryPrepared (c, s.name, s.nparams, params, NULL, NULL, 0))
+        {
+            fprintf (stderr, "[DB_ERROR] %s: %s\n", s.name,
+                     PQerrorMessage (c));
+
+            _record_query (stmt, s.name, start, NULL, 0);
+            return -1;
+        }
+
+    // still works without it, only buffers the whole result
+    if (!PQsetSingleRowMode (c))
+        fprintf (stderr, "[DB_WARN] %s: Single row mode unavailable\n",
+                 s.name);
+
+    int rows = 0;
+    bool failed = false;
+    PGresult *last = NULL;
+
+    while (PGresult *res = PQgetResult (c))
+        {
+            PQclear (last);
+            last = res;
+
+            const ExecStatusType status = PQresultStatus (res);
+
+            if (status != PGRES_SINGLE_TUPLE && status != PGRES_TUPLES_OK)
+                {
+                    fprintf (stderr, "[DB_ERROR] %s: %s\n", s.name,
+                             PQresultErrorMessage (res));
+
+                    failed = true;
+                    continue;
+                }
+
+            // rows already handled are kept when a later one fails
+            for (int i = 0; i < PQntuples (res); i++, rows++)
+                handler (res, i);
+        }
+
+    _record_query (stmt, s.name, start, last, rows);
+    PQclear (last);
+
+    return failed ? -1 : rows;
+}
+
+// quote every element into a text array literal, eg. {"a","b"}
+static std::string
+_to_text_array (const std::vector<std::string> &values)
+{
+    std::string ret = "{";
+
+    for (size_t i = 0; i < values.size (); i++)
+        {
+            if (i)
+                ret += ',';
+
+            ret += '"';
+
+            for (const char c : values[i])
+                {
+                    if (c == '"' || c == '\\')
+                        ret += '\\';
+
+                    ret += c;
+                }
+
+            ret += '"';
         }
 
+    ret += '}';
+
     return ret;
 }
 
-[[nodiscard]] std::string
-_escape_values_query (const std::string &str)
+// bytea text input in hex format, params are sent as text
+static std::string
+_to_bytea_hex (const std::string &data)
 {
-    if (get_debug_state ())
-        fprintf (stderr, "[DB_ESCAPE_VALUES] %ld\n", str.length ());
+    static const char digits[] = "0123456789abcdef";
 
-    char *res = PQescapeLiteral (conn, str.c_str (), str.length ());
+    std::string ret;
+    ret.reserve (2 + data.size () * 2);
+    ret += "\\x";
 
-    if (res == NULL)
+    for (const char c : data)
         {
-            _print_conn_error ("_escape_values_query");
+            ret += digits[(unsigned char)c >> 4];
+            ret += digits[(unsigned char)c & 0xf];
         }
 
-    std::string ret (res == NULL ? "" : res);
+    return ret;
+}
+
+// empty if value is null
+static std::string
+_get_bytea (PGresult *res, int row, int col)
+{
+    if (PQgetisnull (res, row, col))
+        return "";
+
+    size_t len = 0;
+    unsigned char *data = PQunescapeBytea (
+        (const unsigned char *)PQgetvalue (res, row, col), &len);
+
+    if (!data)
+        return "";
+
+    std::string ret ((const char *)data, len);
+    PQfreemem (data);
+
+    return ret;
+}
+
+void
+_describe_result_status (ExecStatusType status)
+{
+    fprintf (stderr, "[DB_RES_STATUS] %s\n", PQresStatus (status));
+}
+
+void
+_print_conn_error (const ConnLease &conn, const char *fn)
+{
+    // local store prints its own errors
+    if (!conn.get () && local_backend)
+        return;
+
+    fprintf (stderr, "[DB_ERROR] %s: %s\n", fn,
+             PQerrorMessage (conn.get ()));
+}
+
+ExecStatusType
+_check_status (const ConnLease &conn, PGresult *res, const char *fn = "",
+               const ExecStatusType status = PGRES_COMMAND_OK)
+{
+
+    ExecStatusType ret = PQresultStatus (res);
+
+    if (ret != status)
+        {
+            _describe_result_status (ret);
+            _print_conn_error (conn, fn);
+        }
 
-    PQfreemem (res);
-    res = NULL;
     return ret;
 }
 
 ExecStatusType
 _create_table (const char *query, const char *fn = "msg")
 {
-    PGresult *res = _db_exec (query);
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, query);
 
-    ExecStatusType status = _check_status (res, fn);
+    ExecStatusType status = _check_status (conn, res, fn);
 
     return finish_res (res, status);
 }
@@ -163,6 +916,28 @@ create_table_guilds_current_queue ()
     return status;
 }
 
+ExecStatusType
+create_table_guilds_current_queue_tracks ()
+{
+    static const char query[]
+        = "CREATE TABLE IF NOT EXISTS \""
+          "guilds_current_queue_tracks\" ( "
+          // guild_id
+          "\"gid\" VARCHAR(24) NOT NULL, "
+          // position, sparse to insert between rows without renumbering
+          "\"seq\" BIGINT NOT NULL, "
+          // track_codec blob, "raw" is kept for rows written before it
+          "\"data\" BYTEA, "
+          "\"raw\" JSON, "
+          "\"ts\" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL, "
+          "PRIMARY KEY (\"gid\", \"seq\") );";
+
+    ExecStatusType status
+        = _create_table (query, "create_table_guilds_current_queue_tracks");
+
+    return status;
+}
+
 ExecStatusType
 create_table_guilds_player_config ()
 {
@@ -190,18 +965,46 @@ create_table_playlists ()
 {
     static const char query[]
         = "CREATE TABLE IF NOT EXISTS "
-          "\"playlists\" ( \"raw\" JSON NOT NULL, "
+          "\"playlists\" ( \"raw\" JSON, "
           // user_id
           "\"uid\" VARCHAR(24) NOT NULL, "
           "\"name\" VARCHAR(100) NOT NULL, "
           "\"ts\" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL, "
-          "\"uts\" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL );";
+          "\"uts\" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL, "
+          // track_codec blob, "raw" is kept for rows written before it
+          "\"data\" BYTEA, "
+          // NULL until tracks are stored in "playlists_tracks"
+          "\"track_count\" INT, "
+          // ms
+          "\"duration\" BIGINT, "
+          "UNIQUE (\"uid\", \"name\") );";
 
     ExecStatusType status = _create_table (query, "create_table_playlists");
 
     return status;
 }
 
+ExecStatusType
+create_table_playlists_tracks ()
+{
+    static const char query[]
+        = "CREATE TABLE IF NOT EXISTS "
+          "\"playlists_tracks\" ( "
+          // user_id
+          "\"uid\" VARCHAR(24) NOT NULL, "
+          "\"name\" VARCHAR(100) NOT NULL, "
+          // 0 based, no gap
+          "\"pos\" INT NOT NULL, "
+          // track_codec blob of one track
+          "\"data\" BYTEA NOT NULL, "
+          "PRIMARY KEY (\"uid\", \"name\", \"pos\") );";
+
+    ExecStatusType status
+        = _create_table (query, "create_table_playlists_tracks");
+
+    return status;
+}
+
 ExecStatusType
 create_table_auths ()
 {
@@ -236,6 +1039,26 @@ create_table_equalizer_presets ()
     return status;
 }
 
+ExecStatusType
+create_table_spotify_track_mappings ()
+{
+    static const char query[]
+        = "CREATE TABLE IF NOT EXISTS "
+          "\"spotify_track_mappings\" ( "
+          // spotify track id
+          "\"sid\" VARCHAR(32) UNIQUE PRIMARY KEY NOT NULL, "
+          // youtube id
+          "\"yid\" VARCHAR(32) NOT NULL, "
+          "\"raw\" JSON NOT NULL, "
+          "\"ts\" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL, "
+          "\"uts\" TIMESTAMPTZ DEFAULT CURRENT_TIMESTAMP NOT NULL );";
+
+    ExecStatusType status
+        = _create_table (query, "create_table_spotify_track_mappings");
+
+    return status;
+}
+
 // -----------------------------------------------------------------------
 // INSTANCE MANIPULATION
 // -----------------------------------------------------------------------
@@ -248,136 +1071,406 @@ struct init_table_handler_t
 
 inline constexpr const init_table_handler_t init_table_handlers[]
     = { { "guilds_current_queue", create_table_guilds_current_queue },
+        { "guilds_current_queue_tracks",
+          create_table_guilds_current_queue_tracks },
         { "guilds_player_config", create_table_guilds_player_config },
         { "playlists", create_table_playlists },
+        { "playlists_tracks", create_table_playlists_tracks },
         /*
            // what user table for?
         { "users", create_table_users },
         */
         { "auths", create_table_auths },
         { "equalizer_presets", create_table_equalizer_presets },
+        { "spotify_track_mappings", create_table_spotify_track_mappings },
         { NULL, NULL } };
 
-ConnStatusType
-init (const std::string &_conninfo)
-{
-    bool debug = get_debug_state ();
-    if (debug)
-        fprintf (stderr, "[DB] Initializing...\n");
+// -----------------------------------------------------------------------
+// CONNECTION POOL
+// -----------------------------------------------------------------------
 
-    std::lock_guard lk (conn_mutex);
-    conninfo = _conninfo;
+ConnLease::ConnLease () : slot (0), conn (nullptr)
+{
+    const auto start = std::chrono::steady_clock::now ();
 
-    if (debug)
-        fprintf (stderr, "[DB] Connecting to database with param: %s\n",
-                 conninfo.c_str ());
+    std::unique_lock lk (pool_m);
 
-    conn = PQconnectdb (conninfo.c_str ());
+    if (pool.empty () || pool_closing)
+        return;
 
-    ConnStatusType status = PQstatus (conn);
+    pool_waiting++;
+    pool_cv.wait (lk, [] () {
+        return !pool_idle.empty () || pool_closing || pool.empty ();
+    });
+    pool_waiting--;
 
-    if (status != CONNECTION_OK)
-        {
-            fprintf (stderr, "[DB_ERROR] Can't connect to database\n");
-            conninfo = "";
-            PQfinish (conn);
-            conn = nullptr;
-        }
-    else
-        {
-            fprintf (stderr, "[DB] Database connected: %s\n", PQdb (conn));
+    if (pool_idle.empty ())
+        return;
 
-            for (size_t i = 0; i < (sizeof (init_table_handlers)
-                                    / sizeof (*init_table_handlers));
-                 i++)
-                {
-                    const init_table_handler_t *h = &init_table_handlers[i];
+    slot = pool_idle.back ();
+    pool_idle.pop_back ();
+    conn = pool[slot].conn;
 
-                    if (!h->name && !h->init)
-                        {
-                            break;
-                        }
+    const uint64_t us = _elapsed_us (start);
 
-                    if (h->init () != PGRES_COMMAND_OK)
-                        {
-                            fprintf (stderr,
-                                     "[DB_ERROR] Failed to create table "
-                                     "%s\n",
-                                     h->name ? h->name : "unknown");
+    stats.leases++;
+    stats.wait_us_total += us;
+    if (us > stats.wait_us_max)
+        stats.wait_us_max = us;
 
-                            conninfo = "";
-                            PQfinish (conn);
-                            conn = nullptr;
+    stats.wait_histogram[_latency_bucket (us)]++;
 
-                            return CONNECTION_BAD;
-                        }
-                }
+    lk.unlock ();
 
-            fprintf (stderr, "[DB] Database successfully initialized\n");
-        }
+    const uint64_t slow_us = slow_query_us;
 
-    if (!PQisthreadsafe ())
-        {
-            fprintf (stderr, "[DB_WARN] Database isn't thread safe!\n");
-        }
+    if (slow_us && us >= slow_us)
+        fprintf (stderr, "[DB_SLOW] Waited %lu ms for a connection\n",
+                 (unsigned long)(us / 1000));
 
-    return status;
+    // broken by the last query, reconnect before handing it out
+    if (PQstatus (conn) != CONNECTION_OK)
+        _reset_conn (pool[slot]);
 }
 
-// check connection status
-ConnStatusType
-get_conn_status ()
+ConnLease::~ConnLease ()
+{
+    if (!conn)
+        return;
+
+    {
+        std::lock_guard lk (pool_m);
+
+        pool[slot].status = PQstatus (conn);
+        pool[slot].last_used = time (NULL);
+        pool_idle.push_back (slot);
+    }
+
+    // shutdown might be waiting too
+    pool_cv.notify_all ();
+}
+
+PGconn *
+ConnLease::get () const
 {
-    std::lock_guard lk (conn_mutex);
-    return PQstatus (conn);
+    return conn;
 }
 
+size_t
+ConnLease::get_slot () const
+{
+    return slot;
+}
+
+// -----------------------------------------------------------------------
+// INSTANCE MANIPULATION
+// -----------------------------------------------------------------------
+
 ConnStatusType
-reconnect (bool force, const std::string &_conninfo)
+init (const std::string &_conninfo)
 {
-    bool should_reconnect = conn == nullptr || force;
+    bool debug = get_debug_state ();
+    if (debug)
+        fprintf (stderr, "[DB] Initializing...\n");
+
+    const size_t pool_size = get_db_pool_size ();
+    slow_query_us = get_db_slow_query_ms () * 1000;
+
+    std::vector<conn_slot_t> slots;
+    slots.reserve (pool_size);
+
+    {
+        std::lock_guard lk (pool_m);
+
+        if (!pool.empty ())
+            return CONNECTION_OK;
+
+        conninfo = _conninfo;
+    }
+
+    if (debug)
+        fprintf (stderr,
+                 "[DB] Connecting to database with param: %s (%ld "
+                 "connections)\n",
+                 _conninfo.c_str (), pool_size);
+
+    for (size_t i = 0; i < pool_size; i++)
+        {
+            PGconn *c = PQconnectdb (_conninfo.c_str ());
+            ConnStatusType status = PQstatus (c);
+
+            // the first one decides whether database is usable at all
+            if (i == 0 && status != CONNECTION_OK)
+                {
+                    fprintf (stderr, "[DB_ERROR] Can't connect to database\n");
+                    PQfinish (c);
+
+                    std::lock_guard lk (pool_m);
+                    conninfo = "";
 
-    if (!should_reconnect)
+                    return status;
+                }
+
+            if (status != CONNECTION_OK)
+                fprintf (stderr,
+                         "[DB_WARN] Pooled connection %ld failed to connect, "
+                         "retrying on use\n",
+                         i);
+
+            PGcancel *cobj
+                = status == CONNECTION_OK ? PQgetCancel (c) : nullptr;
+
+            slots.push_back ({ c, status, time (NULL), 0, cobj });
+        }
+
+    {
+        std::lock_guard lk (pool_m);
+
+        pool = std::move (slots);
+
+        pool_idle.clear ();
+        for (size_t i = pool.size (); i > 0; i--)
+            pool_idle.push_back (i - 1);
+    }
+
+    fprintf (stderr, "[DB] Database connected: %s\n", PQdb (pool[0].conn));
+
+    for (size_t i = 0;
+         i < (sizeof (init_table_handlers) / sizeof (*init_table_handlers));
+         i++)
         {
-            ConnStatusType status = get_conn_status ();
+            const init_table_handler_t *h = &init_table_handlers[i];
+
+            if (!h->name && !h->init)
+                {
+                    break;
+                }
+
+            if (h->init () != PGRES_COMMAND_OK)
+                {
+                    fprintf (stderr,
+                             "[DB_ERROR] Failed to create table "
+                             "%s\n",
+                             h->name ? h->name : "unknown");
+
+                    shutdown ();
 
-            if (status == CONNECTION_OK)
-                goto reconnect_ok;
+                    std::lock_guard lk (pool_m);
+                    conninfo = "";
 
-            fprintf (stderr, "[DB ERROR] Connection BAD. Reconnecting...\n");
+                    return CONNECTION_BAD;
+                }
         }
 
-    if (!_conninfo.empty ())
-        conninfo = _conninfo;
+    fprintf (stderr, "[DB] Database successfully initialized\n");
 
-    shutdown ();
+    if (!PQisthreadsafe ())
+        {
+            fprintf (stderr, "[DB_WARN] Database isn't thread safe!\n");
+        }
 
-    return init (conninfo);
+    _wb_start ();
 
-reconnect_ok:
     return CONNECTION_OK;
 }
 
-int
-cancel ()
+ConnStatusType
+init_local (const std::string &path)
 {
-    if (!conn)
-        return 0;
+    {
+        std::lock_guard lk (pool_m);
+
+        if (!pool.empty ())
+            return CONNECTION_OK;
+    }
+
+    if (local::init (path) != 0)
+        return CONNECTION_BAD;
+
+    slow_query_us = get_db_slow_query_ms () * 1000;
+
+    local_backend = true;
 
-    std::lock_guard lk (conn_mutex);
-    PGcancel *cobj = PQgetCancel (conn);
+    fprintf (stderr, "[DB] Using local store: %s\n", path.c_str ());
 
-    char err[256];
-    memset (err, '\0', sizeof (err));
-    int ret = PQcancel (cobj, err, ERRBUFSIZE);
+    _wb_start ();
 
-    if (strlen (err) > 0UL)
+    return CONNECTION_OK;
+}
+
+// check connection status
+ConnStatusType
+get_conn_status ()
+{
+    if (local_backend)
+        return CONNECTION_OK;
+
+    std::lock_guard lk (pool_m);
+
+    for (const conn_slot_t &s : pool)
+        {
+            if (s.status == CONNECTION_OK)
+                return CONNECTION_OK;
+        }
+
+    return CONNECTION_BAD;
+}
+
+ConnStatusType
+health_check (const std::string &_conninfo)
+{
+    // never switched back to postgres while running, that would split data
+    // between the two
+    if (local_backend)
+        return CONNECTION_OK;
+
+    bool initialized;
+
+    {
+        std::lock_guard lk (pool_m);
+
+        initialized = !pool.empty ();
+    }
+
+    if (!initialized)
+        {
+            const std::string param
+                = _conninfo.empty () ? get_connect_param () : _conninfo;
+
+            if (param.empty ())
+                return CONNECTION_BAD;
+
+            return init (param);
+        }
+
+    const time_t now = time (NULL);
+
+    std::vector<size_t> to_check;
+
+    // take idle connections out of the pool while checking them
+    {
+        std::lock_guard lk (pool_m);
+
+        for (auto i = pool_idle.begin (); i != pool_idle.end ();)
+            {
+                const conn_slot_t &s = pool[*i];
+
+                if (s.status == CONNECTION_OK
+                    && (now - s.last_used) < IDLE_PING_INTERVAL)
+                    {
+                        i++;
+                        continue;
+                    }
+
+                to_check.push_back (*i);
+                i = pool_idle.erase (i);
+            }
+    }
+
+    for (const size_t i : to_check)
+        {
+            PGconn *c = pool[i].conn;
+
+            if (PQstatus (c) == CONNECTION_OK)
+                {
+                    PGresult *res = PQexec (c, "SELECT 1;");
+                    PQclear (res);
+                }
+
+            if (PQstatus (c) != CONNECTION_OK)
+                _reset_conn (pool[i]);
+
+            std::lock_guard lk (pool_m);
+
+            pool[i].status = PQstatus (c);
+            pool[i].last_used = now;
+            pool_idle.push_back (i);
+        }
+
+    if (!to_check.empty ())
+        pool_cv.notify_all ();
+
+    return get_conn_status ();
+}
+
+pool_stats_t
+get_pool_stats ()
+{
+    std::lock_guard lk (pool_m);
+    std::lock_guard qlk (query_stats_m);
+
+    pool_stats_t ret = stats;
+    ret.size = pool.size ();
+    ret.idle = pool_idle.size ();
+    ret.waiting = pool_waiting;
+    ret.bad = 0;
+
+    for (const conn_slot_t &s : pool)
+        {
+            if (s.status != CONNECTION_OK)
+                ret.bad++;
+        }
+
+    return ret;
+}
+
+std::vector<query_stats_t>
+get_query_stats ()
+{
+    std::vector<query_stats_t> ret (QUERY_STATS_MAX);
+
+    std::lock_guard lk (query_stats_m);
+
+    for (size_t i = 0; i < QUERY_STATS_MAX; i++)
         {
-            fprintf (stderr, "[DB_ERROR] Cancel error: '%s'\n", err);
+            ret[i] = query_stats[i];
+
+            if (i < STMT_MAX)
+                ret[i].name = statements[i].name;
+            else
+                ret[i].name
+                    = i == QUERY_STATS_RAW ? "(raw)" : "(pipeline)";
         }
 
-    PQfreeCancel (cobj);
-    cobj = nullptr;
+    return ret;
+}
+
+uint64_t
+get_latency_bucket_bound (size_t bucket)
+{
+    if (bucket >= DB_LATENCY_BUCKETS - 1)
+        return UINT64_MAX;
+
+    return 250ULL << bucket;
+}
+
+int
+cancel ()
+{
+    std::lock_guard lk (pool_m);
+
+    int ret = 0;
+
+    // only touch the cancel handles, the connections themselves may be
+    // in use by other threads right now
+    for (const conn_slot_t &s : pool)
+        {
+            PGcancel *cobj = s.cancel;
+            if (!cobj)
+                continue;
+
+            char err[ERRBUFSIZE];
+            memset (err, '\0', sizeof (err));
+
+            // idle connection has nothing to cancel, still succeed
+            if (PQcancel (cobj, err, ERRBUFSIZE))
+                ret = 1;
+
+            if (strlen (err) > 0UL)
+                {
+                    fprintf (stderr, "[DB_ERROR] Cancel error: '%s'\n", err);
+                }
+        }
 
     return ret;
 }
@@ -390,26 +1483,72 @@ shutdown ()
     if (debug)
         fprintf (stderr, "[DB] Shutting down...\n");
 
-    if (!conn)
+    // deferred writes go out before the pool closes
+    _wb_stop ();
+
+    _preload_clear ();
+    _name_index_clear ();
+
+    if (local_backend)
         {
-            if (debug)
-                fprintf (stderr, "[DB] No connection\n");
+            local::shutdown ();
+            local_backend = false;
 
             return;
         }
 
+    {
+        std::lock_guard lk (pool_m);
+
+        if (pool.empty ())
+            {
+                if (debug)
+                    fprintf (stderr, "[DB] No connection\n");
+
+                return;
+            }
+    }
+
     if (cancel ())
         {
             if (debug)
-                fprintf (stderr, "[DB] Latest query cancelled\n");
+                fprintf (stderr, "[DB] Running queries cancelled\n");
         }
     else if (debug)
         fprintf (stderr, "[DB] No query cancelled\n");
 
-    std::lock_guard lk (conn_mutex);
+    std::unique_lock lk (pool_m);
+
+    pool_closing = true;
+    pool_cv.notify_all ();
+
+    // wait for every leased connection to be given back
+    pool_cv.wait (lk, [] () { return pool_idle.size () == pool.size (); });
+
+    for (conn_slot_t &s : pool)
+        {
+            if (s.cancel)
+                PQfreeCancel (s.cancel);
+            s.cancel = nullptr;
+
+            PQfinish (s.conn);
+            s.conn = nullptr;
+        }
+
+    pool.clear ();
+    pool_idle.clear ();
+    pool_closing = false;
+}
+
+const char *
+get_backend_name ()
+{
+    if (local_backend)
+        return "local";
+
+    std::lock_guard lk (pool_m);
 
-    PQfinish (conn);
-    conn = nullptr;
+    return pool.empty () ? "none" : "postgres";
 }
 
 const std::string
@@ -438,18 +1577,24 @@ valid_name (const std::string &str)
         return false;
 }
 
+// only what get_playlist_from_PGresult needs to rebuild the track
+static nlohmann::json
+_track_to_json (const player::MCTrack &t)
+{
+    nlohmann::json r = t.raw;
+    r["filename"] = t.filename;
+    r["raw_info"] = t.info.raw;
+
+    return r;
+}
+
 nlohmann::json
 convert_playlist_to_json (const std::deque<player::MCTrack> &playlist)
 {
     nlohmann::json jso;
 
     for (auto &t : playlist)
-        {
-            nlohmann::json r = t.raw;
-            r["filename"] = t.filename;
-            r["raw_info"] = t.info.raw;
-            jso.push_back (r);
-        }
+        jso.push_back (_track_to_json (t));
 
     return jso;
 }
@@ -466,34 +1611,18 @@ get_all_user_playlist (const dpp::snowflake &user_id,
     if (!user_id)
         return std::make_pair (nullptr, (ExecStatusType)-1);
 
-    std::string query ("SELECT ");
-
-    switch (type)
-        {
-        case gup_all:
-            query += "*";
-            break;
-        case gup_name_only:
-            query += "\"name\"";
-            break;
-        case gup_raw_only:
-            query += "\"raw\"";
-            break;
-        case gup_ts_only:
-            query += "\"ts\"";
-            break;
-        default:
-            return std::make_pair (nullptr, (ExecStatusType)-2);
-        }
+    if (type < gup_all || type > gup_ts_only)
+        return std::make_pair (nullptr, (ExecStatusType)-2);
 
-    query += " FROM \"playlists\" WHERE \"uid\" = '" + std::to_string (user_id)
-             + "';";
+    const std::string str_user_id = std::to_string (user_id);
+    const char *params[] = { str_user_id.c_str () };
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    ConnLease conn;
+    PGresult *res = _db_exec (
+        conn, (statement_e)(STMT_GET_ALL_USER_PLAYLIST_ALL + type), params);
 
     ExecStatusType status
-        = _check_status (res, "get_all_user_playlists", PGRES_TUPLES_OK);
+        = _check_status (conn, res, "get_all_user_playlists", PGRES_TUPLES_OK);
 
     return std::make_pair (res, status);
 }
@@ -511,49 +1640,55 @@ get_user_playlist (const dpp::snowflake &user_id, const std::string &name,
             return std::make_pair (nullptr, (ExecStatusType)-3);
         }
 
-    std::string query ("SELECT ");
-
-    switch (type)
-        {
-        case gup_all:
-            query += "*";
-            break;
-        case gup_name_only:
-            query += "\"name\"";
-            break;
-        case gup_raw_only:
-            query += "\"raw\"";
-            break;
-        case gup_ts_only:
-            query += "\"ts\"";
-            break;
-        default:
-            return std::make_pair (nullptr, (ExecStatusType)-2);
-        }
+    if (type < gup_all || type > gup_ts_only)
+        return std::make_pair (nullptr, (ExecStatusType)-2);
 
-    query += " FROM \"playlists\" WHERE \"uid\" = '" + std::to_string (user_id)
-             + "' AND \"name\" = " + _escape_values_query (name) + ";";
+    const std::string str_user_id = std::to_string (user_id);
+    const char *params[] = { str_user_id.c_str (), name.c_str () };
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    ConnLease conn;
+    PGresult *res = _db_exec (
+        conn, (statement_e)(STMT_GET_USER_PLAYLIST_ALL + type), params);
 
     ExecStatusType status
-        = _check_status (res, "get_user_playlists", PGRES_TUPLES_OK);
+        = _check_status (conn, res, "get_user_playlists", PGRES_TUPLES_OK);
 
     return std::make_pair (res, status);
 }
 
-std::pair<std::deque<player::MCTrack>, int>
-get_playlist_from_PGresult (PGresult *res)
+// tracks in row of a queue or playlist result
+static std::pair<std::deque<player::MCTrack>, int>
+_playlist_from_row (PGresult *res, int row)
 {
     std::deque<player::MCTrack> ret = {};
-    if (PQgetisnull (res, 0, 0))
+
+    // binary column is preferred, json column is from before track_codec
+    if (PQnfields (res) > 1 && !PQgetisnull (res, row, 1))
+        {
+            const int status
+                = track_codec::decode (_get_bytea (res, row, 1), ret);
+
+            if (status != 0)
+                {
+                    fprintf (stderr,
+                             "[database::get_playlist_from_PGresult ERROR] "
+                             "Can't decode tracks: %d\n",
+                             status);
+
+                    return std::make_pair (std::deque<player::MCTrack> (),
+                                           -3);
+                }
+
+            return std::make_pair (ret, ret.empty () ? -1 : 0);
+        }
+
+    if (PQgetisnull (res, row, 0))
         return std::make_pair (ret, -2);
 
     nlohmann::json jso;
     try
         {
-            jso = nlohmann::json::parse (PQgetvalue (res, 0, 0));
+            jso = nlohmann::json::parse (PQgetvalue (res, row, 0));
         }
     catch (const nlohmann::json::exception &e)
         {
@@ -583,6 +1718,12 @@ get_playlist_from_PGresult (PGresult *res)
     return std::make_pair (ret, 0);
 }
 
+std::pair<std::deque<player::MCTrack>, int>
+get_playlist_from_PGresult (PGresult *res)
+{
+    return _playlist_from_row (res, 0);
+}
+
 ExecStatusType
 update_user_playlist (const dpp::snowflake &user_id, const std::string &name,
                       const std::deque<player::MCTrack> &playlist)
@@ -591,51 +1732,136 @@ update_user_playlist (const dpp::snowflake &user_id, const std::string &name,
     if (!user_id)
         return (ExecStatusType)-1;
 
-    std::string str_user_id = std::to_string (user_id);
+    const std::string str_user_id = std::to_string (user_id);
 
-    nlohmann::json jso = convert_playlist_to_json (playlist);
+    // one blob per track row, to fetch a page without the rest
+    std::vector<std::string> blobs;
+    blobs.reserve (playlist.size ());
 
-    std::string values = _escape_values_query (jso.dump ());
+    uint64_t duration = 0;
 
-    std::string escaped_name = _escape_values_query (name);
+    for (const player::MCTrack &t : playlist)
+        {
+            blobs.push_back (_to_bytea_hex (track_codec::encode (t)));
+            duration += mctrack::get_duration (t);
+        }
 
-    std::lock_guard lk (conn_mutex);
+    const std::string values = _to_text_array (blobs);
+    const std::string str_duration = std::to_string (duration);
 
-    std::string query_update (
-        "UPDATE \"playlists\" SET "
-        "\"raw\" = "
-        + values + ", \"uts\" = CURRENT_TIMESTAMP WHERE \"uid\" = '"
-        + str_user_id + "' AND \"name\" = " + escaped_name
-        + " RETURNING \"name\";");
+    const char *params[] = { str_user_id.c_str (), name.c_str (),
+                             values.c_str (), str_duration.c_str () };
 
-    PGresult *res = _db_exec (query_update.c_str ());
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_UPDATE_USER_PLAYLIST, params);
 
     ExecStatusType status
-        = _check_status (res, "update_user_playlist", PGRES_TUPLES_OK);
+        = _check_status (conn, res, "update_user_playlist", PGRES_TUPLES_OK);
 
-    bool not_updated = false;
-    if (PQgetisnull (res, 0, 0))
-        not_updated = true;
-    else
-        status = PGRES_COMMAND_OK;
+    if (status != PGRES_TUPLES_OK)
+        return finish_res (res, status);
+
+    // created or updated along with its tracks in the same statement
+    _name_index_playlist_add (user_id, name);
+
+    return finish_res (res, PGRES_COMMAND_OK);
+}
+
+std::pair<PGresult *, ExecStatusType>
+get_user_playlist_page (const dpp::snowflake &user_id,
+                        const std::string &name, size_t start, size_t count)
+{
+    if (!user_id)
+        return std::make_pair (nullptr, (ExecStatusType)-1);
+
+    if (name.empty ())
+        return std::make_pair (nullptr, (ExecStatusType)-3);
+
+    const std::string str_user_id = std::to_string (user_id);
+    const std::string str_start = std::to_string (start);
+    const std::string str_count = std::to_string (count);
+    const char *params[] = { str_user_id.c_str (), name.c_str (),
+                             str_start.c_str (), str_count.c_str () };
+
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_GET_USER_PLAYLIST_PAGE, params);
+
+    ExecStatusType status = _check_status (
+        conn, res, "get_user_playlist_page", PGRES_TUPLES_OK);
+
+    return std::make_pair (res, status);
+}
+
+std::pair<playlist_info_t, int>
+get_user_playlist_info (const dpp::snowflake &user_id,
+                        const std::string &name)
+{
+    playlist_info_t info = { 0, 0 };
+
+    if (!user_id)
+        return std::make_pair (info, -1);
 
-    if (not_updated)
+    const std::string str_user_id = std::to_string (user_id);
+    const char *params[] = { str_user_id.c_str (), name.c_str () };
+
+    PGresult *res;
+    ExecStatusType status;
+    {
+        ConnLease conn;
+        res = _db_exec (conn, STMT_GET_USER_PLAYLIST_INFO, params);
+
+        status = _check_status (conn, res, "get_user_playlist_info",
+                                PGRES_TUPLES_OK);
+    }
+
+    if (status != PGRES_TUPLES_OK)
         {
-            finish_res (res, status);
+            finish_res (res);
+            return std::make_pair (info, -3);
+        }
 
-            std::string query_insert (
-                "INSERT INTO \"playlists\" "
-                "(\"uid\", \"raw\", \"name\") VALUES ('");
+    if (PQntuples (res) == 0)
+        {
+            finish_res (res);
+            return std::make_pair (info, -2);
+        }
 
-            query_insert
-                += str_user_id + "', " + values + ", " + escaped_name + ");";
+    if (!PQgetisnull (res, 0, 0))
+        {
+            info.track_count = std::stoull (PQgetvalue (res, 0, 0));
 
-            res = _db_exec (query_insert.c_str ());
+            if (!PQgetisnull (res, 0, 1))
+                info.duration = std::stoull (PQgetvalue (res, 0, 1));
 
-            status = _check_status (res, "insert_user_playlist");
+            finish_res (res);
+            return std::make_pair (info, 0);
         }
 
-    return finish_res (res, status);
+    finish_res (res);
+
+    // saved as a single blob before playlists were split into track rows,
+    // rewrite it now so pages can be fetched
+    std::pair<PGresult *, ExecStatusType> full
+        = get_user_playlist (user_id, name, gup_raw_only);
+
+    std::pair<std::deque<player::MCTrack>, int> playlist
+        = get_playlist_from_PGresult (full.first);
+
+    finish_res (full.first);
+
+    // -1 is an empty playlist, migrated as such
+    if (playlist.second != 0 && playlist.second != -1)
+        return std::make_pair (info, playlist.second);
+
+    if (update_user_playlist (user_id, name, playlist.first)
+        != PGRES_COMMAND_OK)
+        return std::make_pair (info, -3);
+
+    info.track_count = playlist.first.size ();
+    for (const player::MCTrack &t : playlist.first)
+        info.duration += mctrack::get_duration (t);
+
+    return std::make_pair (info, 0);
 }
 
 ExecStatusType
@@ -645,21 +1871,22 @@ delete_user_playlist (const dpp::snowflake &user_id, const std::string &name)
     if (!user_id)
         return (ExecStatusType)-1;
 
-    std::string query ("DELETE FROM \"");
-    query += "playlists\" "
-             "WHERE \"uid\" = '"
-             + std::to_string (user_id) + "' AND \"name\" = "
-             + _escape_values_query (name) + " RETURNING \"name\" ;";
+    const std::string str_user_id = std::to_string (user_id);
+    const char *params[] = { str_user_id.c_str (), name.c_str () };
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_DELETE_USER_PLAYLIST, params);
 
     ExecStatusType status = PGRES_FATAL_ERROR;
 
     if (!PQgetisnull (res, 0, 0))
-        status = _check_status (res, "delete_user_playlist", PGRES_TUPLES_OK);
+        status = _check_status (conn, res, "delete_user_playlist",
+                                PGRES_TUPLES_OK);
     else
-        _check_status (res, "delete_user_playlist", PGRES_TUPLES_OK);
+        _check_status (conn, res, "delete_user_playlist", PGRES_TUPLES_OK);
+
+    if (status == PGRES_TUPLES_OK)
+        _name_index_playlist_remove (user_id, name);
 
     return finish_res (res, status);
 }
@@ -673,22 +1900,12 @@ update_guild_current_queue (const dpp::snowflake &guild_id,
     if (!playlist.size ())
         return (ExecStatusType)-2;
 
-    nlohmann::json jso = convert_playlist_to_json (playlist);
-
-    std::string values = _escape_values_query (jso.dump ());
+    if (!defer_update_guild_current_queue (guild_id, playlist))
+        return PGRES_FATAL_ERROR;
 
-    std::string query ("INSERT INTO \"guilds_current_queue\" ");
-    query += "( \"raw\", \"gid\") VALUES (" + values + ", '"
-             + std::to_string (guild_id)
-             + "') ON CONFLICT (\"gid\") DO UPDATE SET \"raw\" = " + values
-             + ", \"uts\" = CURRENT_TIMESTAMP;";
+    _wb_flush (guild_id);
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
-
-    ExecStatusType status = _check_status (res, "update_guild_current_queue");
-
-    return finish_res (res, status);
+    return _wb_is_pending (guild_id) ? PGRES_FATAL_ERROR : PGRES_COMMAND_OK;
 }
 
 std::pair<PGresult *, ExecStatusType>
@@ -697,42 +1914,58 @@ get_guild_current_queue (const dpp::snowflake &guild_id)
     if (!guild_id)
         return std::make_pair (nullptr, (ExecStatusType)-1);
 
-    std::string query (
-        "SELECT \"raw\" FROM \"guilds_current_queue\" WHERE \"gid\" = '");
-    query += std::to_string (guild_id) + "';";
+    // don't read older state than what's waiting to be written
+    _wb_flush (guild_id);
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    // read below, anything preloaded is no newer
+    _preload_drop_queue (guild_id);
 
-    ExecStatusType status
-        = _check_status (res, "get_guild_current_queue", PGRES_TUPLES_OK);
+    const std::string str_guild_id = std::to_string (guild_id);
+    const char *params[] = { str_guild_id.c_str () };
 
-    return std::make_pair (res, status);
-}
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_GET_GUILD_QUEUE_TRACKS, params);
 
-ExecStatusType
-delete_guild_current_queue (const dpp::snowflake &guild_id)
-{
-    if (!guild_id)
-        return (ExecStatusType)-1;
+    ExecStatusType status
+        = _check_status (conn, res, "get_guild_current_queue",
+                         PGRES_TUPLES_OK);
 
-    std::string query ("DELETE FROM \"");
-    query += "guilds_current_queue\" "
-             "WHERE \"gid\" = '"
-             + std::to_string (guild_id) + "' RETURNING \"gid\" ;";
+    // seq column is only null when guild has no queue rows
+    if (status != PGRES_TUPLES_OK || !PQgetisnull (res, 0, 2))
+        {
+            if (status == PGRES_TUPLES_OK)
+                _wb_set_known (guild_id, res);
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+            return std::make_pair (res, status);
+        }
 
-    ExecStatusType status = PGRES_FATAL_ERROR;
+    PQclear (res);
 
-    if (!PQgetisnull (res, 0, 0))
-        status = _check_status (res, "delete_guild_current_queue",
-                                PGRES_TUPLES_OK);
-    else
-        _check_status (res, "delete_guild_current_queue", PGRES_TUPLES_OK);
+    // saved by older version as a single json blob, first update rewrites
+    // it into rows
+    res = _db_exec (conn, STMT_GET_GUILD_CURRENT_QUEUE, params);
 
-    return finish_res (res, status);
+    status = _check_status (conn, res, "get_guild_current_queue",
+                            PGRES_TUPLES_OK);
+
+    if (status == PGRES_TUPLES_OK && PQntuples (res) == 0)
+        _wb_set_known (guild_id, NULL);
+
+    return std::make_pair (res, status);
+}
+
+ExecStatusType
+delete_guild_current_queue (const dpp::snowflake &guild_id)
+{
+    if (!guild_id)
+        return (ExecStatusType)-1;
+
+    if (!defer_delete_guild_current_queue (guild_id))
+        return PGRES_FATAL_ERROR;
+
+    _wb_flush (guild_id);
+
+    return _wb_is_pending (guild_id) ? PGRES_FATAL_ERROR : PGRES_COMMAND_OK;
 }
 
 ExecStatusType
@@ -753,71 +1986,42 @@ update_guild_player_config (const dpp::snowflake &guild_id,
             return (ExecStatusType)-2;
         }
 
-    std::vector<std::string> values, names;
-    values.reserve (4);
-    names.reserve (4);
+    const std::string str_guild_id = std::to_string (guild_id);
+
+    // NULL leaves the column as is
+    std::string str_threshold, str_loop_mode, str_fx_states;
+
+    const char *params[] = { str_guild_id.c_str (), NULL, NULL, NULL, NULL };
 
     if (autoplay_state)
-        {
-            names.push_back ("\"autoplay_state\"");
-            values.push_back (*autoplay_state ? "TRUE" : "FALSE");
-        }
+        params[1] = *autoplay_state ? "TRUE" : "FALSE";
 
     if (autoplay_threshold)
         {
-            names.push_back ("\"autoplay_threshold\"");
-            values.push_back (std::to_string (*autoplay_threshold));
+            str_threshold = std::to_string (*autoplay_threshold);
+            params[2] = str_threshold.c_str ();
         }
 
     if (loop_mode)
         {
-            names.push_back ("\"loop_mode\"");
-            values.push_back (_stringify_loop_mode (*loop_mode));
+            str_loop_mode = _stringify_loop_mode (*loop_mode);
+            params[3] = str_loop_mode.c_str ();
         }
 
     if (fx_states.is_object ())
         {
-            const std::string esc = _escape_values_query (fx_states.dump ());
-
-            if (!esc.empty ())
-                {
-                    names.push_back ("\"fx_states\"");
-                    values.push_back (esc);
-                }
-        }
-
-    std::string query ("INSERT INTO \"guilds_player_config\" ");
-    query += "( \"gid\", ";
-
-    for (auto i = names.begin (); i != names.end (); i++)
-        {
-            query += *i;
-            if ((i + 1) != names.end ())
-                query += ", ";
+            str_fx_states = fx_states.dump ();
+            params[4] = str_fx_states.c_str ();
         }
 
-    query += " ) VALUES ( '" + std::to_string (guild_id) + "', ";
+    _preload_drop_config (guild_id);
 
-    for (auto i = values.begin (); i != values.end (); i++)
-        {
-            query += *i;
-            if ((i + 1) != values.end ())
-                query += ", ";
-        }
-
-    query += " ) ON CONFLICT (\"gid\") DO UPDATE SET ";
-
-    for (size_t i = 0; i < names.size (); i++)
-        {
-            query += names[i] + " = " + values[i] + ", ";
-        }
-
-    query += "\"uts\" = CURRENT_TIMESTAMP;";
-
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str (), get_debug_state ());
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_UPDATE_GUILD_PLAYER_CONFIG, params,
+                              get_debug_state ());
 
-    ExecStatusType status = _check_status (res, "update_guild_player_config");
+    ExecStatusType status
+        = _check_status (conn, res, "update_guild_player_config");
 
     return finish_res (res, status);
 }
@@ -828,22 +2032,27 @@ get_guild_player_config (const dpp::snowflake &guild_id)
     if (!guild_id)
         return std::make_pair (nullptr, (ExecStatusType)-1);
 
-    std::string query ("SELECT \"autoplay_state\", \"autoplay_threshold\", "
-                       "\"loop_mode\", \"fx_states\" "
-                       "FROM \"guilds_player_config\" WHERE \"gid\" = '");
-    query += std::to_string (guild_id) + "';";
+    _wb_flush (guild_id);
+
+    // read below, anything preloaded is no newer
+    _preload_drop_config (guild_id);
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    const std::string str_guild_id = std::to_string (guild_id);
+    const char *params[] = { str_guild_id.c_str () };
+
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_GET_GUILD_PLAYER_CONFIG, params);
 
     ExecStatusType status
-        = _check_status (res, "get_guild_player_config", PGRES_TUPLES_OK);
+        = _check_status (conn, res, "get_guild_player_config",
+                         PGRES_TUPLES_OK);
 
     return std::make_pair (res, status);
 }
 
-std::pair<player_config, int>
-parse_guild_player_config_PGresult (PGresult *res)
+// columns 0 to 3 of row are the player config columns
+static std::pair<player_config, int>
+_player_config_from_row (PGresult *res, int row)
 {
     player_config ret;
     ret.autoplay_state = false;
@@ -853,9 +2062,9 @@ parse_guild_player_config_PGresult (PGresult *res)
     bool set = false;
     const bool debug = get_debug_state ();
 
-    if (!PQgetisnull (res, 0, 0))
+    if (!PQgetisnull (res, row, 0))
         {
-            const char *val = PQgetvalue (res, 0, 0);
+            const char *val = PQgetvalue (res, row, 0);
             if (debug)
                 fprintf (stderr,
                          "[DB_DEBUG] Parse player config atp_state: %s\n",
@@ -867,9 +2076,9 @@ parse_guild_player_config_PGresult (PGresult *res)
                 }
         }
 
-    if (!PQgetisnull (res, 0, 1))
+    if (!PQgetisnull (res, row, 1))
         {
-            const char *val = PQgetvalue (res, 0, 1);
+            const char *val = PQgetvalue (res, row, 1);
             if (debug)
                 fprintf (stderr,
                          "[DB_DEBUG] Parse player config atp_thres: %s\n",
@@ -879,9 +2088,9 @@ parse_guild_player_config_PGresult (PGresult *res)
             set = true;
         }
 
-    if (!PQgetisnull (res, 0, 2))
+    if (!PQgetisnull (res, row, 2))
         {
-            const char *val = PQgetvalue (res, 0, 2);
+            const char *val = PQgetvalue (res, row, 2);
             if (debug)
                 fprintf (stderr, "[DB_DEBUG] Parse player config l_mode: %s\n",
                          val);
@@ -889,9 +2098,9 @@ parse_guild_player_config_PGresult (PGresult *res)
             set = true;
         }
 
-    if (!PQgetisnull (res, 0, 3))
+    if (!PQgetisnull (res, row, 3))
         {
-            const char *val = PQgetvalue (res, 0, 3);
+            const char *val = PQgetvalue (res, row, 3);
             if (debug)
                 fprintf (stderr,
                          "[DB_DEBUG] Parse player config fx_states: %s\n",
@@ -913,20 +2122,26 @@ parse_guild_player_config_PGresult (PGresult *res)
     return std::make_pair (ret, set ? 0 : 1);
 }
 
+std::pair<player_config, int>
+parse_guild_player_config_PGresult (PGresult *res)
+{
+    return _player_config_from_row (res, 0);
+}
+
 std::pair<PGresult *, ExecStatusType>
 get_user_auth (const dpp::snowflake &user_id)
 {
     if (!user_id)
         return std::make_pair (nullptr, (ExecStatusType)-1);
 
-    std::string query ("SELECT \"raw\" FROM \"auths\" WHERE \"uid\" = '");
-    query += std::to_string (user_id) + "';";
+    const std::string str_user_id = std::to_string (user_id);
+    const char *params[] = { str_user_id.c_str () };
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_GET_USER_AUTH, params);
 
     ExecStatusType status
-        = _check_status (res, "get_user_auth", PGRES_TUPLES_OK);
+        = _check_status (conn, res, "get_user_auth", PGRES_TUPLES_OK);
 
     return std::make_pair (res, status);
 }
@@ -963,18 +2178,15 @@ update_user_auth (const dpp::snowflake &user_id, const nlohmann::json &data)
     if (!data.size ())
         return (ExecStatusType)-2;
 
-    std::string values = _escape_values_query (data.dump ());
+    const std::string str_user_id = std::to_string (user_id);
+    const std::string values = data.dump ();
 
-    std::string query ("INSERT INTO \"auths\" ");
-    query += "( \"raw\", \"uid\") VALUES (" + values + ", '"
-             + std::to_string (user_id)
-             + "') ON CONFLICT (\"uid\") DO UPDATE SET \"raw\" = " + values
-             + ", \"uts\" = CURRENT_TIMESTAMP;";
+    const char *params[] = { str_user_id.c_str (), values.c_str () };
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_UPDATE_USER_AUTH, params);
 
-    ExecStatusType status = _check_status (res, "update_user_auth");
+    ExecStatusType status = _check_status (conn, res, "update_user_auth");
 
     return finish_res (res, status);
 }
@@ -982,13 +2194,11 @@ update_user_auth (const dpp::snowflake &user_id, const nlohmann::json &data)
 std::pair<PGresult *, ExecStatusType>
 get_all_equalizer_preset_name ()
 {
-    std::string query = "SELECT \"name\" FROM \"equalizer_presets\";";
-
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_GET_ALL_EQUALIZER_PRESET_NAME, NULL);
 
     ExecStatusType status = _check_status (
-        res, "get_all_equalizer_preset_name", PGRES_TUPLES_OK);
+        conn, res, "get_all_equalizer_preset_name", PGRES_TUPLES_OK);
 
     return std::make_pair (res, status);
 }
@@ -999,15 +2209,13 @@ get_equalizer_preset (const std::string &name)
     if (name.empty () /*|| !valid_name (name)*/)
         return std::make_pair (std::make_pair ("", ""), (ExecStatusType)-1);
 
-    std::string query = "SELECT \"value\", \"name\" FROM "
-                        "\"equalizer_presets\" WHERE \"name\" = "
-                        + _escape_values_query (name) + ";";
+    const char *params[] = { name.c_str () };
 
-    std::lock_guard lk (conn_mutex);
-    PGresult *res = _db_exec (query.c_str ());
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_GET_EQUALIZER_PRESET, params);
 
     ExecStatusType status
-        = _check_status (res, "get_equalizer_preset", PGRES_TUPLES_OK);
+        = _check_status (conn, res, "get_equalizer_preset", PGRES_TUPLES_OK);
 
     std::string val, ori_name;
 
@@ -1036,23 +2244,1518 @@ create_equalizer_preset (const std::string &name, const std::string &value,
     // if (!valid_name (name))
     //     return (ExecStatusType)-2;
 
-    std::string escaped_value = _escape_values_query (value);
+    const std::string str_user_id = std::to_string (user_id);
+
+    const char *params[]
+        = { str_user_id.c_str (), value.c_str (), name.c_str () };
+
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_CREATE_EQUALIZER_PRESET, params);
+
+    ExecStatusType status
+        = _check_status (conn, res, "create_equalizer_preset");
+
+    if (status == PGRES_COMMAND_OK)
+        _name_index_preset_add (name);
+
+    return finish_res (res, status);
+}
+
+std::pair<std::vector<spotify_track_mapping_t>, ExecStatusType>
+get_spotify_track_mappings (const std::vector<std::string> &spotify_ids)
+{
+    if (spotify_ids.empty ())
+        return std::make_pair (std::vector<spotify_track_mapping_t>{},
+                               (ExecStatusType)-1);
+
+    const std::string ids = _to_text_array (spotify_ids);
+    const char *params[] = { ids.c_str () };
 
-    std::string str_user_id = std::to_string (user_id);
+    ConnLease conn;
+    PGresult *res = _db_exec (conn, STMT_GET_SPOTIFY_TRACK_MAPPINGS, params);
 
-    std::string query_insert ("INSERT INTO \"equalizer_presets\" "
-                              "(\"uid\", \"value\", \"name\") VALUES ('");
+    ExecStatusType status
+        = _check_status (conn, res, "get_spotify_track_mappings",
+                         PGRES_TUPLES_OK);
+
+    std::vector<spotify_track_mapping_t> ret;
+
+    if (status != PGRES_TUPLES_OK)
+        return std::make_pair (ret, finish_res (res, status));
+
+    const int rows = PQntuples (res);
+    ret.reserve (rows);
+
+    for (int i = 0; i < rows; i++)
+        {
+            if (PQgetisnull (res, i, 0) || PQgetisnull (res, i, 2))
+                continue;
+
+            spotify_track_mapping_t m;
+            m.spotify_id = PQgetvalue (res, i, 0);
+            m.youtube_id = PQgetvalue (res, i, 1);
+            m.raw = nlohmann::json::parse (PQgetvalue (res, i, 2), nullptr,
+                                           false);
+
+            if (m.raw.is_discarded ())
+                {
+                    fprintf (stderr,
+                             "[database::get_spotify_track_mappings WARN] "
+                             "Invalid json for '%s'\n",
+                             m.spotify_id.c_str ());
+                    continue;
+                }
+
+            ret.push_back (std::move (m));
+        }
+
+    return std::make_pair (ret, finish_res (res, status));
+}
 
-    query_insert += str_user_id + "', " + escaped_value + ", "
-                    + _escape_values_query (name) + ");";
+ExecStatusType
+update_spotify_track_mappings (
+    const std::vector<spotify_track_mapping_t> &mappings)
+{
+    if (mappings.empty ())
+        return (ExecStatusType)-1;
+
+    std::vector<std::string> sids, yids, raws;
+    sids.reserve (mappings.size ());
+    yids.reserve (mappings.size ());
+    raws.reserve (mappings.size ());
+
+    // a row can only be upserted once per statement, last one wins
+    std::unordered_map<std::string, size_t> seen;
+
+    for (const spotify_track_mapping_t &m : mappings)
+        {
+            auto i = seen.find (m.spotify_id);
+            if (i != seen.end ())
+                {
+                    yids[i->second] = m.youtube_id;
+                    raws[i->second] = m.raw.dump ();
+                    continue;
+                }
+
+            seen.emplace (m.spotify_id, sids.size ());
+            sids.push_back (m.spotify_id);
+            yids.push_back (m.youtube_id);
+            raws.push_back (m.raw.dump ());
+        }
+
+    const std::string arr_sids = _to_text_array (sids);
+    const std::string arr_yids = _to_text_array (yids);
+    const std::string arr_raws = _to_text_array (raws);
 
-    PGresult *res = _db_exec (query_insert.c_str ());
+    const char *params[]
+        = { arr_sids.c_str (), arr_yids.c_str (), arr_raws.c_str () };
 
-    ExecStatusType status = _check_status (res, "create_equalizer_preset");
+    ConnLease conn;
+    PGresult *res
+        = _db_exec (conn, STMT_UPDATE_SPOTIFY_TRACK_MAPPINGS, params);
+
+    ExecStatusType status
+        = _check_status (conn, res, "update_spotify_track_mappings");
 
     return finish_res (res, status);
 }
 
+// -----------------------------------------------------------------------
+// WRITE BEHIND
+// -----------------------------------------------------------------------
+
+// apply newer on top of older, result in newer
+static void
+_wb_merge (wb_pending_t &newer, const wb_pending_t &older)
+{
+    if (!newer.queue_reset)
+        {
+            std::unordered_set<int64_t> deletes (newer.queue_deletes.begin (),
+                                                 newer.queue_deletes.end ());
+
+            std::vector<std::pair<int64_t, std::string>> inserts;
+            inserts.reserve (older.queue_inserts.size ()
+                             + newer.queue_inserts.size ());
+
+            // row deleted before ever reaching the table, drop both
+            for (const auto &i : older.queue_inserts)
+                {
+                    if (deletes.erase (i.first))
+                        continue;
+
+                    inserts.push_back (i);
+                }
+
+            std::vector<int64_t> merged_deletes = older.queue_deletes;
+            merged_deletes.insert (merged_deletes.end (), deletes.begin (),
+                                   deletes.end ());
+
+            inserts.insert (inserts.end (),
+                            std::make_move_iterator (
+                                newer.queue_inserts.begin ()),
+                            std::make_move_iterator (
+                                newer.queue_inserts.end ()));
+
+            newer.queue_reset = older.queue_reset;
+            newer.queue_deletes = std::move (merged_deletes);
+            newer.queue_inserts = std::move (inserts);
+        }
+
+    if (!newer.autoplay_state.has_value ())
+        newer.autoplay_state = older.autoplay_state;
+
+    if (!newer.autoplay_threshold.has_value ())
+        newer.autoplay_threshold = older.autoplay_threshold;
+
+    if (!newer.loop_mode.has_value ())
+        newer.loop_mode = older.loop_mode;
+
+    if (!newer.fx_states.is_object ())
+        newer.fx_states = older.fx_states;
+
+    if (older.attempts > newer.attempts)
+        newer.attempts = older.attempts;
+}
+
+static bool
+_wb_has_queue (const wb_pending_t &p)
+{
+    return p.queue_reset || !p.queue_deletes.empty ()
+           || !p.queue_inserts.empty ();
+}
+
+static bool
+_wb_has_config (const wb_pending_t &p)
+{
+    return p.autoplay_state.has_value () || p.autoplay_threshold.has_value ()
+           || p.loop_mode.has_value () || p.fx_states.is_object ();
+}
+
+// caller holds wb_m. Merge update into pending entry of guild_id
+static void
+_wb_add (const dpp::snowflake &guild_id, wb_pending_t &update)
+{
+    if (!_wb_has_queue (update) && !_wb_has_config (update))
+        return;
+
+    auto i = wb_pending.find (guild_id);
+    if (i == wb_pending.end ())
+        {
+            wb_pending.emplace (guild_id, std::move (update));
+            return;
+        }
+
+    _wb_merge (update, i->second);
+    i->second = std::move (update);
+
+    wb_stats.coalesced++;
+}
+
+static bool
+_wb_is_pending (const dpp::snowflake &guild_id)
+{
+    std::lock_guard lk (wb_m);
+
+    return wb_pending.find (guild_id) != wb_pending.end ();
+}
+
+// key of a queue row for diffing, both a queued track and a saved row only
+// know their filename. Empty key never matches, track without filename has
+// nothing stable to match by and its row is always rewritten
+static std::string
+_track_key (std::string filename)
+{
+    // filename is unique per downloaded track
+    return filename;
+}
+
+// remember saved rows of guild read from get_guild_queue_tracks result row,
+// or that it has none when res is NULL
+static void
+_wb_set_known (const dpp::snowflake &guild_id, PGresult *res, int row)
+{
+    std::vector<queue_row_t> rows;
+
+    if (res)
+        {
+            // json rows are left unknown so the next update rewrites the
+            // whole queue in binary
+            if (!PQgetisnull (res, row, 0))
+                return;
+
+            const nlohmann::json seqs = nlohmann::json::parse (
+                PQgetvalue (res, row, 2), nullptr, false);
+
+            std::vector<std::string> keys;
+            if (track_codec::decode_filenames (_get_bytea (res, row, 1), keys)
+                    != 0
+                || !seqs.is_array () || seqs.size () != keys.size ())
+                return;
+
+            rows.reserve (seqs.size ());
+
+            for (size_t i = 0; i < seqs.size (); i++)
+                {
+                    if (!seqs[i].is_number_integer ())
+                        return;
+
+                    rows.push_back ({ seqs[i].get<int64_t> (),
+                                      _track_key (std::move (keys[i])) });
+                }
+        }
+
+    std::lock_guard lk (wb_m);
+
+    // already tracking changes newer than what was read
+    wb_known.emplace (guild_id, std::move (rows));
+}
+
+/**
+ * @brief Caller holds wb_m. Diff playlist against known rows of guild into
+ * the fewest row deletes and inserts: tracks still in the same relative order
+ * keep their rows, the rest get a seq between their kept neighbours. Whole
+ * queue is rewritten when rows are unknown or there's no room left between
+ * two rows.
+ */
+static void
+_wb_diff_queue (const dpp::snowflake &guild_id,
+                const std::deque<player::MCTrack> &playlist,
+                wb_pending_t &update)
+{
+    const size_t n = playlist.size ();
+
+    std::vector<queue_row_t> rows (n);
+    std::vector<bool> kept (n, false);
+
+    for (size_t i = 0; i < n; i++)
+        rows[i].key = _track_key (playlist[i].filename);
+
+    auto k = wb_known.find (guild_id);
+    bool rewrite = k == wb_known.end ();
+
+    if (!rewrite)
+        {
+            const std::vector<queue_row_t> &old = k->second;
+
+            // pair every track with the first unused row of the same key
+            std::unordered_map<std::string, std::deque<size_t>> by_key;
+            for (size_t i = 0; i < old.size (); i++)
+                if (!old[i].key.empty ())
+                    by_key[old[i].key].push_back (i);
+
+            std::vector<int64_t> match (n, -1);
+            for (size_t i = 0; i < n; i++)
+                {
+                    if (rows[i].key.empty ())
+                        continue;
+
+                    auto f = by_key.find (rows[i].key);
+                    if (f == by_key.end () || f->second.empty ())
+                        continue;
+
+                    match[i] = f->second.front ();
+                    f->second.pop_front ();
+                }
+
+            // longest increasing run of matched rows, patience sorting
+            std::vector<size_t> tails;
+            std::vector<int64_t> prev (n, -1);
+            for (size_t i = 0; i < n; i++)
+                {
+                    if (match[i] < 0)
+                        continue;
+
+                    auto pos = std::lower_bound (
+                        tails.begin (), tails.end (), match[i],
+                        [&match] (size_t t, int64_t m) {
+                            return match[t] < m;
+                        });
+
+                    if (pos != tails.begin ())
+                        prev[i] = *(pos - 1);
+
+                    if (pos == tails.end ())
+                        tails.push_back (i);
+                    else
+                        *pos = i;
+                }
+
+            std::vector<bool> old_kept (old.size (), false);
+            for (int64_t i = tails.empty () ? -1 : (int64_t)tails.back ();
+                 i >= 0; i = prev[i])
+                {
+                    kept[i] = true;
+                    old_kept[match[i]] = true;
+                    rows[i].seq = old[match[i]].seq;
+                }
+
+            for (size_t i = 0; i < old.size (); i++)
+                if (!old_kept[i])
+                    update.queue_deletes.push_back (old[i].seq);
+
+            // number every run of new tracks
+            size_t i = 0;
+            while (i < n && !rewrite)
+                {
+                    if (kept[i])
+                        {
+                            i++;
+                            continue;
+                        }
+
+                    size_t end = i;
+                    while (end < n && !kept[end])
+                        end++;
+
+                    const int64_t count = end - i;
+                    int64_t lo = 0;
+                    int64_t step = QUEUE_SEQ_STEP;
+
+                    if (i > 0 && end < n)
+                        {
+                            lo = rows[i - 1].seq;
+                            step = (rows[end].seq - lo) / (count + 1);
+                        }
+                    else if (i > 0)
+                        lo = rows[i - 1].seq;
+                    else if (end < n)
+                        lo = rows[end].seq - (step * (count + 1));
+
+                    if (step == 0)
+                        rewrite = true;
+
+                    for (int64_t j = 0; j < count; j++)
+                        rows[i + j].seq = lo + (step * (j + 1));
+
+                    i = end;
+                }
+        }
+
+    if (rewrite)
+        {
+            update.queue_reset = true;
+            update.queue_deletes.clear ();
+
+            for (size_t i = 0; i < n; i++)
+                {
+                    kept[i] = false;
+                    rows[i].seq = QUEUE_SEQ_STEP * (i + 1);
+                }
+        }
+
+    for (size_t i = 0; i < n; i++)
+        if (!kept[i])
+            update.queue_inserts.emplace_back (
+                rows[i].seq,
+                _to_bytea_hex (track_codec::encode (playlist[i])));
+
+    wb_known[guild_id] = std::move (rows);
+}
+
+struct wb_item_t
+{
+    dpp::snowflake guild_id;
+    wb_pending_t p;
+
+    std::string str_guild_id;
+    std::string str_deletes;
+    std::string str_insert_seqs;
+    std::string str_insert_raws;
+    std::string str_threshold;
+    std::string str_loop_mode;
+    std::string str_fx_states;
+};
+
+struct wb_cmd_t
+{
+    size_t item;
+    statement_e stmt;
+    const char *params[5];
+};
+
+// build statements to run, item must outlive returned params
+static std::vector<wb_cmd_t>
+_wb_build_cmds (std::vector<wb_item_t> &items)
+{
+    std::vector<wb_cmd_t> cmds;
+    cmds.reserve (items.size () * 2);
+
+    for (size_t i = 0; i < items.size (); i++)
+        {
+            wb_item_t &it = items[i];
+            it.str_guild_id = std::to_string (it.guild_id);
+
+            const char *gid = it.str_guild_id.c_str ();
+
+            if (it.p.queue_reset)
+                {
+                    cmds.push_back (
+                        { i, STMT_CLEAR_GUILD_QUEUE_TRACKS, { gid } });
+                    // migrated to rows
+                    cmds.push_back (
+                        { i, STMT_DELETE_GUILD_CURRENT_QUEUE, { gid } });
+                }
+
+            if (!it.p.queue_deletes.empty ())
+                {
+                    std::vector<std::string> seqs;
+                    seqs.reserve (it.p.queue_deletes.size ());
+
+                    for (const int64_t seq : it.p.queue_deletes)
+                        seqs.push_back (std::to_string (seq));
+
+                    it.str_deletes = _to_text_array (seqs);
+
+                    cmds.push_back ({ i,
+                                      STMT_DELETE_GUILD_QUEUE_TRACKS,
+                                      { gid, it.str_deletes.c_str () } });
+                }
+
+            if (!it.p.queue_inserts.empty ())
+                {
+                    std::vector<std::string> seqs, raws;
+                    seqs.reserve (it.p.queue_inserts.size ());
+                    raws.reserve (it.p.queue_inserts.size ());
+
+                    for (const auto &ins : it.p.queue_inserts)
+                        {
+                            seqs.push_back (std::to_string (ins.first));
+                            raws.push_back (ins.second);
+                        }
+
+                    it.str_insert_seqs = _to_text_array (seqs);
+                    it.str_insert_raws = _to_text_array (raws);
+
+                    cmds.push_back ({ i,
+                                      STMT_INSERT_GUILD_QUEUE_TRACKS,
+                                      { gid, it.str_insert_seqs.c_str (),
+                                        it.str_insert_raws.c_str () } });
+                }
+
+            if (!_wb_has_config (it.p))
+                continue;
+
+            wb_cmd_t cmd = { i,
+                             STMT_UPDATE_GUILD_PLAYER_CONFIG,
+                             { gid, NULL, NULL, NULL, NULL } };
+
+            if (it.p.autoplay_state.has_value ())
+                cmd.params[1] = *it.p.autoplay_state ? "TRUE" : "FALSE";
+
+            if (it.p.autoplay_threshold.has_value ())
+                {
+                    it.str_threshold
+                        = std::to_string (*it.p.autoplay_threshold);
+                    cmd.params[2] = it.str_threshold.c_str ();
+                }
+
+            if (it.p.loop_mode.has_value ())
+                {
+                    it.str_loop_mode = _stringify_loop_mode (*it.p.loop_mode);
+                    cmd.params[3] = it.str_loop_mode.c_str ();
+                }
+
+            if (it.p.fx_states.is_object ())
+                {
+                    it.str_fx_states = it.p.fx_states.dump ();
+                    cmd.params[4] = it.str_fx_states.c_str ();
+                }
+
+            cmds.push_back (cmd);
+        }
+
+    return cmds;
+}
+
+static bool
+_wb_result_ok (const ConnLease &conn, PGresult *res, const statement_e stmt)
+{
+    const ExecStatusType status = PQresultStatus (res);
+
+    // delete of a queue never saved has nothing to return
+    if (status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK)
+        return true;
+
+    // aborted by an earlier failure in the same pipeline, not its fault
+    if (status == PGRES_PIPELINE_ABORTED)
+        return false;
+
+    const char *state = PQresultErrorField (res, PG_DIAG_SQLSTATE);
+
+    if (conn.get () && state && strcmp (state, "26000") == 0)
+        pool[conn.get_slot ()].prepared &= ~(1ULL << stmt);
+
+    fprintf (stderr, "[database::write_behind ERROR] %s: %s\n",
+             statements[stmt].name,
+             res ? PQresultErrorMessage (res) : PQerrorMessage (conn.get ()));
+
+    return false;
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+// read what's left up to the last of `syncs` sync points so the pipeline can
+// be left, false when the connection is gone before that
+static bool
+_wb_drain (PGconn *c, size_t syncs)
+{
+    // a NULL only ends a command result, two in a row means nothing is left
+    int nulls = 0;
+
+    while (syncs && nulls < 2 && PQstatus (c) == CONNECTION_OK)
+        {
+            PGresult *res = PQgetResult (c);
+            if (!res)
+                {
+                    nulls++;
+                    continue;
+                }
+
+            nulls = 0;
+
+            if (PQresultStatus (res) == PGRES_PIPELINE_SYNC)
+                syncs--;
+
+            PQclear (res);
+        }
+
+    return syncs == 0;
+}
+#endif
+
+/**
+ * @brief Run every command in a single round trip using pipeline mode,
+ * falls back to one query per command when libpq doesn't support it. Each
+ * guild's commands end with their own sync so they commit or roll back
+ * together without touching other guilds
+ *
+ * @return std::vector<bool> success of each command, a command rolled back
+ *         by a later failure of the same guild still reads true but its
+ *         guild always has a failed one
+ */
+static std::vector<bool>
+_wb_exec (const ConnLease &conn, const std::vector<wb_cmd_t> &cmds)
+{
+    std::vector<bool> ok (cmds.size (), false);
+
+    if (!conn.get ())
+        {
+            // embedded store has no round trip to save
+            if (local_backend)
+                for (size_t i = 0; i < cmds.size (); i++)
+                    {
+                        PGresult *res
+                            = _db_exec (conn, cmds[i].stmt, cmds[i].params);
+
+                        ok[i] = _wb_result_ok (conn, res, cmds[i].stmt);
+                        PQclear (res);
+                    }
+
+            return ok;
+        }
+
+    // prepare outside the pipeline, only happens once per connection
+    for (const wb_cmd_t &cmd : cmds)
+        if (!_prepare (conn, cmd.stmt))
+            return ok;
+
+#ifdef LIBPQ_HAS_PIPELINING
+    PGconn *c = conn.get ();
+
+    if (PQenterPipelineMode (c) == 1)
+        {
+            const auto start = std::chrono::steady_clock::now ();
+
+            // commands followed by a sync, the rest is never committed
+            size_t synced = 0;
+            size_t syncs = 0;
+            bool send_failed = false;
+
+            for (size_t i = 0; i < cmds.size (); i++)
+                {
+                    const statement_t &s = statements[cmds[i].stmt];
+
+                    if (!PQsendQueryPrepared (c, s.name, s.nparams,
+                                              cmds[i].params, NULL, NULL, 0))
+                        {
+                            send_failed = true;
+                            break;
+                        }
+
+                    if (i + 1 < cmds.size ()
+                        && cmds[i + 1].item == cmds[i].item)
+                        continue;
+
+                    if (!PQpipelineSync (c))
+                        {
+                            send_failed = true;
+                            break;
+                        }
+
+                    synced = i + 1;
+                    syncs++;
+                }
+
+            if (send_failed)
+                fprintf (stderr, "[database::write_behind ERROR] Failed "
+                                 "sending pipeline: %s\n",
+                         PQerrorMessage (c));
+
+            uint64_t rows = 0;
+            // first failure of the batch, a command never synced counts too
+            int error = synced < cmds.size () ? QUERY_ERROR_CONNECTION : -1;
+
+            // first command of the guild being read
+            size_t group = 0;
+
+            for (size_t i = 0; i < synced; i++)
+                {
+                    PGresult *res = PQgetResult (c);
+                    if (!res)
+                        {
+                            error = QUERY_ERROR_CONNECTION;
+                            break;
+                        }
+
+                    ok[i] = _wb_result_ok (conn, res, cmds[i].stmt);
+
+                    if (ok[i])
+                        rows += _result_rows (res);
+                    else if (error == -1)
+                        error = _classify_error (res);
+
+                    PQclear (res);
+
+                    // every command result is terminated by a NULL
+                    while ((res = PQgetResult (c)))
+                        PQclear (res);
+
+                    if (i + 1 < synced && cmds[i + 1].item == cmds[i].item)
+                        continue;
+
+                    // guild's transaction ends here
+                    res = PQgetResult (c);
+                    const bool committed
+                        = PQresultStatus (res) == PGRES_PIPELINE_SYNC;
+                    PQclear (res);
+
+                    if (!committed)
+                        {
+                            for (size_t j = group; j <= i; j++)
+                                ok[j] = false;
+
+                            if (error == -1)
+                                error = QUERY_ERROR_CONNECTION;
+
+                            break;
+                        }
+
+                    syncs--;
+                    group = i + 1;
+                }
+
+            _record_query_stats (QUERY_STATS_PIPELINE, "(pipeline)",
+                                 _elapsed_us (start), rows, error);
+
+            // commands sent without their sync are still in an open
+            // transaction, only dropping the session gets rid of them
+            if (!_wb_drain (c, syncs) || send_failed
+                || PQexitPipelineMode (c) != 1)
+                _reset_conn (pool[conn.get_slot ()]);
+
+            return ok;
+        }
+#endif
+
+    for (size_t i = 0; i < cmds.size (); i++)
+        {
+            PGresult *res = _db_exec (conn, cmds[i].stmt, cmds[i].params);
+
+            ok[i] = _wb_result_ok (conn, res, cmds[i].stmt);
+            PQclear (res);
+        }
+
+    return ok;
+}
+
+// take at most WB_MAX_BATCH guilds not in flight, or only guild_id when it's
+// set once its write in flight is done. Taken guilds are in flight until
+// _wb_flush is done with them
+static std::vector<wb_item_t>
+_wb_take (const dpp::snowflake &guild_id)
+{
+    std::vector<wb_item_t> items;
+
+    std::unique_lock lk (wb_m);
+
+    if (guild_id)
+        {
+            wb_flight_cv.wait (lk, [&guild_id] () {
+                return wb_in_flight.find (guild_id) == wb_in_flight.end ();
+            });
+
+            auto i = wb_pending.find (guild_id);
+            if (i == wb_pending.end ())
+                return items;
+
+            wb_in_flight.insert (i->first);
+            items.push_back ({ i->first, std::move (i->second) });
+            wb_pending.erase (i);
+
+            return items;
+        }
+
+    items.reserve (std::min (wb_pending.size (), (size_t)WB_MAX_BATCH));
+
+    auto i = wb_pending.begin ();
+    while (i != wb_pending.end () && items.size () < WB_MAX_BATCH)
+        {
+            // left for the flush writing it, picked up by the next one
+            if (wb_in_flight.find (i->first) != wb_in_flight.end ())
+                {
+                    i++;
+                    continue;
+                }
+
+            wb_in_flight.insert (i->first);
+            items.push_back ({ i->first, std::move (i->second) });
+            i = wb_pending.erase (i);
+        }
+
+    return items;
+}
+
+static size_t
+_wb_flush (const dpp::snowflake &guild_id)
+{
+    size_t written = 0;
+
+    while (true)
+        {
+            std::vector<wb_item_t> items = _wb_take (guild_id);
+            if (items.empty ())
+                break;
+
+            std::vector<wb_cmd_t> cmds = _wb_build_cmds (items);
+
+            std::vector<bool> ok;
+            {
+                ConnLease conn;
+                ok = _wb_exec (conn, cmds);
+            }
+
+            std::vector<bool> item_ok (items.size (), true);
+            for (size_t i = 0; i < cmds.size (); i++)
+                if (!ok[i])
+                    item_ok[cmds[i].item] = false;
+
+            size_t failed = 0;
+
+            {
+                std::lock_guard lk (wb_m);
+
+                wb_stats.batches++;
+
+                for (size_t i = 0; i < items.size (); i++)
+                    {
+                        if (item_ok[i])
+                            {
+                                written++;
+                                wb_stats.written++;
+                                continue;
+                            }
+
+                        wb_item_t &it = items[i];
+
+                        if (!wb_running
+                            || ++it.p.attempts >= WB_MAX_ATTEMPTS)
+                            {
+                                fprintf (stderr,
+                                         "[database::write_behind ERROR] "
+                                         "Dropping pending write of guild "
+                                         "%s\n",
+                                         it.str_guild_id.c_str ());
+
+                                // saved rows are unknown now, next update
+                                // rewrites the whole queue
+                                if (_wb_has_queue (it.p))
+                                    wb_known.erase (it.guild_id);
+
+                                wb_stats.failed++;
+                                continue;
+                            }
+
+                        // retried on next flush, newer update wins
+                        auto p = wb_pending.find (it.guild_id);
+                        if (p == wb_pending.end ())
+                            wb_pending.emplace (it.guild_id,
+                                                std::move (it.p));
+                        else
+                            _wb_merge (p->second, it.p);
+
+                        failed++;
+                    }
+
+                for (const wb_item_t &it : items)
+                    wb_in_flight.erase (it.guild_id);
+            }
+
+            wb_flight_cv.notify_all ();
+
+            // leave the retries to the next flush
+            if (failed || guild_id)
+                break;
+        }
+
+    return written;
+}
+
+static void
+_wb_worker ()
+{
+    std::unique_lock lk (wb_m);
+
+    while (wb_running)
+        {
+            wb_cv.wait (lk,
+                        [] () { return !wb_pending.empty () || !wb_running; });
+
+            if (!wb_running)
+                break;
+
+            // let rapid updates coalesce into the pending snapshot
+            wb_cv.wait_for (lk, std::chrono::milliseconds (WB_WINDOW_MS),
+                            [] () { return !wb_running; });
+
+            lk.unlock ();
+            _wb_flush (0);
+            lk.lock ();
+        }
+}
+
+static void
+_wb_start ()
+{
+    std::lock_guard lk (wb_m);
+
+    if (wb_running)
+        return;
+
+    wb_running = true;
+    wb_thread = std::thread (_wb_worker);
+}
+
+// stop writer and write whatever is still pending
+static void
+_wb_stop ()
+{
+    {
+        std::lock_guard lk (wb_m);
+
+        if (!wb_running)
+            return;
+
+        wb_running = false;
+    }
+
+    wb_cv.notify_all ();
+
+    if (wb_thread.joinable ())
+        wb_thread.join ();
+
+    // a guild written by a read is left out of the final batch otherwise
+    {
+        std::unique_lock lk (wb_m);
+        wb_flight_cv.wait (lk, [] () { return wb_in_flight.empty (); });
+    }
+
+    _wb_flush (0);
+}
+
+bool
+defer_update_guild_current_queue (const dpp::snowflake &guild_id,
+                                  const std::deque<player::MCTrack> &playlist)
+{
+    if (!guild_id || playlist.empty ())
+        return false;
+
+    _preload_drop_queue (guild_id);
+
+    {
+        std::lock_guard lk (wb_m);
+
+        if (!wb_running)
+            return false;
+
+        wb_pending_t update = {};
+        // only changed tracks are serialized, caller keeps modifying its
+        // queue after this
+        _wb_diff_queue (guild_id, playlist, update);
+
+        _wb_add (guild_id, update);
+    }
+
+    wb_cv.notify_all ();
+
+    return true;
+}
+
+bool
+defer_delete_guild_current_queue (const dpp::snowflake &guild_id)
+{
+    if (!guild_id)
+        return false;
+
+    _preload_drop_queue (guild_id);
+
+    {
+        std::lock_guard lk (wb_m);
+
+        if (!wb_running)
+            return false;
+
+        wb_pending_t update = {};
+        update.queue_reset = true;
+
+        wb_known[guild_id] = {};
+
+        _wb_add (guild_id, update);
+    }
+
+    wb_cv.notify_all ();
+
+    return true;
+}
+
+bool
+defer_update_guild_player_config (const dpp::snowflake &guild_id,
+                                  const bool *autoplay_state,
+                                  const int *autoplay_threshold,
+                                  const player::loop_mode_t *loop_mode,
+                                  const nlohmann::json &fx_states)
+{
+    if (!guild_id)
+        return false;
+
+    wb_pending_t update = {};
+
+    if (autoplay_state)
+        update.autoplay_state = *autoplay_state;
+
+    if (autoplay_threshold)
+        update.autoplay_threshold = *autoplay_threshold;
+
+    if (loop_mode)
+        update.loop_mode = *loop_mode;
+
+    if (fx_states.is_object ())
+        update.fx_states = fx_states;
+
+    if (!_wb_has_config (update))
+        return false;
+
+    _preload_drop_config (guild_id);
+
+    {
+        std::lock_guard lk (wb_m);
+
+        if (!wb_running)
+            return false;
+
+        _wb_add (guild_id, update);
+    }
+
+    wb_cv.notify_all ();
+
+    return true;
+}
+
+size_t
+flush_deferred (const dpp::snowflake &guild_id)
+{
+    return _wb_flush (guild_id);
+}
+
+write_behind_stats_t
+get_write_behind_stats ()
+{
+    std::lock_guard lk (wb_m);
+
+    write_behind_stats_t ret = wb_stats;
+    ret.pending = wb_pending.size ();
+
+    return ret;
+}
+
+// -----------------------------------------------------------------------
+// PRELOAD
+// -----------------------------------------------------------------------
+
+static void
+_preload_drop_config (const dpp::snowflake &guild_id)
+{
+    std::lock_guard lk (preload_m);
+
+    preloaded_configs.erase (guild_id);
+    preload_config_dropped.insert (guild_id);
+}
+
+static void
+_preload_drop_queue (const dpp::snowflake &guild_id)
+{
+    std::lock_guard lk (preload_m);
+
+    preloaded_queues.erase (guild_id);
+    preload_queue_saved.erase (guild_id);
+    preload_queue_dropped.insert (guild_id);
+}
+
+static void
+_preload_clear ()
+{
+    std::lock_guard lk (preload_m);
+
+    preloaded_configs.clear ();
+    preloaded_queues.clear ();
+    preload_queue_saved.clear ();
+    preload_queue_requested.clear ();
+    preload_configs_done = false;
+    preload_queues_done = false;
+    preload_config_dropped.clear ();
+    preload_queue_dropped.clear ();
+}
+
+int
+preload_guild_states ()
+{
+    std::map<dpp::snowflake, player_config> configs;
+    std::set<dpp::snowflake> saved;
+
+    const int config_count = _db_stream (
+        STMT_GET_ALL_GUILD_PLAYER_CONFIG, NULL,
+        [&configs] (PGresult *res, int row) {
+            const dpp::snowflake guild_id (
+                strtoull (PQgetvalue (res, row, 4), NULL, 10));
+            std::pair<player_config, int> conf
+                = _player_config_from_row (res, row);
+
+            if (guild_id && conf.second == 0)
+                configs.emplace (guild_id, std::move (conf.first));
+        });
+
+    const int queue_count
+        = _db_stream (STMT_GET_SAVED_QUEUE_GUILDS, NULL,
+                      [&saved] (PGresult *res, int row) {
+                          saved.insert (
+                              strtoull (PQgetvalue (res, row, 0), NULL, 10));
+                      });
+
+    std::lock_guard lk (preload_m);
+
+    if (config_count >= 0)
+        {
+            // anything read or written meanwhile is newer than this
+            for (const dpp::snowflake &id : preload_config_dropped)
+                configs.erase (id);
+
+            preloaded_configs = std::move (configs);
+            preload_configs_done = true;
+        }
+
+    if (queue_count >= 0)
+        {
+            for (const dpp::snowflake &id : preload_queue_dropped)
+                saved.erase (id);
+
+            preload_queue_saved = std::move (saved);
+            preload_queues_done = true;
+        }
+
+    if (config_count < 0 || queue_count < 0)
+        return -1;
+
+    return preloaded_configs.size ();
+}
+
+void
+request_guild_current_queue_preload (const dpp::snowflake &guild_id)
+{
+    std::lock_guard lk (preload_m);
+
+    // nothing saved or already read
+    if (preload_queue_saved.find (guild_id) == preload_queue_saved.end ()
+        || preloaded_queues.find (guild_id) != preloaded_queues.end ())
+        return;
+
+    preload_queue_requested.push_back (guild_id);
+}
+
+size_t
+preload_requested_guild_current_queues ()
+{
+    std::vector<dpp::snowflake> requested;
+
+    {
+        std::lock_guard lk (preload_m);
+
+        if (preload_queue_requested.empty ())
+            return 0;
+
+        requested.swap (preload_queue_requested);
+    }
+
+    size_t loaded = 0;
+
+    for (size_t i = 0; i < requested.size (); i += PRELOAD_QUEUE_BATCH)
+        {
+            const size_t end
+                = std::min (i + PRELOAD_QUEUE_BATCH, requested.size ());
+
+            std::vector<std::string> ids;
+            ids.reserve (end - i);
+
+            for (size_t j = i; j < end; j++)
+                ids.push_back (std::to_string (requested[j]));
+
+            const std::string str_ids = _to_text_array (ids);
+            const char *params[] = { str_ids.c_str () };
+
+            _db_stream (
+                STMT_GET_GUILDS_QUEUE_TRACKS, params,
+                [&loaded] (PGresult *res, int row) {
+                    const dpp::snowflake guild_id (
+                        strtoull (PQgetvalue (res, row, 3), NULL, 10));
+
+                    std::pair<std::deque<player::MCTrack>, int> queue
+                        = _playlist_from_row (res, row);
+
+                    if (queue.second != 0)
+                        return;
+
+                    std::lock_guard lk (preload_m);
+
+                    // written while reading, let its load read it again
+                    if (!preload_queue_saved.erase (guild_id))
+                        return;
+
+                    _wb_set_known (guild_id, res, row);
+
+                    preloaded_queues[guild_id] = std::move (queue.first);
+                    loaded++;
+                });
+        }
+
+    return loaded;
+}
+
+int
+take_preloaded_guild_player_config (const dpp::snowflake &guild_id,
+                                    player_config &out)
+{
+    std::lock_guard lk (preload_m);
+
+    auto i = preloaded_configs.find (guild_id);
+    if (i != preloaded_configs.end ())
+        {
+            out = std::move (i->second);
+            preloaded_configs.erase (i);
+            preload_config_dropped.insert (guild_id);
+
+            return 0;
+        }
+
+    if (preload_configs_done
+        && preload_config_dropped.find (guild_id)
+               == preload_config_dropped.end ())
+        return 1;
+
+    return -1;
+}
+
+int
+take_preloaded_guild_current_queue (const dpp::snowflake &guild_id,
+                                    std::deque<player::MCTrack> &out)
+{
+    std::unique_lock lk (preload_m);
+
+    auto i = preloaded_queues.find (guild_id);
+    if (i != preloaded_queues.end ())
+        {
+            out = std::move (i->second);
+            preloaded_queues.erase (i);
+            preload_queue_dropped.insert (guild_id);
+
+            return 0;
+        }
+
+    if (preload_queues_done
+        && preload_queue_saved.find (guild_id) == preload_queue_saved.end ()
+        && preload_queue_dropped.find (guild_id)
+               == preload_queue_dropped.end ())
+        {
+            lk.unlock ();
+
+            // first update doesn't need to read what's saved either
+            _wb_set_known (guild_id, NULL);
+
+            return 1;
+        }
+
+    return -1;
+}
+
+// -----------------------------------------------------------------------
+// NAME INDEX
+// -----------------------------------------------------------------------
+
+static name_entry_t
+_name_entry (const std::string &name)
+{
+    name_entry_t e = { name, name };
+
+    for (char &c : e.lower)
+        c = std::tolower (c);
+
+    return e;
+}
+
+static bool
+_name_entry_less (const name_entry_t &e, const std::string &name)
+{
+    return e.name < name;
+}
+
+static void
+_name_index_add (name_index_t &index, const std::string &name)
+{
+    auto i = std::lower_bound (index.entries.begin (), index.entries.end (),
+                               name, _name_entry_less);
+
+    if (i != index.entries.end () && i->name == name)
+        return;
+
+    index.entries.insert (i, _name_entry (name));
+}
+
+static void
+_name_index_remove (name_index_t &index, const std::string &name)
+{
+    auto i = std::lower_bound (index.entries.begin (), index.entries.end (),
+                               name, _name_entry_less);
+
+    if (i != index.entries.end () && i->name == name)
+        index.entries.erase (i);
+}
+
+// same matching as autocomplete::filter_candidates
+static bool
+_name_match (const std::string &lower, const std::string &query,
+             bool fuzzy)
+{
+    if (!fuzzy)
+        return lower.find (query) != std::string::npos;
+
+    size_t i = 0;
+    for (char c : query)
+        {
+            i = lower.find (c, i);
+            if (i == std::string::npos)
+                return false;
+
+            i++;
+        }
+
+    return true;
+}
+
+static std::vector<std::string>
+_name_index_search (const name_index_t &index, const std::string &query,
+                    size_t limit, bool fuzzy)
+{
+    std::string q = util::trim_str (query);
+    for (char &c : q)
+        c = std::tolower (c);
+
+    std::vector<std::string> ret;
+
+    for (const name_entry_t &e : index.entries)
+        {
+            if (ret.size () >= limit)
+                break;
+
+            if (q.empty () || _name_match (e.lower, q, fuzzy))
+                ret.push_back (e.name);
+        }
+
+    return ret;
+}
+
+// every name in the first column of a name query result
+static std::optional<name_index_t>
+_name_index_from_result (std::pair<PGresult *, ExecStatusType> res)
+{
+    if (res.second != PGRES_TUPLES_OK)
+        {
+            finish_res (res.first);
+            return std::nullopt;
+        }
+
+    name_index_t index;
+    index.last_used = time (NULL);
+
+    const int rows = PQntuples (res.first);
+    index.entries.reserve (rows);
+
+    for (int i = 0; i < rows; i++)
+        {
+            if (!PQgetisnull (res.first, i, 0))
+                index.entries.push_back (
+                    _name_entry (PQgetvalue (res.first, i, 0)));
+        }
+
+    finish_res (res.first);
+
+    std::sort (index.entries.begin (), index.entries.end (),
+               [] (const name_entry_t &a, const name_entry_t &b) {
+                   return a.name < b.name;
+               });
+
+    return index;
+}
+
+static void
+_name_index_playlist_add (const dpp::snowflake &user_id,
+                          const std::string &name)
+{
+    std::lock_guard lk (name_index_m);
+
+    name_index_gen++;
+
+    auto i = playlist_names.find (user_id);
+    if (i != playlist_names.end ())
+        _name_index_add (i->second, name);
+}
+
+static void
+_name_index_playlist_remove (const dpp::snowflake &user_id,
+                             const std::string &name)
+{
+    std::lock_guard lk (name_index_m);
+
+    name_index_gen++;
+
+    auto i = playlist_names.find (user_id);
+    if (i != playlist_names.end ())
+        _name_index_remove (i->second, name);
+}
+
+static void
+_name_index_preset_add (const std::string &name)
+{
+    std::lock_guard lk (name_index_m);
+
+    name_index_gen++;
+
+    if (preset_names)
+        _name_index_add (*preset_names, name);
+}
+
+static void
+_name_index_clear ()
+{
+    std::lock_guard lk (name_index_m);
+
+    name_index_gen++;
+
+    playlist_names.clear ();
+    preset_names.reset ();
+}
+
+std::vector<std::string>
+search_user_playlist_names (const dpp::snowflake &user_id,
+                            const std::string &query, size_t limit,
+                            bool fuzzy)
+{
+    if (!user_id)
+        return {};
+
+    uint64_t gen;
+    {
+        std::lock_guard lk (name_index_m);
+
+        auto i = playlist_names.find (user_id);
+        if (i != playlist_names.end ())
+            {
+                i->second.last_used = time (NULL);
+                return _name_index_search (i->second, query, limit, fuzzy);
+            }
+
+        gen = name_index_gen;
+    }
+
+    std::optional<name_index_t> index = _name_index_from_result (
+        get_all_user_playlist (user_id, gup_name_only));
+
+    if (!index)
+        return {};
+
+    std::vector<std::string> ret
+        = _name_index_search (*index, query, limit, fuzzy);
+
+    std::lock_guard lk (name_index_m);
+
+    if (gen != name_index_gen)
+        return ret;
+
+    if (playlist_names.size () >= NAME_INDEX_MAX_USERS)
+        {
+            auto oldest = playlist_names.begin ();
+
+            for (auto i = playlist_names.begin (); i != playlist_names.end ();
+                 i++)
+                {
+                    if (i->second.last_used < oldest->second.last_used)
+                        oldest = i;
+                }
+
+            playlist_names.erase (oldest);
+        }
+
+    playlist_names.emplace (user_id, std::move (*index));
+
+    return ret;
+}
+
+std::vector<std::string>
+search_equalizer_preset_names (const std::string &query, size_t limit,
+                               bool fuzzy)
+{
+    uint64_t gen;
+    {
+        std::lock_guard lk (name_index_m);
+
+        if (preset_names)
+            return _name_index_search (*preset_names, query, limit, fuzzy);
+
+        gen = name_index_gen;
+    }
+
+    std::optional<name_index_t> index
+        = _name_index_from_result (get_all_equalizer_preset_name ());
+
+    if (!index)
+        return {};
+
+    std::vector<std::string> ret
+        = _name_index_search (*index, query, limit, fuzzy);
+
+    std::lock_guard lk (name_index_m);
+
+    if (gen == name_index_gen)
+        preset_names = std::move (index);
+
+    return ret;
+}
+
 // !TODO: expired user auth clear aggregate
 
 } // database
@@ -0,0 +1,1575 @@
+#include "musicat/db_local.h"
+#include "nlohmann/json.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+// first bytes of the log file, followed by LOG_VERSION
+#define LOG_MAGIC "MCLS"
+#define LOG_VERSION 1
+#define LOG_HEADER_SIZE (sizeof (LOG_MAGIC) - 1 + 1)
+// record length and checksum
+#define RECORD_HEADER_SIZE 8
+
+// log is compacted once it's this many times bigger than its live records
+#define COMPACT_RATIO 2
+// and at least this many bytes
+#define COMPACT_MIN_SIZE (4 * 1024 * 1024)
+
+// text type for every column, callers only read values as text
+#define TEXTOID 25
+
+namespace musicat::database::local
+{
+
+// order is part of the log format, only append
+enum table_e : uint8_t
+{
+    T_PLAYLISTS,
+    T_PLAYLISTS_TRACKS,
+    T_QUEUE_TRACKS,
+    T_PLAYER_CONFIG,
+    T_AUTHS,
+    T_EQUALIZER_PRESETS,
+    T_SPOTIFY_TRACK_MAPPINGS,
+    T_MAX,
+};
+
+enum op_e : uint8_t
+{
+    OP_PUT,
+    OP_DEL,
+};
+
+using table_t = std::map<std::string, std::string>;
+using row_t = std::vector<std::optional<std::string> >;
+using handler_fn = PGresult *(*)(const char *const *params);
+
+struct handler_t
+{
+    const char *name;
+    int nparams;
+    handler_fn fn;
+};
+
+static std::mutex m;
+static table_t tables[T_MAX];
+static FILE *log_file = NULL;
+static std::string log_path;
+// ops of the statement being run, applied once written to the log
+static std::string batch;
+static stats_t stats = { 0, 0, 0, 0 };
+
+// -----------------------------------------------------------------------
+// ENCODING
+// -----------------------------------------------------------------------
+
+static void
+_put_varint (std::string &out, uint64_t v)
+{
+    while (v >= 0x80)
+        {
+            out += (char)((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+
+    out += (char)v;
+}
+
+static bool
+_get_varint (std::string_view &in, uint64_t &v)
+{
+    v = 0;
+
+    for (int shift = 0; shift < 64 && !in.empty (); shift += 7)
+        {
+            const unsigned char c = in.front ();
+            in.remove_prefix (1);
+
+            v |= (uint64_t)(c & 0x7f) << shift;
+
+            if (!(c & 0x80))
+                return true;
+        }
+
+    return false;
+}
+
+static void
+_put_u32 (std::string &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        out += (char)((v >> (i * 8)) & 0xff);
+}
+
+static uint32_t
+_get_u32 (const char *p)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= (uint32_t)(unsigned char)p[i] << (i * 8);
+
+    return v;
+}
+
+// FNV-1a, only catches torn and garbled writes
+static uint32_t
+_checksum (std::string_view data)
+{
+    uint32_t h = 2166136261u;
+
+    for (const char c : data)
+        {
+            h ^= (unsigned char)c;
+            h *= 16777619u;
+        }
+
+    return h;
+}
+
+// big endian so map order is numeric order
+static std::string
+_be64 (uint64_t v)
+{
+    std::string ret (8, '\0');
+    for (int i = 0; i < 8; i++)
+        ret[i] = (char)((v >> ((7 - i) * 8)) & 0xff);
+
+    return ret;
+}
+
+static uint64_t
+_from_be64 (std::string_view s)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < 8 && i < s.size (); i++)
+        v = (v << 8) | (unsigned char)s[i];
+
+    return v;
+}
+
+// signed seq flipped so negative sorts first
+static std::string
+_seq_key (int64_t seq)
+{
+    return _be64 ((uint64_t)seq ^ (1ULL << 63));
+}
+
+static int64_t
+_from_seq_key (std::string_view s)
+{
+    return (int64_t)(_from_be64 (s) ^ (1ULL << 63));
+}
+
+static std::string
+_key (const char *a, const char *b = NULL)
+{
+    std::string ret = a;
+
+    if (b)
+        {
+            ret += '\0';
+            ret += b;
+        }
+
+    return ret;
+}
+
+static std::string
+_to_hex (std::string_view data)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    std::string ret;
+    ret.reserve (2 + data.size () * 2);
+    ret += "\\x";
+
+    for (const char c : data)
+        {
+            ret += digits[(unsigned char)c >> 4];
+            ret += digits[(unsigned char)c & 0xf];
+        }
+
+    return ret;
+}
+
+static int
+_hex_digit (char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+// bytea text input, only hex format is ever sent
+static bool
+_from_hex (std::string_view text, std::string &out)
+{
+    if (text.size () < 2 || text[0] != '\\' || text[1] != 'x'
+        || text.size () % 2)
+        return false;
+
+    out.clear ();
+    out.reserve ((text.size () - 2) / 2);
+
+    for (size_t i = 2; i < text.size (); i += 2)
+        {
+            const int hi = _hex_digit (text[i]);
+            const int lo = _hex_digit (text[i + 1]);
+
+            if (hi < 0 || lo < 0)
+                return false;
+
+            out += (char)((hi << 4) | lo);
+        }
+
+    return true;
+}
+
+/**
+ * @brief Parse text array literal, eg. {"a","b"} or {1,2}. Unquoted NULL is
+ * an SQL NULL element
+ */
+static bool
+_parse_array (const char *text, std::vector<std::optional<std::string> > &out)
+{
+    out.clear ();
+
+    if (!text || *text != '{')
+        return false;
+
+    const char *p = text + 1;
+
+    if (*p == '}')
+        return p[1] == '\0';
+
+    while (true)
+        {
+            std::string v;
+            bool quoted = false;
+
+            if (*p == '"')
+                {
+                    quoted = true;
+                    p++;
+
+                    while (*p && *p != '"')
+                        {
+                            if (*p == '\\' && p[1])
+                                p++;
+
+                            v += *p++;
+                        }
+
+                    if (*p != '"')
+                        return false;
+
+                    p++;
+                }
+            else
+                {
+                    while (*p && *p != ',' && *p != '}')
+                        v += *p++;
+                }
+
+            if (!quoted && v == "NULL")
+                out.emplace_back (std::nullopt);
+            else
+                out.emplace_back (std::move (v));
+
+            if (*p == ',')
+                {
+                    p++;
+                    continue;
+                }
+
+            return *p == '}' && p[1] == '\0';
+        }
+}
+
+static bool
+_parse_bool (const char *text)
+{
+    return strcasecmp (text, "t") == 0 || strcasecmp (text, "true") == 0
+           || strcmp (text, "1") == 0;
+}
+
+// same text Postgres gives for TIMESTAMPTZ in UTC
+static std::string
+_now ()
+{
+    struct timeval tv;
+    gettimeofday (&tv, NULL);
+
+    struct tm tm;
+    gmtime_r (&tv.tv_sec, &tm);
+
+    char buf[64];
+    const size_t len = strftime (buf, sizeof (buf), "%Y-%m-%d %H:%M:%S", &tm);
+    snprintf (buf + len, sizeof (buf) - len, ".%06ld+00", (long)tv.tv_usec);
+
+    return buf;
+}
+
+// -----------------------------------------------------------------------
+// RESULTS
+// -----------------------------------------------------------------------
+
+static PGresult *
+_make_status (ExecStatusType status)
+{
+    return PQmakeEmptyPGresult (NULL, status);
+}
+
+static PGresult *
+_make_result (const std::vector<const char *> &columns,
+              const std::vector<row_t> &rows)
+{
+    PGresult *res = PQmakeEmptyPGresult (NULL, PGRES_TUPLES_OK);
+    if (!res)
+        return NULL;
+
+    std::vector<PGresAttDesc> attrs (columns.size ());
+
+    for (size_t i = 0; i < columns.size (); i++)
+        attrs[i] = { (char *)columns[i], 0, 0, 0, TEXTOID, -1, -1 };
+
+    if (!PQsetResultAttrs (res, attrs.size (), attrs.data ()))
+        {
+            PQclear (res);
+            return _make_status (PGRES_FATAL_ERROR);
+        }
+
+    for (size_t r = 0; r < rows.size (); r++)
+        for (size_t c = 0; c < rows[r].size (); c++)
+            {
+                const std::optional<std::string> &v = rows[r][c];
+
+                if (!PQsetvalue (res, r, c, v ? (char *)v->data () : NULL,
+                                 v ? (int)v->size () : -1))
+                    {
+                        PQclear (res);
+                        return _make_status (PGRES_FATAL_ERROR);
+                    }
+            }
+
+    return res;
+}
+
+static PGresult *
+_error (const char *fn, const char *msg)
+{
+    fprintf (stderr, "[database::local::%s ERROR] %s\n", fn, msg);
+
+    return _make_status (PGRES_FATAL_ERROR);
+}
+
+// -----------------------------------------------------------------------
+// TABLES
+// -----------------------------------------------------------------------
+
+// bytes a record takes in a compacted log, varints are estimated
+static uint64_t
+_record_size (const std::string &key, const std::string &value)
+{
+    return RECORD_HEADER_SIZE + 2 + 10 + key.size () + value.size ();
+}
+
+static const std::string *
+_get (table_e t, const std::string &key)
+{
+    auto i = tables[t].find (key);
+
+    return i == tables[t].end () ? NULL : &i->second;
+}
+
+static void
+_put (table_e t, const std::string &key, const std::string &value)
+{
+    batch += (char)OP_PUT;
+    batch += (char)t;
+    _put_varint (batch, key.size ());
+    batch += key;
+    _put_varint (batch, value.size ());
+    batch += value;
+}
+
+static void
+_del (table_e t, const std::string &key)
+{
+    batch += (char)OP_DEL;
+    batch += (char)t;
+    _put_varint (batch, key.size ());
+    batch += key;
+}
+
+// every key starting with prefix, in order
+template <typename F>
+static void
+_scan (table_e t, const std::string &prefix, F &&fn)
+{
+    for (auto i = tables[t].lower_bound (prefix);
+         i != tables[t].end ()
+         && i->first.compare (0, prefix.size (), prefix) == 0;
+         i++)
+        fn (i->first, i->second);
+}
+
+
+/**
+ * @brief Apply every op in a log record payload to tables
+ *
+ * @return bool false if payload is malformed, ops before the malformed one
+ * are already applied
+ */
+static bool
+_apply (std::string_view in)
+{
+    while (!in.empty ())
+        {
+            if (in.size () < 2)
+                return false;
+
+            const uint8_t op = in[0];
+            const uint8_t t = in[1];
+            in.remove_prefix (2);
+
+            if (t >= T_MAX || op > OP_DEL)
+                return false;
+
+            uint64_t klen;
+            if (!_get_varint (in, klen) || klen > in.size ())
+                return false;
+
+            std::string key (in.substr (0, klen));
+            in.remove_prefix (klen);
+
+            std::string value;
+
+            if (op == OP_PUT)
+                {
+                    uint64_t vlen;
+                    if (!_get_varint (in, vlen) || vlen > in.size ())
+                        return false;
+
+                    value.assign (in.data (), vlen);
+                    in.remove_prefix (vlen);
+                }
+
+            auto i = tables[t].find (key);
+
+            if (i != tables[t].end ())
+                {
+                    stats.live_size -= _record_size (i->first, i->second);
+                    stats.records--;
+
+                    if (op == OP_DEL)
+                        tables[t].erase (i);
+                }
+
+            if (op == OP_DEL)
+                continue;
+
+            stats.live_size += _record_size (key, value);
+            stats.records++;
+
+            if (i != tables[t].end ())
+                i->second = std::move (value);
+            else
+                tables[t].emplace (std::move (key), std::move (value));
+        }
+
+    return true;
+}
+
+static bool
+_write_record (FILE *f, std::string_view payload)
+{
+    std::string header;
+    _put_u32 (header, payload.size ());
+    _put_u32 (header, _checksum (payload));
+
+    return fwrite (header.data (), 1, header.size (), f) == header.size ()
+           && fwrite (payload.data (), 1, payload.size (), f)
+                  == payload.size ();
+}
+
+static void
+_compact ()
+{
+    const std::string tmp_path = log_path + ".tmp";
+
+    FILE *f = fopen (tmp_path.c_str (), "wb");
+    bool failed = f == NULL;
+
+    if (!failed)
+        {
+            failed = fwrite (LOG_MAGIC, 1, sizeof (LOG_MAGIC) - 1, f)
+                         != sizeof (LOG_MAGIC) - 1
+                     || fputc (LOG_VERSION, f) == EOF;
+
+            std::string payload;
+
+            for (int t = 0; t < T_MAX && !failed; t++)
+                for (const auto &[key, value] : tables[t])
+                    {
+                        payload.clear ();
+                        payload += (char)OP_PUT;
+                        payload += (char)t;
+                        _put_varint (payload, key.size ());
+                        payload += key;
+                        _put_varint (payload, value.size ());
+                        payload += value;
+
+                        if (!_write_record (f, payload))
+                            {
+                                failed = true;
+                                break;
+                            }
+                    }
+
+            failed = fflush (f) != 0 || failed;
+            failed = fsync (fileno (f)) != 0 || failed;
+            failed = (fclose (f) != 0) || failed;
+        }
+
+    if (!failed)
+        failed = rename (tmp_path.c_str (), log_path.c_str ()) != 0;
+
+    if (failed)
+        {
+            perror ("[database::local::compact ERROR]");
+            fprintf (stderr, "^^^ Failed writing '%s'\n", tmp_path.c_str ());
+
+            unlink (tmp_path.c_str ());
+
+            return;
+        }
+
+    // old file is unlinked, keep appending to the new one
+    FILE *nf = fopen (log_path.c_str (), "ab");
+    if (!nf)
+        {
+            perror ("[database::local::compact ERROR]");
+            return;
+        }
+
+    fclose (log_file);
+    log_file = nf;
+
+    stats.log_size = ftell (log_file);
+    stats.compactions++;
+}
+
+/**
+ * @brief Append batch to the log and apply it. Nothing is applied when the
+ * write fails, partial record is cut off so later records stay readable
+ */
+static bool
+_commit ()
+{
+    if (batch.empty ())
+        return true;
+
+    bool ok = _write_record (log_file, batch);
+    ok = fflush (log_file) == 0 && ok;
+
+    if (!ok)
+        {
+            perror ("[database::local::exec ERROR]");
+
+            if (ftruncate (fileno (log_file), stats.log_size) != 0)
+                perror ("[database::local::exec ERROR]");
+
+            clearerr (log_file);
+            batch.clear ();
+
+            return false;
+        }
+
+    stats.log_size += RECORD_HEADER_SIZE + batch.size ();
+
+    _apply (batch);
+    batch.clear ();
+
+    if (stats.log_size > COMPACT_MIN_SIZE
+        && stats.log_size > stats.live_size * COMPACT_RATIO)
+        _compact ();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------
+// PARAMS
+// -----------------------------------------------------------------------
+
+static bool
+_parse_int (const char *text, int64_t &out)
+{
+    if (!text || !*text)
+        return false;
+
+    char *end = NULL;
+    errno = 0;
+    out = strtoll (text, &end, 10);
+
+    return errno == 0 && *end == '\0';
+}
+
+// bytea[] param, every element must be set
+static bool
+_parse_bytea_array (const char *text, std::vector<std::string> &out)
+{
+    std::vector<std::optional<std::string> > elems;
+    if (!_parse_array (text, elems))
+        return false;
+
+    out.resize (elems.size ());
+
+    for (size_t i = 0; i < elems.size (); i++)
+        if (!elems[i] || !_from_hex (*elems[i], out[i]))
+            return false;
+
+    return true;
+}
+
+static bool
+_parse_int_array (const char *text, std::vector<int64_t> &out)
+{
+    std::vector<std::optional<std::string> > elems;
+    if (!_parse_array (text, elems))
+        return false;
+
+    out.resize (elems.size ());
+
+    for (size_t i = 0; i < elems.size (); i++)
+        if (!elems[i] || !_parse_int (elems[i]->c_str (), out[i]))
+            return false;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------
+// PLAYLISTS
+// -----------------------------------------------------------------------
+
+static std::string
+_track_prefix (const std::string &playlist_key)
+{
+    return playlist_key + '\0';
+}
+
+static std::string
+_track_key (const std::string &playlist_key, uint32_t pos)
+{
+    std::string ret = _track_prefix (playlist_key);
+
+    // lowest 4 bytes, position is an INT column
+    ret += _be64 (pos).substr (4);
+
+    return ret;
+}
+
+// concatenated track blobs of tracks [offset, offset + limit), NULL if none
+static std::optional<std::string>
+_playlist_data (const std::string &playlist_key, int64_t offset = 0,
+                int64_t limit = -1)
+{
+    std::string data;
+    int64_t pos = 0, count = 0;
+
+    _scan (T_PLAYLISTS_TRACKS, _track_prefix (playlist_key),
+           [&] (const std::string &, const std::string &value) {
+               if (pos++ < offset || (limit >= 0 && count >= limit))
+                   return;
+
+               data += value;
+               count++;
+           });
+
+    if (!count)
+        return std::nullopt;
+
+    return _to_hex (data);
+}
+
+enum playlist_column_e
+{
+    PC_ALL,
+    PC_NAME,
+    PC_RAW,
+    PC_TS,
+};
+
+static row_t
+_playlist_row (playlist_column_e type, const std::string &key,
+               const std::string &value)
+{
+    const size_t sep = key.find ('\0');
+    const std::string uid = key.substr (0, sep);
+    const std::string name = key.substr (sep + 1);
+
+    const nlohmann::json meta = nlohmann::json::parse (value, nullptr, false);
+
+    auto get = [&meta] (const char *k) -> std::optional<std::string> {
+        if (!meta.is_object ())
+            return std::nullopt;
+
+        auto i = meta.find (k);
+        if (i == meta.end () || i->is_null ())
+            return std::nullopt;
+
+        return i->is_string () ? i->get<std::string> () : i->dump ();
+    };
+
+    switch (type)
+        {
+        case PC_NAME:
+            return { name };
+        case PC_RAW:
+            return { std::nullopt, _playlist_data (key) };
+        case PC_TS:
+            return { get ("ts") };
+        default:
+            return { std::nullopt,        uid,
+                     name,                get ("ts"),
+                     get ("uts"),         std::nullopt,
+                     get ("track_count"), get ("duration") };
+        }
+}
+
+static PGresult *
+_playlist_result (playlist_column_e type, const std::vector<row_t> &rows)
+{
+    static const std::vector<const char *> columns[] = {
+        { "raw", "uid", "name", "ts", "uts", "data", "track_count",
+          "duration" },
+        { "name" },
+        { "raw", "coalesce" },
+        { "ts" },
+    };
+
+    return _make_result (columns[type], rows);
+}
+
+static PGresult *
+_get_all_user_playlist (playlist_column_e type, const char *const *params)
+{
+    std::vector<row_t> rows;
+
+    _scan (T_PLAYLISTS, _key (params[0], ""),
+           [&] (const std::string &key, const std::string &value) {
+               rows.push_back (_playlist_row (type, key, value));
+           });
+
+    return _playlist_result (type, rows);
+}
+
+static PGresult *
+_get_user_playlist (playlist_column_e type, const char *const *params)
+{
+    std::vector<row_t> rows;
+
+    const std::string key = _key (params[0], params[1]);
+
+    if (const std::string *value = _get (T_PLAYLISTS, key))
+        rows.push_back (_playlist_row (type, key, *value));
+
+    return _playlist_result (type, rows);
+}
+
+static PGresult *
+get_all_user_playlist_all (const char *const *params)
+{
+    return _get_all_user_playlist (PC_ALL, params);
+}
+
+static PGresult *
+get_all_user_playlist_name (const char *const *params)
+{
+    return _get_all_user_playlist (PC_NAME, params);
+}
+
+static PGresult *
+get_all_user_playlist_raw (const char *const *params)
+{
+    return _get_all_user_playlist (PC_RAW, params);
+}
+
+static PGresult *
+get_all_user_playlist_ts (const char *const *params)
+{
+    return _get_all_user_playlist (PC_TS, params);
+}
+
+static PGresult *
+get_user_playlist_all (const char *const *params)
+{
+    return _get_user_playlist (PC_ALL, params);
+}
+
+static PGresult *
+get_user_playlist_name (const char *const *params)
+{
+    return _get_user_playlist (PC_NAME, params);
+}
+
+static PGresult *
+get_user_playlist_raw (const char *const *params)
+{
+    return _get_user_playlist (PC_RAW, params);
+}
+
+static PGresult *
+get_user_playlist_ts (const char *const *params)
+{
+    return _get_user_playlist (PC_TS, params);
+}
+
+static PGresult *
+get_user_playlist_page (const char *const *params)
+{
+    int64_t offset, limit;
+    if (!_parse_int (params[2], offset) || !_parse_int (params[3], limit)
+        || limit < 0)
+        return _error ("get_user_playlist_page", "Invalid offset or limit");
+
+    return _make_result (
+        { "json", "string_agg" },
+        { { std::nullopt,
+            _playlist_data (_key (params[0], params[1]), offset, limit) } });
+}
+
+static PGresult *
+get_user_playlist_info (const char *const *params)
+{
+    std::vector<row_t> rows;
+
+    const std::string key = _key (params[0], params[1]);
+
+    if (const std::string *value = _get (T_PLAYLISTS, key))
+        {
+            const row_t row = _playlist_row (PC_ALL, key, *value);
+            rows.push_back ({ row[6], row[7] });
+        }
+
+    return _make_result ({ "track_count", "duration" }, rows);
+}
+
+// meta row of a playlist, keeps creation time of existing one
+static std::string
+_playlist_meta (const std::string *existing, size_t track_count,
+                const char *duration)
+{
+    nlohmann::json meta = existing
+                              ? nlohmann::json::parse (*existing, nullptr,
+                                                       false)
+                              : nlohmann::json ();
+
+    const std::string now = _now ();
+
+    if (!meta.is_object () || !meta["ts"].is_string ())
+        meta = { { "ts", now } };
+
+    int64_t d;
+    meta["uts"] = now;
+    meta["track_count"] = track_count;
+    meta["duration"] = duration && _parse_int (duration, d)
+                           ? nlohmann::json (d)
+                           : nlohmann::json ();
+
+    return meta.dump ();
+}
+
+static PGresult *
+update_user_playlist (const char *const *params)
+{
+    std::vector<std::string> tracks;
+    if (!_parse_bytea_array (params[2], tracks))
+        return _error ("update_user_playlist", "Invalid track array");
+
+    const std::string key = _key (params[0], params[1]);
+
+    for (size_t i = 0; i < tracks.size (); i++)
+        _put (T_PLAYLISTS_TRACKS, _track_key (key, i), tracks[i]);
+
+    // rows past the new end
+    std::vector<std::string> stale;
+    _scan (T_PLAYLISTS_TRACKS, _track_prefix (key),
+           [&] (const std::string &k, const std::string &) {
+               if (_from_be64 (std::string_view (k).substr (k.size () - 4))
+                   >= tracks.size ())
+                   stale.push_back (k);
+           });
+
+    for (const std::string &k : stale)
+        _del (T_PLAYLISTS_TRACKS, k);
+
+    // created when missing
+    _put (T_PLAYLISTS, key,
+          _playlist_meta (_get (T_PLAYLISTS, key), tracks.size (),
+                          params[3]));
+
+    return _make_result ({ "name" }, { { std::string (params[1]) } });
+}
+
+static PGresult *
+delete_user_playlist (const char *const *params)
+{
+    const std::string key = _key (params[0], params[1]);
+
+    _scan (T_PLAYLISTS_TRACKS, _track_prefix (key),
+           [] (const std::string &k, const std::string &) {
+               _del (T_PLAYLISTS_TRACKS, k);
+           });
+
+    std::vector<row_t> rows;
+
+    if (_get (T_PLAYLISTS, key))
+        {
+            _del (T_PLAYLISTS, key);
+            rows.push_back ({ std::string (params[1]) });
+        }
+
+    return _make_result ({ "name" }, rows);
+}
+
+// -----------------------------------------------------------------------
+// QUEUES
+// -----------------------------------------------------------------------
+
+// never written before queue rows existed, there's nothing to migrate
+static PGresult *
+get_guild_current_queue (const char *const *)
+{
+    return _make_result ({ "raw" }, {});
+}
+
+static PGresult *
+delete_guild_current_queue (const char *const *)
+{
+    return _make_result ({ "gid" }, {});
+}
+
+// aggregated queue rows of guild, every column is NULL when it has none
+static row_t
+_queue_row (const std::string &guild_id)
+{
+    std::string data;
+    nlohmann::json seqs = nlohmann::json::array ();
+
+    _scan (T_QUEUE_TRACKS, _key (guild_id.c_str (), ""),
+           [&] (const std::string &key, const std::string &value) {
+               seqs.push_back (_from_seq_key (
+                   std::string_view (key).substr (key.size () - 8)));
+               data += value;
+           });
+
+    row_t row = { std::nullopt, std::nullopt, std::nullopt };
+
+    if (!seqs.empty ())
+        {
+            row[1] = _to_hex (data);
+            row[2] = seqs.dump ();
+        }
+
+    return row;
+}
+
+static PGresult *
+get_guild_queue_tracks (const char *const *params)
+{
+    return _make_result ({ "json_agg", "string_agg", "json_agg" },
+                         { _queue_row (params[0]) });
+}
+
+static PGresult *
+get_guilds_queue_tracks (const char *const *params)
+{
+    std::vector<std::optional<std::string> > gids;
+    if (!_parse_array (params[0], gids))
+        return _error ("get_guilds_queue_tracks", "Invalid gid array");
+
+    std::vector<row_t> rows;
+
+    for (const std::optional<std::string> &gid : gids)
+        {
+            if (!gid)
+                continue;
+
+            row_t row = _queue_row (*gid);
+
+            if (!row[2])
+                continue;
+
+            row.push_back (*gid);
+            rows.push_back (std::move (row));
+        }
+
+    return _make_result ({ "json_agg", "string_agg", "json_agg", "gid" },
+                         rows);
+}
+
+static PGresult *
+get_saved_queue_guilds (const char *const *)
+{
+    std::vector<row_t> rows;
+    std::string last;
+
+    // keys are sorted, rows of a guild are next to each other
+    for (const auto &[key, value] : tables[T_QUEUE_TRACKS])
+        {
+            std::string gid = key.substr (0, key.find ('\0'));
+
+            if (gid == last)
+                continue;
+
+            last = gid;
+            rows.push_back ({ std::move (gid) });
+        }
+
+    return _make_result ({ "gid" }, rows);
+}
+
+static PGresult *
+clear_guild_queue_tracks (const char *const *params)
+{
+    _scan (T_QUEUE_TRACKS, _key (params[0], ""),
+           [] (const std::string &key, const std::string &) {
+               _del (T_QUEUE_TRACKS, key);
+           });
+
+    return _make_status (PGRES_COMMAND_OK);
+}
+
+static PGresult *
+delete_guild_queue_tracks (const char *const *params)
+{
+    std::vector<int64_t> seqs;
+    if (!_parse_int_array (params[1], seqs))
+        return _error ("delete_guild_queue_tracks", "Invalid seq array");
+
+    for (const int64_t seq : seqs)
+        {
+            const std::string key = _key (params[0], "") + _seq_key (seq);
+
+            if (_get (T_QUEUE_TRACKS, key))
+                _del (T_QUEUE_TRACKS, key);
+        }
+
+    return _make_status (PGRES_COMMAND_OK);
+}
+
+static PGresult *
+insert_guild_queue_tracks (const char *const *params)
+{
+    std::vector<int64_t> seqs;
+    std::vector<std::string> tracks;
+
+    if (!_parse_int_array (params[1], seqs)
+        || !_parse_bytea_array (params[2], tracks)
+        || seqs.size () != tracks.size ())
+        return _error ("insert_guild_queue_tracks",
+                       "Invalid seq or track array");
+
+    for (size_t i = 0; i < seqs.size (); i++)
+        _put (T_QUEUE_TRACKS, _key (params[0], "") + _seq_key (seqs[i]),
+              tracks[i]);
+
+    return _make_status (PGRES_COMMAND_OK);
+}
+
+// -----------------------------------------------------------------------
+// PLAYER CONFIG
+// -----------------------------------------------------------------------
+
+static PGresult *
+update_guild_player_config (const char *const *params)
+{
+    const std::string *existing = _get (T_PLAYER_CONFIG, params[0]);
+
+    nlohmann::json config
+        = existing ? nlohmann::json::parse (*existing, nullptr, false)
+                   : nlohmann::json ();
+
+    if (!config.is_object ())
+        config = { { "autoplay_state", false },
+                   { "autoplay_threshold", 0 },
+                   { "loop_mode", 0 },
+                   { "fx_states", nullptr } };
+
+    if (params[1])
+        config["autoplay_state"] = _parse_bool (params[1]);
+
+    int64_t v;
+
+    if (params[2])
+        {
+            if (!_parse_int (params[2], v) || v < 0 || v > 10000)
+                return _error ("update_guild_player_config",
+                               "Invalid autoplay_threshold");
+
+            config["autoplay_threshold"] = v;
+        }
+
+    if (params[3])
+        {
+            if (!_parse_int (params[3], v) || v < 0 || v > 10)
+                return _error ("update_guild_player_config",
+                               "Invalid loop_mode");
+
+            config["loop_mode"] = v;
+        }
+
+    if (params[4])
+        {
+            nlohmann::json fx = nlohmann::json::parse (params[4], nullptr,
+                                                       false);
+            if (fx.is_discarded ())
+                return _error ("update_guild_player_config",
+                               "Invalid fx_states");
+
+            config["fx_states"] = fx;
+        }
+
+    config["uts"] = _now ();
+
+    _put (T_PLAYER_CONFIG, params[0], config.dump ());
+
+    return _make_status (PGRES_COMMAND_OK);
+}
+
+static std::optional<row_t>
+_player_config_row (const std::string &value)
+{
+    const nlohmann::json config
+        = nlohmann::json::parse (value, nullptr, false);
+
+    if (!config.is_object ())
+        return std::nullopt;
+
+    auto fx = config.find ("fx_states");
+
+    return row_t{ std::string (config.value ("autoplay_state", false) ? "t"
+                                                                      : "f"),
+                  std::to_string (config.value ("autoplay_threshold", 0)),
+                  std::to_string (config.value ("loop_mode", 0)),
+                  fx == config.end () || fx->is_null ()
+                      ? std::nullopt
+                      : std::optional<std::string> (fx->dump ()) };
+}
+
+static PGresult *
+get_guild_player_config (const char *const *params)
+{
+    std::vector<row_t> rows;
+
+    if (const std::string *value = _get (T_PLAYER_CONFIG, params[0]))
+        if (std::optional<row_t> row = _player_config_row (*value))
+            rows.push_back (std::move (*row));
+
+    return _make_result (
+        { "autoplay_state", "autoplay_threshold", "loop_mode", "fx_states" },
+        rows);
+}
+
+static PGresult *
+get_all_guild_player_config (const char *const *)
+{
+    std::vector<row_t> rows;
+
+    for (const auto &[gid, value] : tables[T_PLAYER_CONFIG])
+        if (std::optional<row_t> row = _player_config_row (value))
+            {
+                row->push_back (gid);
+                rows.push_back (std::move (*row));
+            }
+
+    return _make_result ({ "autoplay_state", "autoplay_threshold",
+                           "loop_mode", "fx_states", "gid" },
+                         rows);
+}
+
+// -----------------------------------------------------------------------
+// AUTHS
+// -----------------------------------------------------------------------
+
+static PGresult *
+get_user_auth (const char *const *params)
+{
+    std::vector<row_t> rows;
+
+    if (const std::string *value = _get (T_AUTHS, params[0]))
+        rows.push_back ({ *value });
+
+    return _make_result ({ "raw" }, rows);
+}
+
+static PGresult *
+update_user_auth (const char *const *params)
+{
+    if (!params[1])
+        return _error ("update_user_auth", "raw can't be NULL");
+
+    _put (T_AUTHS, params[0], params[1]);
+
+    return _make_status (PGRES_COMMAND_OK);
+}
+
+// -----------------------------------------------------------------------
+// EQUALIZER PRESETS
+// -----------------------------------------------------------------------
+
+static PGresult *
+get_all_equalizer_preset_name (const char *const *)
+{
+    std::vector<row_t> rows;
+
+    for (const auto &[name, value] : tables[T_EQUALIZER_PRESETS])
+        rows.push_back ({ name });
+
+    return _make_result ({ "name" }, rows);
+}
+
+static PGresult *
+get_equalizer_preset (const char *const *params)
+{
+    std::vector<row_t> rows;
+
+    if (const std::string *value = _get (T_EQUALIZER_PRESETS, params[0]))
+        {
+            const nlohmann::json preset
+                = nlohmann::json::parse (*value, nullptr, false);
+
+            if (preset.is_object ())
+                rows.push_back ({ preset.value ("value", ""),
+                                  std::string (params[0]) });
+        }
+
+    return _make_result ({ "value", "name" }, rows);
+}
+
+static PGresult *
+create_equalizer_preset (const char *const *params)
+{
+    if (!params[0] || !params[1] || !params[2])
+        return _error ("create_equalizer_preset", "Missing value");
+
+    if (_get (T_EQUALIZER_PRESETS, params[2]))
+        return _error ("create_equalizer_preset",
+                       "Preset with the same name already exists");
+
+    const nlohmann::json preset = { { "uid", params[0] },
+                                    { "value", params[1] },
+                                    { "ts", _now () } };
+
+    _put (T_EQUALIZER_PRESETS, params[2], preset.dump ());
+
+    return _make_status (PGRES_COMMAND_OK);
+}
+
+// -----------------------------------------------------------------------
+// SPOTIFY TRACK MAPPINGS
+// -----------------------------------------------------------------------
+
+static PGresult *
+get_spotify_track_mappings (const char *const *params)
+{
+    std::vector<std::optional<std::string> > sids;
+    if (!_parse_array (params[0], sids))
+        return _error ("get_spotify_track_mappings", "Invalid sid array");
+
+    std::vector<row_t> rows;
+
+    for (const std::optional<std::string> &sid : sids)
+        {
+            if (!sid)
+                continue;
+
+            const std::string *value = _get (T_SPOTIFY_TRACK_MAPPINGS, *sid);
+            if (!value)
+                continue;
+
+            const nlohmann::json mapping
+                = nlohmann::json::parse (*value, nullptr, false);
+
+            if (mapping.is_object ())
+                rows.push_back ({ *sid, mapping.value ("yid", ""),
+                                  mapping.value ("raw", "") });
+        }
+
+    return _make_result ({ "sid", "yid", "raw" }, rows);
+}
+
+static PGresult *
+update_spotify_track_mappings (const char *const *params)
+{
+    std::vector<std::optional<std::string> > sids, yids, raws;
+
+    if (!_parse_array (params[0], sids) || !_parse_array (params[1], yids)
+        || !_parse_array (params[2], raws) || sids.size () != yids.size ()
+        || sids.size () != raws.size ())
+        return _error ("update_spotify_track_mappings", "Invalid arrays");
+
+    for (size_t i = 0; i < sids.size (); i++)
+        {
+            if (!sids[i] || !yids[i] || !raws[i])
+                return _error ("update_spotify_track_mappings",
+                               "Elements can't be NULL");
+
+            const nlohmann::json mapping = { { "yid", *yids[i] },
+                                             { "raw", *raws[i] },
+                                             { "uts", _now () } };
+
+            _put (T_SPOTIFY_TRACK_MAPPINGS, *sids[i], mapping.dump ());
+        }
+
+    return _make_status (PGRES_COMMAND_OK);
+}
+
+// names match the database statement registry
+static const handler_t handlers[] = {
+    { "get_all_user_playlist_all", 1, get_all_user_playlist_all },
+    { "get_all_user_playlist_name", 1, get_all_user_playlist_name },
+    { "get_all_user_playlist_raw", 1, get_all_user_playlist_raw },
+    { "get_all_user_playlist_ts", 1, get_all_user_playlist_ts },
+    { "get_user_playlist_all", 2, get_user_playlist_all },
+    { "get_user_playlist_name", 2, get_user_playlist_name },
+    { "get_user_playlist_raw", 2, get_user_playlist_raw },
+    { "get_user_playlist_ts", 2, get_user_playlist_ts },
+    { "get_user_playlist_page", 4, get_user_playlist_page },
+    { "get_user_playlist_info", 2, get_user_playlist_info },
+    { "update_user_playlist", 4, update_user_playlist },
+    { "delete_user_playlist", 2, delete_user_playlist },
+    { "get_guild_current_queue", 1, get_guild_current_queue },
+    { "delete_guild_current_queue", 1, delete_guild_current_queue },
+    { "get_guild_queue_tracks", 1, get_guild_queue_tracks },
+    { "get_guilds_queue_tracks", 1, get_guilds_queue_tracks },
+    { "get_saved_queue_guilds", 0, get_saved_queue_guilds },
+    { "clear_guild_queue_tracks", 1, clear_guild_queue_tracks },
+    { "delete_guild_queue_tracks", 2, delete_guild_queue_tracks },
+    { "insert_guild_queue_tracks", 3, insert_guild_queue_tracks },
+    { "update_guild_player_config", 5, update_guild_player_config },
+    { "get_guild_player_config", 1, get_guild_player_config },
+    { "get_all_guild_player_config", 0, get_all_guild_player_config },
+    { "get_user_auth", 1, get_user_auth },
+    { "update_user_auth", 2, update_user_auth },
+    { "get_all_equalizer_preset_name", 0, get_all_equalizer_preset_name },
+    { "get_equalizer_preset", 1, get_equalizer_preset },
+    { "create_equalizer_preset", 3, create_equalizer_preset },
+    { "get_spotify_track_mappings", 1, get_spotify_track_mappings },
+    { "update_spotify_track_mappings", 3, update_spotify_track_mappings },
+};
+
+// -----------------------------------------------------------------------
+// INSTANCE
+// -----------------------------------------------------------------------
+
+/**
+ * @brief Replay every record of data into tables
+ *
+ * @return size_t bytes of data holding valid records, anything past it is
+ * torn or garbled
+ */
+static size_t
+_replay (std::string_view data)
+{
+    size_t offset = LOG_HEADER_SIZE;
+
+    while (data.size () - offset >= RECORD_HEADER_SIZE)
+        {
+            const uint32_t len = _get_u32 (data.data () + offset);
+            const uint32_t sum = _get_u32 (data.data () + offset + 4);
+
+            if (len > data.size () - offset - RECORD_HEADER_SIZE)
+                break;
+
+            const std::string_view payload
+                = data.substr (offset + RECORD_HEADER_SIZE, len);
+
+            if (_checksum (payload) != sum || !_apply (payload))
+                break;
+
+            offset += RECORD_HEADER_SIZE + len;
+        }
+
+    return offset;
+}
+
+int
+init (const std::string &path)
+{
+    std::lock_guard lk (m);
+
+    if (log_file)
+        return 0;
+
+    std::string data;
+
+    FILE *f = fopen (path.c_str (), "rb");
+    if (f)
+        {
+            char buf[65536];
+            size_t n;
+
+            while ((n = fread (buf, 1, sizeof (buf), f)) > 0)
+                data.append (buf, n);
+
+            fclose (f);
+        }
+
+    if (data.empty ())
+        {
+            data = LOG_MAGIC;
+            data += (char)LOG_VERSION;
+
+            f = fopen (path.c_str (), "wb");
+            if (!f || fwrite (data.data (), 1, data.size (), f) != data.size ()
+                || fclose (f) != 0)
+                {
+                    perror ("[database::local::init ERROR]");
+                    fprintf (stderr, "^^^ Failed creating '%s'\n",
+                             path.c_str ());
+
+                    return -1;
+                }
+        }
+
+    if (data.size () < LOG_HEADER_SIZE
+        || data.compare (0, sizeof (LOG_MAGIC) - 1, LOG_MAGIC) != 0
+        || data[sizeof (LOG_MAGIC) - 1] != LOG_VERSION)
+        {
+            fprintf (stderr,
+                     "[database::local::init ERROR] '%s' isn't a supported "
+                     "log file\n",
+                     path.c_str ());
+
+            return -1;
+        }
+
+    const size_t valid = _replay (data);
+
+    if (valid < data.size ())
+        {
+            fprintf (stderr,
+                     "[database::local::init WARN] Dropping %ld bytes of "
+                     "torn log tail in '%s'\n",
+                     (long)(data.size () - valid), path.c_str ());
+
+            if (truncate (path.c_str (), valid) != 0)
+                perror ("[database::local::init ERROR]");
+        }
+
+    log_file = fopen (path.c_str (), "ab");
+    if (!log_file)
+        {
+            perror ("[database::local::init ERROR]");
+
+            for (table_t &t : tables)
+                t.clear ();
+
+            stats = { 0, 0, 0, 0 };
+
+            return -1;
+        }
+
+    log_path = path;
+    stats.log_size = valid;
+
+    return 0;
+}
+
+void
+shutdown ()
+{
+    std::lock_guard lk (m);
+
+    if (!log_file)
+        return;
+
+    fflush (log_file);
+    fsync (fileno (log_file));
+    fclose (log_file);
+    log_file = NULL;
+
+    for (table_t &t : tables)
+        t.clear ();
+
+    stats = { 0, 0, 0, 0 };
+}
+
+bool
+is_open ()
+{
+    std::lock_guard lk (m);
+
+    return log_file != NULL;
+}
+
+PGresult *
+exec (const char *name, int nparams, const char *const *params)
+{
+    std::lock_guard lk (m);
+
+    if (!log_file)
+        return NULL;
+
+    for (const handler_t &h : handlers)
+        {
+            if (strcmp (h.name, name) != 0)
+                continue;
+
+            if (h.nparams != nparams)
+                return _error (name, "Wrong parameter count");
+
+            // every statement taking params is keyed by the first one
+            if (nparams && !params[0])
+                return _error (name, "Key can't be NULL");
+
+            batch.clear ();
+
+            PGresult *res = h.fn (params);
+
+            if (PQresultStatus (res) == PGRES_FATAL_ERROR)
+                {
+                    batch.clear ();
+                    return res;
+                }
+
+            if (!_commit ())
+                {
+                    PQclear (res);
+                    return _error (name, "Failed writing log");
+                }
+
+            return res;
+        }
+
+    return _error (name, "Unknown statement");
+}
+
+stats_t
+get_stats ()
+{
+    std::lock_guard lk (m);
+
+    return stats;
+}
+
+} // musicat::database::local
@@ -0,0 +1,170 @@
+#include "musicat/download_scheduler.h"
+#include "musicat/musicat.h"
+#include "musicat/player.h"
+#include "musicat/thread_manager.h"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace musicat::download_scheduler
+{
+
+struct job_t
+{
+    std::string url;
+    // first guild requested this download, owns the waiting entry
+    dpp::snowflake guild_id;
+    priority_e priority;
+    uint64_t seq;
+    // every guild still wanting this file
+    std::set<dpp::snowflake> requesters;
+};
+
+// priority, seq, fname
+using order_key_t = std::tuple<int, uint64_t, std::string>;
+
+static std::mutex _m;
+static std::unordered_map<std::string, job_t> _pending;
+static std::set<order_key_t> _order;
+static std::unordered_set<std::string> _running;
+static size_t _workers = 0;
+// keeps FIFO order within the same priority
+static uint64_t _seq = 0;
+
+static std::atomic<uint64_t> _completed = 0;
+static std::atomic<uint64_t> _cancelled = 0;
+
+static void
+_worker ()
+{
+    while (true)
+        {
+            std::string fname;
+            job_t job;
+
+            {
+                std::lock_guard lk (_m);
+
+                if (_order.empty () || !get_running_state ())
+                    {
+                        _workers--;
+                        return;
+                    }
+
+                auto o = _order.begin ();
+                fname = std::get<2> (*o);
+                _order.erase (o);
+
+                auto i = _pending.find (fname);
+                job = std::move (i->second);
+                _pending.erase (i);
+
+                _running.insert (fname);
+            }
+
+            auto player_manager = get_player_manager_ptr ();
+            if (player_manager)
+                player_manager->run_download (fname, job.url, job.guild_id);
+
+            {
+                std::lock_guard lk (_m);
+                _running.erase (fname);
+            }
+
+            _completed++;
+        }
+}
+
+enqueue_status_e
+enqueue (const std::string &fname, const std::string &url,
+         const dpp::snowflake &guild_id, priority_e priority)
+{
+    std::lock_guard lk (_m);
+
+    if (_running.find (fname) != _running.end ())
+        return ENQUEUE_STATUS_RUNNING;
+
+    auto i = _pending.find (fname);
+    if (i != _pending.end ())
+        {
+            job_t &job = i->second;
+            job.requesters.insert (guild_id);
+
+            if (priority < job.priority)
+                {
+                    _order.erase ({ job.priority, job.seq, fname });
+                    job.priority = priority;
+                    _order.emplace (job.priority, job.seq, fname);
+                }
+
+            return ENQUEUE_STATUS_PENDING;
+        }
+
+    const uint64_t seq = ++_seq;
+
+    _pending.emplace (fname,
+                      job_t{ url, guild_id, priority, seq, { guild_id } });
+    _order.emplace (priority, seq, fname);
+
+    if (_workers < get_max_concurrent_downloads ())
+        {
+            _workers++;
+
+            std::thread t ([] () {
+                thread_manager::DoneSetter tmds;
+
+                _worker ();
+            });
+
+            thread_manager::dispatch (t);
+        }
+
+    return ENQUEUE_STATUS_QUEUED;
+}
+
+bool
+cancel (const std::string &fname, const dpp::snowflake &guild_id)
+{
+    std::lock_guard lk (_m);
+
+    auto i = _pending.find (fname);
+    if (i == _pending.end ())
+        return false;
+
+    job_t &job = i->second;
+    job.requesters.erase (guild_id);
+
+    if (!job.requesters.empty ())
+        return false;
+
+    _order.erase ({ job.priority, job.seq, fname });
+    _pending.erase (i);
+
+    _cancelled++;
+
+    return true;
+}
+
+bool
+is_scheduled (const std::string &fname)
+{
+    std::lock_guard lk (_m);
+
+    return _pending.find (fname) != _pending.end ()
+           || _running.find (fname) != _running.end ();
+}
+
+stats_t
+get_stats ()
+{
+    std::lock_guard lk (_m);
+
+    return { _pending.size (), _running.size (), _workers, _completed,
+             _cancelled };
+}
+
+} // musicat::download_scheduler
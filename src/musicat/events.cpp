@@ -4,6 +4,8 @@
 #include "musicat/events/on_form_submit.h"
 #include "musicat/events/on_guild_create.h"
 #include "musicat/events/on_guild_delete.h"
+#include "musicat/events/on_guild_member_add.h"
+#include "musicat/events/on_guild_member_remove.h"
 #include "musicat/events/on_message_create.h"
 #include "musicat/events/on_message_delete.h"
 #include "musicat/events/on_message_delete_bulk.h"
@@ -35,6 +37,8 @@ load_events (dpp::cluster *client)
     on_channel_update (client);
     on_guild_create (client);
     on_guild_delete (client);
+    on_guild_member_add (client);
+    on_guild_member_remove (client);
     on_user_update (client);
 
     return 0;
@@ -96,12 +96,13 @@ _handle_modal_p_que_s_track (const dpp::form_submit_t &event,
 
             auto player_manager = get_player_manager_ptr ();
 
-            if (player_manager
-                && player_manager->waiting_file_download.find (fname)
-                       == player_manager->waiting_file_download.end ())
+            if (player_manager)
                 {
                     auto url = mctrack::get_url (result);
-                    player_manager->download (fname, url, guild_id);
+                    player_manager->download (
+                        fname, url, guild_id,
+                        top ? download_scheduler::PRIORITY_NEXT_UP
+                            : download_scheduler::PRIORITY_QUEUED);
                 }
         }
     else
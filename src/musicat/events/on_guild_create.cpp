@@ -1,4 +1,5 @@
 #include "musicat/events/on_guild_create.h"
+#include "musicat/db.h"
 #include "musicat/server/service_cache.h"
 
 namespace musicat::events
@@ -9,6 +10,10 @@ on_guild_create (dpp::cluster *client)
 {
     client->on_guild_create ([] (const dpp::guild_create_t &e) {
         server::service_cache::handle_guild_create (e);
+
+        // read in batches by the main loop
+        if (e.created)
+            database::request_guild_current_queue_preload (e.created->id);
     });
 }
 
@@ -0,0 +1,15 @@
+#include "musicat/events/on_guild_member_add.h"
+#include "musicat/server/service_cache.h"
+
+namespace musicat::events
+{
+
+void
+on_guild_member_add (dpp::cluster *client)
+{
+    client->on_guild_member_add ([] (const dpp::guild_member_add_t &e) {
+        server::service_cache::handle_guild_member_add (e);
+    });
+}
+
+} // musicat::events
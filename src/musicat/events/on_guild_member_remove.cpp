@@ -0,0 +1,15 @@
+#include "musicat/events/on_guild_member_remove.h"
+#include "musicat/server/service_cache.h"
+
+namespace musicat::events
+{
+
+void
+on_guild_member_remove (dpp::cluster *client)
+{
+    client->on_guild_member_remove ([] (const dpp::guild_member_remove_t &e) {
+        server::service_cache::handle_guild_member_remove (e);
+    });
+}
+
+} // musicat::events
@@ -5,8 +5,11 @@
 #include "musicat/child/command.h"
 #include "musicat/child/ytdlp.h"
 #include "musicat/musicat.h"
+#include "musicat/resolver_cache.h"
+#include "musicat/thread_manager.h"
 #include "musicat/util.h"
 #include "musicat/util/base64.h"
+#include "musicat/ytdlp_resolver.h"
 
 namespace musicat::mctrack
 {
@@ -187,24 +190,27 @@ is_short (const player::MCTrack &track)
     return is_url_shorts (mctrack::get_url (track));
 }
 
-nlohmann::json
-fetch (const search_option_t &options)
+// q is the final yt-dlp query
+static nlohmann::json
+fetch_uncached (const std::string &q, int max_entries)
 {
-    // id, ytdlp_util_exe, ytdlp_lib_path and ytdlp_query
-    std::string q = options.query;
+    {
+        // warm resolver process, fall back to one off process below when
+        // it's not running
+        nlohmann::json res;
+        const int rstatus = ytdlp_resolver::resolve (q, max_entries, res);
 
-    if (q.empty ())
-        {
-            fprintf (stderr, "[mctrack::fetch ERROR] Empty query\n");
-            return nullptr;
-        }
+        if (rstatus == 0)
+            return res;
 
-    if (!options.is_url)
-        q = "ytsearch" + std::to_string (options.max_entries) + ":" + q;
+        if (rstatus == -1)
+            return nullptr;
+    }
 
+    // id, ytdlp_util_exe, ytdlp_lib_path and ytdlp_query
     const std::string qid = util::max_len (util::base64::encode (q), 40, true);
 
-    const bool has_max_entries = options.max_entries >= 1;
+    const bool has_max_entries = max_entries >= 1;
 
     const std::string ytdlp_cmd
         = cc::create_arg (cc::command_options_keys_t.command,
@@ -219,7 +225,7 @@ fetch (const search_option_t &options)
           + (has_max_entries
                  ? cc::create_arg (
                        cc::command_options_keys_t.ytdlp_max_entries,
-                       std::to_string (options.max_entries))
+                       std::to_string (max_entries))
                  : "");
 
     const std::string exit_cmd = cc::get_exit_command (qid);
@@ -310,14 +316,80 @@ fetch (const search_option_t &options)
                      "\tDeleting `%s`\n",
                      e.what (), opt.file_path.c_str ());
 
-            unlink (opt.file_path.c_str ());
-
             json_res = nullptr;
         }
 
     scs.close ();
 
+    // results are cached by resolver_cache
+    unlink (opt.file_path.c_str ());
+
     return json_res;
 }
 
+// serves stale result right away and replaces it once refreshed
+static void
+refresh (const std::string &key, const std::string &q, int max_entries,
+         long long fresh_ttl)
+{
+    if (!resolver_cache::begin_refresh (key))
+        return;
+
+    std::thread t ([key, q, max_entries, fresh_ttl] () {
+        thread_manager::DoneSetter tmds;
+
+        nlohmann::json res = fetch_uncached (q, max_entries);
+        if (!res.is_null ())
+            resolver_cache::set (
+                key, std::make_shared<const nlohmann::json> (std::move (res)),
+                fresh_ttl);
+
+        resolver_cache::end_refresh (key);
+    });
+
+    thread_manager::dispatch (t);
+}
+
+std::shared_ptr<const nlohmann::json>
+fetch (const search_option_t &options)
+{
+    std::string q = options.query;
+
+    if (q.empty ())
+        {
+            fprintf (stderr, "[mctrack::fetch ERROR] Empty query\n");
+            return nullptr;
+        }
+
+    if (!options.is_url)
+        q = "ytsearch" + std::to_string (options.max_entries) + ":" + q;
+
+    const std::string key
+        = resolver_cache::create_key (q, options.max_entries, options.is_url);
+
+    const long long fresh_ttl = options.is_url
+                                    ? resolver_cache::URL_FRESH_TTL
+                                    : resolver_cache::SEARCH_FRESH_TTL;
+
+    bool stale = false;
+
+    auto cached = resolver_cache::get (key, stale);
+    if (cached)
+        {
+            if (stale)
+                refresh (key, q, options.max_entries, fresh_ttl);
+
+            return cached;
+        }
+
+    nlohmann::json res = fetch_uncached (q, options.max_entries);
+    if (res.is_null ())
+        return nullptr;
+
+    auto shared = std::make_shared<const nlohmann::json> (std::move (res));
+    resolver_cache::set (key, shared, fresh_ttl);
+
+    return shared;
+}
+
 } // musicat::mctrack
@@ -0,0 +1,558 @@
+#include "musicat/music_index.h"
+#include "musicat/musicat.h"
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sys/stat.h>
+#include <unordered_map>
+
+#define INDEX_FILENAME ".musicat_index"
+#define INDEX_HEADER "musicat_index"
+#define INDEX_VERSION 2
+// version 1 has no priority field
+#define INDEX_V1_FIELD_COUNT 6
+#define INDEX_FIELD_COUNT 7
+
+namespace musicat::music_index
+{
+
+static std::mutex _m;
+static std::unordered_map<std::string, entry_t> _entries;
+static size_t _total_size = 0;
+static uint64_t _last_id = 0;
+// index changed since last save
+static bool _dirty = false;
+
+// GDSF: priority = inflation + frequency * cost / size. Cost is the same
+// for every file as every miss is one fetch, so small and often played files
+// stay longer. Inflation is raised to the priority of every evicted entry,
+// entries not played since keep their old priority and age out
+static double _inflation = 0.0;
+static std::set<std::pair<double, std::string> > _eviction_order;
+
+// only one save can write the file at a time
+static std::mutex _save_m;
+
+static std::string
+_get_index_path (const std::string &music_folder_path)
+{
+    return music_folder_path + INDEX_FILENAME;
+}
+
+static bool
+_is_opus_file (const std::string &filename)
+{
+    const size_t len = filename.length ();
+
+    return len > 5 && filename.compare (len - 5, 5, ".opus") == 0;
+}
+
+static double
+_compute_priority (const entry_t &e)
+{
+    const double kib = e.size > 1024 ? (double)e.size / 1024.0 : 1.0;
+
+    return _inflation + (double)(e.play_count + 1) / kib;
+}
+
+// _m must be locked, call after frequency or size changed, counts as a hit
+static void
+_reprioritize (entry_t &e)
+{
+    _eviction_order.erase ({ e.priority, e.filename });
+
+    e.priority = _compute_priority (e);
+    _eviction_order.emplace (e.priority, e.filename);
+}
+
+// _m must be locked
+static void
+_erase (std::unordered_map<std::string, entry_t>::iterator i)
+{
+    _eviction_order.erase ({ i->second.priority, i->first });
+    _total_size -= i->second.size;
+    _entries.erase (i);
+    _dirty = true;
+}
+
+// _m must be locked
+static entry_t &
+_upsert (const std::string &filename, size_t size)
+{
+    auto i = _entries.find (filename);
+
+    if (i == _entries.end ())
+        {
+            i = _entries
+                    .emplace (filename,
+                              entry_t{ ++_last_id, filename, 0, 0, 0, 0, 0.0 })
+                    .first;
+        }
+
+    _total_size = _total_size - i->second.size + size;
+    i->second.size = size;
+    _dirty = true;
+
+    return i->second;
+}
+
+// _m must be locked, returns false on malformed line
+static bool
+_parse_line (const std::string &line, int version)
+{
+    // id, size, atime, duration, play_count, priority, filename. Filename is
+    // the last field so it's free to contain any character but newline
+    const char *p = line.c_str ();
+    uint64_t fields[INDEX_V1_FIELD_COUNT - 1];
+
+    for (int f = 0; f < INDEX_V1_FIELD_COUNT - 1; f++)
+        {
+            char *end = NULL;
+            fields[f] = strtoull (p, &end, 10);
+
+            if (end == p || *end != '\t')
+                return false;
+
+            p = end + 1;
+        }
+
+    double priority = -1.0;
+
+    if (version >= 2)
+        {
+            char *end = NULL;
+            priority = strtod (p, &end);
+
+            if (end == p || *end != '\t')
+                return false;
+
+            p = end + 1;
+        }
+
+    const std::string filename (p);
+    if (!_is_opus_file (filename))
+        return false;
+
+    auto i = _entries.find (filename);
+    if (i != _entries.end ())
+        _erase (i);
+
+    entry_t e = { fields[0],         filename,  (size_t)fields[1],
+                  (time_t)fields[2], fields[3], fields[4],
+                  priority };
+
+    if (priority < 0.0)
+        e.priority = _compute_priority (e);
+
+    if (e.id > _last_id)
+        _last_id = e.id;
+
+    _total_size += e.size;
+    _eviction_order.emplace (e.priority, filename);
+    _entries.insert_or_assign (filename, std::move (e));
+
+    return true;
+}
+
+// _m must be locked, reconcile index with music folder content. Known entries
+// keep their stats, only size is refreshed
+static int
+_scan (const std::string &music_folder_path)
+{
+    DIR *dir = opendir (music_folder_path.c_str ());
+
+    if (dir == NULL)
+        {
+            perror ("[music_index::_scan] opendir");
+            return -1;
+        }
+
+    std::unordered_map<std::string, bool> seen;
+    seen.reserve (_entries.size ());
+
+    dirent *file;
+    while ((file = readdir (dir)) != NULL)
+        {
+            if (file->d_type != DT_REG)
+                continue;
+
+            const std::string filename (file->d_name);
+            if (!_is_opus_file (filename))
+                continue;
+
+            struct stat st;
+            if (stat ((music_folder_path + filename).c_str (), &st) != 0)
+                {
+                    perror ("[music_index::_scan] stat");
+                    continue;
+                }
+
+            auto i = _entries.find (filename);
+            const bool changed
+                = i == _entries.end () || i->second.size != (size_t)st.st_size;
+
+            if (!changed)
+                {
+                    seen.emplace (filename, true);
+                    continue;
+                }
+
+            const bool is_new = i == _entries.end ();
+
+            entry_t &e = _upsert (filename, st.st_size);
+            if (is_new)
+                e.atime = st.st_atime;
+
+            _reprioritize (e);
+
+            seen.emplace (filename, true);
+        }
+
+    closedir (dir);
+
+    auto i = _entries.begin ();
+    while (i != _entries.end ())
+        {
+            if (seen.find (i->first) != seen.end ())
+                {
+                    i++;
+                    continue;
+                }
+
+            auto next = std::next (i);
+            _erase (i);
+            i = next;
+        }
+
+    return 0;
+}
+
+int
+load ()
+{
+    const std::string music_folder_path = get_music_folder_path ();
+    if (music_folder_path.empty ())
+        return 1;
+
+    const std::string index_path = _get_index_path (music_folder_path);
+
+    std::lock_guard lk (_m);
+
+    _entries.clear ();
+    _eviction_order.clear ();
+    _total_size = 0;
+    _last_id = 0;
+    _inflation = 0.0;
+    _dirty = false;
+
+    std::ifstream ifs (index_path);
+
+    if (!ifs.is_open ())
+        {
+            fprintf (stderr,
+                     "[music_index::load] No index file, scanning '%s'\n",
+                     music_folder_path.c_str ());
+
+            int status = _scan (music_folder_path);
+
+            fprintf (stderr, "[music_index::load] Indexed %zu files\n",
+                     _entries.size ());
+
+            return status;
+        }
+
+    std::string line;
+    std::getline (ifs, line);
+
+    // "musicat_index <version>[\t<inflation>]"
+    int version = 0;
+    double inflation = 0.0;
+
+    if (sscanf (line.c_str (), INDEX_HEADER " %d\t%lf", &version, &inflation)
+            < 1
+        || version < 1 || version > INDEX_VERSION)
+        {
+            fprintf (stderr,
+                     "[music_index::load WARN] Unknown index format, "
+                     "rebuilding from '%s'\n",
+                     music_folder_path.c_str ());
+
+            return _scan (music_folder_path);
+        }
+
+    _inflation = inflation;
+
+    size_t malformed = 0;
+    while (std::getline (ifs, line))
+        {
+            if (line.empty ())
+                continue;
+
+            if (!_parse_line (line, version))
+                malformed++;
+        }
+
+    if (version < INDEX_VERSION)
+        _dirty = true;
+
+    if (malformed)
+        {
+            fprintf (stderr,
+                     "[music_index::load WARN] Skipped %zu malformed "
+                     "entries\n",
+                     malformed);
+
+            _dirty = true;
+        }
+
+    const size_t loaded = _entries.size ();
+
+    // files added, replaced or deleted while not running
+    const int status = _scan (music_folder_path);
+
+    fprintf (stderr,
+             "[music_index::load] Loaded %zu entries, %zu after scanning "
+             "folder (%zu bytes)\n",
+             loaded, _entries.size (), _total_size);
+
+    return status;
+}
+
+int
+save ()
+{
+    std::lock_guard slk (_save_m);
+
+    std::string content;
+
+    {
+        std::lock_guard lk (_m);
+
+        if (!_dirty)
+            return 0;
+
+        content.reserve (_entries.size () * 128);
+
+        char buf[160];
+        snprintf (buf, sizeof (buf), INDEX_HEADER " %d\t%.17g\n",
+                  INDEX_VERSION, _inflation);
+        content += buf;
+
+        for (const auto &i : _entries)
+            {
+                const entry_t &e = i.second;
+
+                snprintf (buf, sizeof (buf),
+                          "%" PRIu64 "\t%zu\t%lld\t%" PRIu64 "\t%" PRIu64
+                          "\t%.17g\t",
+                          e.id, e.size, (long long)e.atime, e.duration,
+                          e.play_count, e.priority);
+
+                content += buf;
+                content += e.filename;
+                content += '\n';
+            }
+
+        _dirty = false;
+    }
+
+    const std::string music_folder_path = get_music_folder_path ();
+    const std::string index_path = _get_index_path (music_folder_path);
+    const std::string tmp_path = index_path + ".tmp";
+
+    // write to temp file then rename so a crash never leaves a truncated
+    // index behind
+    FILE *f = fopen (tmp_path.c_str (), "w");
+    bool failed = f == NULL;
+
+    if (!failed)
+        {
+            failed = fwrite (content.data (), 1, content.size (), f)
+                     != content.size ();
+            failed = (fclose (f) != 0) || failed;
+        }
+
+    if (!failed)
+        failed = rename (tmp_path.c_str (), index_path.c_str ()) != 0;
+
+    if (failed)
+        {
+            perror ("[music_index::save ERROR]");
+            fprintf (stderr, "^^^ Failed writing '%s'\n", index_path.c_str ());
+
+            std::lock_guard lk (_m);
+            _dirty = true;
+
+            return -1;
+        }
+
+    return 0;
+}
+
+void
+add (const std::string &filename, size_t size, time_t atime)
+{
+    std::lock_guard lk (_m);
+
+    entry_t &e = _upsert (filename, size);
+    e.atime = atime;
+    _reprioritize (e);
+}
+
+void
+update (const std::string &filename, size_t size)
+{
+    std::lock_guard lk (_m);
+
+    const bool is_new = _entries.find (filename) == _entries.end ();
+
+    entry_t &e = _upsert (filename, size);
+    if (is_new)
+        e.atime = time (NULL);
+
+    _reprioritize (e);
+}
+
+int
+rescan ()
+{
+    const std::string music_folder_path = get_music_folder_path ();
+    if (music_folder_path.empty ())
+        return 1;
+
+    std::lock_guard lk (_m);
+
+    return _scan (music_folder_path);
+}
+
+void
+on_play (const std::string &filename, size_t size, uint64_t duration)
+{
+    std::lock_guard lk (_m);
+
+    if (!size)
+        {
+            auto i = _entries.find (filename);
+            if (i != _entries.end ())
+                size = i->second.size;
+        }
+
+    entry_t &e = _upsert (filename, size);
+    e.atime = time (NULL);
+    e.play_count++;
+
+    if (duration)
+        e.duration = duration;
+
+    _reprioritize (e);
+}
+
+bool
+remove (const std::string &filename)
+{
+    std::lock_guard lk (_m);
+
+    auto i = _entries.find (filename);
+    if (i == _entries.end ())
+        return false;
+
+    _erase (i);
+
+    return true;
+}
+
+bool
+evict (const std::string &filename)
+{
+    std::lock_guard lk (_m);
+
+    auto i = _entries.find (filename);
+    if (i == _entries.end ())
+        return false;
+
+    if (i->second.priority > _inflation)
+        _inflation = i->second.priority;
+
+    _erase (i);
+
+    return true;
+}
+
+std::vector<entry_t>
+get_eviction_candidates (size_t amount,
+                         const std::unordered_set<std::string> &skip)
+{
+    std::lock_guard lk (_m);
+
+    std::vector<entry_t> ret;
+    ret.reserve (amount);
+
+    for (const auto &o : _eviction_order)
+        {
+            if (ret.size () == amount)
+                break;
+
+            if (skip.find (o.second) != skip.end ())
+                continue;
+
+            auto i = _entries.find (o.second);
+            if (i != _entries.end ())
+                ret.push_back (i->second);
+        }
+
+    return ret;
+}
+
+bool
+exists (const std::string &filename)
+{
+    std::lock_guard lk (_m);
+
+    return _entries.find (filename) != _entries.end ();
+}
+
+std::vector<entry_t>
+list (size_t amount)
+{
+    std::lock_guard lk (_m);
+
+    const size_t count = amount && amount < _entries.size ()
+                             ? amount
+                             : _entries.size ();
+
+    std::vector<entry_t> ret;
+    ret.reserve (count);
+
+    for (const auto &i : _entries)
+        {
+            if (ret.size () == count)
+                break;
+
+            ret.push_back (i.second);
+        }
+
+    return ret;
+}
+
+size_t
+get_total_size ()
+{
+    std::lock_guard lk (_m);
+
+    return _total_size;
+}
+
+size_t
+get_count ()
+{
+    std::lock_guard lk (_m);
+
+    return _entries.size ();
+}
+
+} // musicat::music_index
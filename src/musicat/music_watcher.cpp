@@ -0,0 +1,195 @@
+#include "musicat/music_watcher.h"
+#include "musicat/music_index.h"
+#include "musicat/musicat.h"
+#include "musicat/thread_manager.h"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <string>
+#include <string_view>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// file finished writing or moved in, yt-dlp renames its final output into
+// place. IN_MODIFY isn't watched, it fires on every write while downloading
+#define WATCH_MASK                                                            \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM                 \
+     | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+#define POLL_TIMEOUT_MS 1000
+
+namespace musicat::music_watcher
+{
+
+static bool
+_is_opus_file (const char *name, uint32_t len)
+{
+    const std::string_view n (name, strnlen (name, len));
+
+    return n.length () > 5 && n.substr (n.length () - 5) == ".opus";
+}
+
+static void
+_check_cache_limit ()
+{
+    const size_t mcs = get_max_music_cache_size ();
+
+    // exact running total from index, main loop only has to act when
+    // it's actually over the limit
+    if (mcs != 0 && music_index::get_total_size () > mcs)
+        set_should_check_music_cache (true);
+}
+
+static int
+_add_watch (int fd, const std::string &music_folder_path, bool log_error)
+{
+    struct stat st;
+    if (stat (music_folder_path.c_str (), &st) != 0)
+        std::filesystem::create_directory (music_folder_path);
+
+    const int wd
+        = inotify_add_watch (fd, music_folder_path.c_str (), WATCH_MASK);
+
+    if (wd < 0 && log_error)
+        {
+            perror ("[music_watcher::_add_watch ERROR] inotify_add_watch");
+            fprintf (stderr, "^^^ Failed watching '%s', retrying\n",
+                     music_folder_path.c_str ());
+        }
+
+    return wd;
+}
+
+static void
+_handle_event (const struct inotify_event *e,
+               const std::string &music_folder_path, int &wd)
+{
+    if (e->mask & IN_Q_OVERFLOW)
+        {
+            fprintf (stderr, "[music_watcher WARN] Event queue overflowed, "
+                             "rescanning music folder\n");
+
+            music_index::rescan ();
+            _check_cache_limit ();
+            return;
+        }
+
+    // folder itself is gone, watch is removed by kernel
+    if (e->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+        {
+            if (e->wd == wd)
+                {
+                    fprintf (stderr,
+                             "[music_watcher WARN] Music folder removed\n");
+                    wd = -1;
+                }
+
+            return;
+        }
+
+    if (!e->len || (e->mask & IN_ISDIR) || !_is_opus_file (e->name, e->len))
+        return;
+
+    const std::string filename (e->name);
+
+    if (e->mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            music_index::remove (filename);
+            return;
+        }
+
+    struct stat st;
+    if (stat ((music_folder_path + filename).c_str (), &st) != 0)
+        {
+            // removed before we get to it, delete event will follow
+            return;
+        }
+
+    music_index::update (filename, st.st_size);
+    _check_cache_limit ();
+}
+
+static void
+_watch (int fd, int wd, std::string music_folder_path)
+{
+    alignas (struct inotify_event) char buf[4096];
+
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    while (get_running_state ())
+        {
+            if (wd < 0)
+                {
+                    wd = _add_watch (fd, music_folder_path, false);
+
+                    // catch up with whatever happened while not watching
+                    if (wd >= 0)
+                        {
+                            music_index::rescan ();
+                            _check_cache_limit ();
+                        }
+                }
+
+            const int pr = poll (&pfd, 1, POLL_TIMEOUT_MS);
+
+            if (pr < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    perror ("[music_watcher ERROR] poll");
+                    break;
+                }
+
+            if (pr == 0 || !(pfd.revents & POLLIN))
+                continue;
+
+            ssize_t len;
+            while ((len = read (fd, buf, sizeof (buf))) > 0)
+                {
+                    const char *p = buf;
+                    while (p < buf + len)
+                        {
+                            const auto *e = (const struct inotify_event *)p;
+
+                            _handle_event (e, music_folder_path, wd);
+
+                            p += sizeof (struct inotify_event) + e->len;
+                        }
+                }
+        }
+
+    close (fd);
+}
+
+int
+init ()
+{
+    const std::string music_folder_path = get_music_folder_path ();
+    if (music_folder_path.empty ())
+        return 1;
+
+    const int fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        {
+            perror ("[music_watcher::init ERROR] inotify_init1");
+            return -1;
+        }
+
+    const int wd = _add_watch (fd, music_folder_path, true);
+
+    std::thread t ([fd, wd, music_folder_path] () {
+        thread_manager::DoneSetter tmds;
+
+        _watch (fd, wd, music_folder_path);
+    });
+
+    thread_manager::dispatch (t);
+
+    return 0;
+}
+
+} // musicat::music_watcher
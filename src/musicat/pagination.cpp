@@ -6,6 +6,7 @@
 #include "musicat/storage.h"
 #include "musicat/util.h"
 #include "musicat/util_response.h"
+#include <algorithm>
 #include <dpp/dpp.h>
 #include <map>
 #include <memory>
@@ -14,6 +15,9 @@
 #include <variant>
 #include <vector>
 
+// tracks per page, first page also shows the current track
+#define PAGE_TRACKS 10
+
 namespace musicat
 {
 namespace paginate
@@ -40,6 +44,8 @@ pages_t::pages_t ()
     this->client = NULL;
     this->message = {};
     this->pages = {};
+    this->renderer = {};
+    this->page_count = 0;
     this->current = 0;
     this->has_storage_data = false;
 }
@@ -51,12 +57,20 @@ pages_t::pages_t (dpp::cluster *client, std::shared_ptr<dpp::message> message,
     this->client = client;
     this->message = message;
     this->pages = pages;
+    this->renderer = {};
+    this->page_count = 0;
     this->current = current;
     this->has_storage_data = has_storage_data;
 }
 
 pages_t::~pages_t () = default;
 
+size_t
+pages_t::size () const
+{
+    return this->renderer ? this->page_count : this->pages.size ();
+}
+
 void
 pages_t::edit_cb (const dpp::confirmation_callback_t &cb, size_t new_current)
 {
@@ -137,7 +151,19 @@ pages_t::edit (size_t c, const dpp::interaction_create_t &event)
             return;
         }
 
-    dpp::embed to = this->pages.at (c);
+    dpp::embed to;
+
+    if (!this->renderer)
+        to = this->pages.at (c);
+    else if (!this->renderer (c, to))
+        {
+            event.reply (
+                util::response::str_mention_user (event.command.usr.id)
+                + "Can't load this page, try again later");
+
+            return;
+        }
+
     this->message->embeds.clear ();
     this->message->add_embed (to);
 
@@ -171,7 +197,7 @@ void
 pages_t::next (const dpp::interaction_create_t &event)
 {
     size_t c = this->current;
-    if (c == (this->pages.size () - 1))
+    if (c == (this->size () - 1))
         {
             c = 0;
         }
@@ -186,7 +212,7 @@ pages_t::previous (const dpp::interaction_create_t &event)
     size_t c = this->current;
     if (c == 0)
         {
-            c = this->pages.size () - 1;
+            c = this->size () - 1;
         }
     else
         c--;
@@ -288,7 +314,7 @@ update_page (const dpp::snowflake &msg_id, const std::string &param,
     try
         {
             int64_t pn = std::stoll (param) - 1;
-            int64_t psize = (int64_t)b.pages.size ();
+            int64_t psize = (int64_t)b.size ();
             int64_t max_psize = (psize - 1);
 
             if (pn > max_psize)
@@ -317,12 +343,13 @@ update_page (const dpp::snowflake &msg_id, const std::string &param,
         }
 }
 
-dpp::command_completion_event_t
-get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
-                    dpp::cluster *client, std::vector<dpp::embed> embeds,
-                    std::any storage_data)
+static dpp::command_completion_event_t
+_get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
+                     dpp::cluster *client, std::vector<dpp::embed> embeds,
+                     page_renderer_t renderer, size_t page_count,
+                     std::any storage_data)
 {
-    return [event, paginate, client, embeds,
+    return [event, paginate, client, embeds, renderer, page_count,
             storage_data] (const dpp::confirmation_callback_t &cb) {
         if (cb.is_error ())
             {
@@ -334,7 +361,8 @@ get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
         bool has_v = storage_data.has_value ();
         if (paginate || has_v)
             {
-                event.get_original_response ([client, embeds, has_v,
+                event.get_original_response ([client, embeds, renderer,
+                                              page_count, has_v,
                                               storage_data] (
                                                  const dpp::
                                                      confirmation_callback_t
@@ -355,6 +383,8 @@ get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
                     paginated_messages[m->id].client = client;
                     paginated_messages[m->id].message = m;
                     paginated_messages[m->id].pages = embeds;
+                    paginated_messages[m->id].renderer = renderer;
+                    paginated_messages[m->id].page_count = page_count;
                     paginated_messages[m->id].current = 0;
                     paginated_messages[m->id].has_storage_data = has_v;
 
@@ -380,6 +410,24 @@ get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
     };
 }
 
+dpp::command_completion_event_t
+get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
+                    dpp::cluster *client, std::vector<dpp::embed> embeds,
+                    std::any storage_data)
+{
+    return _get_inter_reply_cb (event, paginate, client, embeds, {}, 0,
+                                storage_data);
+}
+
+dpp::command_completion_event_t
+get_inter_reply_cb (const dpp::interaction_create_t &event, bool paginate,
+                    dpp::cluster *client, page_renderer_t renderer,
+                    size_t page_count)
+{
+    return _get_inter_reply_cb (event, paginate, client, {}, renderer,
+                                page_count, std::any ());
+}
+
 void
 add_pagination_buttons (dpp::message *msg)
 {
@@ -456,76 +504,98 @@ gc (bool clear)
                  paginated_messages.size (), storage::size ());
 }
 
-void
-_construct_desc (std::deque<player::MCTrack> &queue,
-                 std::deque<player::MCTrack>::iterator i, std::string &desc,
-                 size_t &id, size_t &count, size_t &qs, dpp::embed &embed,
-                 const std::string &title, std::vector<dpp::embed> &embeds,
-                 uint64_t &totald,
-                 std::shared_ptr<player::Player> guild_player)
+static size_t
+_get_page_count (size_t track_count)
 {
-    if (i == queue.begin ())
-        {
-            player::track_progress prog = { 0, 0, -1 };
-            if (util::player_has_current_track (guild_player))
-                prog = util::get_track_progress (guild_player->current_track);
-            else
-                prog = util::get_track_progress (*i);
-
-            desc += "Current track: [" + mctrack::get_title (*i) + "]("
-                    + mctrack::get_url (*i) + ")"
-                    + std::string (
-                        !prog.status
-                            ? std::string (" [")
-                                  + format_duration (prog.current_ms) + "/"
-                                  + format_duration (prog.duration) + "]"
-                            : "")
-                    + " - <@" + std::to_string (i->user_id) + ">\n\n";
-        }
-    else
+    if (track_count <= PAGE_TRACKS + 1)
+        return 1;
+
+    return 1 + (track_count - PAGE_TRACKS - 1 + PAGE_TRACKS - 1) / PAGE_TRACKS;
+}
+
+// index of first track on page and how many tracks it shows
+static std::pair<size_t, size_t>
+_get_page_range (size_t page)
+{
+    if (!page)
+        return std::make_pair (0, PAGE_TRACKS + 1);
+
+    return std::make_pair (page * PAGE_TRACKS + 1, PAGE_TRACKS);
+}
+
+/**
+ * @brief Render one page, tracks are only the tracks of that page with the
+ * first one at index start of the whole list
+ */
+static dpp::embed
+_render_page (const std::deque<player::MCTrack> &tracks, size_t start,
+              const std::string &title, uint64_t totald, size_t qs,
+              std::shared_ptr<player::Player> guild_player)
+{
+    std::string desc = "";
+
+    for (size_t n = 0; n < tracks.size (); n++)
         {
-            uint64_t dur = mctrack::get_duration (*i);
+            const player::MCTrack &t = tracks[n];
+            const size_t id = start + n;
+
+            if (id == 0)
+                {
+                    player::track_progress prog = { 0, 0, -1 };
+                    if (util::player_has_current_track (guild_player))
+                        prog = util::get_track_progress (
+                            guild_player->current_track);
+                    else
+                        prog = util::get_track_progress (t);
+
+                    desc += "Current track: [" + mctrack::get_title (t)
+                            + "](" + mctrack::get_url (t) + ")"
+                            + std::string (
+                                !prog.status
+                                    ? std::string (" [")
+                                          + format_duration (prog.current_ms)
+                                          + "/"
+                                          + format_duration (prog.duration)
+                                          + "]"
+                                    : "")
+                            + " - <@" + std::to_string (t.user_id) + ">\n\n";
+
+                    continue;
+                }
+
+            uint64_t dur = mctrack::get_duration (t);
 
-            desc += std::to_string (id) + ": [" + mctrack::get_title (*i)
-                    + "](" + mctrack::get_url (*i) + ")"
+            desc += std::to_string (id) + ": [" + mctrack::get_title (t) + "]("
+                    + mctrack::get_url (t) + ")"
                     + std::string (dur ? std::string (" [")
                                              + format_duration (dur) + "]"
                                        : "")
-                    + " - <@" + std::to_string (i->user_id) + ">\n";
-
-            id++;
-            count++;
+                    + " - <@" + std::to_string (t.user_id) + ">\n";
         }
 
-    if ((count && !(count % 10)) || id == qs)
-        {
-            embed.set_title (title).set_description (
-                desc.length () > 2048
-                    ? "Description too long, pagination is on the way!"
-                    : desc);
+    dpp::embed embed;
+    embed.set_title (title).set_description (
+        desc.length () > 2048
+            ? "Description too long, pagination is on the way!"
+            : desc);
 
-            std::string fot = "";
+    std::string fot = "";
 
-            if (totald)
-                fot += format_duration (totald);
-
-            if (qs)
-                {
-                    if (!fot.empty ())
-                        fot += " | ";
-
-                    fot += std::to_string (qs) + " track"
-                           + (qs > 1 ? "s" : "");
-                }
+    if (totald)
+        fot += format_duration (totald);
 
+    if (qs)
+        {
             if (!fot.empty ())
-                embed.set_footer (fot, "");
+                fot += " | ";
 
-            embeds.emplace_back (embed);
-            embed = dpp::embed ();
-            desc = "";
-            count = 0;
+            fot += std::to_string (qs) + " track" + (qs > 1 ? "s" : "");
         }
+
+    if (!fot.empty ())
+        embed.set_footer (fot, "");
+
+    return embed;
 }
 
 void
@@ -533,36 +603,75 @@ reply_paginated_playlist (const dpp::interaction_create_t &event,
                           std::deque<player::MCTrack> queue,
                           const std::string &title, const bool edit_response)
 {
-    // unused var
-    // const bool debug = get_debug_state ();
-
-    std::vector<dpp::embed> embeds = {};
-
-    dpp::embed embed;
-    // std::vector<std::string> queue_str;
-    std::string desc = "";
-    size_t id = 1;
-    size_t qs = queue.size ();
-    size_t count = 0;
-
     uint64_t totald = 0;
 
     for (auto i = queue.begin (); i != queue.end (); i++)
         totald += mctrack::get_duration (*i);
 
-    auto guild_player
-        = get_player_manager_ptr ()->get_player (event.command.guild_id);
+    const size_t qs = queue.size ();
 
-    for (auto i = queue.begin (); i != queue.end (); i++)
+    // kept by the loader until the message is gone
+    auto tracks
+        = std::make_shared<const std::deque<player::MCTrack> > (std::move (
+            queue));
+
+    reply_paginated_playlist (
+        event,
+        [tracks] (size_t start, size_t count,
+                  std::deque<player::MCTrack> &out) {
+            const size_t end = std::min (start + count, tracks->size ());
+
+            for (size_t i = start; i < end; i++)
+                out.push_back (tracks->at (i));
+
+            return true;
+        },
+        qs, totald, title, edit_response);
+}
+
+void
+reply_paginated_playlist (const dpp::interaction_create_t &event,
+                          track_loader_t loader, size_t track_count,
+                          uint64_t total_duration, const std::string &title,
+                          const bool edit_response)
+{
+    const dpp::snowflake guild_id = event.command.guild_id;
+
+    page_renderer_t renderer = [loader, track_count, total_duration, title,
+                                guild_id] (size_t page, dpp::embed &embed) {
+        const std::pair<size_t, size_t> range = _get_page_range (page);
+
+        std::deque<player::MCTrack> tracks;
+        if (!loader (range.first, range.second, tracks))
+            return false;
+
+        auto guild_player = get_player_manager_ptr ()->get_player (guild_id);
+
+        embed = _render_page (tracks, range.first, title, total_duration,
+                              track_count, guild_player);
+
+        return true;
+    };
+
+    dpp::embed first;
+    if (!renderer (0, first))
         {
-            _construct_desc (queue, i, desc, id, count, qs, embed, title,
-                             embeds, totald, guild_player);
+            const std::string err = "Can't load this list, try again later";
+
+            if (!edit_response)
+                event.reply (err);
+            else
+                event.edit_response (err);
+
+            return;
         }
 
     dpp::message msg;
-    msg.add_embed (embeds.front ());
+    msg.add_embed (first);
+
+    const size_t page_count = _get_page_count (track_count);
 
-    bool paginate = embeds.size () > 1;
+    bool paginate = page_count > 1;
     if (paginate)
         {
             paginate::add_pagination_buttons (&msg);
@@ -570,11 +679,13 @@ reply_paginated_playlist (const dpp::interaction_create_t &event,
 
     if (!edit_response)
         event.reply (msg, paginate::get_inter_reply_cb (
-                              event, paginate, event.from->creator, embeds));
+                              event, paginate, event.from->creator, renderer,
+                              page_count));
     else
         event.edit_response (
             msg, paginate::get_inter_reply_cb (event, paginate,
-                                               event.from->creator, embeds));
+                                               event.from->creator, renderer,
+                                               page_count));
 
 } // reply_paginated_playlist
 } // paginate
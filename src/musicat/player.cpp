@@ -219,7 +219,8 @@ Player::set_max_history_size (const size_t &siz)
 {
     this->max_history_size = siz;
     int set = (int)siz;
-    database::update_guild_player_config (this->guild_id, NULL, &set, NULL);
+    database::defer_update_guild_player_config (this->guild_id, NULL, &set,
+                                                NULL);
     return *this;
 }
 
@@ -317,7 +318,8 @@ Player &
 Player::set_auto_play (const bool state)
 {
     this->auto_play = state;
-    database::update_guild_player_config (this->guild_id, &state, NULL, NULL);
+    database::defer_update_guild_player_config (this->guild_id, &state, NULL,
+                                                NULL);
     return *this;
 }
 
@@ -359,7 +361,8 @@ Player::set_loop_mode (int64_t mode)
         }
 
     this->loop_mode = nm;
-    database::update_guild_player_config (this->guild_id, NULL, NULL, &nm);
+    database::defer_update_guild_player_config (this->guild_id, NULL, NULL,
+                                                &nm);
 
     return *this;
 }
@@ -392,6 +395,7 @@ Player::remove_track (const size_t &pos, size_t amount, const size_t &to)
         amount = max;
 
     std::deque<MCTrack>::iterator b = this->queue.begin () + pos;
+    std::deque<MCTrack> removed = {};
     size_t a = 0;
 
     while (b != this->queue.end ())
@@ -399,10 +403,13 @@ Player::remove_track (const size_t &pos, size_t amount, const size_t &to)
             if (a == amount)
                 break;
 
+            removed.push_back (*b);
             b = this->queue.erase (b);
             a++;
         }
 
+    this->cancel_downloads (removed);
+
     return amount;
 }
 
@@ -413,12 +420,14 @@ Player::remove_track_by_user (const dpp::snowflake &user_id)
         return 0;
 
     size_t ret = 0;
+    std::deque<MCTrack> removed = {};
     auto i = this->queue.begin ();
     while (i != this->queue.end ())
         {
             if (i->user_id == user_id && i != this->queue.begin ())
                 {
-                    this->queue.erase (i);
+                    removed.push_back (*i);
+                    i = this->queue.erase (i);
                     ret++;
                     continue;
                 }
@@ -426,9 +435,37 @@ Player::remove_track_by_user (const dpp::snowflake &user_id)
             i++;
         }
 
+    this->cancel_downloads (removed);
+
     return ret;
 }
 
+void
+Player::cancel_downloads (const std::deque<MCTrack> &removed)
+{
+    if (!this->manager)
+        return;
+
+    for (const MCTrack &t : removed)
+        {
+            if (t.filename.empty ())
+                continue;
+
+            bool still_queued = false;
+            for (const MCTrack &q : this->queue)
+                {
+                    if (q.filename != t.filename)
+                        continue;
+
+                    still_queued = true;
+                    break;
+                }
+
+            if (!still_queued)
+                this->manager->cancel_download (t.filename, this->guild_id);
+        }
+}
+
 bool
 Player::pause (dpp::discord_client *from, const dpp::snowflake &user_id)
 {
@@ -1,5 +1,8 @@
 #include "musicat/child/command.h"
 #include "musicat/child/dl_music.h"
+#include "musicat/download_scheduler.h"
+#include "musicat/mctrack.h"
+#include "musicat/music_index.h"
 #include "musicat/musicat.h"
 #include "musicat/player.h"
 #include "musicat/thread_manager.h"
@@ -280,10 +283,10 @@ read_notif_fifo (int notif_fifo, const std::string &filepath,
 
 void
 Manager::download (const string &fname, const string &url,
-                   const dpp::snowflake &guild_id)
+                   const dpp::snowflake &guild_id,
+                   download_scheduler::priority_e priority)
 {
-    const string yt_dlp = get_ytdlp_exe ();
-    if (yt_dlp.empty ())
+    if (get_ytdlp_exe ().empty ())
         {
             fprintf (stderr,
                      "[ERROR Manager::download] yt-dlp executable isn't "
@@ -293,125 +296,188 @@ Manager::download (const string &fname, const string &url,
             return;
         }
 
-    std::thread tj (
-        [this, yt_dlp] (string fname, string url, dpp::snowflake guild_id) {
-            thread_manager::DoneSetter tmds;
+    bool marked = false;
+
+    {
+        std::lock_guard lk (this->dl_m);
+
+        // marks scheduled download as waiting right away so
+        // wait_for_download doesn't return before it even started
+        if (this->waiting_file_download.find (fname)
+            == this->waiting_file_download.end ())
             {
-                std::lock_guard lk (this->dl_m);
                 this->waiting_file_download[fname] = guild_id;
+                marked = true;
             }
+    }
 
-            const string music_folder_path = get_music_folder_path ();
+    const download_scheduler::enqueue_status_e status
+        = download_scheduler::enqueue (fname, url, guild_id, priority);
 
-            {
-                struct stat buf;
-                if (stat (music_folder_path.c_str (), &buf) != 0)
-                    std::filesystem::create_directory (music_folder_path);
-            }
+    // running download already cleared its mark, nothing would clear ours
+    if (status != download_scheduler::ENQUEUE_STATUS_RUNNING || !marked)
+        return;
 
-            const string filepath = music_folder_path + fname;
-            const bool debug = get_debug_state ();
-
-            // always log these to "easily" spot problem in prod
-            fprintf (stderr, "[Manager::download] Download: \"%s\" \"%s\"\n",
-                     fname.c_str (), url.c_str ());
-
-            namespace cc = child::command;
-
-            const std::string qid
-                = util::max_len (util::base64::encode (fname), 32);
-
-            const std::string child_cmd
-                = cc::create_arg_sanitize_value (cc::command_options_keys_t.id,
-                                                 qid)
-                  + cc::create_arg (cc::command_options_keys_t.command,
-                                    cc::command_execute_commands_t.dl_music)
-                  + cc::create_arg_sanitize_value (
-                      cc::command_options_keys_t.file_path, filepath)
-                  + cc::create_arg_sanitize_value (
-                      cc::command_options_keys_t.ytdlp_query, url)
-                  + cc::create_arg_sanitize_value (
-                      cc::command_options_keys_t.ytdlp_util_exe, yt_dlp)
-                  + cc::create_arg (cc::command_options_keys_t.debug,
-                                    debug ? "1" : "0");
-
-            const std::string exit_cmd = cc::get_exit_command (qid);
-
-            // send download command then wait until it exits
-            cc::send_command (child_cmd);
-            int status = child::command::wait_slave_ready (qid, 10);
-            if (status != 0)
-                {
-                    fprintf (
-                        stderr,
-                        "[Manager::download ERROR] Error downloading '%s' "
-                        "to '%s' with code %d\n",
-                        url.c_str (), filepath.c_str (), status);
-                }
-            else
-                {
-                    const std::string notif_fifo_path
-                        = child::dl_music::get_download_music_fifo_path (qid);
+    {
+        std::lock_guard lk (this->dl_m);
+        this->waiting_file_download.erase (fname);
+    }
 
-                    int notif_fifo = open (notif_fifo_path.c_str (), O_RDONLY);
+    this->dl_cv.notify_all ();
+}
 
-                    if (notif_fifo < 0)
-                        fprintf (stderr,
-                                 "[Manager::download ERROR] "
-                                 "Failed to open notif_fifo: '%s'\n",
-                                 notif_fifo_path.c_str ());
-                    else
-                        {
-                            status
-                                = read_notif_fifo (notif_fifo, filepath, url);
-                            close (notif_fifo);
-                            notif_fifo = -1;
-                        }
+bool
+Manager::cancel_download (const string &fname, const dpp::snowflake &guild_id)
+{
+    if (!download_scheduler::cancel (fname, guild_id))
+        return false;
+
+    {
+        std::lock_guard lk (this->dl_m);
+        this->waiting_file_download.erase (fname);
+    }
+
+    this->dl_cv.notify_all ();
+
+    return true;
+}
+
+void
+Manager::prefetch_queue (std::shared_ptr<Player> guild_player)
+{
+    // queue front is the current track
+    const size_t end = std::min (get_download_prefetch_count () + 1,
+                                 guild_player->queue.size ());
+
+    for (size_t i = 1; i < end; i++)
+        {
+            const MCTrack &track = guild_player->queue.at (i);
+
+            if (track.filename.empty ()
+                || music_index::exists (track.filename))
+                continue;
 
-                    cc::send_command (exit_cmd);
+            this->download (track.filename, mctrack::get_url (track),
+                            guild_player->guild_id,
+                            i == 1 ? download_scheduler::PRIORITY_NEXT_UP
+                                   : download_scheduler::PRIORITY_PREFETCH);
+        }
+}
+
+void
+Manager::run_download (const string &fname, const string &url,
+                       const dpp::snowflake &guild_id)
+{
+    const string music_folder_path = get_music_folder_path ();
+
+    {
+        struct stat buf;
+        if (stat (music_folder_path.c_str (), &buf) != 0)
+            std::filesystem::create_directory (music_folder_path);
+    }
+
+    const string filepath = music_folder_path + fname;
+    const bool debug = get_debug_state ();
+    const string yt_dlp = get_ytdlp_exe ();
+
+    // always log these to "easily" spot problem in prod
+    fprintf (stderr,
+             "[Manager::download] Download: \"%s\" \"%s\" for guild %s\n",
+             fname.c_str (), url.c_str (), guild_id.str ().c_str ());
+
+    namespace cc = child::command;
+
+    const std::string qid = util::max_len (util::base64::encode (fname), 32);
+
+    const std::string child_cmd
+        = cc::create_arg_sanitize_value (cc::command_options_keys_t.id, qid)
+          + cc::create_arg (cc::command_options_keys_t.command,
+                            cc::command_execute_commands_t.dl_music)
+          + cc::create_arg_sanitize_value (
+              cc::command_options_keys_t.file_path, filepath)
+          + cc::create_arg_sanitize_value (
+              cc::command_options_keys_t.ytdlp_query, url)
+          + cc::create_arg_sanitize_value (
+              cc::command_options_keys_t.ytdlp_util_exe, yt_dlp)
+          + cc::create_arg (cc::command_options_keys_t.debug,
+                            debug ? "1" : "0");
+
+    const std::string exit_cmd = cc::get_exit_command (qid);
+
+    // send download command then wait until it exits
+    cc::send_command (child_cmd);
+    int status = child::command::wait_slave_ready (qid, 10);
+    if (status != 0)
+        {
+            fprintf (stderr,
+                     "[Manager::download ERROR] Error downloading '%s' "
+                     "to '%s' with code %d\n",
+                     url.c_str (), filepath.c_str (), status);
+        }
+    else
+        {
+            const std::string notif_fifo_path
+                = child::dl_music::get_download_music_fifo_path (qid);
+
+            int notif_fifo = open (notif_fifo_path.c_str (), O_RDONLY);
+
+            if (notif_fifo < 0)
+                fprintf (stderr,
+                         "[Manager::download ERROR] "
+                         "Failed to open notif_fifo: '%s'\n",
+                         notif_fifo_path.c_str ());
+            else
+                {
+                    status = read_notif_fifo (notif_fifo, filepath, url);
+                    close (notif_fifo);
+                    notif_fifo = -1;
                 }
 
-            {
-                std::lock_guard lk (this->dl_m);
-                this->waiting_file_download.erase (fname);
+            cc::send_command (exit_cmd);
+        }
 
-                // update newly downloaded file access time
-                bool utimeerr = false;
-                struct stat downloaded_stat;
-                struct utimbuf new_times;
+    {
+        std::lock_guard lk (this->dl_m);
+        this->waiting_file_download.erase (fname);
 
-                if (stat (filepath.c_str (), &downloaded_stat) == 0)
-                    {
-                        new_times.actime
-                            = time (NULL); /* set atime to current time */
-                        new_times.modtime
-                            = downloaded_stat
-                                  .st_mtime; /* keep mtime unchanged */
-                        if (utime (filepath.c_str (), &new_times) < 0)
-                            {
-                                perror (filepath.c_str ());
-                                utimeerr = true;
-                            }
-                    }
-                else
+        // update newly downloaded file access time
+        bool utimeerr = false;
+        struct stat downloaded_stat;
+        struct utimbuf new_times;
+
+        if (stat (filepath.c_str (), &downloaded_stat) == 0)
+            {
+                new_times.actime
+                    = time (NULL); /* set atime to current time */
+                new_times.modtime
+                    = downloaded_stat.st_mtime; /* keep mtime unchanged */
+                if (utime (filepath.c_str (), &new_times) < 0)
                     {
                         perror (filepath.c_str ());
                         utimeerr = true;
                     }
+            }
+        else
+            {
+                perror (filepath.c_str ());
+                utimeerr = true;
 
-                // if above access time update success
-                if (!utimeerr)
-                    // tells main loop to control music cache
-                    set_should_check_music_cache (true);
+                // played progressively before it failed
+                music_index::remove (fname);
             }
 
-            this->dl_cv.notify_all ();
+        // if above access time update success
+        if (!utimeerr)
+            {
+                music_index::add (fname, downloaded_stat.st_size,
+                                  new_times.actime);
 
-            // TODO: set status somewhere when needed?
-        },
-        fname, url, guild_id);
+                // tells main loop to control music cache
+                set_should_check_music_cache (true);
+            }
+    }
 
-    thread_manager::dispatch (tj);
+    this->dl_cv.notify_all ();
 }
 
 int
@@ -175,7 +175,7 @@ Manager::handle_on_track_marker (const dpp::voice_track_marker_t &event)
                 }
 
             if (!just_loaded_queue)
-                database::delete_guild_current_queue (
+                database::defer_delete_guild_current_queue (
                     event.voice_client->server_id);
 
             guild_player->current_track = MCTrack ();
@@ -192,8 +192,8 @@ Manager::handle_on_track_marker (const dpp::voice_track_marker_t &event)
     guild_player->stopped = false;
 
     if (!just_loaded_queue)
-        database::update_guild_current_queue (event.voice_client->server_id,
-                                              guild_player->queue);
+        database::defer_update_guild_current_queue (
+            event.voice_client->server_id, guild_player->queue);
 
     auto c = get_voice_from_gid (event.voice_client->server_id, sha_id);
 
@@ -591,7 +591,9 @@ Manager::spawn_handle_track_marker_worker (
             // guild
             dpp::guild *g = dpp::find_guild (guild_id);
 
-            this->wait_for_download (track.filename);
+            // start playing as soon as enough has been downloaded
+            const bool progressive
+                = this->wait_for_playable (track.filename);
 
             const string track_id = mctrack::get_id (track);
 
@@ -633,6 +635,9 @@ Manager::spawn_handle_track_marker_worker (
                         goto has_file;
                     }
 
+                if (progressive)
+                    goto has_file;
+
                 track_info_m
                     = embed_perms
                           ? '`' + mctrack::get_title (track) + "` (added by <@"
@@ -719,9 +724,9 @@ Manager::spawn_handle_track_marker_worker (
                 if (!is_downloading && !dont_retry)
                     {
                         // try redownload
-                        this->waiting_file_download[fname] = guild_id;
-                        this->download (fname, mctrack::get_url (track),
-                                        guild_id);
+                        this->download (
+                            fname, mctrack::get_url (track), guild_id,
+                            download_scheduler::PRIORITY_NOW_PLAYING);
 
                         std::thread dlt (
                             [this, guild_player, guild_id, fname,
@@ -752,6 +757,8 @@ Manager::spawn_handle_track_marker_worker (
             }
 
         has_file:
+            this->prefetch_queue (guild_player);
+
             set_track_failed_playback_count (track.filename, 0);
             // make sure it has no reset timer active in case it failed again
             timer::remove_failed_playback_reset_timer (track.filename);
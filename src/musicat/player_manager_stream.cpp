@@ -2,9 +2,11 @@
 #include "musicat/audio_processing.h"
 #include "musicat/child.h"
 #include "musicat/child/command.h"
+#include "musicat/child/dl_music.h"
 #include "musicat/config.h"
 #include "musicat/db.h"
 #include "musicat/mctrack.h"
+#include "musicat/music_index.h"
 #include "musicat/musicat.h"
 #include "musicat/player.h"
 #include <memory>
@@ -12,6 +14,7 @@
 #include <sys/poll.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 namespace musicat::player
 {
@@ -463,7 +466,7 @@ handle_effect_chain_change (handle_effect_chain_change_states_t &states)
         return;
 
     // update fx_states in db
-    database::update_guild_player_config (
+    database::defer_update_guild_player_config (
         states.guild_player->guild_id, NULL, NULL, NULL,
         states.guild_player->fx_states_to_json ());
 
@@ -579,24 +582,59 @@ Manager::stream (const dpp::snowflake &guild_id, player::MCTrack &track)
 
             FILE *ofile = fopen (file_path.c_str (), "r");
 
+            // still downloading, play what's been written so far
+            bool progressive = false;
+            bool downloading = false;
             if (!ofile)
                 {
+                    std::lock_guard lk (this->dl_m);
+                    downloading = this->is_waiting_file_download (fname);
+                }
+
+            if (downloading)
+                {
+                    const std::string partial_path
+                        = child::dl_music::get_partial_file_path (file_path);
+
+                    progressive = access (partial_path.c_str (), F_OK) == 0;
+
+                    // download might just completed and renamed it
+                    if (!progressive)
+                        ofile = fopen (file_path.c_str (), "r");
+                }
+
+            if (!ofile && !progressive)
+                {
+                    music_index::remove (fname);
                     std::filesystem::create_directory (music_folder_path);
                     throw 2;
                 }
 
-            struct stat ofile_stat;
-            if (fstat (fileno (ofile), &ofile_stat) != 0)
+            if (progressive)
                 {
+                    // size unknown until complete, disables byte based
+                    // position and seek
+                    track.filesize = 0;
+                }
+            else
+                {
+                    struct stat ofile_stat;
+                    if (fstat (fileno (ofile), &ofile_stat) != 0)
+                        {
+                            fclose (ofile);
+                            ofile = NULL;
+                            throw 2;
+                        }
+
                     fclose (ofile);
                     ofile = NULL;
-                    throw 2;
-                }
 
-            fclose (ofile);
-            ofile = NULL;
+                    track.filesize = ofile_stat.st_size;
+                }
 
-            track.filesize = ofile_stat.st_size;
+            // size is set by the download once complete when progressive
+            music_index::on_play (fname, track.filesize,
+                                  mctrack::get_duration (track));
 
             const std::string server_id_str = std::to_string (guild_id);
             const std::string slave_id = "processor-" + server_id_str + "."
@@ -615,6 +653,10 @@ Manager::stream (const dpp::snowflake &guild_id, player::MCTrack &track)
                     cmd += cc::command_options_keys_t.debug + "=1;";
                 }
 
+            if (progressive)
+                cmd += cc::create_arg (cc::command_options_keys_t.progressive,
+                                       "1");
+
             cmd += cc::command_options_keys_t.file_path + '='
                    + cc::sanitize_command_value (file_path) + ';'
 
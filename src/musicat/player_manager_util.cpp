@@ -1,19 +1,28 @@
 #include "musicat/YTDLPTrack.h"
+#include "musicat/child/dl_music.h"
 #include "musicat/db.h"
 #include "musicat/mctrack.h"
+#include "musicat/music_index.h"
 #include "musicat/musicat.h"
 #include "musicat/player.h"
 #include "musicat/player_manager_timer.h"
+#include "musicat/search-cache.h"
+#include "musicat/spotify_resolver.h"
 #include "musicat/thread_manager.h"
 #include "musicat/util.h"
 #include "musicat/util/spotify_api.h"
 #include "musicat/util_response.h"
-#include <dirent.h>
+#include <atomic>
+#include <cerrno>
 #include <libpq-fe.h>
 #include <regex>
 #include <sys/stat.h>
 
-/* #define USE_SEARCH_CACHE */
+#define USE_SEARCH_CACHE
+
+// files unlinked per batch before in use files are collected again
+#define EVICTION_BATCH_SIZE 16
+#define EVICTION_BATCH_INTERVAL_MS 100
 
 namespace musicat
 {
@@ -21,164 +30,113 @@ namespace player
 {
 using string = std::string;
 
-enum gat_cache_completeness_e
-{
-    GATCC_NONE = 0,
-    GATCC_ZERO_AMOUNT = 1,
-    GATCC_HAS_STAT = 1 << 1,
-};
-
-std::mutex gat_m;
-std::vector<gat_t> gat_ret_cache;
-time_t gat_last_uc = 0;
-int gat_cache_completeness = 0;
-
-// returns true if gat_cache_completeness is missing flag
-// and required by rc
-bool
-gatcc_rnot (int rc, int flag)
-{
-    return (rc & flag) == flag && (gat_cache_completeness & flag) != flag;
-}
-
-bool
-gatcc_is_complete ()
-{
-    constexpr const int complete_f = GATCC_ZERO_AMOUNT | GATCC_HAS_STAT;
-    return (gat_cache_completeness & complete_f) == complete_f;
-}
-
-bool
-gatcc_rnot_zero_amount (int rc)
-{
-    return gatcc_rnot (rc, GATCC_ZERO_AMOUNT);
-}
-
-bool
-gatcc_rnot_has_stat (int rc)
-{
-    return gatcc_rnot (rc, GATCC_HAS_STAT);
-}
-
-void
-invalidate_track_list_cache ()
-{
-    std::lock_guard lk (gat_m);
-    gat_last_uc = 0;
-}
-
 std::vector<gat_t>
-get_available_tracks (const size_t &amount, bool with_stat)
+get_available_tracks (const size_t &amount)
 {
-    std::lock_guard lk (gat_m);
-
-    int required_completeness = 0;
+    const std::string musicdir = get_music_folder_path ();
+    const std::vector<music_index::entry_t> entries
+        = music_index::list (amount);
 
-    if (amount == 0)
-        {
-            required_completeness |= GATCC_ZERO_AMOUNT;
-        }
+    std::vector<gat_t> ret;
+    ret.reserve (entries.size ());
 
-    if (with_stat)
+    for (const music_index::entry_t &e : entries)
         {
-            required_completeness |= GATCC_HAS_STAT;
+            ret.push_back ({ e.filename.substr (0, e.filename.length () - 5),
+                             e.filename, musicdir + e.filename, e.size,
+                             e.atime });
         }
 
-    time_t cur_t = time (NULL);
-
-    // cache last updated was less than 11 second ago
-    if ((cur_t - gat_last_uc) < 11)
-        {
-            // check for cache completeness
-            bool is_sufficient = true;
-
-            if (!gatcc_is_complete ())
-                is_sufficient
-                    = !gatcc_rnot_zero_amount (required_completeness)
-                      && !gatcc_rnot_has_stat (required_completeness);
+    return ret;
+}
 
-            // returns cache if sufficient
-            if (is_sufficient)
-                return gat_ret_cache;
-        }
+// only one eviction thread at a time
+static std::atomic<bool> evicting = false;
 
-    std::vector<gat_t> ret = {};
+static void
+evict_music_cache (const size_t size_limit)
+{
     const std::string musicdir = get_music_folder_path ();
+    const size_t prev_cache_size = music_index::get_total_size ();
+    size_t rc = 0;
 
-    size_t c = 0;
-    DIR *dir = opendir (musicdir.c_str ());
+    // files failed to unlink, don't pick them again
+    std::unordered_set<std::string> failed;
 
-    if (dir == NULL)
-        return ret;
+    while (get_running_state ()
+           && music_index::get_total_size () > size_limit)
+        {
+            auto player_manager = get_player_manager_ptr ();
 
-    dirent *file = readdir (dir);
+            // refreshed every batch as queues keep changing
+            std::unordered_set<std::string> skip
+                = player_manager ? player_manager->get_in_use_files ()
+                                 : std::unordered_set<std::string>{};
 
-    // full filename
-    string s;
-    // full file path
-    string fpath;
-    size_t slen;
-    size_t opus_ext_idx;
-    // while also getting size why not get last access too
-    time_t last_access = 0;
-    size_t siz = 0;
+            skip.insert (failed.begin (), failed.end ());
 
-    while (file != NULL)
-        {
-            last_access = 0;
-            siz = 0;
+            const auto candidates = music_index::get_eviction_candidates (
+                EVICTION_BATCH_SIZE, skip);
 
-            // skip non regular file (dir, fifo etc)
-            if (file->d_type != DT_REG)
-                goto cont;
-
-            s = string (file->d_name);
+            if (candidates.empty ())
+                {
+                    fprintf (stderr,
+                             "[player::evict_music_cache WARN] Every cached "
+                             "music is in use, can't go under %zu bytes\n",
+                             size_limit);
+                    break;
+                }
 
-            slen = s.length ();
-            opus_ext_idx = slen > 5 ? (slen - 5) : (size_t)-1;
+            for (const music_index::entry_t &e : candidates)
+                {
+                    if (music_index::get_total_size () <= size_limit)
+                        break;
 
-            // skip non opus file
-            if (opus_ext_idx == (size_t)-1 || s.find (".opus") != opus_ext_idx)
-                goto cont;
+                    const std::string fullpath = musicdir + e.filename;
 
-            fpath = musicdir + s;
+                    fprintf (stderr,
+                             "[player::evict_music_cache] "
+                             "Unlinking '%s'\n",
+                             fullpath.c_str ());
 
-            if (with_stat)
-                {
-                    struct stat st;
-                    // musicdir always have trailing slash /
-                    if (stat (fpath.c_str (), &st) != 0)
+                    if (unlink (fullpath.c_str ()) == 0)
                         {
-                            perror ("[Manager::get_available_"
-                                    "tracks] stat");
-
-                            fprintf (stderr, "^^^ Failed stating '%s'\n",
-                                     fpath.c_str ());
+                            music_index::evict (e.filename);
+                            rc++;
+                            continue;
+                        }
 
-                            goto sk_stat;
+                    // already gone, stale entry
+                    if (errno == ENOENT)
+                        {
+                            music_index::remove (e.filename);
+                            continue;
                         }
 
-                    siz = st.st_size;
-                    last_access = st.st_atime;
-                }
-        sk_stat:
-            ret.push_back (
-                { s.substr (0, opus_ext_idx), s, fpath, siz, last_access });
+                    perror ("[player::evict_music_cache] unlink");
+                    fprintf (stderr,
+                             "^^^ Failed unlink "
+                             "'%s'\n",
+                             fullpath.c_str ());
 
-            if (amount && ++c == amount)
-                break;
+                    failed.insert (e.filename);
+                }
 
-        cont:
-            file = readdir (dir);
+            // leave disk alone for a bit between batches
+            std::this_thread::sleep_for (
+                std::chrono::milliseconds (EVICTION_BATCH_INTERVAL_MS));
         }
 
-    closedir (dir);
-
-    gat_ret_cache = ret;
-    gat_last_uc = cur_t;
-    gat_cache_completeness = required_completeness;
+    const size_t cur_cache_size = music_index::get_total_size ();
 
-    return ret;
+    fprintf (stderr,
+             "[player::evict_music_cache] Cleaned up %zu "
+             "music files and %zu bytes worth "
+             "of storage space\n",
+             rc,
+             prev_cache_size > cur_cache_size
+                 ? prev_cache_size - cur_cache_size
+                 : 0);
 }
 
 void
@@ -187,71 +145,35 @@ control_music_cache (const size_t size_limit)
     if (size_limit == 0)
         return;
 
-    size_t cur_cache_size = 0;
-    auto ats = get_available_tracks (0, true);
-
-    for (const gat_t &g : ats)
-        cur_cache_size += g.size;
+    const size_t cur_cache_size = music_index::get_total_size ();
 
     fprintf (stderr,
-             "[main::loop] Current cached music: %ld "
-             "files (%ld bytes)\n",
-             ats.size (), cur_cache_size);
+             "[main::loop] Current cached music: %zu "
+             "files (%zu bytes)\n",
+             music_index::get_count (), cur_cache_size);
 
     if (cur_cache_size <= size_limit)
         // current cached music size does not go over limit
         return;
 
-    // currect cached music is over the limit defined
-    // in conf
+    if (evicting.exchange (true))
+        return;
 
     fprintf (stderr,
              "[main::loop] Current cached music "
-             "size goes over %ld bytes limit, "
-             "cleaning old music...\n",
+             "size goes over %zu bytes limit, "
+             "cleaning least valuable music...\n",
              size_limit);
 
-    // sort by oldest first
-    std::sort (ats.begin (), ats.end (), [] (const gat_t &a, const gat_t &b) {
-        return a.last_access < b.last_access;
-    });
-
-    size_t prev_cache_size = cur_cache_size;
-    size_t rc = 0;
-
-    // delete everything until size is less
-    // than limit
-    for (const gat_t &g : ats)
-        {
-            if (cur_cache_size < size_limit)
-                break;
-
-            fprintf (stderr,
-                     "[main::loop] "
-                     "Unlinking '%s'\n",
-                     g.fullpath.c_str ());
-
-            if (unlink (g.fullpath.c_str ()) == 0)
-                {
-                    cur_cache_size -= g.size;
-                    rc++;
-                    continue;
-                }
+    std::thread t ([size_limit] () {
+        thread_manager::DoneSetter tmds;
 
-            perror ("[main::loop] unlink");
-            fprintf (stderr,
-                     "^^^ Failed unlink "
-                     "'%s'\n",
-                     g.fullpath.c_str ());
-        }
+        evict_music_cache (size_limit);
 
-    fprintf (stderr,
-             "[main::loop] Cleaned up %ld "
-             "music files and %ld bytes worth "
-             "of storage space\n",
-             rc, prev_cache_size - cur_cache_size);
+        evicting = false;
+    });
 
-    invalidate_track_list_cache ();
+    thread_manager::dispatch (t);
 }
 
 // ================================================================================
@@ -374,26 +296,24 @@ find_track (const bool playlist, const std::string &arg_query,
 
     // prioritize cache over searching
     std::vector<player::MCTrack> searches;
+    // shared cached results, used instead of searches when found
+    search_cache::value_t cached = nullptr;
+    bool searched = false;
 
 #ifdef USE_YTSEARCH_H
     yt_search::YSearchResult search_result = {};
     yt_search::YPlaylist playlist_result = {};
 
 #ifdef USE_SEARCH_CACHE
+    // read in place below, never copied into searches
     if (has_cache_id)
-        searches = search_cache::get (cache_id);
+        cached = search_cache::get (cache_id);
 #endif
 
-    size_t searches_size = has_cache_id ? searches.size () : 0;
-
-    // quick decide to remove when no result found instead of looking up in the
-    // cache map
-    size_t cached_size = has_cache_id ? searches_size : 0;
-
-    bool searched = false;
+    size_t searches_size = 0;
 
     // cache not found or no cache Id provided, lets search
-    if (!searches_size)
+    if (!cached)
         {
             try
                 {
@@ -465,56 +385,51 @@ find_track (const bool playlist, const std::string &arg_query,
     searches_size = searches.size ();
 
 #else
+#ifdef USE_SEARCH_CACHE
+    // autoplay keeps picking from the same radio playlist
+    if (has_cache_id)
+        cached = search_cache::get (cache_id);
+#endif
+
     // use mctrack::fetch
     // playlist true means autoplay request, which is always a playlist url
     // query
-    if (is_spotify)
+    if (!cached && is_spotify)
         {
             if (debug)
                 fprintf (stderr, "[find_track] Spotify query: %s\n",
                          trimmed_query.c_str ());
 
-            auto sp_tracks
-                = spotify_api::fetch_tracks (trimmed_query, sp_id, sp_secret);
-
-            for (const auto &t : sp_tracks)
-                {
-                    std::string q = t.artist + " " + t.title;
-
-                    nlohmann::json res
-                        = mctrack::fetch ( { q, 1, false } );
-
-                    if (res.is_null ())
-                        continue;
-
-                    auto entries = YTDLPTrack::get_playlist_entries (res);
-                    if (!entries.empty ())
-                        searches.push_back (entries.front ());
-                }
+            searches = spotify_resolver::resolve (trimmed_query, sp_id,
+                                                  sp_secret);
         }
-    else
+    else if (!cached)
         {
-            nlohmann::json res
-                = mctrack::fetch ( { trimmed_query, YDLP_DEFAULT_MAX_ENTRIES,
-                                     playlist } );
+            auto res = mctrack::fetch (
+                { trimmed_query, YDLP_DEFAULT_MAX_ENTRIES, playlist });
 
-            if (res.is_null ())
+            if (!res)
                 return { {}, 2 };
 
-            searches = YTDLPTrack::get_playlist_entries (res);
+            searches = YTDLPTrack::get_playlist_entries (*res);
         }
 
+    searched = !cached;
+
 #endif
 
 #ifdef USE_SEARCH_CACHE
     // indicate if this cache is updated
-    bool update_cache = searched && has_cache_id && searches_size;
+    const bool update_cache = searched && has_cache_id && !searches.empty ();
     // save the result to cache
     if (update_cache)
-        search_cache::set (cache_id, searches);
+        cached = search_cache::set (cache_id, std::move (searches));
 #endif
 
-    if (searches.begin () == searches.end ())
+    // read only from here, either cached or freshly searched
+    const std::vector<player::MCTrack> &results = cached ? *cached : searches;
+
+    if (results.empty ())
         {
             if (debug && is_spotify)
                 fprintf (stderr,
@@ -527,13 +442,13 @@ find_track (const bool playlist, const std::string &arg_query,
     player::MCTrack result = {};
     if (playlist == false || no_check_history)
         // play the first result according to user query
-        result = searches.front ();
+        result = results.front ();
     else if (!no_check_history)
         {
             size_t gphs = guild_player->history.size ();
 
             // find entry that wasn't played before
-            for (const auto &i : searches)
+            for (const auto &i : results)
                 {
                     auto iid = mctrack::get_id (i);
                     bool br = false;
@@ -575,19 +490,22 @@ find_track (const bool playlist, const std::string &arg_query,
                 {
 #ifdef USE_SEARCH_CACHE
                     // invalidate cache if Id provided
-                    if (has_cache_id && cached_size)
-                        search_cache::remove (cache_id);
+                    if (has_cache_id && cached)
+                        {
+                            search_cache::remove (cache_id);
+
+                            // every cached entry was played already, the
+                            // list might have new ones now so search again
+                            if (!searched)
+                                return find_track (playlist, arg_query,
+                                                   player_manager, guild_id,
+                                                   no_check_history, cache_id);
+                        }
 #endif
                     return { {}, 1 };
                 }
         }
 
-#ifdef USE_SEARCH_CACHE
-    // save cache with key result id if update_cache is false
-    if (!update_cache && !result.raw.is_null ())
-        search_cache::set (result.id (), searches);
-#endif
-
     return { result, 0 };
 }
 
@@ -611,7 +529,8 @@ get_filename_from_result (player::MCTrack &result)
 std::pair<bool, int>
 track_exist (const std::string &fname, const std::string &url,
              player::player_manager_ptr_t player_manager,
-             bool from_interaction, dpp::snowflake guild_id, bool no_download)
+             bool from_interaction, dpp::snowflake guild_id, bool no_download,
+             download_scheduler::priority_e priority)
 {
     if (fname.empty ())
         return { false, 2 };
@@ -628,12 +547,9 @@ track_exist (const std::string &fname, const std::string &url,
             if (from_interaction)
                 status = 1;
 
-            if (!no_download
-                && player_manager->waiting_file_download.find (fname)
-                       == player_manager->waiting_file_download.end ())
-                {
-                    player_manager->download (fname, url, guild_id);
-                }
+            // already scheduled download only gets its priority raised
+            if (!no_download)
+                player_manager->download (fname, url, guild_id, priority);
         }
     else
         {
@@ -715,8 +631,22 @@ add_track (bool playlist, dpp::snowflake guild_id, std::string arg_query,
 
         const auto result_url = mctrack::get_url (result);
 
-        auto download_result = track_exist (fname, result_url, player_manager,
-                                            from_interaction, guild_id);
+        download_scheduler::priority_e dl_priority
+            = download_scheduler::PRIORITY_QUEUED;
+
+        {
+            auto guild_player = player_manager->get_player (guild_id);
+
+            // nothing is playing, this will be played right away
+            if (!guild_player || guild_player->queue.empty ())
+                dl_priority = download_scheduler::PRIORITY_NOW_PLAYING;
+            else if (arg_top || arg_slip == 1)
+                dl_priority = download_scheduler::PRIORITY_NEXT_UP;
+        }
+
+        auto download_result
+            = track_exist (fname, result_url, player_manager, from_interaction,
+                           guild_id, false, dl_priority);
         bool dling = download_result.first;
 
         switch (download_result.second)
@@ -1247,6 +1177,51 @@ Manager::is_waiting_file_download (const string &file_name)
            != this->waiting_file_download.end ();
 }
 
+std::unordered_set<std::string>
+Manager::get_in_use_files ()
+{
+    std::unordered_set<std::string> ret;
+    std::vector<std::shared_ptr<Player> > guild_players;
+
+    {
+        std::lock_guard lk (this->ps_m);
+
+        guild_players.reserve (this->players.size ());
+        for (const auto &i : this->players)
+            guild_players.push_back (i.second);
+    }
+
+    for (const auto &guild_player : guild_players)
+        {
+            std::lock_guard lk (guild_player->t_mutex);
+
+            if (!guild_player->current_track.filename.empty ())
+                ret.insert (guild_player->current_track.filename);
+
+            for (const auto &t : guild_player->queue)
+                {
+                    if (!t.filename.empty ())
+                        ret.insert (t.filename);
+                }
+        }
+
+    {
+        std::lock_guard lk (this->wd_m);
+
+        for (const auto &i : this->waiting_vc_ready)
+            ret.insert (i.second);
+    }
+
+    {
+        std::lock_guard lk (this->dl_m);
+
+        for (const auto &i : this->waiting_file_download)
+            ret.insert (i.first);
+    }
+
+    return ret;
+}
+
 void
 Manager::wait_for_download (const string &file_name)
 {
@@ -1261,6 +1236,28 @@ Manager::wait_for_download (const string &file_name)
     });
 }
 
+bool
+Manager::wait_for_playable (const string &file_name)
+{
+    const string partial_path = child::dl_music::get_partial_file_path (
+        get_music_folder_path () + file_name);
+
+    std::unique_lock lk (this->dl_m);
+
+    while (this->is_waiting_file_download (file_name))
+        {
+            struct stat st;
+            if (stat (partial_path.c_str (), &st) == 0
+                && st.st_size >= child::dl_music::PROGRESSIVE_MIN_SIZE)
+                return true;
+
+            // partial file growth isn't notified, poll it
+            this->dl_cv.wait_for (lk, std::chrono::milliseconds (250));
+        }
+
+    return false;
+}
+
 bool
 Manager::set_info_message_as_deleted (dpp::snowflake id)
 {
@@ -1328,14 +1325,25 @@ Manager::load_guild_current_queue (const dpp::snowflake &guild_id,
 
     player->saved_queue_loaded = true;
 
-    std::pair<PGresult *, ExecStatusType> res
-        = database::get_guild_current_queue (guild_id);
+    std::pair<std::deque<MCTrack>, int> queue;
 
-    std::pair<std::deque<MCTrack>, int> queue
-        = database::get_playlist_from_PGresult (res.first);
+    // read ahead on boot, no query needed
+    const int preloaded
+        = database::take_preloaded_guild_current_queue (guild_id, queue.first);
 
-    database::finish_res (res.first);
-    res.first = nullptr;
+    if (preloaded == 1)
+        return -2;
+
+    if (preloaded != 0)
+        {
+            std::pair<PGresult *, ExecStatusType> res
+                = database::get_guild_current_queue (guild_id);
+
+            queue = database::get_playlist_from_PGresult (res.first);
+
+            database::finish_res (res.first);
+            res.first = nullptr;
+        }
 
     if (queue.second != 0)
         return queue.second;
@@ -1360,14 +1368,22 @@ Manager::load_guild_player_config (const dpp::snowflake &guild_id)
 
     player->saved_config_loaded = true;
 
-    std::pair<PGresult *, ExecStatusType> res
-        = database::get_guild_player_config (guild_id);
+    std::pair<database::player_config, int> conf;
 
-    std::pair<database::player_config, int> conf
-        = database::parse_guild_player_config_PGresult (res.first);
+    // read ahead on boot, no query needed
+    conf.second
+        = database::take_preloaded_guild_player_config (guild_id, conf.first);
 
-    database::finish_res (res.first);
-    res.first = nullptr;
+    if (conf.second < 0)
+        {
+            std::pair<PGresult *, ExecStatusType> res
+                = database::get_guild_player_config (guild_id);
+
+            conf = database::parse_guild_player_config_PGresult (res.first);
+
+            database::finish_res (res.first);
+            res.first = nullptr;
+        }
 
     if (conf.second != 0)
         return conf.second;
@@ -0,0 +1,399 @@
+#include "musicat/resolver_cache.h"
+#include "musicat/musicat.h"
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#define CACHE_FILENAME ".musicat_resolver_cache"
+#define CACHE_HEADER "musicat_resolver_cache"
+#define CACHE_VERSION 1
+
+// a full search result is usually a few KiB
+#define MAX_SIZE (32 * 1024 * 1024)
+// rough per entry bookkeeping cost on top of key and value
+#define ENTRY_OVERHEAD 128
+#define SAVE_INTERVAL_S 300
+
+namespace musicat::resolver_cache
+{
+
+struct entry_t
+{
+    // shared so get can hand it out without holding the lock or copying
+    std::shared_ptr<const nlohmann::json> result;
+    // serialized result, reused when persisting
+    std::string raw;
+    size_t size;
+    long long fetched_at;
+    long long fresh_until;
+    std::list<std::string>::iterator lru_i;
+};
+
+static std::mutex _m;
+static std::unordered_map<std::string, entry_t> _entries;
+// most recently used at front
+static std::list<std::string> _lru;
+static size_t _size = 0;
+static std::unordered_set<std::string> _refreshing;
+static bool _dirty = false;
+static time_t _last_save = 0;
+
+static std::atomic<uint64_t> _hits = 0;
+static std::atomic<uint64_t> _stale_hits = 0;
+static std::atomic<uint64_t> _misses = 0;
+static std::atomic<uint64_t> _evictions = 0;
+
+// only one save can write the file at a time
+static std::mutex _save_m;
+
+static std::string
+_get_cache_path (const std::string &music_folder_path)
+{
+    return music_folder_path + CACHE_FILENAME;
+}
+
+// _m must be locked
+static void
+_erase (std::unordered_map<std::string, entry_t>::iterator i)
+{
+    _size -= i->second.size;
+    _lru.erase (i->second.lru_i);
+    _entries.erase (i);
+    _dirty = true;
+}
+
+// _m must be locked
+static void
+_evict ()
+{
+    while (_size > MAX_SIZE && !_lru.empty ())
+        {
+            _erase (_entries.find (_lru.back ()));
+            _evictions++;
+        }
+}
+
+// _m must be locked, `back` inserts as least recently used
+static void
+_insert (const std::string &key, std::string raw,
+         std::shared_ptr<const nlohmann::json> result, long long fetched_at,
+         long long fresh_until, bool back)
+{
+    auto old = _entries.find (key);
+    if (old != _entries.end ())
+        _erase (old);
+
+    const size_t size = key.length () + raw.length () + ENTRY_OVERHEAD;
+
+    auto lru_i = back ? _lru.insert (_lru.end (), key)
+                      : _lru.insert (_lru.begin (), key);
+
+    _entries.emplace (key, entry_t{ std::move (result), std::move (raw), size,
+                                    fetched_at, fresh_until, lru_i });
+    _size += size;
+    _dirty = true;
+
+    _evict ();
+}
+
+std::string
+create_key (const std::string &query, int max_entries, bool is_url)
+{
+    std::string key;
+    key.reserve (query.length () + 8);
+
+    if (is_url)
+        key = query;
+    else
+        {
+            // lowercase and collapse whitespace
+            bool space = true;
+            for (const char c : query)
+                {
+                    if (std::isspace ((unsigned char)c))
+                        {
+                            space = true;
+                            continue;
+                        }
+
+                    if (space && !key.empty ())
+                        key += ' ';
+
+                    space = false;
+                    key += (char)std::tolower ((unsigned char)c);
+                }
+        }
+
+    // tab never appears in key, used as persisted field separator
+    for (char &c : key)
+        if (c == '\t' || c == '\n')
+            c = ' ';
+
+    key += ' ';
+    key += std::to_string (max_entries);
+
+    return key;
+}
+
+std::shared_ptr<const nlohmann::json>
+get (const std::string &key, bool &stale)
+{
+    std::shared_ptr<const nlohmann::json> cached;
+
+    {
+        std::lock_guard lk (_m);
+
+        auto i = _entries.find (key);
+        if (i == _entries.end ())
+            {
+                _misses++;
+                return nullptr;
+            }
+
+        const long long now = time (NULL);
+
+        if (now > i->second.fresh_until + STALE_TTL)
+            {
+                _erase (i);
+                _misses++;
+                return nullptr;
+            }
+
+        stale = now > i->second.fresh_until;
+
+        _lru.splice (_lru.begin (), _lru, i->second.lru_i);
+        cached = i->second.result;
+    }
+
+    if (stale)
+        _stale_hits++;
+    else
+        _hits++;
+
+    return cached;
+}
+
+void
+set (const std::string &key, std::shared_ptr<const nlohmann::json> result,
+     long long fresh_ttl)
+{
+    if (!result)
+        return;
+
+    std::string raw = result->dump ();
+
+    const long long now = time (NULL);
+
+    std::lock_guard lk (_m);
+
+    _insert (key, std::move (raw), std::move (result), now, now + fresh_ttl,
+             false);
+}
+
+bool
+begin_refresh (const std::string &key)
+{
+    std::lock_guard lk (_m);
+
+    return _refreshing.insert (key).second;
+}
+
+void
+end_refresh (const std::string &key)
+{
+    std::lock_guard lk (_m);
+
+    _refreshing.erase (key);
+}
+
+int
+load ()
+{
+    const std::string music_folder_path = get_music_folder_path ();
+    if (music_folder_path.empty ())
+        return 1;
+
+    const std::string cache_path = _get_cache_path (music_folder_path);
+
+    std::ifstream ifs (cache_path);
+    if (!ifs.is_open ())
+        {
+            // no file yet is fine, anything else means it's unreadable
+            if (errno == ENOENT)
+                return 0;
+
+            perror ("[resolver_cache::load ERROR]");
+            fprintf (stderr, "^^^ Failed opening '%s'\n",
+                     cache_path.c_str ());
+            return -1;
+        }
+
+    std::string line;
+    std::getline (ifs, line);
+
+    int version = 0;
+    if (sscanf (line.c_str (), CACHE_HEADER " %d", &version) != 1
+        || version != CACHE_VERSION)
+        {
+            fprintf (stderr, "[resolver_cache::load WARN] Unknown cache "
+                             "format, ignoring it\n");
+            return 0;
+        }
+
+    const long long now = time (NULL);
+    size_t loaded = 0, malformed = 0;
+
+    std::lock_guard lk (_m);
+
+    // "<fetched_at>\t<fresh_until>\t<key>\t<json>", most recently used first
+    while (std::getline (ifs, line))
+        {
+            const size_t t1 = line.find ('\t');
+            const size_t t2 = t1 == std::string::npos
+                                  ? t1
+                                  : line.find ('\t', t1 + 1);
+            const size_t t3 = t2 == std::string::npos
+                                  ? t2
+                                  : line.find ('\t', t2 + 1);
+
+            if (t3 == std::string::npos)
+                {
+                    malformed++;
+                    continue;
+                }
+
+            long long fetched_at, fresh_until;
+            if (sscanf (line.c_str (), "%lld\t%lld", &fetched_at,
+                        &fresh_until)
+                != 2)
+                {
+                    malformed++;
+                    continue;
+                }
+
+            if (now > fresh_until + STALE_TTL)
+                continue;
+
+            std::string raw = line.substr (t3 + 1);
+            std::shared_ptr<const nlohmann::json> result;
+
+            try
+                {
+                    result = std::make_shared<const nlohmann::json> (
+                        nlohmann::json::parse (raw));
+                }
+            catch (const nlohmann::detail::parse_error &)
+                {
+                    malformed++;
+                    continue;
+                }
+
+            _insert (line.substr (t2 + 1, t3 - t2 - 1), std::move (raw),
+                     std::move (result), fetched_at, fresh_until, true);
+            loaded++;
+        }
+
+    _dirty = false;
+    _last_save = now;
+
+    if (malformed)
+        fprintf (stderr,
+                 "[resolver_cache::load WARN] Skipped %zu malformed "
+                 "entries\n",
+                 malformed);
+
+    if (get_debug_state ())
+        fprintf (stderr, "[resolver_cache::load] Loaded %zu entries\n",
+                 loaded);
+
+    return 0;
+}
+
+int
+save (bool force)
+{
+    const std::string music_folder_path = get_music_folder_path ();
+    if (music_folder_path.empty ())
+        return 0;
+
+    std::lock_guard slk (_save_m);
+
+    std::string content;
+
+    {
+        std::lock_guard lk (_m);
+
+        const time_t now = time (NULL);
+
+        if (!_dirty || (!force && now - _last_save < SAVE_INTERVAL_S))
+            return 0;
+
+        content.reserve (_size);
+        content += CACHE_HEADER " " + std::to_string (CACHE_VERSION) + '\n';
+
+        for (const std::string &key : _lru)
+            {
+                const entry_t &e = _entries.find (key)->second;
+
+                content += std::to_string (e.fetched_at) + '\t'
+                           + std::to_string (e.fresh_until) + '\t' + key
+                           + '\t';
+                content += e.raw;
+                content += '\n';
+            }
+
+        _dirty = false;
+        _last_save = now;
+    }
+
+    const std::string cache_path = _get_cache_path (music_folder_path);
+    const std::string tmp_path = cache_path + ".tmp";
+
+    FILE *f = fopen (tmp_path.c_str (), "w");
+    bool failed = f == NULL;
+
+    if (!failed)
+        {
+            failed = fwrite (content.data (), 1, content.size (), f)
+                     != content.size ();
+            failed = (fclose (f) != 0) || failed;
+        }
+
+    if (!failed)
+        failed = rename (tmp_path.c_str (), cache_path.c_str ()) != 0;
+
+    if (failed)
+        {
+            perror ("[resolver_cache::save ERROR]");
+            fprintf (stderr, "^^^ Failed writing '%s'\n", cache_path.c_str ());
+
+            unlink (tmp_path.c_str ());
+
+            std::lock_guard lk (_m);
+            _dirty = true;
+
+            return -1;
+        }
+
+    return 0;
+}
+
+stats_t
+get_stats ()
+{
+    std::lock_guard lk (_m);
+
+    return { _hits,          _stale_hits, _misses, _evictions,
+             _entries.size (), _size,     MAX_SIZE };
+}
+
+} // musicat::resolver_cache
@@ -8,12 +8,18 @@
 #include "musicat/eliza.h"
 #include "musicat/events.h"
 #include "musicat/function_macros.h"
+#include "musicat/music_index.h"
+#include "musicat/music_watcher.h"
 #include "musicat/musicat.h"
 #include "musicat/pagination.h"
 #include "musicat/player_manager_timer.h"
+#include "musicat/resolver_cache.h"
 #include "musicat/runtime_cli.h"
+#include "musicat/search-cache.h"
 #include "musicat/server.h"
 #include "musicat/thread_manager.h"
+#include "musicat/util/http.h"
+#include "musicat/ytdlp_resolver.h"
 #include <cstdint>
 #include <sys/wait.h>
 
@@ -59,6 +65,13 @@ std::vector<std::string> cors_enabled_origin = {};
 std::vector<dpp::snowflake> musicat_admins = {};
 
 size_t max_music_cache_size = -1;
+size_t max_service_cache_size = -1;
+int64_t max_concurrent_downloads = -1;
+size_t max_search_cache_size = -1;
+int search_cache_snapshot = -1;
+int64_t download_prefetch_count = -1;
+int64_t db_pool_size = -1;
+int64_t db_slow_query_ms = -1;
 
 // main loop usage only
 std::atomic<bool> should_check_music_cache = true;
@@ -110,6 +123,12 @@ get_sha_db_params ()
     return get_config_value<std::string> ("SHA_DB", "");
 }
 
+std::string
+get_sha_db_local_path ()
+{
+    return get_config_value<std::string> ("SHA_DB_LOCAL", "");
+}
+
 bool
 get_sha_runtime_cli_opt ()
 {
@@ -592,6 +611,115 @@ get_max_music_cache_size ()
     return max_music_cache_size;
 }
 
+size_t
+get_max_service_cache_size ()
+{
+    std::lock_guard lk (main_mutex);
+
+    if (max_service_cache_size == (size_t)-1)
+        {
+            // 64 MiB
+            size_t set_v = get_config_value<size_t> ("MAX_SERVICE_CACHE_SIZE",
+                                                     (size_t)67108864);
+
+            max_service_cache_size = set_v;
+        }
+
+    return max_service_cache_size;
+}
+
+size_t
+get_max_concurrent_downloads ()
+{
+    std::lock_guard lk (main_mutex);
+
+    if (max_concurrent_downloads == -1)
+        {
+            int64_t set_v
+                = get_config_value<int64_t> ("MAX_CONCURRENT_DOWNLOADS", 2);
+
+            max_concurrent_downloads = set_v < 1 ? 1 : set_v;
+        }
+
+    return (size_t)max_concurrent_downloads;
+}
+
+size_t
+get_db_pool_size ()
+{
+    std::lock_guard lk (main_mutex);
+
+    if (db_pool_size == -1)
+        {
+            int64_t set_v = get_config_value<int64_t> ("SHA_DB_POOL_SIZE", 4);
+
+            db_pool_size = set_v < 1 ? 1 : set_v;
+        }
+
+    return (size_t)db_pool_size;
+}
+
+uint64_t
+get_db_slow_query_ms ()
+{
+    std::lock_guard lk (main_mutex);
+
+    if (db_slow_query_ms == -1)
+        {
+            int64_t set_v
+                = get_config_value<int64_t> ("SHA_DB_SLOW_QUERY_MS", 500);
+
+            db_slow_query_ms = set_v < 0 ? 0 : set_v;
+        }
+
+    return (uint64_t)db_slow_query_ms;
+}
+
+size_t
+get_download_prefetch_count ()
+{
+    std::lock_guard lk (main_mutex);
+
+    if (download_prefetch_count == -1)
+        {
+            int64_t set_v
+                = get_config_value<int64_t> ("DOWNLOAD_PREFETCH_COUNT", 3);
+
+            download_prefetch_count = set_v < 0 ? 0 : set_v;
+        }
+
+    return (size_t)download_prefetch_count;
+}
+
+size_t
+get_max_search_cache_size ()
+{
+    std::lock_guard lk (main_mutex);
+
+    if (max_search_cache_size == (size_t)-1)
+        {
+            // 16 MiB
+            size_t set_v = get_config_value<size_t> ("MAX_SEARCH_CACHE_SIZE",
+                                                     (size_t)16777216);
+
+            max_search_cache_size = set_v;
+        }
+
+    return max_search_cache_size;
+}
+
+bool
+get_search_cache_snapshot ()
+{
+    std::lock_guard lk (main_mutex);
+
+    if (search_cache_snapshot == -1)
+        search_cache_snapshot
+            = get_config_value<bool> ("SEARCH_CACHE_SNAPSHOT", false) ? 1 : 0;
+
+    return search_cache_snapshot == 1;
+}
+
 // ================================================================================
 
 std::atomic<int> _sigint_count = 0;
@@ -716,18 +844,26 @@ run (int argc, const char *argv[])
             return child_init_status;
         }
 
+    // curl global init isn't thread safe, do it before any thread
+    if (util::http::init () != 0)
+        {
+            fprintf (stderr, "[ERROR] Failed initializing http client\n");
+        }
+
     // !IMPORTANT: only AFTER initializing child can you
     // spawn a thread! Never fork after being multi threaded!
     if (get_sha_runtime_cli_opt ())
         runtime_cli::attach_listener ();
 
     const bool no_db = sha_cfg["SHA_DB"].is_null ();
+    const std::string db_local_path = get_sha_db_local_path ();
     std::string db_connect_param = "";
 
     if (no_db)
         {
-            fprintf (stderr, "[WARN] No database configured, some "
-                             "functionality might not work\n");
+            if (db_local_path.empty ())
+                fprintf (stderr, "[WARN] No database configured, some "
+                                 "functionality might not work\n");
         }
     else
         {
@@ -744,6 +880,54 @@ run (int argc, const char *argv[])
                 }
         }
 
+    // postgres unavailable, keep data in local store instead
+    if (!db_local_path.empty ()
+        && database::get_conn_status () != CONNECTION_OK)
+        {
+            if (database::init_local (db_local_path) != CONNECTION_OK)
+                fprintf (stderr,
+                         "[ERROR] Error opening local database '%s'\n",
+                         db_local_path.c_str ());
+        }
+
+    // saved guild state is ready before the first command after a restart
+    if (database::get_conn_status () == CONNECTION_OK)
+        {
+            const int count = database::preload_guild_states ();
+
+            if (count < 0)
+                fprintf (stderr, "[WARN] Failed preloading guild states, "
+                                 "they will be loaded on first use\n");
+            else
+                fprintf (stderr, "[DB] Preloaded %d guild player configs\n",
+                         count);
+        }
+
+    if (music_index::load () < 0)
+        {
+            fprintf (stderr, "[ERROR] Failed loading music index, cached "
+                             "tracks won't be listed until downloaded or "
+                             "played again\n");
+        }
+    else if (music_watcher::init () < 0)
+        {
+            fprintf (stderr, "[ERROR] Failed watching music folder, changes "
+                             "made outside of the bot won't be indexed\n");
+        }
+
+    search_cache::load ();
+
+    if (resolver_cache::load () < 0)
+        {
+            fprintf (stderr, "[ERROR] Failed loading resolver cache\n");
+        }
+
+    if (ytdlp_resolver::init () != 0)
+        {
+            fprintf (stderr, "[WARN] yt-dlp util isn't configured, searching "
+                             "won't work\n");
+        }
+
     // initialize cluster here since constructing cluster
     // also spawns threads
     dpp::cluster client (cluster_params.token, cluster_params.intents,
@@ -827,7 +1011,6 @@ run (int argc, const char *argv[])
 
     time_t last_gc;
     time_t last_5sec;
-    time_t last_music_cache_check = 0;
 
     time (&last_gc);
     time (&last_5sec);
@@ -866,11 +1049,11 @@ run (int argc, const char *argv[])
 
             if (r_s && (cur_time - last_5sec) > 5)
                 {
-                    // db reconnect check
+                    // ping idle db connections and reconnect broken ones
                     if (!no_db)
                         {
-                            ConnStatusType status = database::reconnect (
-                                false, db_connect_param);
+                            ConnStatusType status
+                                = database::health_check (db_connect_param);
 
                             if (status != CONNECTION_OK && debug)
                                 fprintf (
@@ -879,18 +1062,19 @@ run (int argc, const char *argv[])
                                     status);
                         }
 
+                    // set by music watcher or download whenever music
+                    // index total goes over the limit
                     const size_t mcs = get_max_music_cache_size ();
-                    if ((should_check_music_cache
-                         || ((cur_time - last_music_cache_check)
-                             > ONE_HOUR_SECOND))
-                        && mcs != 0)
+                    if (should_check_music_cache && mcs != 0)
                         {
-                            player::control_music_cache (mcs);
-
                             should_check_music_cache = false;
-                            last_music_cache_check = cur_time;
+
+                            player::control_music_cache (mcs);
                         }
 
+                    music_index::save ();
+                    resolver_cache::save ();
+
                     // the only solution to reap child exited abnormally in
                     // docker container env
                     int wstatus;
@@ -900,12 +1084,13 @@ run (int argc, const char *argv[])
                     time (&last_5sec);
                 }
 
+            // saved queues of guilds that just became available
+            database::preload_requested_guild_current_queues ();
+
             player::timer::check_track_marker_rm_timers ();
             player::timer::check_resume_timers ();
             player::timer::check_failed_playback_reset_timers ();
 
-            server::main_loop_routine ();
-
             thread_manager::join_done ();
         }
 
@@ -929,6 +1114,11 @@ run (int argc, const char *argv[])
 
     thread_manager::join_all ();
     database::shutdown ();
+    util::http::shutdown ();
+
+    music_index::save ();
+    resolver_cache::save (true);
+    search_cache::save ();
 
     return 0;
 }
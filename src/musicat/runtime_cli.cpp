@@ -1,8 +1,14 @@
 #include "musicat/runtime_cli.h"
+#include "musicat/db.h"
+#include "musicat/db_local.h"
 #include "musicat/mctrack.h"
 #include "musicat/musicat.h"
 #include "musicat/player.h"
+#include "musicat/resolver_cache.h"
+#include "musicat/search-cache.h"
+#include "musicat/server/service_cache.h"
 #include "musicat/thread_manager.h"
+#include "musicat/util/http.h"
 #include <sys/poll.h>
 
 using cmd_args_t = std::vector<std::string>;
@@ -159,6 +165,243 @@ effect_states_send_command (const cmd_args_t &args)
     return 0;
 }
 
+static int
+service_cache_stats (const cmd_args_t &args)
+{
+    const auto stats = server::service_cache::get_stats ();
+
+    const uint64_t lookups = stats.hits + stats.misses;
+    const double hit_rate
+        = lookups ? (double)stats.hits * 100.0 / (double)lookups : 0.0;
+
+    fprintf (stderr,
+             "Entries: %zu\n"
+             "Size: %zu / %zu bytes\n"
+             "Hits: %lu\n"
+             "Misses: %lu\n"
+             "Hit rate: %.2f%%\n"
+             "Evictions: %lu\n"
+             "Expirations: %lu\n",
+             stats.entries, stats.size, stats.max_size,
+             (unsigned long)stats.hits, (unsigned long)stats.misses, hit_rate,
+             (unsigned long)stats.evictions,
+             (unsigned long)stats.expirations);
+
+    return 0;
+}
+
+static int
+search_cache_stats (const cmd_args_t &args)
+{
+    const auto stats = search_cache::get_stats ();
+    const auto rstats = resolver_cache::get_stats ();
+
+    const uint64_t lookups = stats.hits + stats.misses;
+    const double hit_rate
+        = lookups ? (double)stats.hits * 100.0 / (double)lookups : 0.0;
+
+    const uint64_t rlookups = rstats.hits + rstats.stale_hits + rstats.misses;
+    const double rhit_rate
+        = rlookups ? (double)(rstats.hits + rstats.stale_hits) * 100.0
+                         / (double)rlookups
+                   : 0.0;
+
+    fprintf (stderr,
+             "Search cache:\n"
+             "  Entries: %zu\n"
+             "  Size: %zu / %zu bytes\n"
+             "  Hits: %lu\n"
+             "  Misses: %lu\n"
+             "  Hit rate: %.2f%%\n"
+             "  Evictions: %lu\n"
+             "Resolver cache:\n"
+             "  Entries: %zu\n"
+             "  Size: %zu / %zu bytes\n"
+             "  Hits: %lu\n"
+             "  Stale hits: %lu\n"
+             "  Misses: %lu\n"
+             "  Hit rate: %.2f%%\n"
+             "  Evictions: %lu\n",
+             stats.entries, stats.size, stats.max_size,
+             (unsigned long)stats.hits, (unsigned long)stats.misses, hit_rate,
+             (unsigned long)stats.evictions, rstats.entries, rstats.size,
+             rstats.max_size, (unsigned long)rstats.hits,
+             (unsigned long)rstats.stale_hits, (unsigned long)rstats.misses,
+             rhit_rate, (unsigned long)rstats.evictions);
+
+    return 0;
+}
+
+static int
+http_stats (const cmd_args_t &args)
+{
+    const auto stats = util::http::get_stats ();
+
+    if (stats.empty ())
+        {
+            fprintf (stderr, "No http request made yet\n");
+            return 0;
+        }
+
+    for (const auto &s : stats)
+        {
+            const uint64_t avg_ms = s.requests ? s.total_ms / s.requests : 0;
+
+            fprintf (stderr,
+                     "%s:\n"
+                     "  Requests: %lu\n"
+                     "  Failures: %lu\n"
+                     "  Reused connections: %lu\n"
+                     "  Avg latency: %lu ms\n"
+                     "  Max latency: %lu ms\n"
+                     "  Active: %zu\n"
+                     "  Waiting: %zu\n",
+                     s.host.c_str (), (unsigned long)s.requests,
+                     (unsigned long)s.failures, (unsigned long)s.reused,
+                     (unsigned long)avg_ms, (unsigned long)s.max_ms, s.active,
+                     s.waiting);
+        }
+
+    return 0;
+}
+
+// upper bound of the bucket pct percent of samples fall in, in us
+static uint64_t
+_latency_percentile (const uint64_t (&histogram)[DB_LATENCY_BUCKETS],
+                     uint64_t count, uint64_t pct)
+{
+    const uint64_t target = (count * pct + 99) / 100;
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < DB_LATENCY_BUCKETS; i++)
+        {
+            seen += histogram[i];
+
+            if (seen >= target)
+                return database::get_latency_bucket_bound (i);
+        }
+
+    return UINT64_MAX;
+}
+
+static void
+_print_latency (uint64_t us)
+{
+    if (us == UINT64_MAX)
+        fprintf (stderr, "slower");
+    else if (us < 1000)
+        fprintf (stderr, "<%lu us", (unsigned long)us);
+    else
+        fprintf (stderr, "<%lu ms", (unsigned long)(us / 1000));
+}
+
+static int
+db_stats (const cmd_args_t &args)
+{
+    const auto s = database::get_pool_stats ();
+
+    fprintf (stderr, "Backend: %s\n", database::get_backend_name ());
+
+    const uint64_t avg_wait = s.leases ? s.wait_us_total / s.leases : 0;
+    const uint64_t avg_query = s.queries ? s.query_us_total / s.queries : 0;
+
+    fprintf (stderr,
+             "Database pool:\n"
+             "  Connections: %zu (%zu idle, %zu bad)\n"
+             "  Waiting: %zu\n"
+             "  Leases: %lu\n"
+             "  Avg wait: %lu us\n"
+             "  Max wait: %lu us\n"
+             "  Queries: %lu (%lu failed)\n"
+             "  Avg query: %lu us\n"
+             "  Max query: %lu us\n"
+             "  Reconnects: %lu\n",
+             s.size, s.idle, s.bad, s.waiting, (unsigned long)s.leases,
+             (unsigned long)avg_wait, (unsigned long)s.wait_us_max,
+             (unsigned long)s.queries, (unsigned long)s.failed_queries,
+             (unsigned long)avg_query, (unsigned long)s.query_us_max,
+             (unsigned long)s.resets);
+
+    if (s.leases)
+        {
+            fprintf (stderr, "  Wait p50: ");
+            _print_latency (
+                _latency_percentile (s.wait_histogram, s.leases, 50));
+            fprintf (stderr, ", p99: ");
+            _print_latency (
+                _latency_percentile (s.wait_histogram, s.leases, 99));
+            fprintf (stderr, "\n");
+        }
+
+    const auto wb = database::get_write_behind_stats ();
+
+    fprintf (stderr,
+             "Write behind:\n"
+             "  Pending guilds: %zu\n"
+             "  Coalesced: %lu\n"
+             "  Written: %lu (%lu dropped)\n"
+             "  Round trips: %lu\n",
+             wb.pending, (unsigned long)wb.coalesced,
+             (unsigned long)wb.written, (unsigned long)wb.failed,
+             (unsigned long)wb.batches);
+
+    if (database::local::is_open ())
+        {
+            const auto l = database::local::get_stats ();
+
+            fprintf (stderr,
+                     "Local store:\n"
+                     "  Records: %zu\n"
+                     "  Log size: %lu bytes (%lu live)\n"
+                     "  Compactions: %lu\n",
+                     l.records, (unsigned long)l.log_size,
+                     (unsigned long)l.live_size, (unsigned long)l.compactions);
+        }
+
+    return 0;
+}
+
+static int
+db_queries (const cmd_args_t &args)
+{
+    bool empty = true;
+
+    for (const auto &q : database::get_query_stats ())
+        {
+            if (!q.calls)
+                continue;
+
+            empty = false;
+
+            fprintf (stderr,
+                     "%s:\n"
+                     "  Calls: %lu (%lu rows)\n"
+                     "  Errors: %lu connection, %lu canceled, %lu "
+                     "constraint, %lu other\n"
+                     "  Avg: %lu us, max: %lu us\n"
+                     "  p50: ",
+                     q.name, (unsigned long)q.calls, (unsigned long)q.rows,
+                     (unsigned long)q.errors[database::QUERY_ERROR_CONNECTION],
+                     (unsigned long)q.errors[database::QUERY_ERROR_CANCELED],
+                     (unsigned long)q.errors[database::QUERY_ERROR_CONSTRAINT],
+                     (unsigned long)q.errors[database::QUERY_ERROR_OTHER],
+                     (unsigned long)(q.us_total / q.calls),
+                     (unsigned long)q.us_max);
+
+            _print_latency (_latency_percentile (q.histogram, q.calls, 50));
+            fprintf (stderr, ", p90: ");
+            _print_latency (_latency_percentile (q.histogram, q.calls, 90));
+            fprintf (stderr, ", p99: ");
+            _print_latency (_latency_percentile (q.histogram, q.calls, 99));
+            fprintf (stderr, "\n");
+        }
+
+    if (empty)
+        fprintf (stderr, "No database query made yet\n");
+
+    return 0;
+}
+
 // !TODO: more cmd? maybe stats/utility
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -181,6 +424,14 @@ inline constexpr const command_entry_t commands[] = {
     { "shutdown", NULL, "Shutdown Musicat", shutdown_cmd },
     { "list effect states", "-ls es", "List currently active effect states",
       list_effect_states },
+    { "service cache stats", "-scs", "Print server service cache stats",
+      service_cache_stats },
+    { "search cache stats", "-ss",
+      "Print search and yt-dlp resolver cache stats", search_cache_stats },
+    { "http stats", "-ns", "Print http client stats per host", http_stats },
+    { "db stats", "-pgs", "Print database connection pool stats", db_stats },
+    { "db queries", "-pgq", "Print latency and errors of every database query",
+      db_queries },
     { NULL, NULL, NULL, NULL },
 };
 
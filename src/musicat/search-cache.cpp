@@ -1,33 +1,203 @@
 #include "musicat/search-cache.h"
+#include "musicat/musicat.h"
+#include "musicat/util/json.h"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <list>
 #include <mutex>
 #include <string>
+#include <unistd.h>
+#include <unordered_map>
+
+#define SNAPSHOT_FILENAME ".musicat_search_cache"
+#define SNAPSHOT_HEADER "musicat_search_cache"
+#define SNAPSHOT_VERSION 1
+
+// rough per entry bookkeeping cost on top of key and value
+#define ENTRY_OVERHEAD 128
+// rough per track cost on top of its raw json
+#define TRACK_OVERHEAD 256
 
 namespace musicat
 {
 namespace search_cache
 {
-static search_cache_map_t cache = {};
+
+struct entry_t
+{
+    value_t value;
+    // id and bookkeeping only, value is counted in value_sizes
+    size_t size;
+    std::list<std::string>::iterator lru_i;
+};
+
+struct value_size_t
+{
+    size_t size;
+    // entries sharing the value
+    size_t refs;
+};
+
+static std::unordered_map<std::string, entry_t> cache;
+// shared values are counted once no matter how many ids they're under
+static std::unordered_map<const track_v_t *, value_size_t> value_sizes;
+// most recently used at front
+static std::list<std::string> lru;
+static size_t cache_size = 0;
 static std::mutex cache_m;
 
-track_v_t
+static std::atomic<uint64_t> hits = 0;
+static std::atomic<uint64_t> misses = 0;
+static std::atomic<uint64_t> evictions = 0;
+
+static std::string
+get_snapshot_path (const std::string &music_folder_path)
+{
+    return music_folder_path + SNAPSHOT_FILENAME;
+}
+
+static size_t
+compute_value_size (const track_v_t &val)
+{
+    size_t size = 0;
+
+    for (const auto &t : val)
+        size += util::json::estimate_size (t.raw) + TRACK_OVERHEAD;
+
+    return size;
+}
+
+// cache_m must be locked
+static bool
+is_value_counted (const value_t &val)
+{
+    return value_sizes.find (val.get ()) != value_sizes.end ();
+}
+
+// cache_m must be locked, `val_size` is only used when `val` isn't counted
+// yet
+static void
+ref_value (const value_t &val, size_t val_size)
+{
+    auto i = value_sizes.find (val.get ());
+    if (i != value_sizes.end ())
+        {
+            i->second.refs++;
+            return;
+        }
+
+    value_sizes.emplace (val.get (), value_size_t{ val_size, 1 });
+    cache_size += val_size;
+}
+
+// cache_m must be locked
+static void
+unref_value (const value_t &val)
+{
+    auto i = value_sizes.find (val.get ());
+    if (i == value_sizes.end () || --i->second.refs)
+        return;
+
+    cache_size -= i->second.size;
+    value_sizes.erase (i);
+}
+
+// cache_m must be locked
+static void
+erase (std::unordered_map<std::string, entry_t>::iterator i)
+{
+    cache_size -= i->second.size;
+    unref_value (i->second.value);
+    lru.erase (i->second.lru_i);
+    cache.erase (i);
+}
+
+// cache_m must be locked, `back` inserts as least recently used
+static void
+insert (const std::string &id, const value_t &val, size_t val_size,
+        bool back)
+{
+    // ref before erasing old entry, it might hold the same value
+    ref_value (val, val_size);
+
+    auto old = cache.find (id);
+    if (old != cache.end ())
+        erase (old);
+
+    auto lru_i
+        = back ? lru.insert (lru.end (), id) : lru.insert (lru.begin (), id);
+
+    const size_t size = id.length () + ENTRY_OVERHEAD;
+
+    cache.emplace (id, entry_t{ val, size, lru_i });
+    cache_size += size;
+
+    const size_t max_size = get_max_search_cache_size ();
+    if (!max_size)
+        return;
+
+    // never evict what was just inserted
+    while (cache_size > max_size && lru.size () > 1)
+        {
+            erase (cache.find (lru.back ()));
+            evictions++;
+        }
+}
+
+value_t
 get (const std::string &id)
 {
     std::lock_guard lk (cache_m);
 
     auto i = cache.find (id);
     if (i == cache.end ())
-        return {};
+        {
+            misses++;
+            return nullptr;
+        }
 
-    return i->second;
+    hits++;
+    lru.splice (lru.begin (), lru, i->second.lru_i);
+
+    return i->second.value;
 }
 
-int
-set (const std::string &id, const track_v_t &val)
+value_t
+set (const std::string &id, track_v_t val)
 {
+    const size_t val_size = compute_value_size (val);
+    value_t shared = std::make_shared<const track_v_t> (std::move (val));
+
     std::lock_guard lk (cache_m);
 
-    cache.insert_or_assign (id, val);
-    return 0;
+    insert (id, shared, val_size, false);
+
+    return shared;
+}
+
+void
+set (const std::string &id, const value_t &val)
+{
+    if (!val)
+        return;
+
+    {
+        std::lock_guard lk (cache_m);
+
+        if (is_value_counted (val))
+            {
+                insert (id, val, 0, false);
+                return;
+            }
+    }
+
+    // every entry holding it was evicted, size it again outside the lock
+    const size_t val_size = compute_value_size (*val);
+
+    std::lock_guard lk (cache_m);
+
+    insert (id, val, val_size, false);
 }
 
 size_t
@@ -35,7 +205,158 @@ remove (const std::string &id)
 {
     std::lock_guard lk (cache_m);
 
-    return cache.erase (id);
+    auto i = cache.find (id);
+    if (i == cache.end ())
+        return 0;
+
+    erase (i);
+
+    return 1;
+}
+
+stats_t
+get_stats ()
+{
+    std::lock_guard lk (cache_m);
+
+    return { hits,      misses,     evictions, cache.size (),
+             cache_size, get_max_search_cache_size () };
+}
+
+int
+load ()
+{
+    const std::string music_folder_path = get_music_folder_path ();
+    if (music_folder_path.empty () || !get_search_cache_snapshot ())
+        return 0;
+
+    const std::string snapshot_path = get_snapshot_path (music_folder_path);
+
+    std::ifstream ifs (snapshot_path);
+    if (!ifs.is_open ())
+        return 0;
+
+    std::string line;
+    std::getline (ifs, line);
+
+    int version = 0;
+    if (sscanf (line.c_str (), SNAPSHOT_HEADER " %d", &version) != 1
+        || version != SNAPSHOT_VERSION)
+        {
+            fprintf (stderr, "[search_cache::load WARN] Unknown snapshot "
+                             "format, ignoring it\n");
+            return 0;
+        }
+
+    size_t loaded = 0;
+
+    std::lock_guard lk (cache_m);
+
+    // "<id>\t<json array of raw tracks>", most recently used first
+    while (std::getline (ifs, line))
+        {
+            const size_t tab = line.find ('\t');
+            if (tab == std::string::npos)
+                continue;
+
+            nlohmann::json raws;
+            try
+                {
+                    raws = nlohmann::json::parse (line.substr (tab + 1));
+                }
+            catch (const nlohmann::detail::parse_error &)
+                {
+                    continue;
+                }
+
+            if (!raws.is_array ())
+                continue;
+
+            track_v_t val;
+            val.reserve (raws.size ());
+
+            for (auto &r : raws)
+                {
+                    player::MCTrack t;
+                    t.raw = std::move (r);
+                    val.push_back (std::move (t));
+                }
+
+            const size_t val_size = compute_value_size (val);
+
+            insert (line.substr (0, tab),
+                    std::make_shared<const track_v_t> (std::move (val)),
+                    val_size, true);
+            loaded++;
+        }
+
+    // snapshot is only valid for one restart
+    unlink (snapshot_path.c_str ());
+
+    if (get_debug_state ())
+        fprintf (stderr, "[search_cache::load] Loaded %zu entries\n", loaded);
+
+    return 0;
+}
+
+int
+save ()
+{
+    const std::string music_folder_path = get_music_folder_path ();
+    if (music_folder_path.empty () || !get_search_cache_snapshot ())
+        return 0;
+
+    const std::string snapshot_path = get_snapshot_path (music_folder_path);
+    const std::string tmp_path = snapshot_path + ".tmp";
+
+    FILE *f = fopen (tmp_path.c_str (), "w");
+    bool failed = f == NULL;
+
+    if (!failed)
+        {
+            std::lock_guard lk (cache_m);
+
+            fprintf (f, SNAPSHOT_HEADER " %d\n", SNAPSHOT_VERSION);
+
+            for (const std::string &id : lru)
+                {
+                    // tab separates id from value
+                    if (id.find_first_of ("\t\n") != std::string::npos)
+                        continue;
+
+                    nlohmann::json raws = nlohmann::json::array ();
+                    for (const auto &t : *cache.find (id)->second.value)
+                        raws.push_back (t.raw);
+
+                    const std::string line = id + '\t' + raws.dump () + '\n';
+
+                    if (fwrite (line.data (), 1, line.size (), f)
+                        != line.size ())
+                        {
+                            failed = true;
+                            break;
+                        }
+                }
+        }
+
+    if (f)
+        failed = (fclose (f) != 0) || failed;
+
+    if (!failed)
+        failed = rename (tmp_path.c_str (), snapshot_path.c_str ()) != 0;
+
+    if (failed)
+        {
+            perror ("[search_cache::save ERROR]");
+            fprintf (stderr, "^^^ Failed writing '%s'\n",
+                     snapshot_path.c_str ());
+
+            unlink (tmp_path.c_str ());
+
+            return -1;
+        }
+
+    return 0;
 }
 
 } // search_cache
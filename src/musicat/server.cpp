@@ -3,15 +3,13 @@
 #include "musicat/musicat.h"
 #include "musicat/server/middlewares.h"
 #include "musicat/server/routes.h"
-#include "musicat/server/service_cache.h"
 #include "musicat/server/states.h"
+#include "musicat/server/static_files.h"
+#include "musicat/server/timer_wheel.h"
 #include "musicat/server/ws.h"
 #include "musicat/server/ws/player.h"
 #include <stdio.h>
 #include <uWebSockets/src/App.h>
-/*#include "uWebSockets/AsyncFileReader.h"
-#include "uWebSockets/AsyncFileStreamer.h"
-#include "uWebSockets/Middleware.h"*/
 
 namespace musicat::server
 {
@@ -285,6 +283,9 @@ run ()
     _app_ptr = &app;
     _loop_ptr = uWS::Loop::get ();
 
+    // every server side expiry runs on this
+    timer_wheel::init (_loop_ptr);
+
     int PORT = get_server_port ();
 
     middlewares::load_cors_enabled_origin ();
@@ -295,17 +296,13 @@ run ()
     ws::define_ws_routes (&app);
 
     // serve webapp
-    /* !TODO: this is not working, need fix
-    std::string webapp_dir = get_webapp_dir ();
-    if (!webapp_dir.empty ()) {
-        AsyncFileStreamer asyncFileStreamer(webapp_dir);
-
-        app.get("/*", [&asyncFileStreamer](auto *res, auto *req) {
-                serveFile(res, req);
-                asyncFileStreamer.streamFile(res, req->getUrl());
-            });
-    }
-    */
+    const std::string webapp_dir = get_webapp_dir ();
+    const bool serve_webapp
+        = !webapp_dir.empty () && static_files::load (webapp_dir) == 0;
+
+    if (serve_webapp)
+        app.get ("/*", static_files::handle);
+
     // define http routes =======================================}
 
     app.listen (PORT, [PORT] (us_listen_socket_t *listen_socket) {
@@ -335,6 +332,10 @@ run ()
 
     states::set_jwt_verifier_ptr (nullptr);
 
+    // no response can still be streaming a mapped file at this point
+    if (serve_webapp)
+        static_files::unload ();
+
     // socket exiting, assigning null to these pointer
     _listen_socket_ptr = nullptr;
     _loop_ptr = nullptr;
@@ -414,7 +415,7 @@ shutdown ()
 
         fprintf (stderr, "[server] Shutting down...\n");
 
-        states::remove_all_timers ();
+        timer_wheel::shutdown ();
         _app_ptr->close ();
     });
 
@@ -423,11 +424,4 @@ shutdown ()
     return 0;
 }
 
-void
-main_loop_routine ()
-{
-    states::check_timers ();
-    service_cache::check_timers ();
-}
-
 } // musicat::server
@@ -0,0 +1,480 @@
+#include "musicat/server/body_parser.h"
+
+namespace musicat::server::body_parser
+{
+
+static bool
+_is_ws (char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int
+_hex_value (char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+json_parser_t::json_parser_t (size_t _max_size, size_t _max_depth)
+    : max_size (_max_size), max_depth (_max_depth), size (0),
+      status (PARSE_STATUS_INCOMPLETE), state (STATE_VALUE), root (nullptr),
+      string_is_key (false), unicode_cp (0), unicode_digits (0),
+      high_surrogate (0), literal (NULL), literal_i (0)
+{
+}
+
+parse_status_e
+json_parser_t::feed (std::string_view chunk)
+{
+    if (status != PARSE_STATUS_INCOMPLETE && status != PARSE_STATUS_OK)
+        return status;
+
+    size += chunk.size ();
+    if (size > max_size)
+        return fail (PARSE_STATUS_ERROR_TOO_LARGE);
+
+    for (const char c : chunk)
+        {
+            if (!consume (c))
+                return fail (status == PARSE_STATUS_ERROR_TOO_DEEP
+                                 ? PARSE_STATUS_ERROR_TOO_DEEP
+                                 : PARSE_STATUS_ERROR_SYNTAX);
+        }
+
+    return status;
+}
+
+parse_status_e
+json_parser_t::finish ()
+{
+    if (status != PARSE_STATUS_INCOMPLETE && status != PARSE_STATUS_OK)
+        return status;
+
+    // a top level number has no terminator
+    if (state == STATE_NUMBER && stack.empty ())
+        {
+            if (!end_number ())
+                return fail (PARSE_STATUS_ERROR_SYNTAX);
+        }
+
+    if (state != STATE_DONE)
+        return fail (PARSE_STATUS_ERROR_SYNTAX);
+
+    return status;
+}
+
+nlohmann::json &
+json_parser_t::get ()
+{
+    return root;
+}
+
+size_t
+json_parser_t::get_size () const
+{
+    return size;
+}
+
+parse_status_e
+json_parser_t::fail (parse_status_e s)
+{
+    status = s;
+    stack.clear ();
+    buf.clear ();
+    key.clear ();
+    root = nullptr;
+
+    return status;
+}
+
+bool
+json_parser_t::emit (nlohmann::json &&v)
+{
+    if (stack.empty ())
+        {
+            root = std::move (v);
+            state = STATE_DONE;
+            status = PARSE_STATUS_OK;
+            return true;
+        }
+
+    nlohmann::json *top = stack.back ();
+
+    if (top->is_array ())
+        top->push_back (std::move (v));
+    else
+        (*top)[key] = std::move (v);
+
+    state = STATE_AFTER_VALUE;
+    return true;
+}
+
+bool
+json_parser_t::open_container (nlohmann::json &&v, state_e next)
+{
+    if (stack.size () >= max_depth)
+        {
+            status = PARSE_STATUS_ERROR_TOO_DEEP;
+            return false;
+        }
+
+    nlohmann::json *inserted;
+
+    if (stack.empty ())
+        {
+            root = std::move (v);
+            inserted = &root;
+        }
+    else
+        {
+            nlohmann::json *top = stack.back ();
+
+            if (top->is_array ())
+                {
+                    top->push_back (std::move (v));
+                    inserted = &top->back ();
+                }
+            else
+                {
+                    nlohmann::json &slot = (*top)[key];
+                    slot = std::move (v);
+                    inserted = &slot;
+                }
+        }
+
+    stack.push_back (inserted);
+    state = next;
+    return true;
+}
+
+bool
+json_parser_t::close_container (bool is_object)
+{
+    if (stack.empty () || stack.back ()->is_object () != is_object)
+        return false;
+
+    stack.pop_back ();
+
+    if (stack.empty ())
+        {
+            state = STATE_DONE;
+            status = PARSE_STATUS_OK;
+        }
+    else
+        state = STATE_AFTER_VALUE;
+
+    return true;
+}
+
+bool
+json_parser_t::end_number ()
+{
+    // let the real parser validate number grammar, it's tiny
+    nlohmann::json v = nlohmann::json::parse (buf, nullptr, false);
+    buf.clear ();
+
+    if (v.is_discarded () || !v.is_number ())
+        return false;
+
+    return emit (std::move (v));
+}
+
+void
+json_parser_t::append_codepoint (unsigned int cp)
+{
+    if (cp < 0x80)
+        buf += (char)cp;
+    else if (cp < 0x800)
+        {
+            buf += (char)(0xC0 | (cp >> 6));
+            buf += (char)(0x80 | (cp & 0x3F));
+        }
+    else if (cp < 0x10000)
+        {
+            buf += (char)(0xE0 | (cp >> 12));
+            buf += (char)(0x80 | ((cp >> 6) & 0x3F));
+            buf += (char)(0x80 | (cp & 0x3F));
+        }
+    else
+        {
+            buf += (char)(0xF0 | (cp >> 18));
+            buf += (char)(0x80 | ((cp >> 12) & 0x3F));
+            buf += (char)(0x80 | ((cp >> 6) & 0x3F));
+            buf += (char)(0x80 | (cp & 0x3F));
+        }
+}
+
+bool
+json_parser_t::begin_value (char c)
+{
+    switch (c)
+        {
+        case '{':
+            return open_container (nlohmann::json::object (),
+                                   STATE_OBJECT_KEY_OR_END);
+
+        case '[':
+            return open_container (nlohmann::json::array (),
+                                   STATE_ARRAY_VALUE_OR_END);
+
+        case '"':
+            buf.clear ();
+            string_is_key = false;
+            state = STATE_STRING;
+            return true;
+
+        case 't':
+            literal = "true";
+            break;
+
+        case 'f':
+            literal = "false";
+            break;
+
+        case 'n':
+            literal = "null";
+            break;
+
+        default:
+            if (c == '-' || (c >= '0' && c <= '9'))
+                {
+                    buf.assign (1, c);
+                    state = STATE_NUMBER;
+                    return true;
+                }
+
+            return false;
+        }
+
+    literal_i = 1;
+    state = STATE_LITERAL;
+    return true;
+}
+
+bool
+json_parser_t::consume (char c)
+{
+    switch (state)
+        {
+        case STATE_VALUE:
+            if (_is_ws (c))
+                return true;
+
+            return begin_value (c);
+
+        case STATE_ARRAY_VALUE_OR_END:
+            if (_is_ws (c))
+                return true;
+
+            if (c == ']')
+                return close_container (false);
+
+            return begin_value (c);
+
+        case STATE_OBJECT_KEY_OR_END:
+        case STATE_OBJECT_KEY:
+            if (_is_ws (c))
+                return true;
+
+            if (c == '}' && state == STATE_OBJECT_KEY_OR_END)
+                return close_container (true);
+
+            if (c != '"')
+                return false;
+
+            buf.clear ();
+            string_is_key = true;
+            state = STATE_STRING;
+            return true;
+
+        case STATE_COLON:
+            if (_is_ws (c))
+                return true;
+
+            if (c != ':')
+                return false;
+
+            state = STATE_VALUE;
+            return true;
+
+        case STATE_AFTER_VALUE:
+            if (_is_ws (c))
+                return true;
+
+            if (c == ',')
+                {
+                    state = stack.back ()->is_object () ? STATE_OBJECT_KEY
+                                                        : STATE_VALUE;
+                    return true;
+                }
+
+            if (c == '}')
+                return close_container (true);
+
+            if (c == ']')
+                return close_container (false);
+
+            return false;
+
+        case STATE_STRING:
+            if (c == '"')
+                {
+                    if (high_surrogate)
+                        return false;
+
+                    if (string_is_key)
+                        {
+                            key = std::move (buf);
+                            buf.clear ();
+                            state = STATE_COLON;
+                            return true;
+                        }
+
+                    nlohmann::json v = std::move (buf);
+                    buf.clear ();
+                    return emit (std::move (v));
+                }
+
+            if (c == '\\')
+                {
+                    state = STATE_STRING_ESCAPE;
+                    return true;
+                }
+
+            // unescaped control character
+            if ((unsigned char)c < 0x20 || high_surrogate)
+                return false;
+
+            buf += c;
+            return true;
+
+        case STATE_STRING_ESCAPE:
+            if (c == 'u')
+                {
+                    unicode_cp = 0;
+                    unicode_digits = 0;
+                    state = STATE_STRING_UNICODE;
+                    return true;
+                }
+
+            // a high surrogate must be followed by \u low surrogate
+            if (high_surrogate)
+                return false;
+
+            switch (c)
+                {
+                case '"':
+                case '\\':
+                case '/':
+                    buf += c;
+                    break;
+                case 'b':
+                    buf += '\b';
+                    break;
+                case 'f':
+                    buf += '\f';
+                    break;
+                case 'n':
+                    buf += '\n';
+                    break;
+                case 'r':
+                    buf += '\r';
+                    break;
+                case 't':
+                    buf += '\t';
+                    break;
+                default:
+                    return false;
+                }
+
+            state = STATE_STRING;
+            return true;
+
+        case STATE_STRING_UNICODE:
+            {
+                const int h = _hex_value (c);
+                if (h < 0)
+                    return false;
+
+                unicode_cp = (unicode_cp << 4) | (unsigned int)h;
+
+                if (++unicode_digits < 4)
+                    return true;
+
+                state = STATE_STRING;
+
+                if (high_surrogate)
+                    {
+                        if (unicode_cp < 0xDC00 || unicode_cp > 0xDFFF)
+                            return false;
+
+                        append_codepoint (0x10000
+                                          + ((high_surrogate - 0xD800) << 10)
+                                          + (unicode_cp - 0xDC00));
+                        high_surrogate = 0;
+                        return true;
+                    }
+
+                if (unicode_cp >= 0xD800 && unicode_cp <= 0xDBFF)
+                    {
+                        high_surrogate = unicode_cp;
+                        return true;
+                    }
+
+                // lone low surrogate
+                if (unicode_cp >= 0xDC00 && unicode_cp <= 0xDFFF)
+                    return false;
+
+                append_codepoint (unicode_cp);
+                return true;
+            }
+
+        case STATE_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E'
+                || c == '+' || c == '-')
+                {
+                    buf += c;
+                    return true;
+                }
+
+            // number ends here, current char belongs to what comes after
+            if (!end_number ())
+                return false;
+
+            return consume (c);
+
+        case STATE_LITERAL:
+            if (c != literal[literal_i])
+                return false;
+
+            if (literal[++literal_i] != '\0')
+                return true;
+
+            switch (literal[0])
+                {
+                case 't':
+                    return emit (true);
+                case 'f':
+                    return emit (false);
+                default:
+                    return emit (nullptr);
+                }
+
+        case STATE_DONE:
+            // trailing whitespace only
+            return _is_ws (c);
+        }
+
+    return false;
+}
+
+} // musicat::server::body_parser
@@ -16,7 +16,8 @@ header_v_t
 get_cors_headers (std::string_view req_allow_headers)
 {
     std::string allow_headers = "DNT,User-Agent,X-Requested-With,If-Modified-"
-                                "Since,Cache-Control,Content-Type,Range";
+                                "Since,If-None-Match,Cache-Control,Content-"
+                                "Type,Range";
 
     if (!req_allow_headers.empty ())
         {
@@ -282,4 +283,36 @@ set_guild_is_mutual (const std::string &user_id, nlohmann::json &guild)
     guild["is_mutual"] = i_member != g->members.end ();
 }
 
+bool
+etag_match (APIRequest *req, std::string_view etag)
+{
+    std::string_view list = req->getHeader ("if-none-match");
+
+    while (!list.empty ())
+        {
+            const size_t comma = list.find (',');
+            std::string_view token = list.substr (0, comma);
+
+            while (!token.empty () && token.front () == ' ')
+                token.remove_prefix (1);
+
+            while (!token.empty () && token.back () == ' ')
+                token.remove_suffix (1);
+
+            // If-None-Match uses weak comparison
+            if (token.substr (0, 2) == "W/")
+                token.remove_prefix (2);
+
+            if (token == "*" || token == etag)
+                return true;
+
+            if (comma == std::string_view::npos)
+                break;
+
+            list.remove_prefix (comma + 1);
+        }
+
+    return false;
+}
+
 } // musicat::server::middlewares
@@ -4,6 +4,7 @@
 #include "musicat/server/routes/get_guilds.h"
 #include "musicat/server/routes/get_invite.h"
 #include "musicat/server/routes/get_login.h"
+#include "musicat/server/routes/get_metrics.h"
 #include "musicat/server/routes/get_root.h"
 #include "musicat/server/routes/get_stream.h"
 #include "musicat/server/routes/post_login.h"
@@ -103,6 +104,7 @@ inline constexpr const route_handler_t route_handlers[]
         { "/guilds", ROUTE_METHOD_GET, get_guilds },
         { "/invite", ROUTE_METHOD_GET, get_invite },
         { "/stream/:server_id", ROUTE_METHOD_GET, get_stream },
+        { "/metrics", ROUTE_METHOD_GET, get_metrics },
         { NULL, ROUTE_METHOD_NULL, NULL } };
 
 void
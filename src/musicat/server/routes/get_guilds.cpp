@@ -19,6 +19,29 @@ set_guilds_is_mutual (const std::string &user_id, nlohmann::json &guilds)
         }
 }
 
+// serialize and cache final response body, mutual state is baked in
+static service_cache::response_t
+create_guilds_response (const std::string &user_id, nlohmann::json guilds)
+{
+    set_guilds_is_mutual (user_id, guilds);
+
+    service_cache::set_cached_user_guilds_response (
+        user_id, response::payload (guilds).dump ());
+
+    return service_cache::get_cached_user_guilds_response (user_id);
+}
+
+static void
+set_endres_guilds_response (response::end_t &endres,
+                            const service_cache::cached_response_t &r)
+{
+    endres.set_header ("ETag", r.etag);
+    // dashboard should always revalidate
+    endres.set_header ("Cache-Control", "private, no-cache");
+    endres.set_content_type_json ();
+    endres.response = r.body;
+}
+
 void
 get_guilds (APIResponse *res, APIRequest *req)
 {
@@ -35,19 +58,45 @@ get_guilds (APIResponse *res, APIRequest *req)
     response::end_t endres (res);
     endres.headers = cors_headers;
 
+    service_cache::response_t cached_res
+        = service_cache::get_cached_user_guilds_response (user_id);
+
+    if (cached_res)
+        {
+            if (middlewares::etag_match (req, cached_res->etag))
+                {
+                    endres.status = http_status_t.NOT_MODIFIED_304;
+                    endres.set_header ("ETag", cached_res->etag);
+                    return;
+                }
+
+            set_endres_guilds_response (endres, *cached_res);
+            return;
+        }
+
     // array of guild
-    nlohmann::json cached = service_cache::get_cached_user_guilds (user_id);
+    service_cache::value_t cached
+        = service_cache::get_cached_user_guilds (user_id);
 
-    if (cached.is_array ())
+    if (cached && cached->is_array ())
         {
-            // not included in cache and it's fine
-            // some people just refresh to see if
-            // the bot sucessfully invited to their
-            // server
-            set_guilds_is_mutual (user_id, cached);
+            // mutual state isn't included in guild list cache, some people
+            // just refresh to see if the bot sucessfully invited to their
+            // server. Guild events invalidate both caches
+            cached_res = create_guilds_response (user_id, *cached);
+
+            if (cached_res)
+                {
+                    set_endres_guilds_response (endres, *cached_res);
+                    return;
+                }
+
+            // response doesn't fit in cache
+            nlohmann::json guilds = *cached;
+            set_guilds_is_mutual (user_id, guilds);
 
             endres.set_content_type_json ();
-            endres.response = response::payload (cached).dump ();
+            endres.response = response::payload (guilds).dump ();
 
             return;
         }
@@ -72,9 +121,12 @@ get_guilds (APIResponse *res, APIRequest *req)
         endres.response = lresponse;
         response::defer_end_t dendt (endres);
 
-        nlohmann::json auth = service_cache::get_cached_user_auth (user_id);
+        service_cache::value_t cached_auth
+            = service_cache::get_cached_user_auth (user_id);
+
+        nlohmann::json auth = cached_auth ? *cached_auth : nullptr;
 
-        if (auth.is_null ())
+        if (!cached_auth)
             {
                 auto db_auth = database::get_user_auth (user_id);
                 auto auth_p = database::get_user_auth_json_from_PGresult (
@@ -133,6 +185,15 @@ get_guilds (APIResponse *res, APIRequest *req)
 
         service_cache::set_cached_user_guilds (user_id, r);
 
+        service_cache::response_t cached_res
+            = create_guilds_response (user_id, r);
+
+        if (cached_res)
+            {
+                set_endres_guilds_response (endres, *cached_res);
+                return;
+            }
+
         set_guilds_is_mutual (user_id, r);
 
         endres.set_content_type_json ();
@@ -0,0 +1,110 @@
+#include "musicat/server/routes/get_metrics.h"
+#include "musicat/db.h"
+#include "musicat/musicat.h"
+#include "musicat/server/middlewares.h"
+#include "musicat/server/response.h"
+
+namespace musicat::server::routes
+{
+
+static nlohmann::json
+histogram_json (const uint64_t (&histogram)[DB_LATENCY_BUCKETS])
+{
+    nlohmann::json ret = nlohmann::json::array ();
+
+    for (size_t i = 0; i < DB_LATENCY_BUCKETS; i++)
+        ret.push_back (histogram[i]);
+
+    return ret;
+}
+
+static nlohmann::json
+database_metrics ()
+{
+    // upper bound of each histogram bucket in us, null is unbounded
+    nlohmann::json buckets = nlohmann::json::array ();
+
+    for (size_t i = 0; i < DB_LATENCY_BUCKETS; i++)
+        {
+            const uint64_t bound = database::get_latency_bucket_bound (i);
+
+            if (bound == UINT64_MAX)
+                buckets.push_back (nullptr);
+            else
+                buckets.push_back (bound);
+        }
+
+    const auto p = database::get_pool_stats ();
+
+    nlohmann::json queries = nlohmann::json::array ();
+
+    for (const auto &q : database::get_query_stats ())
+        {
+            if (!q.calls)
+                continue;
+
+            queries.push_back ({
+                { "name", q.name },
+                { "calls", q.calls },
+                { "rows", q.rows },
+                { "us_total", q.us_total },
+                { "us_max", q.us_max },
+                { "errors",
+                  {
+                      { "connection",
+                        q.errors[database::QUERY_ERROR_CONNECTION] },
+                      { "canceled", q.errors[database::QUERY_ERROR_CANCELED] },
+                      { "constraint",
+                        q.errors[database::QUERY_ERROR_CONSTRAINT] },
+                      { "other", q.errors[database::QUERY_ERROR_OTHER] },
+                  } },
+                { "histogram", histogram_json (q.histogram) },
+            });
+        }
+
+    return {
+        { "backend", database::get_backend_name () },
+        { "buckets_us", buckets },
+        { "pool",
+          {
+              { "size", p.size },
+              { "idle", p.idle },
+              { "waiting", p.waiting },
+              { "bad", p.bad },
+              { "leases", p.leases },
+              { "wait_us_total", p.wait_us_total },
+              { "wait_us_max", p.wait_us_max },
+              { "wait_histogram", histogram_json (p.wait_histogram) },
+              { "resets", p.resets },
+          } },
+        { "queries", queries },
+    };
+}
+
+void
+get_metrics (APIResponse *res, APIRequest *req)
+{
+    auto cors_headers = middlewares::cors (res, req);
+    if (cors_headers.empty ())
+        return;
+
+    std::string user_id = middlewares::validate_token (res, req, cors_headers);
+    if (user_id.empty ())
+        return;
+
+    response::end_t endres (res);
+    endres.headers = cors_headers;
+
+    if (!is_musicat_admin (dpp::snowflake (user_id)))
+        {
+            endres.status = http_status_t.FORBIDDEN_403;
+            return;
+        }
+
+    endres.set_header ("Cache-Control", "no-store");
+    endres.set_content_type_json ();
+    endres.response
+        = response::payload ({ { "database", database_metrics () } }).dump ();
+}
+
+} // musicat::server::routes
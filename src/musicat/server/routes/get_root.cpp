@@ -52,11 +52,12 @@ get_root (APIResponse *res, APIRequest *req)
             return;
         }
 
-    const nlohmann::json musicat_data
+    const service_cache::value_t musicat_data
         = service_cache::get_cached_musicat_detailed_user ();
-    if (musicat_data.is_object ())
+    if (musicat_data && musicat_data->is_object ())
         {
-            set_endres_response_with_musicat_data (bot, endres, musicat_data);
+            set_endres_response_with_musicat_data (bot, endres,
+                                                   *musicat_data);
 
             return;
         }
@@ -2,12 +2,17 @@
 #include "musicat/musicat.h"
 #include "musicat/server.h"
 #include "musicat/server/auth.h"
+#include "musicat/server/body_parser.h"
 #include "musicat/server/middlewares.h"
 #include "musicat/server/response.h"
 #include "musicat/server/service_cache.h"
 #include "musicat/server/states.h"
 #include "musicat/thread_manager.h"
 
+// login body only has a few short strings
+#define POST_LOGIN_MAX_BODY_SIZE 8192
+#define POST_LOGIN_MAX_BODY_DEPTH 4
+
 namespace musicat::server::routes
 {
 
@@ -240,16 +245,12 @@ handle_post_login_creds (response::end_t &endres, const std::string &redirect,
 }
 
 void
-handle_post_login_body (const states::recv_body_t &recv)
+handle_post_login_body (APIResponse *res, const header_v_t &cors_headers,
+                        nlohmann::json &&body)
 {
-    std::thread t ([recv] () {
+    std::thread t ([res, cors_headers, json_body = std::move (body)] () {
         thread_manager::DoneSetter tmds;
 
-        APIResponse *res = recv.res;
-        APIRequest *req = recv.req;
-        const std::string &body = recv.body;
-        const auto &cors_headers = recv.cors_headers;
-
         response::end_t endres (res);
         response::defer_end_t defer_endres (endres);
 
@@ -257,14 +258,6 @@ handle_post_login_body (const states::recv_body_t &recv)
         endres.headers = cors_headers;
         endres.response = "body";
 
-        // request might been aborted? or they actually sent empty body??
-        // the former should never happen when it reaches here, so just reply
-        // with bad request
-        if (body.empty ())
-            {
-                return;
-            }
-
         /*
            {
                 "code": string,
@@ -272,27 +265,6 @@ handle_post_login_body (const states::recv_body_t &recv)
                 "redirect_uri": string
            }
          */
-        nlohmann::json json_body;
-
-        try
-            {
-                json_body = nlohmann::json::parse (body);
-            }
-        catch (const nlohmann::json::exception &e)
-            {
-                fprintf (stderr,
-                         "[server::routes::handle_post_login_body ERROR] %s\n",
-                         e.what ());
-
-                fprintf (stderr,
-                         "================================================\n");
-                std::cerr << body << '\n';
-                fprintf (stderr,
-                         "================================================\n");
-
-                // let fall through so handled by below if
-            }
-
         if (!json_body.is_object ())
             {
                 return;
@@ -300,7 +272,7 @@ handle_post_login_body (const states::recv_body_t &recv)
 
         // the actual post handler starts here...
 
-        auto i_state = json_body["state"];
+        auto i_state = json_body.value ("state", nlohmann::json ());
 
         std::string state
             = !i_state.is_string () ? "" : i_state.get<std::string> ();
@@ -323,7 +295,7 @@ handle_post_login_body (const states::recv_body_t &recv)
                 return;
             }
 
-        auto i_code = json_body["code"];
+        auto i_code = json_body.value ("code", nlohmann::json ());
 
         std::string code
             = !i_code.is_string () ? "" : i_code.get<std::string> ();
@@ -334,7 +306,8 @@ handle_post_login_body (const states::recv_body_t &recv)
                 return;
             }
 
-        auto i_redirect_uri = json_body["redirect_uri"];
+        auto i_redirect_uri
+            = json_body.value ("redirect_uri", nlohmann::json ());
 
         std::string redirect_uri = !i_redirect_uri.is_string ()
                                        ? ""
@@ -381,6 +354,25 @@ handle_post_login_body (const states::recv_body_t &recv)
     thread_manager::dispatch (t);
 }
 
+// respond right away on the server thread
+static void
+reject_post_login_body (APIResponse *res, const header_v_t &cors_headers,
+                        body_parser::parse_status_e status)
+{
+    response::end_t endres (res);
+    endres.headers = cors_headers;
+
+    if (status == body_parser::PARSE_STATUS_ERROR_TOO_LARGE)
+        {
+            endres.status = http_status_t.PAYLOAD_TOO_LARGE_413;
+            endres.response = "body";
+            return;
+        }
+
+    endres.status = http_status_t.BAD_REQUEST_400;
+    endres.response = "body";
+}
+
 void
 post_login (APIResponse *res, APIRequest *req)
 {
@@ -390,62 +382,68 @@ post_login (APIResponse *res, APIRequest *req)
 
     /* middlewares::print_headers (req); */
 
-    states::recv_body_t struct_body = states::create_recv_body_t (
-        "post_login", std::string (res->getRemoteAddressAsText ()), res, req,
-        cors_headers);
+    // reject before receiving any of it when client tells us it's too large
+    const std::string_view content_length = req->getHeader ("content-length");
+    if (!content_length.empty ()
+        && strtoull (std::string (content_length).c_str (), NULL, 10)
+               > POST_LOGIN_MAX_BODY_SIZE)
+        {
+            reject_post_login_body (res, cors_headers,
+                                    body_parser::PARSE_STATUS_ERROR_TOO_LARGE);
+            return;
+        }
+
+    uint64_t rid;
 
     {
         std::lock_guard lk (states::recv_body_cache_m);
-        int status = states::store_recv_body_cache (struct_body);
+        rid = states::store_recv_body_cache (
+            "post_login", std::string (res->getRemoteAddressAsText ()), res,
+            cors_headers, POST_LOGIN_MAX_BODY_SIZE, POST_LOGIN_MAX_BODY_DEPTH);
+    }
 
-        if (status)
-            {
-                // this should never happen, there's smt wrong with your code
-                fprintf (
-                    stderr,
-                    "[server::routes::post_login FATAL] Duplicate request "
-                    "found, terminating\n");
+    res->onData ([rid] (std::string_view chunk, bool is_last) {
+        std::lock_guard lk (states::recv_body_cache_m);
+        states::recv_body_t *cache = states::get_recv_body_cache (rid);
 
-                std::terminate ();
+        if (!cache)
+            {
+                // request aborted or already rejected, returns now
+                return;
             }
-    }
 
-    res->onData (
-        [cors_headers, struct_body] (std::string_view chunk, bool is_last) {
-            std::lock_guard lk (states::recv_body_cache_m);
-            std::vector<states::recv_body_t>::iterator cache
-                = get_recv_body_cache (struct_body);
+        body_parser::parse_status_e status = cache->parser.feed (chunk);
 
-            if (is_recv_body_cache_end_iterator (cache))
-                {
-                    // request aborted, returns now
-                    return;
-                }
+        // only OK when body is exactly one complete document
+        if (is_last
+            && (status == body_parser::PARSE_STATUS_OK
+                || status == body_parser::PARSE_STATUS_INCOMPLETE))
+            status = cache->parser.finish ();
 
-            cache->body.append (chunk);
+        if (status != body_parser::PARSE_STATUS_OK
+            && status != body_parser::PARSE_STATUS_INCOMPLETE)
+            {
+                reject_post_login_body (cache->res, cache->cors_headers,
+                                        status);
 
-            if (is_last)
-                {
-                    handle_post_login_body (*cache);
+                states::delete_recv_body_cache (rid);
+                return;
+            }
 
-                    delete_recv_body_cache (cache);
+        if (!is_last)
+            return;
 
-                    return;
-                }
-        });
+        handle_post_login_body (cache->res, cache->cors_headers,
+                                std::move (cache->parser.get ()));
 
-    res->onAborted ([struct_body] () {
-        std::lock_guard lk (states::recv_body_cache_m);
-        std::vector<states::recv_body_t>::iterator cache
-            = get_recv_body_cache (struct_body);
+        states::delete_recv_body_cache (rid);
+    });
 
-        if (is_recv_body_cache_end_iterator (cache))
-            {
-                // well nothing to clean up, what else to do?
-                return;
-            }
+    res->onAborted ([rid] () {
+        std::lock_guard lk (states::recv_body_cache_m);
 
-        delete_recv_body_cache (cache);
+        // nothing to clean up if it's already done
+        states::delete_recv_body_cache (rid);
     });
 
     /*
@@ -1,120 +1,298 @@
 #include "musicat/server/service_cache.h"
 #include "musicat/musicat.h"
+#include "musicat/server/timer_wheel.h"
+#include "musicat/util/hash.h"
+#include "musicat/util/json.h"
 #include "nlohmann/json.hpp"
+#include <atomic>
 #include <dpp/dpp.h>
-#include <map>
+#include <list>
 #include <mutex>
+#include <unordered_map>
 
 // can be used for db cache too
 namespace musicat::server::service_cache
 {
 
-struct invalidate_timer_t
+// keys are spread across shards so concurrent requests for different users
+// don't contend on a single lock
+inline constexpr const size_t SHARD_COUNT = 16;
+
+// rough per entry bookkeeping cost on top of key and value
+inline constexpr const size_t ENTRY_OVERHEAD = 128;
+
+struct entry_t
 {
-    long long ts;
-    int second_max_age;
-    std::string key;
+    // only one of these is set
+    value_t value;
+    response_t response;
+    size_t size;
+    // 0 never expire
+    long long expire_at;
+    // 0 when never expire
+    timer_wheel::timer_id_t timer;
+    std::list<std::string>::iterator lru_i;
 };
 
-std::map<std::string, nlohmann::json> _cache;
-std::mutex cache_m;
+struct shard_t
+{
+    std::mutex m;
+    std::unordered_map<std::string, entry_t> entries;
+    // most recently used at front
+    std::list<std::string> lru;
+    size_t size = 0;
+};
 
-std::vector<invalidate_timer_t> _timers;
-std::mutex _timers_m;
+static shard_t _shards[SHARD_COUNT];
 
-void
-set (const std::string &key, const nlohmann::json &value)
+static std::atomic<uint64_t> _hits = 0;
+static std::atomic<uint64_t> _misses = 0;
+static std::atomic<uint64_t> _evictions = 0;
+static std::atomic<uint64_t> _expirations = 0;
+
+static long long
+_now_second ()
 {
-    std::lock_guard lk (cache_m);
+    return std::chrono::duration_cast<std::chrono::seconds> (
+               std::chrono::steady_clock::now ().time_since_epoch ())
+        .count ();
+}
 
-    _cache.insert_or_assign (key, value);
+static shard_t &
+_get_shard (const std::string &key)
+{
+    return _shards[std::hash<std::string>{}(key) % SHARD_COUNT];
 }
 
-nlohmann::json
-get (const std::string &key)
+static bool
+_is_expired (const entry_t &e, long long now)
 {
-    std::lock_guard lk (cache_m);
+    return e.expire_at && e.expire_at <= now;
+}
+
+// shard must be locked
+static void
+_erase (shard_t &s, std::unordered_map<std::string, entry_t>::iterator i)
+{
+    if (i->second.timer)
+        timer_wheel::cancel (i->second.timer);
+
+    s.size -= i->second.size;
+    s.lru.erase (i->second.lru_i);
+    s.entries.erase (i);
+}
 
-    auto i = _cache.find (key);
-    if (i == _cache.end ())
+// shard must be locked
+static void
+_evict_to_fit (shard_t &s, size_t max_size)
+{
+    while (s.size > max_size && !s.lru.empty ())
         {
-            return nullptr;
+            auto i = s.entries.find (s.lru.back ());
+            if (i == s.entries.end ())
+                {
+                    // shouldn't happen
+                    s.lru.pop_back ();
+                    continue;
+                }
+
+            _erase (s, i);
+            _evictions++;
         }
+}
+
+// called by timer wheel on server thread
+static void
+_expire (const std::string &key, long long expire_at)
+{
+    shard_t &s = _get_shard (key);
+    std::lock_guard lk (s.m);
+
+    auto i = s.entries.find (key);
 
-    return i->second;
+    // replaced entry has its own timer
+    if (i == s.entries.end () || i->second.expire_at != expire_at)
+        return;
+
+    // already fired, nothing to cancel
+    i->second.timer = 0;
+    _erase (s, i);
+    _expirations++;
 }
 
-void
-remove (const std::string &key)
+// shard must be locked
+template <typename F>
+static void
+_remove_if (shard_t &s, F pred)
 {
-    std::lock_guard lk (cache_m);
+    auto i = s.entries.begin ();
+    while (i != s.entries.end ())
+        {
+            if (!pred (i->first))
+                {
+                    i++;
+                    continue;
+                }
+
+            auto next = std::next (i);
+            _erase (s, i);
+            i = next;
+        }
+}
 
-    auto i = _cache.find (key);
-    if (i == _cache.end ())
+static size_t
+_get_max_shard_size ()
+{
+    const size_t max_total = get_max_service_cache_size ();
+
+    return max_total ? max_total / SHARD_COUNT : (size_t)-1;
+}
+
+static void
+_insert (const std::string &key, entry_t &&entry, int second_max_age)
+{
+    const size_t max_size = _get_max_shard_size ();
+
+    entry.expire_at
+        = second_max_age > 0 ? _now_second () + second_max_age : 0;
+
+    shard_t &s = _get_shard (key);
+    std::lock_guard lk (s.m);
+
+    auto i = s.entries.find (key);
+    if (i != s.entries.end ())
+        _erase (s, i);
+
+    // wouldn't fit anyway
+    if (entry.size > max_size)
+        return;
+
+    const long long expire_at = entry.expire_at;
+
+    entry.timer = 0;
+    if (expire_at)
+        entry.timer = timer_wheel::schedule (
+            (uint64_t)second_max_age * 1000,
+            [key, expire_at] () { _expire (key, expire_at); });
+
+    s.lru.push_front (key);
+    entry.lru_i = s.lru.begin ();
+    s.size += entry.size;
+    s.entries.insert_or_assign (key, std::move (entry));
+
+    _evict_to_fit (s, max_size);
+}
+
+// shard must be locked, returns end iterator and counts a miss when
+// there's no valid entry
+static std::unordered_map<std::string, entry_t>::iterator
+_find_valid (shard_t &s, const std::string &key)
+{
+    auto i = s.entries.find (key);
+    if (i == s.entries.end ())
         {
-            return;
+            _misses++;
+            return i;
         }
 
-    _cache.erase (i);
+    if (_is_expired (i->second, _now_second ()))
+        {
+            _erase (s, i);
+            _expirations++;
+            _misses++;
+            return s.entries.end ();
+        }
+
+    s.lru.splice (s.lru.begin (), s.lru, i->second.lru_i);
+
+    _hits++;
+    return i;
 }
 
 void
-create_invalidate_timer (const std::string &key, int second_max_age)
+set (const std::string &key, const nlohmann::json &value, int second_max_age)
 {
-    std::lock_guard lk (_timers_m);
+    entry_t e;
+    e.size = key.size () + util::json::estimate_size (value)
+             + ENTRY_OVERHEAD;
+    // constructed outside of lock
+    e.value = std::make_shared<const nlohmann::json> (value);
 
-    _timers.push_back ({ std::chrono::high_resolution_clock::now ()
-                             .time_since_epoch ()
-                             .count (),
-                         second_max_age, key });
+    _insert (key, std::move (e), second_max_age);
 }
 
 void
-check_timers ()
+set_response (const std::string &key, std::string body, int second_max_age)
 {
-    std::lock_guard lk (_timers_m);
+    entry_t e;
+    e.size = key.size () + body.size () + ENTRY_OVERHEAD;
 
-    auto i = _timers.begin ();
-    while (i != _timers.end ())
-        {
-            long long current_ts = std::chrono::high_resolution_clock::now ()
-                                       .time_since_epoch ()
-                                       .count ();
+    std::string etag = util::hash::create_etag (body);
+    e.response = std::make_shared<const cached_response_t> (
+        cached_response_t{ std::move (body), std::move (etag) });
 
-            long long passed = (current_ts - i->ts);
-            long long max = ((long long)i->second_max_age * 1000000000LL);
+    _insert (key, std::move (e), second_max_age);
+}
 
-            if (passed > max)
-                {
-                    remove (i->key);
-                    i = _timers.erase (i);
-                    continue;
-                }
+value_t
+get (const std::string &key)
+{
+    shard_t &s = _get_shard (key);
+    std::lock_guard lk (s.m);
 
-            i++;
-        }
+    auto i = _find_valid (s, key);
+    if (i == s.entries.end ())
+        return nullptr;
+
+    return i->second.value;
+}
+
+response_t
+get_response (const std::string &key)
+{
+    shard_t &s = _get_shard (key);
+    std::lock_guard lk (s.m);
+
+    auto i = _find_valid (s, key);
+    if (i == s.entries.end ())
+        return nullptr;
+
+    return i->second.response;
 }
 
 void
-remove_invalidate_timer (const std::string &key)
+remove (const std::string &key)
 {
-    std::lock_guard lk (_timers_m);
+    shard_t &s = _get_shard (key);
+    std::lock_guard lk (s.m);
 
-    auto i = _timers.begin ();
-    while (i != _timers.end ())
+    auto i = s.entries.find (key);
+    if (i == s.entries.end ())
         {
-            if (i->key != key)
-                {
-                    i++;
-                    continue;
-                }
-
-            _timers.erase (i);
             return;
         }
+
+    // cancels its expire timer too
+    _erase (s, i);
+}
+
+stats_t
+get_stats ()
+{
+    stats_t ret = { _hits, _misses, _evictions, _expirations, 0, 0,
+                    get_max_service_cache_size () };
+
+    for (shard_t &s : _shards)
+        {
+            std::lock_guard lk (s.m);
+            ret.entries += s.entries.size ();
+            ret.size += s.size;
+        }
+
+    return ret;
 }
 
-nlohmann::json
+value_t
 get_cached_user_auth (const std::string &user_id)
 {
     return get (user_id + "/auth");
@@ -123,14 +301,11 @@ get_cached_user_auth (const std::string &user_id)
 void
 set_cached_user_auth (const std::string &user_id, const nlohmann::json &data)
 {
-    std::string key = user_id + "/auth";
-    set (key, data);
-
     // 5 minutes
-    create_invalidate_timer (key, 300);
+    set (user_id + "/auth", data, 300);
 }
 
-nlohmann::json
+value_t
 get_cached_user_guilds (const std::string &user_id)
 {
     return get (user_id + "/get_user_guilds");
@@ -139,25 +314,37 @@ get_cached_user_guilds (const std::string &user_id)
 void
 set_cached_user_guilds (const std::string &user_id, const nlohmann::json &data)
 {
-    std::string key = user_id + "/get_user_guilds";
-    set (key, data);
-
     // now we handle guild event properly and cache invalidation
     // we can store all the cache as long as we want
     // one day
-    create_invalidate_timer (key, 86400);
+    set (user_id + "/get_user_guilds", data, 86400);
+}
+
+response_t
+get_cached_user_guilds_response (const std::string &user_id)
+{
+    return get_response (user_id + "/get_user_guilds/response");
 }
 
 void
-remove_cached_user_guilds (const std::string &user_id)
+set_cached_user_guilds_response (const std::string &user_id,
+                                 std::string body)
 {
-    std::string key = user_id + "/get_user_guilds";
+    // bound to guild list so it's invalidated by the same events, but
+    // mutual state can still change without them, eg. when bot cache isn't
+    // ready yet on boot. Keep this short
+    set_response (user_id + "/get_user_guilds/response", std::move (body),
+                  300);
+}
 
-    remove (key);
-    remove_invalidate_timer (key);
+void
+remove_cached_user_guilds (const std::string &user_id)
+{
+    remove (user_id + "/get_user_guilds");
+    remove (user_id + "/get_user_guilds/response");
 }
 
-nlohmann::json
+value_t
 get_cached_musicat_detailed_user ()
 {
     const auto shaid = get_sha_id ();
@@ -176,15 +363,29 @@ set_cached_musicat_detailed_user (const nlohmann::json &data)
     if (!shaid)
         return;
 
-    std::string key = shaid.str () + "/detailed_user";
-    set (key, data);
-
     // 1 hour
-    create_invalidate_timer (key, 3600);
+    set (shaid.str () + "/detailed_user", data, 3600);
 }
 
 // !TODO: handle user update
 
+static void
+_remove_members_cached_user_guilds (const dpp::members_container &members)
+{
+    for (shard_t &s : _shards)
+        {
+            std::lock_guard lk (s.m);
+
+            _remove_if (s, [&members] (const std::string &key) {
+                size_t idx = key.find ("/get_user_guilds");
+                if (idx == key.npos)
+                    return false;
+
+                return members.find (key.substr (0, idx)) != members.end ();
+            });
+        }
+}
+
 void
 handle_guild_create (const dpp::guild_create_t &e)
 {
@@ -193,29 +394,7 @@ handle_guild_create (const dpp::guild_create_t &e)
 
     remove_cached_user_guilds (e.created->owner_id.str ());
 
-    std::lock_guard lk (cache_m);
-
-    auto i = _cache.begin ();
-    while (i != _cache.end ())
-        {
-            size_t idx = i->first.find ("/get_user_guilds");
-            if (idx == i->first.npos)
-                {
-                    i++;
-                    continue;
-                }
-
-            std::string uid = i->first.substr (0, idx);
-
-            if (e.created->members.find (uid) == e.created->members.end ())
-                {
-                    i++;
-                    continue;
-                }
-
-            remove_invalidate_timer (i->first);
-            i = _cache.erase (i);
-        }
+    _remove_members_cached_user_guilds (e.created->members);
 }
 
 void
@@ -226,31 +405,20 @@ handle_guild_delete (const dpp::guild_delete_t &e)
 
     remove_cached_user_guilds (e.deleted.owner_id.str ());
 
-    std::lock_guard lk (cache_m);
-
-    auto i = _cache.begin ();
-    while (i != _cache.end ())
-        {
-            size_t idx = i->first.find ("/get_user_guilds");
-            if (idx == i->first.npos)
-                {
-                    i++;
-                    continue;
-                }
-
-            std::string uid = i->first.substr (0, idx);
-
-            if (e.deleted.members.find (uid) == e.deleted.members.end ())
-                {
-                    i++;
-                    continue;
-                }
+    _remove_members_cached_user_guilds (e.deleted.members);
+}
 
-            remove_invalidate_timer (i->first);
-            i = _cache.erase (i);
-        }
+void
+handle_guild_member_add (const dpp::guild_member_add_t &e)
+{
+    // user guild list and its mutual state changed
+    remove_cached_user_guilds (e.added.user_id.str ());
 }
 
-// !TODO: handle guild member add/delete
+void
+handle_guild_member_remove (const dpp::guild_member_remove_t &e)
+{
+    remove_cached_user_guilds (e.removed.id.str ());
+}
 
 } // musicat::server::service_cache
@@ -1,8 +1,6 @@
 #include "musicat/server/services.h"
 #include "musicat/musicat.h"
-#include <curlpp/Easy.hpp>
-#include <curlpp/Infos.hpp>
-#include <curlpp/Options.hpp>
+#include "musicat/util/http.h"
 
 namespace musicat::server::services
 {
@@ -11,71 +9,28 @@ curlpp_response_t
 discord_get_wauth (const char *endpoint, const std::string &type,
                    const std::string &token)
 {
-    std::ostringstream os;
-
-    curlpp::Easy req;
-
-    req.setOpt (
-        curlpp::options::Url (std::string (DISCORD_API_URL) + endpoint));
-
     std::string header = "Authorization: " + type + ' ' + token;
 
-    req.setOpt (curlpp::options::Header (1L));
-    req.setOpt (curlpp::options::HttpHeader ({ header.c_str () }));
-
-    /* req.setOpt (curlpp::options::Verbose (1L)); */
-
-    req.setOpt (curlpp::options::WriteStream (&os));
-
-    try
-        {
-            req.perform ();
-        }
-    catch (const curlpp::LibcurlRuntimeError &e)
-        {
-            fprintf (stderr,
-                     "[ERROR] "
-                     "LibcurlRuntimeError(%d): %s\n",
-                     e.whatCode (), e.what ());
+    util::http::response_t res = util::http::perform (
+        { std::string (DISCORD_API_URL) + endpoint, "", { header }, "", true,
+          0 });
 
-            return { false, 0, 0, "" };
-        }
+    if (!res.success)
+        return { false, 0, 0, "" };
 
-    return { true, curlpp::Infos::ResponseCode::get (req),
-             curlpp::Infos::HeaderSize::get (req), os.str () };
+    return { true, res.status, res.header_size, std::move (res.response) };
 }
 
 curlpp_response_t
 discord_post_creds (const std::string &creds)
 {
-    std::ostringstream os;
-
-    curlpp::Easy req;
-
-    req.setOpt (curlpp::options::Url (DISCORD_API_URL "/oauth2/token"));
-    req.setOpt (curlpp::options::Header (1L));
-
-    req.setOpt (curlpp::options::PostFields (creds));
-    req.setOpt (curlpp::options::PostFieldSize (creds.length ()));
-
-    req.setOpt (curlpp::options::WriteStream (&os));
-
-    try
-        {
-            req.perform ();
-        }
-    catch (const curlpp::LibcurlRuntimeError &e)
-        {
-            fprintf (stderr,
-                     "[ERROR] "
-                     "LibcurlRuntimeError(%d): %s\n",
-                     e.whatCode (), e.what ());
+    util::http::response_t res = util::http::perform (
+        { DISCORD_API_URL "/oauth2/token", "", {}, creds, true, 0 });
 
-            return { false, 0, 0, "" };
-        }
+    if (!res.success)
+        return { false, 0, 0, "" };
 
-    return { true, curlpp::Infos::ResponseCode::get (req),
-             curlpp::Infos::HeaderSize::get (req), os.str () };
+    return { true, res.status, res.header_size, std::move (res.response) };
 }
 
 curlpp_response_t
@@ -1,29 +1,37 @@
 #include "musicat/server/states.h"
 #include "musicat/musicat.h"
 #include "musicat/server/auth.h"
+#include "musicat/server/response.h"
 #include "musicat/thread_manager.h"
 #include "musicat/util.h"
 #include <deque>
 #include <string>
+#include <unordered_map>
 
 // in seconds
 #define STATE_LIFETIME 600
+#define RECV_BODY_TIMEOUT 30
 
 namespace musicat::server::states
 {
 // this should always be used inside server thread, hence no mutex
 auth::jwt_verifier_t *_jwt_verifier = nullptr;
 
-std::map<std::string, std::string> _oauth_states;
+struct oauth_state_t
+{
+    std::string redirect;
+    timer_wheel::timer_id_t timer;
+};
+
+static std::unordered_map<std::string, oauth_state_t> _oauth_states;
 std::mutex _oauth_states_m;
 
+// indexed by recv_body_t::rid
 // !TODO: reserve from somewhere?
-static std::vector<recv_body_t> _recv_body_cache;
+static std::unordered_map<uint64_t, recv_body_t> _recv_body_cache;
+static uint64_t _recv_body_rid = 0;
 std::mutex recv_body_cache_m; // EXTERN_VARIABLE
 
-static std::vector<oauth_timer_t> _oauth_timers;
-std::mutex oauth_timers_m; // EXTERN_VARIABLE
-
 int
 remove_oauth_state (const std::string &state, std::string *redirect)
 {
@@ -34,28 +42,20 @@ remove_oauth_state (const std::string &state, std::string *redirect)
         return -1;
 
     if (redirect)
-        *redirect = i->second;
+        *redirect = i->second.redirect;
+
+    // no-op when called by the timer itself
+    timer_wheel::cancel (i->second.timer);
 
     _oauth_states.erase (i);
     return 0;
 }
 
-bool
-should_break_oauth_states (const std::string &val)
+size_t
+get_oauth_state_count ()
 {
     std::lock_guard lk (_oauth_states_m);
-    auto i = _oauth_states.find (val);
-    return i == _oauth_states.end ();
-}
-
-void
-util_create_remove_thread (int second_sleep, const std::string &val,
-                           int (*remove_fn) (const std::string &,
-                                             std::string *),
-                           bool (*should_break) (const std::string &) = NULL)
-{
-    register_timer ({ util::get_current_ts (), second_sleep, val, remove_fn,
-                      should_break });
+    return _oauth_states.size ();
 }
 
 inline constexpr const char token[]
@@ -85,64 +85,69 @@ generate_oauth_state (const std::string &redirect)
         }
     while (_oauth_states.find (state) != _oauth_states.end ());
 
-    _oauth_states.insert_or_assign (state, redirect);
+    const timer_wheel::timer_id_t timer = timer_wheel::schedule (
+        STATE_LIFETIME * 1000, [state] () { remove_oauth_state (state); });
 
-    util_create_remove_thread (STATE_LIFETIME, state, remove_oauth_state,
-                               should_break_oauth_states);
+    _oauth_states.insert_or_assign (state, oauth_state_t{ redirect, timer });
 
     return state;
 }
 
-recv_body_t
-create_recv_body_t (const char *endpoint, const std::string &id,
-                    APIResponse *res, APIRequest *req,
-                    const header_v_t &cors_headers)
+static void
+_recv_body_timeout (uint64_t rid)
 {
-    return {
-        util::get_current_ts (), endpoint, id, "", res, req, cors_headers
-    };
-}
+    std::lock_guard lk (recv_body_cache_m);
 
-std::vector<recv_body_t>::iterator
-get_recv_body_cache (const recv_body_t &struct_body)
-{
-    auto i = _recv_body_cache.begin ();
-    while (i != _recv_body_cache.end ())
-        {
-            if (i->ts == struct_body.ts && i->id == struct_body.id
-                && i->endpoint == struct_body.endpoint)
-                return i;
+    auto i = _recv_body_cache.find (rid);
+    if (i == _recv_body_cache.end ())
+        return;
 
-            i++;
-        }
+    // timer is already gone, called on server thread
+    {
+        response::end_t endres (i->second.res);
+        endres.status = http_status_t.REQUEST_TIMEOUT_408;
+        endres.headers = i->second.cors_headers;
+    }
 
-    return i;
+    _recv_body_cache.erase (i);
 }
 
-bool
-is_recv_body_cache_end_iterator (std::vector<recv_body_t>::iterator i)
+uint64_t
+store_recv_body_cache (const char *endpoint, const std::string &id,
+                       APIResponse *res, const header_v_t &cors_headers,
+                       size_t max_size, size_t max_depth)
 {
-    return i == _recv_body_cache.end ();
+    const uint64_t rid = ++_recv_body_rid;
+
+    const timer_wheel::timer_id_t timer = timer_wheel::schedule (
+        RECV_BODY_TIMEOUT * 1000, [rid] () { _recv_body_timeout (rid); });
+
+    _recv_body_cache.try_emplace (
+        rid, recv_body_t{ rid, util::get_current_ts (), endpoint, id,
+                          body_parser::json_parser_t (max_size, max_depth),
+                          res, cors_headers, timer });
+
+    return rid;
 }
 
-int
-store_recv_body_cache (const recv_body_t &struct_body)
+recv_body_t *
+get_recv_body_cache (uint64_t rid)
 {
-    auto i = get_recv_body_cache (struct_body);
-    if (!is_recv_body_cache_end_iterator (i))
-        return 1;
-
-    _recv_body_cache.emplace_back (struct_body);
+    auto i = _recv_body_cache.find (rid);
+    if (i == _recv_body_cache.end ())
+        return NULL;
 
-    return 0;
+    return &i->second;
 }
 
 void
-delete_recv_body_cache (std::vector<recv_body_t>::iterator i)
+delete_recv_body_cache (uint64_t rid)
 {
+    auto i = _recv_body_cache.find (rid);
     if (i == _recv_body_cache.end ())
         return;
 
+    timer_wheel::cancel (i->second.timer);
     _recv_body_cache.erase (i);
 }
 
@@ -157,6 +162,11 @@ init ()
 {
     reserve_recv_body_cache (100);
 
+    {
+        std::lock_guard lk (_oauth_states_m);
+        _oauth_states.reserve (1000);
+    }
+
     return 0;
 }
 
@@ -172,129 +182,4 @@ get_jwt_verifier_ptr ()
     return _jwt_verifier;
 }
 
-bool
-oauth_timer_t_is (const oauth_timer_t &t1, const oauth_timer_t &t2)
-{
-    return t1.ts == t2.ts && t1.val == t2.val && t1.remove_fn == t2.remove_fn
-           && t1.second_sleep == t2.second_sleep
-           && t1.should_break == t2.should_break;
-}
-
-int
-register_timer (const oauth_timer_t &t)
-{
-    std::lock_guard lk (oauth_timers_m);
-
-    int status = 0;
-
-    auto i = _oauth_timers.begin ();
-    while (i != _oauth_timers.end ())
-        {
-            if (!oauth_timer_t_is (t, *i))
-                {
-                    i++;
-                    continue;
-                }
-
-            status = -1;
-            break;
-        }
-
-    if (status)
-        return status;
-
-    _oauth_timers.push_back (t);
-
-    return 0;
-}
-
-int
-remove_timer (const oauth_timer_t &t)
-{
-    std::lock_guard lk (oauth_timers_m);
-
-    int status = -1;
-
-    auto i = _oauth_timers.begin ();
-    while (i != _oauth_timers.end ())
-        {
-            if (!oauth_timer_t_is (t, *i))
-                {
-                    i++;
-                    continue;
-                }
-
-            status = 0;
-            i->remove_fn (i->val, NULL);
-            i = _oauth_timers.erase (i);
-        }
-
-    return status;
-}
-
-int
-check_timers ()
-{
-    std::lock_guard lk (oauth_timers_m);
-
-    int status = -1;
-
-    auto i = _oauth_timers.begin ();
-    while (i != _oauth_timers.end ())
-        {
-            if (i->should_break && i->should_break (i->val))
-                {
-                    i = _oauth_timers.erase (i);
-                    continue;
-                }
-
-            long long current_ts = util::get_current_ts ();
-
-            long long passed = (current_ts - i->ts);
-            long long max = ((long long)i->second_sleep * 1000000000LL);
-
-            if (passed > max)
-                {
-                    i->remove_fn (i->val, NULL);
-                    i = _oauth_timers.erase (i);
-                    continue;
-                }
-
-            i++;
-        }
-
-    return status;
-}
-
-int
-remove_all_timers ()
-{
-    std::lock_guard lk (oauth_timers_m);
-
-    auto i = _oauth_timers.begin ();
-    while (i != _oauth_timers.end ())
-        {
-            i->remove_fn (i->val, NULL);
-            i = _oauth_timers.erase (i);
-        }
-
-    return 0;
-}
-
-oauth_timer_t
-get_oauth_timer (const std::string &val)
-{
-    std::lock_guard lk (oauth_timers_m);
-
-    for (const auto &i : _oauth_timers)
-        {
-            if (i.val != val)
-                continue;
-
-            return i;
-        }
-
-    return { 0, 0, "", NULL, NULL };
-}
-
 } // musicat::server::states
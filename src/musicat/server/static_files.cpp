@@ -0,0 +1,439 @@
+#include "musicat/server/static_files.h"
+#include "musicat/server/middlewares.h"
+#include "musicat/util/hash.h"
+#include <fcntl.h>
+#include <filesystem>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace musicat::server::static_files
+{
+
+struct content_type_entry_t
+{
+    const char *ext;
+    const char *type;
+};
+
+inline constexpr const content_type_entry_t content_types[] = {
+    { ".html", "text/html; charset=utf-8" },
+    { ".js", "text/javascript; charset=utf-8" },
+    { ".mjs", "text/javascript; charset=utf-8" },
+    { ".css", "text/css; charset=utf-8" },
+    { ".json", "application/json" },
+    { ".map", "application/json" },
+    { ".webmanifest", "application/manifest+json" },
+    { ".txt", "text/plain; charset=utf-8" },
+    { ".xml", "application/xml" },
+    { ".svg", "image/svg+xml" },
+    { ".png", "image/png" },
+    { ".jpg", "image/jpeg" },
+    { ".jpeg", "image/jpeg" },
+    { ".gif", "image/gif" },
+    { ".webp", "image/webp" },
+    { ".avif", "image/avif" },
+    { ".ico", "image/x-icon" },
+    { ".woff", "font/woff" },
+    { ".woff2", "font/woff2" },
+    { ".ttf", "font/ttf" },
+    { ".wasm", "application/wasm" },
+    { ".mp3", "audio/mpeg" },
+    { ".ogg", "audio/ogg" },
+    { ".opus", "audio/ogg" },
+    { NULL, NULL },
+};
+
+inline constexpr const char *default_content_type = "application/octet-stream";
+
+// suffix and header value of each encoding_e, identity has no suffix
+inline constexpr const char *encoding_suffixes[ENCODING_MAX]
+    = { "", ".gz", ".br" };
+inline constexpr const char *encoding_names[ENCODING_MAX]
+    = { "identity", "gzip", "br" };
+
+// url path -> file
+static std::map<std::string, file_entry_t> _files;
+
+////////////////////////////////////////////////////////////////////////////////
+
+static const char *
+_get_content_type (const std::string &path)
+{
+    const size_t dot = path.find_last_of ('.');
+    if (dot == std::string::npos)
+        return default_content_type;
+
+    const std::string ext = path.substr (dot);
+
+    for (size_t i = 0; content_types[i].ext; i++)
+        {
+            if (ext == content_types[i].ext)
+                return content_types[i].type;
+        }
+
+    return default_content_type;
+}
+
+static std::string
+_create_etag (const char *data, size_t size, encoding_e enc)
+{
+    // content addressed so the tag is stable across restart
+    return util::hash::create_etag (
+        std::string_view (data, size),
+        enc == ENCODING_IDENTITY ? "" : encoding_names[enc]);
+}
+
+static int
+_map_file (const std::string &fullpath, encoding_e enc, mapped_file_t &out)
+{
+    out = { NULL, 0, "" };
+
+    int fd = open (fullpath.c_str (), O_RDONLY);
+    if (fd < 0)
+        {
+            fprintf (stderr,
+                     "[server::static_files::_map_file ERROR] "
+                     "Can't open '%s': ",
+                     fullpath.c_str ());
+            perror ("");
+            return -1;
+        }
+
+    struct stat st;
+    if (fstat (fd, &st) != 0)
+        {
+            perror ("[server::static_files::_map_file ERROR] fstat");
+            close (fd);
+            return -1;
+        }
+
+    const size_t size = st.st_size;
+
+    // mmap doesn't accept zero length, serve empty body instead
+    if (!size)
+        {
+            close (fd);
+            out.etag = _create_etag (NULL, 0, enc);
+            return 0;
+        }
+
+    void *data = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // mapping holds its own reference to the file
+    close (fd);
+
+    if (data == MAP_FAILED)
+        {
+            fprintf (stderr,
+                     "[server::static_files::_map_file ERROR] "
+                     "Can't map '%s': ",
+                     fullpath.c_str ());
+            perror ("");
+            return -1;
+        }
+
+    // served front to back
+    madvise (data, size, MADV_SEQUENTIAL);
+
+    out.data = (const char *)data;
+    out.size = size;
+    out.etag = _create_etag (out.data, size, enc);
+
+    return 0;
+}
+
+static void
+_unmap_file (mapped_file_t &f)
+{
+    if (f.data)
+        munmap ((void *)f.data, f.size);
+
+    f = { NULL, 0, "" };
+}
+
+static std::string_view
+_trim (std::string_view s)
+{
+    while (!s.empty () && (s.front () == ' ' || s.front () == '\t'))
+        s.remove_prefix (1);
+
+    while (!s.empty () && (s.back () == ' ' || s.back () == '\t'))
+        s.remove_suffix (1);
+
+    return s;
+}
+
+// calls cb with each trimmed, non empty comma separated token
+template <typename F>
+static void
+_for_each_token (std::string_view list, F cb)
+{
+    while (!list.empty ())
+        {
+            const size_t comma = list.find (',');
+            std::string_view token = _trim (list.substr (0, comma));
+
+            if (!token.empty ())
+                cb (token);
+
+            if (comma == std::string_view::npos)
+                break;
+
+            list.remove_prefix (comma + 1);
+        }
+}
+
+static void
+_parse_accept_encoding (std::string_view header,
+                        bool (&accepted)[ENCODING_MAX])
+{
+    accepted[ENCODING_IDENTITY] = true;
+
+    _for_each_token (header, [&accepted] (std::string_view token) {
+        std::string_view name = token;
+        std::string_view params = "";
+
+        const size_t semi = token.find (';');
+        if (semi != std::string_view::npos)
+            {
+                name = _trim (token.substr (0, semi));
+                params = token.substr (semi + 1);
+            }
+
+        // explicitly refused: q=0, q=0.0, q=0.00...
+        const size_t q = params.find ("q=0");
+        const bool refused = q != std::string_view::npos
+                             && params.find_first_not_of ("0.", q + 3)
+                                    == std::string_view::npos;
+
+        for (int i = ENCODING_GZIP; i < ENCODING_MAX; i++)
+            {
+                if (name == encoding_names[i])
+                    accepted[i] = !refused;
+            }
+    });
+}
+
+static const file_entry_t *
+_find_entry (std::string_view url)
+{
+    std::string path (url);
+
+    if (path.empty () || path.back () == '/')
+        path += "index.html";
+
+    auto i = _files.find (path);
+    if (i != _files.end ())
+        return &i->second;
+
+    // let the webapp router handle path without file extension
+    const size_t slash = path.find_last_of ('/');
+    if (path.find ('.', slash) != std::string::npos)
+        return NULL;
+
+    i = _files.find ("/index.html");
+    if (i != _files.end ())
+        return &i->second;
+
+    return NULL;
+}
+
+// returns false when socket is under backpressure
+static bool
+_stream (APIResponse *res, const mapped_file_t *f)
+{
+    const uintmax_t offset = res->getWriteOffset ();
+
+    auto [ok, done] = res->tryEnd (
+        std::string_view (f->data + offset, f->size - offset), f->size);
+
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int
+load (const std::string &dir)
+{
+    unload ();
+
+    std::error_code ec;
+    auto it = std::filesystem::recursive_directory_iterator (dir, ec);
+    if (ec)
+        {
+            fprintf (stderr,
+                     "[server::static_files::load ERROR] Can't read '%s': "
+                     "%s\n",
+                     dir.c_str (), ec.message ().c_str ());
+            return -1;
+        }
+
+    // url path -> fullpath, collected first so precompressed variants can
+    // always find their uncompressed sibling
+    std::map<std::string, std::string> paths;
+
+    for (const auto &p : it)
+        {
+            if (!p.is_regular_file (ec))
+                continue;
+
+            const std::string fullpath = p.path ().string ();
+            const std::string rel
+                = std::filesystem::relative (p.path (), dir, ec).string ();
+
+            if (ec || rel.empty ())
+                continue;
+
+            paths.insert_or_assign ("/" + rel, fullpath);
+        }
+
+    size_t mapped_size = 0;
+
+    for (const auto &[url, fullpath] : paths)
+        {
+            bool is_variant = false;
+            for (int i = ENCODING_GZIP; i < ENCODING_MAX; i++)
+                {
+                    const std::string_view suffix = encoding_suffixes[i];
+                    if (url.size () > suffix.size ()
+                        && url.compare (url.size () - suffix.size (),
+                                        suffix.size (), suffix)
+                               == 0
+                        && paths.find (url.substr (0, url.size ()
+                                                          - suffix.size ()))
+                               != paths.end ())
+                        {
+                            is_variant = true;
+                            break;
+                        }
+                }
+
+            // mapped together with its sibling
+            if (is_variant)
+                continue;
+
+            file_entry_t entry;
+            entry.content_type = _get_content_type (url);
+
+            if (_map_file (fullpath, ENCODING_IDENTITY,
+                           entry.variants[ENCODING_IDENTITY])
+                != 0)
+                continue;
+
+            mapped_size += entry.variants[ENCODING_IDENTITY].size;
+
+            for (int i = ENCODING_GZIP; i < ENCODING_MAX; i++)
+                {
+                    mapped_file_t &v = entry.variants[i];
+                    v = { NULL, 0, "" };
+
+                    auto vi = paths.find (url + encoding_suffixes[i]);
+                    if (vi == paths.end ())
+                        continue;
+
+                    if (_map_file (vi->second, (encoding_e)i, v) != 0)
+                        continue;
+
+                    // a "compressed" variant that isn't smaller is useless
+                    if (v.size >= entry.variants[ENCODING_IDENTITY].size)
+                        {
+                            _unmap_file (v);
+                            continue;
+                        }
+
+                    mapped_size += v.size;
+                }
+
+            _files.insert_or_assign (url, std::move (entry));
+        }
+
+    fprintf (stderr,
+             "[server::static_files] Loaded %zu files (%zu bytes) from "
+             "'%s'\n",
+             _files.size (), mapped_size, dir.c_str ());
+
+    return 0;
+}
+
+void
+unload ()
+{
+    for (auto &[url, entry] : _files)
+        {
+            for (int i = 0; i < ENCODING_MAX; i++)
+                _unmap_file (entry.variants[i]);
+        }
+
+    _files.clear ();
+}
+
+void
+handle (APIResponse *res, APIRequest *req)
+{
+    const file_entry_t *entry = _find_entry (req->getUrl ());
+    if (!entry)
+        {
+            res->writeStatus (http_status_t.NOT_FOUND_404);
+            res->end ();
+            return;
+        }
+
+    bool accepted[ENCODING_MAX] = {};
+    _parse_accept_encoding (req->getHeader ("accept-encoding"), accepted);
+
+    bool has_variant = false;
+    int enc = ENCODING_IDENTITY;
+    for (int i = ENCODING_GZIP; i < ENCODING_MAX; i++)
+        {
+            const mapped_file_t &v = entry->variants[i];
+            if (!v.data)
+                continue;
+
+            has_variant = true;
+
+            if (accepted[i] && v.size < entry->variants[enc].size)
+                enc = i;
+        }
+
+    const mapped_file_t *f = &entry->variants[enc];
+
+    if (middlewares::etag_match (req, f->etag))
+        {
+            res->writeStatus (http_status_t.NOT_MODIFIED_304);
+            res->writeHeader ("ETag", f->etag);
+            if (has_variant)
+                res->writeHeader ("Vary", "Accept-Encoding");
+            res->end ();
+            return;
+        }
+
+    res->writeStatus (http_status_t.OK_200);
+    res->writeHeader (header_key_t.content_type, entry->content_type);
+    res->writeHeader ("ETag", f->etag);
+    // always revalidate, unchanged file only costs a 304
+    res->writeHeader ("Cache-Control", "no-cache");
+
+    if (has_variant)
+        res->writeHeader ("Vary", "Accept-Encoding");
+
+    if (enc != ENCODING_IDENTITY)
+        res->writeHeader ("Content-Encoding", encoding_names[enc]);
+
+    if (!f->size)
+        {
+            res->end ();
+            return;
+        }
+
+    if (_stream (res, f))
+        return;
+
+    // mapped memory lives until unload, nothing to clean up
+    res->onAborted ([] () {});
+
+    res->onWritable ([res, f] (uintmax_t) { return _stream (res, f); });
+}
+
+} // musicat::server::static_files
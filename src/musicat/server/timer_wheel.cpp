@@ -0,0 +1,255 @@
+#include "musicat/server/timer_wheel.h"
+#include <chrono>
+#include <libusockets.h>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// hierarchical timing wheel, each level covers SLOTS times the span of the
+// level below it: 6.4s, 6.8m, 7.3h, 19.4d with 100ms tick
+#define LEVEL_BITS 6
+#define SLOTS (1 << LEVEL_BITS)
+#define SLOT_MASK (SLOTS - 1)
+#define LEVELS 4
+
+namespace musicat::server::timer_wheel
+{
+
+struct wheel_timer_t
+{
+    timer_id_t id;
+    uint64_t expire_tick;
+    std::function<void ()> cb;
+};
+
+using slot_t = std::list<wheel_timer_t>;
+
+struct location_t
+{
+    slot_t *slot;
+    slot_t::iterator i;
+};
+
+static std::mutex _m;
+
+static slot_t _wheel[LEVELS][SLOTS];
+static std::unordered_map<timer_id_t, location_t> _index;
+
+static timer_id_t _last_id = 0;
+
+// ticks are counted from steady clock so catching up after a late callback
+// is exact
+static uint64_t _current_tick = 0;
+static bool _tick_initialized = false;
+
+static struct us_timer_t *_us_timer = nullptr;
+
+static uint64_t
+_now_tick ()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds> (
+               std::chrono::steady_clock::now ().time_since_epoch ())
+               .count ()
+           / TICK_MS;
+}
+
+// _m must be locked
+static void
+_init_tick ()
+{
+    if (_tick_initialized)
+        return;
+
+    _current_tick = _now_tick ();
+    _tick_initialized = true;
+}
+
+// _m must be locked
+static slot_t *
+_get_slot (uint64_t expire_tick)
+{
+    uint64_t delta
+        = expire_tick > _current_tick ? expire_tick - _current_tick : 0;
+
+    for (int level = 0; level < LEVELS; level++)
+        {
+            if (delta < ((uint64_t)1 << (LEVEL_BITS * (level + 1))))
+                return &_wheel[level][(expire_tick >> (LEVEL_BITS * level))
+                                      & SLOT_MASK];
+        }
+
+    // too far, park in the furthest slot of top level and replace it on
+    // cascade
+    const uint64_t max_tick
+        = _current_tick + ((uint64_t)1 << (LEVEL_BITS * LEVELS)) - 1;
+
+    return &_wheel[LEVELS - 1]
+                  [(max_tick >> (LEVEL_BITS * (LEVELS - 1))) & SLOT_MASK];
+}
+
+// _m must be locked, moves every timer of the slot down to where they belong
+// now, list nodes are spliced so index iterators stay valid
+static void
+_cascade (int level, int idx)
+{
+    slot_t pending;
+    pending.splice (pending.end (), _wheel[level][idx]);
+
+    while (!pending.empty ())
+        {
+            auto i = pending.begin ();
+            slot_t *target = _get_slot (i->expire_tick);
+
+            target->splice (target->end (), pending, i);
+            _index[i->id].slot = target;
+        }
+}
+
+// _m must be locked, collect due callbacks to be called without lock
+static void
+_advance (uint64_t to_tick, std::vector<std::function<void ()> > &due)
+{
+    while (_current_tick < to_tick)
+        {
+            _current_tick++;
+
+            for (int level = 1; level < LEVELS; level++)
+                {
+                    // only cascade when every lower level wrapped around
+                    if (_current_tick
+                        & (((uint64_t)1 << (LEVEL_BITS * level)) - 1))
+                        break;
+
+                    _cascade (level, (_current_tick >> (LEVEL_BITS * level))
+                                         & SLOT_MASK);
+                }
+
+            slot_t &slot = _wheel[0][_current_tick & SLOT_MASK];
+
+            auto i = slot.begin ();
+            while (i != slot.end ())
+                {
+                    // parked timer, still far away
+                    if (i->expire_tick > _current_tick)
+                        {
+                            auto next = std::next (i);
+                            slot_t *target = _get_slot (i->expire_tick);
+
+                            if (target != &slot)
+                                {
+                                    target->splice (target->end (), slot, i);
+                                    _index[i->id].slot = target;
+                                }
+
+                            i = next;
+                            continue;
+                        }
+
+                    _index.erase (i->id);
+                    due.push_back (std::move (i->cb));
+                    i = slot.erase (i);
+                }
+        }
+}
+
+static void
+_on_tick ([[maybe_unused]] struct us_timer_t *t)
+{
+    std::vector<std::function<void ()> > due;
+
+    {
+        std::lock_guard lk (_m);
+        _init_tick ();
+        _advance (_now_tick (), due);
+    }
+
+    for (auto &cb : due)
+        {
+            if (cb)
+                cb ();
+        }
+}
+
+int
+init (uWS::Loop *loop)
+{
+    std::lock_guard lk (_m);
+
+    if (_us_timer)
+        return 1;
+
+    _us_timer = us_create_timer ((struct us_loop_t *)loop, 0, 0);
+    us_timer_set (_us_timer, _on_tick, TICK_MS, TICK_MS);
+
+    return 0;
+}
+
+void
+shutdown ()
+{
+    std::lock_guard lk (_m);
+
+    if (_us_timer)
+        {
+            us_timer_close (_us_timer);
+            _us_timer = nullptr;
+        }
+
+    for (auto &level : _wheel)
+        {
+            for (auto &slot : level)
+                slot.clear ();
+        }
+
+    _index.clear ();
+}
+
+timer_id_t
+schedule (uint64_t ms, std::function<void ()> cb)
+{
+    std::lock_guard lk (_m);
+
+    _init_tick ();
+
+    // round up, never fire early
+    uint64_t expire_tick = _now_tick () + (ms + TICK_MS - 1) / TICK_MS;
+
+    // current tick slot has been processed
+    if (expire_tick <= _current_tick)
+        expire_tick = _current_tick + 1;
+
+    const timer_id_t id = ++_last_id;
+
+    slot_t *slot = _get_slot (expire_tick);
+    slot->push_back ({ id, expire_tick, std::move (cb) });
+
+    _index.insert_or_assign (id, location_t{ slot, std::prev (slot->end ()) });
+
+    return id;
+}
+
+bool
+cancel (timer_id_t id)
+{
+    std::lock_guard lk (_m);
+
+    auto i = _index.find (id);
+    if (i == _index.end ())
+        return false;
+
+    i->second.slot->erase (i->second.i);
+    _index.erase (i);
+
+    return true;
+}
+
+size_t
+get_pending_count ()
+{
+    std::lock_guard lk (_m);
+
+    return _index.size ();
+}
+
+} // musicat::server::timer_wheel
@@ -0,0 +1,196 @@
+#include "musicat/spotify_resolver.h"
+#include "musicat/YTDLPTrack.h"
+#include "musicat/db.h"
+#include "musicat/mctrack.h"
+#include "musicat/musicat.h"
+#include "musicat/thread_manager.h"
+#include "musicat/util/spotify_api.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// searches running at once, ytdlp.py --serve resolves 4 queries at a time
+#define RESOLVE_CONCURRENCY 4
+
+namespace musicat::spotify_resolver
+{
+
+namespace spotify_api = util::spotify_api;
+
+static player::MCTrack
+_search (const spotify_api::Track &track)
+{
+    const std::string q = track.artist.empty ()
+                              ? track.title
+                              : track.artist + " " + track.title;
+
+    auto res = mctrack::fetch ({ q, 1, false });
+
+    if (!res)
+        return {};
+
+    auto entries = YTDLPTrack::get_playlist_entries (*res);
+    if (entries.empty ())
+        return {};
+
+    return entries.front ();
+}
+
+// fill results with known mappings, returns index of tracks still to search
+static std::vector<size_t>
+_load_mappings (const std::vector<spotify_api::Track> &tracks,
+                std::vector<player::MCTrack> &results)
+{
+    std::vector<size_t> missing;
+    std::vector<std::string> ids;
+    ids.reserve (tracks.size ());
+
+    for (const auto &t : tracks)
+        {
+            if (!t.id.empty ())
+                ids.push_back (t.id);
+        }
+
+    std::unordered_map<std::string, nlohmann::json> known;
+
+    if (!ids.empty () && database::get_conn_status () == CONNECTION_OK)
+        {
+            auto mappings = database::get_spotify_track_mappings (ids);
+
+            for (auto &m : mappings.first)
+                known.insert_or_assign (m.spotify_id, std::move (m.raw));
+        }
+
+    for (size_t i = 0; i < tracks.size (); i++)
+        {
+            auto k = tracks[i].id.empty () ? known.end ()
+                                           : known.find (tracks[i].id);
+
+            if (k == known.end ())
+                {
+                    missing.push_back (i);
+                    continue;
+                }
+
+            results[i].raw = k->second;
+        }
+
+    return missing;
+}
+
+static void
+_save_mappings (const std::vector<spotify_api::Track> &tracks,
+                const std::vector<player::MCTrack> &results,
+                const std::vector<size_t> &searched)
+{
+    if (database::get_conn_status () != CONNECTION_OK)
+        return;
+
+    std::vector<database::spotify_track_mapping_t> mappings;
+    mappings.reserve (searched.size ());
+
+    for (const size_t i : searched)
+        {
+            if (tracks[i].id.empty () || results[i].raw.is_null ())
+                continue;
+
+            const std::string yid = mctrack::get_id (results[i]);
+            if (yid.empty ())
+                continue;
+
+            mappings.push_back ({ tracks[i].id, yid, results[i].raw });
+        }
+
+    if (mappings.empty ())
+        return;
+
+    if (database::update_spotify_track_mappings (mappings)
+        != PGRES_COMMAND_OK)
+        fprintf (stderr, "[spotify_resolver ERROR] Failed saving %zu track "
+                         "mappings\n",
+                 mappings.size ());
+}
+
+std::vector<player::MCTrack>
+resolve (const std::string &url, const std::string &client_id,
+         const std::string &client_secret)
+{
+    const bool debug = get_debug_state ();
+
+    const auto tracks
+        = spotify_api::fetch_tracks (url, client_id, client_secret);
+
+    if (tracks.empty ())
+        return {};
+
+    std::vector<player::MCTrack> results (tracks.size ());
+
+    const std::vector<size_t> missing = _load_mappings (tracks, results);
+
+    if (debug)
+        fprintf (stderr,
+                 "[spotify_resolver::resolve] %zu tracks, %zu to search: "
+                 "%s\n",
+                 tracks.size (), missing.size (), url.c_str ());
+
+    const size_t worker_count
+        = std::min<size_t> (RESOLVE_CONCURRENCY, missing.size ());
+
+    // shared with workers so the last one can still notify after resolve
+    // returns
+    struct workers_t
+    {
+        // workers pick the next unsearched track until none left
+        std::atomic<size_t> next;
+        size_t running;
+        std::mutex m;
+        std::condition_variable cv;
+    };
+
+    auto w = std::make_shared<workers_t> ();
+    w->next = 0;
+    w->running = worker_count;
+
+    for (size_t n = 0; n < worker_count; n++)
+        {
+            std::thread t ([w, &tracks, &results, &missing] () {
+                thread_manager::DoneSetter tmds;
+
+                size_t i;
+                while ((i = w->next++) < missing.size ()
+                       && get_running_state ())
+                    results[missing[i]] = _search (tracks[missing[i]]);
+
+                std::lock_guard lk (w->m);
+                w->running--;
+                w->cv.notify_all ();
+            });
+
+            thread_manager::dispatch (t);
+        }
+
+    {
+        std::unique_lock lk (w->m);
+        w->cv.wait (lk, [&w] () { return w->running == 0; });
+    }
+
+    if (!missing.empty ())
+        _save_mappings (tracks, results, missing);
+
+    std::vector<player::MCTrack> ret;
+    ret.reserve (results.size ());
+
+    for (auto &r : results)
+        {
+            if (!r.raw.is_null ())
+                ret.push_back (std::move (r));
+        }
+
+    return ret;
+}
+
+} // musicat::spotify_resolver
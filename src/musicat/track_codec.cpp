@@ -0,0 +1,479 @@
+#include "musicat/track_codec.h"
+#include "musicat/mctrack.h"
+#include <cstring>
+#include <unordered_map>
+
+namespace musicat::track_codec
+{
+
+enum record_kind_e : uint8_t
+{
+    // known yt-dlp fields only
+    RECORD_COMPACT,
+    // full raw json dump
+    RECORD_JSON,
+};
+
+// order is part of the format, only append
+enum field_e
+{
+    F_ID,
+    F_TITLE,
+    F_CHANNEL,
+    F_URL,
+    F_ORIGINAL_URL,
+    F_WEBPAGE_URL,
+    F_THUMBNAIL,
+    F_DESCRIPTION,
+    F_EXTRACTOR,
+    F_EXTRACTOR_KEY,
+    F_IE_KEY,
+    F_WEBPAGE_URL_DOMAIN,
+    F_STRING_MAX,
+};
+
+static const char *const field_keys[F_STRING_MAX] = {
+    "id",
+    "title",
+    "channel",
+    "url",
+    "original_url",
+    "webpage_url",
+    "thumbnail",
+    "description",
+    "extractor",
+    "extractor_key",
+    "ie_key",
+    "webpage_url_domain",
+};
+
+// mask bit after every string field
+static constexpr const uint64_t DURATION_BIT = 1ULL << F_STRING_MAX;
+
+#define HEADER_SIZE (sizeof (MAGIC) - 1 + 1)
+
+struct writer_t
+{
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, uint64_t> index;
+    // dumps referenced by strings
+    std::deque<std::string> owned;
+    std::string records;
+};
+
+static void
+_put_varint (std::string &out, uint64_t v)
+{
+    while (v >= 0x80)
+        {
+            out += (char)((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+
+    out += (char)v;
+}
+
+static void
+_put_double (std::string &out, double v)
+{
+    uint64_t bits;
+    memcpy (&bits, &v, sizeof (bits));
+
+    // little endian regardless of host
+    for (int i = 0; i < 8; i++)
+        out += (char)((bits >> (i * 8)) & 0xff);
+}
+
+// s must outlive the writer
+static uint64_t
+_intern (writer_t &w, std::string_view s)
+{
+    auto i = w.index.find (s);
+    if (i != w.index.end ())
+        return i->second;
+
+    const uint64_t idx = w.strings.size ();
+    w.strings.push_back (s);
+    w.index.emplace (s, idx);
+
+    return idx;
+}
+
+static uint64_t
+_intern_owned (writer_t &w, std::string &&s)
+{
+    w.owned.push_back (std::move (s));
+
+    return _intern (w, w.owned.back ());
+}
+
+// only yt-dlp tracks with every known field of the expected type
+static bool
+_is_compactable (const nlohmann::json &raw)
+{
+    if (!mctrack::is_YTDLPTrack (mctrack::get_track_flag (raw)))
+        return false;
+
+    for (int f = 0; f < F_STRING_MAX; f++)
+        {
+            auto i = raw.find (field_keys[f]);
+            if (i == raw.end ())
+                continue;
+
+            // flags are decided by key presence, null must survive
+            if (!i->is_string ()
+                && (!i->is_null () || f == F_EXTRACTOR_KEY || f == F_IE_KEY))
+                return false;
+        }
+
+    auto d = raw.find ("duration");
+    if (d != raw.end () && !d->is_null () && !d->is_number ())
+        return false;
+
+    return true;
+}
+
+static void
+_write_track (writer_t &w, const player::MCTrack &t)
+{
+    std::string &out = w.records;
+
+    const bool compact = _is_compactable (t.raw);
+
+    out += (char)(compact ? RECORD_COMPACT : RECORD_JSON);
+
+    _put_varint (out, _intern (w, t.filename));
+
+    // 0 is null
+    if (t.info.raw.is_null ())
+        _put_varint (out, 0);
+    else
+        _put_varint (out, _intern_owned (w, t.info.raw.dump ()) + 1);
+
+    if (!compact)
+        {
+            _put_varint (out, _intern_owned (w, t.raw.dump ()));
+            return;
+        }
+
+    uint64_t mask = 0;
+    uint64_t idx[F_STRING_MAX];
+
+    for (int f = 0; f < F_STRING_MAX; f++)
+        {
+            auto i = t.raw.find (field_keys[f]);
+            if (i == t.raw.end () || !i->is_string ())
+                continue;
+
+            mask |= 1ULL << f;
+            idx[f] = _intern (w, i->get_ref<const std::string &> ());
+        }
+
+    auto d = t.raw.find ("duration");
+    if (d != t.raw.end () && d->is_number ())
+        mask |= DURATION_BIT;
+
+    _put_varint (out, mask);
+
+    for (int f = 0; f < F_STRING_MAX; f++)
+        if (mask & (1ULL << f))
+            _put_varint (out, idx[f]);
+
+    if (mask & DURATION_BIT)
+        _put_double (out, d->get<double> ());
+}
+
+static std::string
+_finish (writer_t &w, size_t track_count)
+{
+    std::string out;
+
+    size_t size = HEADER_SIZE + w.records.size () + 20;
+    for (const std::string_view &s : w.strings)
+        size += s.size () + 5;
+
+    out.reserve (size);
+
+    out.append (MAGIC, sizeof (MAGIC) - 1);
+    out += (char)VERSION;
+
+    _put_varint (out, w.strings.size ());
+    for (const std::string_view &s : w.strings)
+        {
+            _put_varint (out, s.size ());
+            out.append (s);
+        }
+
+    _put_varint (out, track_count);
+    out += w.records;
+
+    return out;
+}
+
+std::string
+encode (const std::deque<player::MCTrack> &tracks)
+{
+    writer_t w;
+
+    for (const player::MCTrack &t : tracks)
+        _write_track (w, t);
+
+    return _finish (w, tracks.size ());
+}
+
+std::string
+encode (const player::MCTrack &track)
+{
+    writer_t w;
+
+    _write_track (w, track);
+
+    return _finish (w, 1);
+}
+
+struct reader_t
+{
+    const unsigned char *p;
+    const unsigned char *end;
+    bool ok;
+
+    uint64_t
+    varint ()
+    {
+        uint64_t v = 0;
+
+        for (int shift = 0; shift < 64; shift += 7)
+            {
+                if (p >= end)
+                    break;
+
+                const unsigned char c = *p++;
+                v |= (uint64_t)(c & 0x7f) << shift;
+
+                if (!(c & 0x80))
+                    return v;
+            }
+
+        ok = false;
+        return 0;
+    }
+
+    double
+    f64 ()
+    {
+        if (end - p < 8)
+            {
+                ok = false;
+                return 0;
+            }
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; i++)
+            bits |= (uint64_t)p[i] << (i * 8);
+
+        p += 8;
+
+        double v;
+        memcpy (&v, &bits, sizeof (v));
+
+        return v;
+    }
+};
+
+struct record_t
+{
+    uint8_t kind;
+    uint64_t filename;
+    // 0 is null
+    uint64_t raw_info;
+    // RECORD_JSON
+    uint64_t raw;
+    // RECORD_COMPACT
+    uint64_t mask;
+    uint64_t idx[F_STRING_MAX];
+    double duration;
+};
+
+/**
+ * @brief Read one blob header and string table, strings point into data
+ *
+ * @return int 0 on success, -1 malformed, -2 unsupported version
+ */
+static int
+_read_header (reader_t &r, std::vector<std::string_view> &strings,
+              uint64_t &track_count)
+{
+    if ((size_t)(r.end - r.p) < HEADER_SIZE
+        || memcmp (r.p, MAGIC, sizeof (MAGIC) - 1) != 0)
+        return -1;
+
+    if (r.p[sizeof (MAGIC) - 1] != VERSION)
+        return -2;
+
+    r.p += HEADER_SIZE;
+
+    const uint64_t count = r.varint ();
+    if (!r.ok || count > (uint64_t)(r.end - r.p))
+        return -1;
+
+    strings.clear ();
+    strings.reserve (count);
+
+    for (uint64_t i = 0; i < count; i++)
+        {
+            const uint64_t len = r.varint ();
+            if (!r.ok || len > (uint64_t)(r.end - r.p))
+                return -1;
+
+            strings.emplace_back ((const char *)r.p, len);
+            r.p += len;
+        }
+
+    track_count = r.varint ();
+
+    return r.ok ? 0 : -1;
+}
+
+static bool
+_read_record (reader_t &r, size_t string_count, record_t &rec)
+{
+    if (r.p >= r.end)
+        return false;
+
+    rec.kind = *r.p++;
+    rec.filename = r.varint ();
+    rec.raw_info = r.varint ();
+
+    if (rec.filename >= string_count || rec.raw_info > string_count)
+        return false;
+
+    if (rec.kind == RECORD_JSON)
+        {
+            rec.raw = r.varint ();
+            return r.ok && rec.raw < string_count;
+        }
+
+    if (rec.kind != RECORD_COMPACT)
+        return false;
+
+    rec.mask = r.varint ();
+
+    for (int f = 0; f < F_STRING_MAX; f++)
+        {
+            if (!(rec.mask & (1ULL << f)))
+                continue;
+
+            rec.idx[f] = r.varint ();
+            if (rec.idx[f] >= string_count)
+                return false;
+        }
+
+    if (rec.mask & DURATION_BIT)
+        rec.duration = r.f64 ();
+
+    return r.ok;
+}
+
+// calls handler for every record of every blob in data
+template <typename F>
+static int
+_read_all (std::string_view data, F &&handler)
+{
+    reader_t r = { (const unsigned char *)data.data (),
+                   (const unsigned char *)data.data () + data.size (), true };
+
+    std::vector<std::string_view> strings;
+
+    while (r.p < r.end)
+        {
+            uint64_t track_count = 0;
+
+            const int status = _read_header (r, strings, track_count);
+            if (status != 0)
+                return status;
+
+            for (uint64_t i = 0; i < track_count; i++)
+                {
+                    record_t rec;
+
+                    if (!_read_record (r, strings.size (), rec))
+                        return -1;
+
+                    handler (strings, rec);
+                }
+        }
+
+    return 0;
+}
+
+// tracks often share the same info, parsed once per decode
+using info_cache_t = std::unordered_map<std::string_view, nlohmann::json>;
+
+static player::MCTrack
+_build_track (const std::vector<std::string_view> &strings,
+              const record_t &rec, info_cache_t &infos)
+{
+    player::MCTrack t;
+    t.filename = strings[rec.filename];
+
+    if (rec.raw_info)
+        {
+            const std::string_view dump = strings[rec.raw_info - 1];
+
+            auto i = infos.find (dump);
+            if (i == infos.end ())
+                i = infos
+                        .emplace (dump,
+                                  nlohmann::json::parse (dump, nullptr, false))
+                        .first;
+
+            if (!i->second.is_discarded ())
+                t.info.raw = i->second;
+        }
+
+    if (rec.kind == RECORD_JSON)
+        {
+            t.raw = nlohmann::json::parse (strings[rec.raw], nullptr, false);
+
+            if (t.raw.is_discarded ())
+                t.raw = nullptr;
+
+            return t;
+        }
+
+    t.raw = nlohmann::json::object ();
+
+    for (int f = 0; f < F_STRING_MAX; f++)
+        if (rec.mask & (1ULL << f))
+            t.raw[field_keys[f]] = std::string (strings[rec.idx[f]]);
+
+    if (rec.mask & DURATION_BIT)
+        t.raw["duration"] = rec.duration;
+
+    return t;
+}
+
+int
+decode (std::string_view data, std::deque<player::MCTrack> &out)
+{
+    info_cache_t infos;
+
+    return _read_all (data,
+                      [&out, &infos] (
+                          const std::vector<std::string_view> &strings,
+                          const record_t &rec) {
+                          out.push_back (_build_track (strings, rec, infos));
+                      });
+}
+
+int
+decode_filenames (std::string_view data, std::vector<std::string> &out)
+{
+    return _read_all (
+        data, [&out] (const std::vector<std::string_view> &strings,
+                      const record_t &rec) {
+            out.emplace_back (strings[rec.filename]);
+        });
+}
+
+} // musicat::track_codec
@@ -0,0 +1,40 @@
+#include "musicat/util/hash.h"
+#include <stdio.h>
+
+namespace musicat::util::hash
+{
+uint64_t
+fnv1a_64 (std::string_view data)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (unsigned char c : data)
+        {
+            h ^= c;
+            h *= 0x100000001b3ULL;
+        }
+
+    return h;
+}
+
+std::string
+create_etag (std::string_view data, std::string_view suffix)
+{
+    char buf[40];
+    snprintf (buf, sizeof (buf), "%016lx-%zx",
+              (unsigned long)fnv1a_64 (data), data.size ());
+
+    std::string ret = "\"";
+    ret += buf;
+
+    if (!suffix.empty ())
+        {
+            ret += '-';
+            ret += suffix;
+        }
+
+    ret += '"';
+
+    return ret;
+}
+} // musicat::util::hash
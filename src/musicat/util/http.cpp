@@ -0,0 +1,327 @@
+#include "musicat/util/http.h"
+#include "musicat/musicat.h"
+#include <chrono>
+#include <condition_variable>
+#include <curl/curl.h>
+#include <map>
+#include <mutex>
+
+// concurrent requests to the same host, the rest wait for a free slot
+#define MAX_HOST_CONCURRENCY 8
+// idle easy handles kept for reuse
+#define MAX_IDLE_HANDLES 16
+// open connections kept in each idle handle's own connection cache
+#define MAX_CONNECTIONS 32L
+
+#define DEFAULT_TIMEOUT_MS 30000
+#define CONNECT_TIMEOUT_MS 10000
+
+namespace musicat::util::http
+{
+
+struct host_t
+{
+    host_stats_t stats;
+    std::condition_variable cv;
+};
+
+static CURLSH *_share = NULL;
+// locks for every data type shared through _share
+static std::mutex _share_m[CURL_LOCK_DATA_LAST];
+
+static std::mutex _handles_m;
+static std::vector<CURL *> _handles;
+
+static std::mutex _hosts_m;
+static std::map<std::string, host_t> _hosts;
+
+static void
+_share_lock (CURL *handle, curl_lock_data data, curl_lock_access access,
+             void *userptr)
+{
+    (void)handle;
+    (void)access;
+    (void)userptr;
+
+    _share_m[data].lock ();
+}
+
+static void
+_share_unlock (CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void)handle;
+    (void)userptr;
+
+    _share_m[data].unlock ();
+}
+
+static size_t
+_write_cb (char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    ((std::string *)userdata)->append (ptr, size * nmemb);
+
+    return size * nmemb;
+}
+
+static std::string
+_get_host (const std::string &url)
+{
+    size_t start = url.find ("://");
+    start = start == std::string::npos ? 0 : start + 3;
+
+    const size_t end = url.find_first_of ("/?#", start);
+
+    return url.substr (start, end == std::string::npos ? std::string::npos
+                                                        : end - start);
+}
+
+static CURL *
+_acquire_handle ()
+{
+    {
+        std::lock_guard lk (_handles_m);
+
+        if (!_handles.empty ())
+            {
+                CURL *h = _handles.back ();
+                _handles.pop_back ();
+                return h;
+            }
+    }
+
+    return curl_easy_init ();
+}
+
+static void
+_release_handle (CURL *h)
+{
+    // keeps connection and cache, only options are cleared
+    curl_easy_reset (h);
+
+    {
+        std::lock_guard lk (_handles_m);
+
+        if (_handles.size () < MAX_IDLE_HANDLES)
+            {
+                _handles.push_back (h);
+                return;
+            }
+    }
+
+    curl_easy_cleanup (h);
+}
+
+static host_t &
+_acquire_host (const std::string &host)
+{
+    std::unique_lock lk (_hosts_m);
+
+    host_t &h = _hosts[host];
+    h.stats.host = host;
+
+    h.stats.waiting++;
+    h.cv.wait (lk, [&h] () { return h.stats.active < MAX_HOST_CONCURRENCY; });
+    h.stats.waiting--;
+
+    h.stats.active++;
+
+    return h;
+}
+
+static void
+_release_host (host_t &h, bool success, bool reused, uint64_t ms)
+{
+    {
+        std::lock_guard lk (_hosts_m);
+
+        h.stats.active--;
+        h.stats.requests++;
+
+        if (!success)
+            h.stats.failures++;
+
+        if (reused)
+            h.stats.reused++;
+
+        h.stats.total_ms += ms;
+        if (ms > h.stats.max_ms)
+            h.stats.max_ms = ms;
+    }
+
+    h.cv.notify_one ();
+}
+
+int
+init ()
+{
+    if (curl_global_init (CURL_GLOBAL_DEFAULT) != CURLE_OK)
+        {
+            fprintf (stderr,
+                     "[util::http::init ERROR] curl_global_init failed\n");
+            return -1;
+        }
+
+    _share = curl_share_init ();
+    if (!_share)
+        {
+            fprintf (stderr,
+                     "[util::http::init ERROR] curl_share_init failed\n");
+            return -1;
+        }
+
+    curl_share_setopt (_share, CURLSHOPT_LOCKFUNC, _share_lock);
+    curl_share_setopt (_share, CURLSHOPT_UNLOCKFUNC, _share_unlock);
+
+    // connection cache can't be shared by transfers running at the same
+    // time on different threads, every pooled handle keeps its own
+    curl_share_setopt (_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt (_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    return 0;
+}
+
+void
+shutdown ()
+{
+    {
+        std::lock_guard lk (_handles_m);
+
+        for (CURL *h : _handles)
+            curl_easy_cleanup (h);
+
+        _handles.clear ();
+    }
+
+    if (_share)
+        {
+            curl_share_cleanup (_share);
+            _share = NULL;
+        }
+
+    curl_global_cleanup ();
+}
+
+response_t
+perform (const request_t &req)
+{
+    response_t res = { false, 0, 0, "", "" };
+
+    CURL *h = _acquire_handle ();
+    if (!h)
+        {
+            res.error = "curl_easy_init failed";
+            return res;
+        }
+
+    struct curl_slist *headers = NULL;
+    for (const std::string &header : req.headers)
+        headers = curl_slist_append (headers, header.c_str ());
+
+    char errbuf[CURL_ERROR_SIZE] = "";
+
+    curl_easy_setopt (h, CURLOPT_URL, req.url.c_str ());
+    if (_share)
+        curl_easy_setopt (h, CURLOPT_SHARE, _share);
+    curl_easy_setopt (h, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt (h, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt (h, CURLOPT_MAXCONNECTS, MAX_CONNECTIONS);
+    // multi threaded, timeouts must not use signals
+    curl_easy_setopt (h, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt (h, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt (h, CURLOPT_CONNECTTIMEOUT_MS, (long)CONNECT_TIMEOUT_MS);
+    curl_easy_setopt (h, CURLOPT_TIMEOUT_MS,
+                      req.timeout_ms > 0 ? req.timeout_ms
+                                         : (long)DEFAULT_TIMEOUT_MS);
+    curl_easy_setopt (h, CURLOPT_ERRORBUFFER, errbuf);
+    curl_easy_setopt (h, CURLOPT_WRITEFUNCTION, _write_cb);
+    curl_easy_setopt (h, CURLOPT_WRITEDATA, &res.response);
+
+    if (req.include_header)
+        curl_easy_setopt (h, CURLOPT_HEADER, 1L);
+
+    if (headers)
+        curl_easy_setopt (h, CURLOPT_HTTPHEADER, headers);
+
+    if (!req.body.empty ())
+        {
+            curl_easy_setopt (h, CURLOPT_POSTFIELDS, req.body.c_str ());
+            curl_easy_setopt (h, CURLOPT_POSTFIELDSIZE_LARGE,
+                              (curl_off_t)req.body.length ());
+        }
+
+    if (!req.method.empty ())
+        curl_easy_setopt (h, CURLOPT_CUSTOMREQUEST, req.method.c_str ());
+
+    if (get_debug_state ())
+        {
+            const char *method = !req.method.empty () ? req.method.c_str ()
+                                 : req.body.empty ()  ? "GET"
+                                                      : "POST";
+
+            fprintf (stderr, "[util::http] %s %s\n", method, req.url.c_str ());
+        }
+
+    host_t &host = _acquire_host (_get_host (req.url));
+
+    const auto start = std::chrono::steady_clock::now ();
+
+    const CURLcode code = curl_easy_perform (h);
+
+    const uint64_t ms
+        = std::chrono::duration_cast<std::chrono::milliseconds> (
+              std::chrono::steady_clock::now () - start)
+              .count ();
+
+    long connects = 0;
+
+    if (code == CURLE_OK)
+        {
+            res.success = true;
+            curl_easy_getinfo (h, CURLINFO_RESPONSE_CODE, &res.status);
+            curl_easy_getinfo (h, CURLINFO_HEADER_SIZE, &res.header_size);
+            curl_easy_getinfo (h, CURLINFO_NUM_CONNECTS, &connects);
+        }
+    else
+        {
+            res.error = errbuf[0] ? errbuf : curl_easy_strerror (code);
+
+            fprintf (stderr, "[util::http ERROR] %s: %s\n", req.url.c_str (),
+                     res.error.c_str ());
+        }
+
+    _release_host (host, res.success, res.success && connects == 0, ms);
+
+    _release_handle (h);
+    curl_slist_free_all (headers);
+
+    return res;
+}
+
+response_t
+get (const std::string &url, const std::vector<std::string> &headers)
+{
+    return perform ({ url, "", headers, "", false, 0 });
+}
+
+response_t
+post (const std::string &url, const std::string &body,
+      const std::vector<std::string> &headers)
+{
+    return perform ({ url, "", headers, body, false, 0 });
+}
+
+std::vector<host_stats_t>
+get_stats ()
+{
+    std::lock_guard lk (_hosts_m);
+
+    std::vector<host_stats_t> ret;
+    ret.reserve (_hosts.size ());
+
+    for (const auto &i : _hosts)
+        ret.push_back (i.second.stats);
+
+    return ret;
+}
+
+} // musicat::util::http
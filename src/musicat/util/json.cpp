@@ -0,0 +1,47 @@
+#include "musicat/util/json.h"
+
+namespace musicat::util::json
+{
+size_t
+estimate_size (const nlohmann::json &j)
+{
+    switch (j.type ())
+        {
+        case nlohmann::json::value_t::object:
+            {
+                // braces, then quotes, colon and comma around every key
+                size_t size = 2;
+
+                for (auto i = j.begin (); i != j.end (); i++)
+                    size += i.key ().size () + 4 + estimate_size (i.value ());
+
+                return size;
+            }
+
+        case nlohmann::json::value_t::array:
+            {
+                size_t size = 2;
+
+                for (const nlohmann::json &v : j)
+                    size += estimate_size (v) + 1;
+
+                return size;
+            }
+
+        case nlohmann::json::value_t::string:
+            return j.get_ref<const std::string &> ().size () + 2;
+
+        case nlohmann::json::value_t::binary:
+            return j.get_binary ().size ();
+
+        case nlohmann::json::value_t::null:
+            return 4;
+
+        case nlohmann::json::value_t::boolean:
+            return 5;
+
+        default:
+            return 8;
+        }
+}
+} // musicat::util::json
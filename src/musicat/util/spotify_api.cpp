@@ -1,61 +1,92 @@
 #include "musicat/util/spotify_api.h"
 #include "musicat/util/base64.h"
+#include "musicat/util/http.h"
 #include "musicat/musicat.h"
-#include <list>
-#include <curlpp/Easy.hpp>
-#include <curlpp/Options.hpp>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <regex>
-#include <sstream>
+
+// refresh token this many seconds before spotify says it expires
+#define TOKEN_EXPIRY_MARGIN 60
+// 100 items per page, spotify playlists are capped at 10000 tracks
+#define MAX_PLAYLIST_PAGES 100
 
 namespace musicat::util::spotify_api {
 
+static std::mutex token_m;
+static std::string token;
+static std::string token_client_id;
+static std::chrono::steady_clock::time_point token_expiry;
+
 static std::string
-request(const std::string &url, const std::list<std::string> &headers,
-        const std::string &post)
+request(const std::string &url, const std::vector<std::string> &headers,
+        const std::string &post, long *code = nullptr)
 {
-    curlpp::Easy req;
-    std::ostringstream os;
-    req.setOpt(curlpp::options::Url(url));
-    req.setOpt(curlpp::options::WriteStream(&os));
-    if (!headers.empty())
-        req.setOpt(curlpp::options::HttpHeader(headers));
-    if (!post.empty()) {
-        req.setOpt(curlpp::options::PostFields(post));
-        req.setOpt(curlpp::options::PostFieldSize(post.size()));
-    }
+    auto res = post.empty() ? http::get(url, headers)
+                            : http::post(url, post, headers);
+    if (code)
+        *code = res.status;
     if (get_debug_state())
-        fprintf(stderr, "[spotify_api] %s %s\n",
-                post.empty() ? "GET" : "POST", url.c_str());
-
-    try {
-        req.perform();
-        std::string res = os.str();
-        if (get_debug_state())
-            fprintf(stderr, "[spotify_api] response: %s\n", res.c_str());
-        return res;
-    } catch (std::exception &e) {
-        fprintf(stderr, "[spotify_api ERROR] %s: %s\n", url.c_str(), e.what());
-        return "";
-    }
+        fprintf(stderr, "[spotify_api] response: %s\n", res.response.c_str());
+    return res.success ? res.response : "";
 }
 
-std::string
-authenticate(const std::string &client_id, const std::string &client_secret)
+static nlohmann::json
+request_token(const std::string &client_id, const std::string &client_secret)
 {
     std::string creds = client_id + ":" + client_secret;
     std::string auth =
         "Authorization: Basic " + util::base64::encode_standard(creds);
-    std::list<std::string> headers = {
+    std::vector<std::string> headers = {
         "Content-Type: application/x-www-form-urlencoded", auth };
     std::string body = "grant_type=client_credentials";
     auto res = request("https://accounts.spotify.com/api/token", headers, body);
-    auto j = nlohmann::json::parse(res, nullptr, false);
+    return nlohmann::json::parse(res, nullptr, false);
+}
+
+std::string
+authenticate(const std::string &client_id, const std::string &client_secret)
+{
+    auto j = request_token(client_id, client_secret);
     if (!j.is_object())
         return "";
     return j.value("access_token", "");
 }
 
+std::string
+get_access_token(const std::string &client_id,
+                 const std::string &client_secret, bool refresh)
+{
+    std::lock_guard lk(token_m);
+
+    const auto now = std::chrono::steady_clock::now();
+
+    if (!refresh && !token.empty() && token_client_id == client_id &&
+        now < token_expiry)
+        return token;
+
+    token = "";
+
+    auto j = request_token(client_id, client_secret);
+    if (!j.is_object() || !j.contains("access_token") ||
+        !j["access_token"].is_string())
+        return "";
+
+    int64_t expires_in = 3600;
+    if (j.contains("expires_in") && j["expires_in"].is_number_integer())
+        expires_in = j["expires_in"].get<int64_t>();
+
+    token = j["access_token"].get<std::string>();
+    token_client_id = client_id;
+    token_expiry =
+        now + std::chrono::seconds(
+                  std::max<int64_t>(expires_in - TOKEN_EXPIRY_MARGIN, 0));
+
+    return token;
+}
+
 static bool
 parse_url(const std::string &url, std::string &type, std::string &id)
 {
@@ -69,65 +100,113 @@ parse_url(const std::string &url, std::string &type, std::string &id)
     return false;
 }
 
-std::vector<Track>
-fetch_tracks(const std::string &url_or_id, const std::string &access_token)
+static bool
+parse_track(const nlohmann::json &tr, Track &t)
+{
+    if (!tr.is_object())
+        return false;
+    if (tr.contains("id") && tr["id"].is_string())
+        t.id = tr["id"].get<std::string>();
+    if (tr.contains("name") && tr["name"].is_string())
+        t.title = tr["name"].get<std::string>();
+    if (tr.contains("artists") && tr["artists"].is_array() &&
+        tr["artists"].size() > 0 && tr["artists"][0].is_object())
+        t.artist = tr["artists"][0].value("name", "");
+    return !t.title.empty();
+}
+
+// sets unauthorized when token is rejected, caller can retry with a new one
+static std::vector<Track>
+fetch_tracks(const std::string &url_or_id, const std::string &access_token,
+             bool &unauthorized)
 {
+    unauthorized = false;
+
     std::string type;
     std::string id;
     if (!parse_url(url_or_id, type, id))
         return {};
 
-    std::list<std::string> headers = { "Authorization: Bearer " + access_token };
+    std::vector<std::string> headers = { "Authorization: Bearer " + access_token };
     std::vector<Track> out;
+    long code = 0;
 
     if (type == "track") {
-        std::string url =
-            "https://api.spotify.com/v1/tracks/" + id +
-            "?fields=name,artists(name)";
-        auto res = request(url, headers, "");
-        auto j = nlohmann::json::parse(res, nullptr, false);
-        if (j.is_object()) {
-            Track t;
-            t.title = j.value("name", "");
-            if (j.contains("artists") && j["artists"].is_array() &&
-                j["artists"].size() > 0)
-                t.artist = j["artists"][0].value("name", "");
-            if (!t.title.empty())
-                out.push_back(t);
+        std::string url = "https://api.spotify.com/v1/tracks/" + id;
+        auto res = request(url, headers, "", &code);
+        if (code == 401) {
+            unauthorized = true;
+            return {};
         }
+        auto j = nlohmann::json::parse(res, nullptr, false);
+        Track t;
+        if (parse_track(j, t))
+            out.push_back(t);
     } else if (type == "playlist") {
         std::string url =
             "https://api.spotify.com/v1/playlists/" + id +
-            "/tracks?fields=items(track(name,artists(name)))&limit=100";
-        auto res = request(url, headers, "");
-        auto j = nlohmann::json::parse(res, nullptr, false);
-        if (j.contains("items") && j["items"].is_array()) {
-            for (auto &it : j["items"]) {
-                if (!it.contains("track"))
-                    continue;
-                auto &tr = it["track"];
-                Track t;
-                t.title = tr.value("name", "");
-                if (tr.contains("artists") && tr["artists"].is_array() &&
-                    tr["artists"].size() > 0)
-                    t.artist = tr["artists"][0].value("name", "");
-                if (!t.title.empty())
-                    out.push_back(t);
+            "/tracks?fields=next,total,items(track(id,name,artists(name)))"
+            "&limit=100";
+
+        for (size_t page = 0; !url.empty() && page < MAX_PLAYLIST_PAGES;
+             page++) {
+            auto res = request(url, headers, "", &code);
+            if (code == 401) {
+                unauthorized = true;
+                return {};
             }
+
+            auto j = nlohmann::json::parse(res, nullptr, false);
+            if (!j.is_object())
+                break;
+
+            if (page == 0 && j.contains("total") &&
+                j["total"].is_number_unsigned())
+                out.reserve(j["total"].get<size_t>());
+
+            if (j.contains("items") && j["items"].is_array()) {
+                for (auto &it : j["items"]) {
+                    if (!it.is_object() || !it.contains("track"))
+                        continue;
+                    Track t;
+                    if (parse_track(it["track"], t))
+                        out.push_back(t);
+                }
+            }
+
+            url = "";
+            if (j.contains("next") && j["next"].is_string())
+                url = j["next"].get<std::string>();
         }
     }
     return out;
 }
 
+std::vector<Track>
+fetch_tracks(const std::string &url_or_id, const std::string &access_token)
+{
+    bool unauthorized;
+    return fetch_tracks(url_or_id, access_token, unauthorized);
+}
+
 std::vector<Track>
 fetch_tracks(const std::string &url_or_id, const std::string &client_id,
              const std::string &client_secret)
 {
-    auto token = authenticate(client_id, client_secret);
+    auto token = get_access_token(client_id, client_secret);
+    if (token.empty())
+        return {};
+
+    bool unauthorized;
+    auto out = fetch_tracks(url_or_id, token, unauthorized);
+    if (!unauthorized)
+        return out;
+
+    // revoked or expired early, retry once with a fresh token
+    token = get_access_token(client_id, client_secret, true);
     if (token.empty())
         return {};
-    return fetch_tracks(url_or_id, token);
+    return fetch_tracks(url_or_id, token, unauthorized);
 }
 
 } // namespace musicat::util::spotify_api
-
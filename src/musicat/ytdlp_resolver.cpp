@@ -0,0 +1,384 @@
+#include "musicat/ytdlp_resolver.h"
+#include "musicat/child/command.h"
+#include "musicat/child/ytdlp.h"
+#include "musicat/musicat.h"
+#include "musicat/thread_manager.h"
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+// helper needs time to import yt-dlp before it starts listening
+#define CONNECT_TIMEOUT_MS 30000
+#define CONNECT_RETRY_MS 100
+#define POLL_TIMEOUT_MS 1000
+// delay before restarting helper after it exited
+#define RESTART_DELAY_S 5
+#define RESOLVE_TIMEOUT_S 60
+
+namespace musicat::ytdlp_resolver
+{
+
+namespace cc = child::command;
+
+struct pending_t
+{
+    bool done;
+    int status;
+    nlohmann::json result;
+};
+
+static std::mutex _m;
+static std::condition_variable _cv;
+static int _fd = -1;
+static uint64_t _last_id = 0;
+static std::unordered_map<uint64_t, std::shared_ptr<pending_t> > _pending;
+
+// only one request written to socket at a time, held while writing so the
+// socket can't be closed meanwhile. Always locked before _m
+static std::mutex _write_m;
+
+static int
+_connect (const std::string &socket_path)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+
+    if (socket_path.length () >= sizeof (addr.sun_path))
+        {
+            fprintf (stderr,
+                     "[ytdlp_resolver::_connect ERROR] Socket path too long: "
+                     "%s\n",
+                     socket_path.c_str ());
+            return -1;
+        }
+
+    strcpy (addr.sun_path, socket_path.c_str ());
+
+    for (int waited = 0;
+         waited < CONNECT_TIMEOUT_MS && get_running_state ();
+         waited += CONNECT_RETRY_MS)
+        {
+            int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+                {
+                    perror ("[ytdlp_resolver::_connect ERROR] socket");
+                    return -1;
+                }
+
+            if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) == 0)
+                return fd;
+
+            close (fd);
+
+            std::this_thread::sleep_for (
+                std::chrono::milliseconds (CONNECT_RETRY_MS));
+        }
+
+    fprintf (stderr,
+             "[ytdlp_resolver::_connect ERROR] Timed out connecting to "
+             "'%s'\n",
+             socket_path.c_str ());
+
+    return -1;
+}
+
+static void
+_handle_reply (const std::string &line)
+{
+    nlohmann::json reply;
+
+    try
+        {
+            reply = nlohmann::json::parse (line);
+        }
+    catch (const nlohmann::detail::parse_error &e)
+        {
+            fprintf (stderr, "[ytdlp_resolver ERROR] parse_error: %s\n",
+                     e.what ());
+            return;
+        }
+
+    auto id_it = reply.find ("id");
+    if (id_it == reply.end () || !id_it->is_number_unsigned ())
+        return;
+
+    auto err_it = reply.find ("error");
+    if (err_it != reply.end () && get_debug_state ())
+        fprintf (stderr, "[ytdlp_resolver] Query %lu failed: %s\n",
+                 id_it->get<uint64_t> (), err_it->dump ().c_str ());
+
+    std::lock_guard lk (_m);
+
+    auto i = _pending.find (id_it->get<uint64_t> ());
+    // timed out and gone
+    if (i == _pending.end ())
+        return;
+
+    auto res_it = reply.find ("result");
+    if (res_it != reply.end ())
+        {
+            i->second->result = std::move (*res_it);
+            i->second->status = 0;
+        }
+    else
+        i->second->status = -1;
+
+    i->second->done = true;
+    _pending.erase (i);
+
+    _cv.notify_all ();
+}
+
+// returns on disconnect or when running state is false
+static void
+_read_replies (int fd)
+{
+    char buf[8192];
+    std::string line_buf;
+
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    while (get_running_state ())
+        {
+            const int pr = poll (&pfd, 1, POLL_TIMEOUT_MS);
+
+            if (pr < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    perror ("[ytdlp_resolver ERROR] poll");
+                    return;
+                }
+
+            if (pr == 0)
+                continue;
+
+            const ssize_t r = read (fd, buf, sizeof (buf));
+            if (r <= 0)
+                {
+                    if (r < 0 && errno == EINTR)
+                        continue;
+
+                    return;
+                }
+
+            line_buf.append (buf, r);
+
+            size_t start = 0, end;
+            while ((end = line_buf.find ('\n', start)) != std::string::npos)
+                {
+                    _handle_reply (line_buf.substr (start, end - start));
+                    start = end + 1;
+                }
+
+            line_buf.erase (0, start);
+        }
+}
+
+// fails every waiting query, letting their caller fall back
+static void
+_disconnect ()
+{
+    // fd must not be closed while resolve() is writing to it
+    std::lock_guard wlk (_write_m);
+    std::lock_guard lk (_m);
+
+    close_valid_fd (&_fd);
+
+    for (auto &i : _pending)
+        {
+            i.second->status = 1;
+            i.second->done = true;
+        }
+
+    _pending.clear ();
+
+    _cv.notify_all ();
+}
+
+static void
+_run ()
+{
+    while (get_running_state ())
+        {
+            const std::string slave_id
+                = "ytdlp-resolver." + std::to_string (time (NULL));
+
+            const std::string socket_path
+                = child::ytdlp::get_resolver_socket_path (slave_id);
+
+            const std::string cmd
+                = cc::create_arg_sanitize_value (cc::command_options_keys_t.id,
+                                                 slave_id)
+                  + cc::create_arg (
+                      cc::command_options_keys_t.command,
+                      cc::command_execute_commands_t.ytdlp_resolver)
+                  + cc::create_arg_sanitize_value (
+                      cc::command_options_keys_t.file_path, socket_path)
+                  + cc::create_arg_sanitize_value (
+                      cc::command_options_keys_t.ytdlp_util_exe,
+                      get_ytdlp_util_exe ())
+                  + cc::create_arg_sanitize_value (
+                      cc::command_options_keys_t.ytdlp_lib_path,
+                      get_ytdlp_lib_path ())
+                  + cc::get_dbg_str_arg ();
+
+            const std::string exit_cmd = cc::get_exit_command (slave_id);
+
+            if (cc::send_command_wr (cmd, exit_cmd, slave_id, 10) == 0)
+                {
+                    const int fd = _connect (socket_path);
+
+                    if (fd >= 0)
+                        {
+                            {
+                                std::lock_guard lk (_m);
+                                _fd = fd;
+                            }
+
+                            if (get_debug_state ())
+                                fprintf (stderr,
+                                         "[ytdlp_resolver] Connected to "
+                                         "'%s'\n",
+                                         socket_path.c_str ());
+
+                            _read_replies (fd);
+                        }
+
+                    _disconnect ();
+
+                    // helper exits by itself once disconnected
+                    cc::send_command (exit_cmd);
+                }
+
+            if (get_running_state ())
+                fprintf (stderr, "[ytdlp_resolver WARN] Resolver stopped, "
+                                 "restarting\n");
+
+            for (int i = 0; i < RESTART_DELAY_S && get_running_state (); i++)
+                std::this_thread::sleep_for (std::chrono::seconds (1));
+        }
+}
+
+int
+init ()
+{
+    if (get_ytdlp_util_exe ().empty ())
+        return 1;
+
+    std::thread t ([] () {
+        thread_manager::DoneSetter tmds;
+
+        _run ();
+    });
+
+    thread_manager::dispatch (t);
+
+    return 0;
+}
+
+bool
+is_ready ()
+{
+    std::lock_guard lk (_m);
+
+    return _fd >= 0;
+}
+
+int
+resolve (const std::string &query, int max_entries, nlohmann::json &result)
+{
+    uint64_t id;
+    auto p = std::make_shared<pending_t> ();
+    p->done = false;
+    p->status = 1;
+
+    {
+        std::lock_guard lk (_m);
+
+        if (_fd < 0)
+            return 1;
+
+        id = ++_last_id;
+        _pending[id] = p;
+    }
+
+    const std::string req
+        = nlohmann::json ({ { "id", id },
+                            { "query", query },
+                            { "max_entries", max_entries > 0 ? max_entries
+                                                             : 0 } })
+              .dump ()
+          + '\n';
+
+    bool write_err = false;
+    {
+        std::lock_guard wlk (_write_m);
+
+        // read again under _write_m, it might have been closed and its
+        // number reused by another descriptor since
+        int fd;
+        {
+            std::lock_guard lk (_m);
+            fd = _fd;
+        }
+
+        write_err = fd < 0;
+
+        size_t written = 0;
+        while (!write_err && written < req.length ())
+            {
+                const ssize_t w = send (fd, req.data () + written,
+                                        req.length () - written, MSG_NOSIGNAL);
+
+                if (w < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+
+                        write_err = true;
+                        break;
+                    }
+
+                written += w;
+            }
+    }
+
+    std::unique_lock lk (_m);
+
+    if (write_err)
+        {
+            _pending.erase (id);
+            return 1;
+        }
+
+    if (!_cv.wait_for (lk, std::chrono::seconds (RESOLVE_TIMEOUT_S),
+                       [p] () { return p->done; }))
+        {
+            _pending.erase (id);
+
+            fprintf (stderr,
+                     "[ytdlp_resolver::resolve ERROR] Timed out resolving "
+                     "'%s'\n",
+                     query.c_str ());
+
+            return -1;
+        }
+
+    if (p->status == 0)
+        result = std::move (p->result);
+
+    return p->status;
+}
+
+} // musicat::ytdlp_resolver
@@ -11,6 +11,8 @@ DEFAULT_PLAYLIST_ENTRY_PER_PAGE = 25
 # True will download the whole playlist (usually 6k+ entries)
 # then proceed to get detailed info for each entries!
 DEFAULT_YTDLP_PROCESS_ARG = False
+# concurrent queries in --serve mode
+DEFAULT_SERVE_WORKERS = 4
 
 # if len(sys.argv) < 3:
 #     printerr(r'args: <music_folder_path> <url>')
@@ -19,7 +21,9 @@ DEFAULT_YTDLP_PROCESS_ARG = False
 argvlen = len(sys.argv)
 if argvlen < 2:
     printerr(
-        'Usage: python ytdlp.py <url> [OPTIONS...]\nOptions:\n\t--ytdlp-dir <path>\n\t--max-entries <int>\tDefault',
+        'Usage: python ytdlp.py <url> [OPTIONS...]\n'
+        '       python ytdlp.py --serve <socket_path> [OPTIONS...]\n'
+        'Options:\n\t--ytdlp-dir <path>\n\t--max-entries <int>\tDefault',
         DEFAULT_PLAYLIST_ENTRY_PER_PAGE)
     exit(1)
 
@@ -41,6 +45,7 @@ def exitInvArgVal(arg, val):
 
 LIB_PATH = ''
 ARG_URL = ''
+SERVE_PATH = ''
 
 skipNext = False
 for i in range(1, argvlen):
@@ -67,6 +72,12 @@ for i in range(1, argvlen):
         skipNext = True
 
         LIB_PATH = argVal
+    elif (arg == "--serve"):
+        if not argVal or not len(argVal):
+            exitNoArgVal(arg)
+        skipNext = True
+
+        SERVE_PATH = argVal
     elif not skipNext:
         ARG_URL = arg
     else:
@@ -89,40 +100,110 @@ import yt_dlp
 # available options and public functions
 ydl_opts = {'logtostderr': True}
 
-with yt_dlp.YoutubeDL(ydl_opts) as ydl:
-    try:
-        info = ydl.extract_info(ARG_URL,
-                                download=False,
-                                process=DEFAULT_YTDLP_PROCESS_ARG)
 
-        # dir_name = create_dir_name(info['id'])
+def extract(ydl, url, max_entries):
+    info = ydl.extract_info(url,
+                            download=False,
+                            process=DEFAULT_YTDLP_PROCESS_ARG)
+
+    # ℹ️ ydl.sanitize_info makes the info json-serializable
+    sanitized_info = ydl.sanitize_info(info)
+
+    # printerr(json.dumps(sanitized_info))
+    # printerr('type: ', info['_type'])
+
+    if (info['_type'] == 'playlist' and info['entries']):
+        count = 0
+        results = []
+
+        for i, element in enumerate(info['entries']):
+            results.append(element)
+            count += 1
+            if count >= max_entries:
+                break
+
+        sanitized_info['entries'] = results
+
+    return sanitized_info
 
-        # folder_path = ARG_ROOT_PATH + '/' + dir_name
 
-        # printerr(r'Saving to ' + folder_path)
+def serve(socket_path):
+    """
+    Resolve queries for a single Musicat connection until it disconnects,
+    keeping yt_dlp imported and every worker's YoutubeDL instance (and its
+    caches) warm.
 
-        # if not os.path.exists(folder_path):
-        #     os.makedirs(folder_path)
+    Each line received is a json request {"id", "query", "max_entries"},
+    each line sent back is {"id", "result"} or {"id", "error"}, in
+    completion order.
+    """
+    import socket
+    import threading
+    from concurrent.futures import ThreadPoolExecutor
 
-        # ℹ️ ydl.sanitize_info makes the info json-serializable
-        sanitized_info = ydl.sanitize_info(info)
+    local = threading.local()
+    write_lock = threading.Lock()
 
-        # printerr(json.dumps(sanitized_info))
-        # printerr('type: ', info['_type'])
+    if os.path.exists(socket_path):
+        os.unlink(socket_path)
 
-        if (info['_type'] == 'playlist' and info['entries']):
-            count = 0
-            results = []
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server.bind(socket_path)
+    server.listen(1)
 
-            for i, element in enumerate(info['entries']):
-                results.append(element)
-                count += 1
-                if count >= max_entries:
-                    break
+    printerr("Resolver listening on", socket_path)
 
-            sanitized_info['entries'] = results
+    def get_ydl():
+        # YoutubeDL isn't thread safe, one instance per worker
+        if not hasattr(local, 'ydl'):
+            local.ydl = yt_dlp.YoutubeDL(ydl_opts)
+        return local.ydl
 
-        print(json.dumps(sanitized_info))
+    def reply(conn, res):
+        data = (json.dumps(res) + '\n').encode('utf-8')
+        with write_lock:
+            try:
+                conn.sendall(data)
+            except OSError as e:
+                printerr("ERROR RESOLVER REPLY:", e)
+
+    def handle(conn, req):
+        res = {'id': req.get('id')}
+        try:
+            res['result'] = extract(
+                get_ydl(), req['query'],
+                int(req.get('max_entries') or max_entries))
+        except Exception as e:
+            res['error'] = str(e)
+
+        reply(conn, res)
+
+    conn, _ = server.accept()
+    server.close()
+    os.unlink(socket_path)
+
+    with ThreadPoolExecutor(max_workers=DEFAULT_SERVE_WORKERS) as pool:
+        with conn.makefile('r', encoding='utf-8') as reader:
+            for line in reader:
+                try:
+                    req = json.loads(line)
+                except ValueError as e:
+                    printerr("ERROR RESOLVER REQUEST:", e)
+                    continue
+
+                pool.submit(handle, conn, req)
+
+    conn.close()
+    printerr("Resolver client disconnected")
+
+
+if len(SERVE_PATH):
+    serve(SERVE_PATH)
+    exit(0)
+
+with yt_dlp.YoutubeDL(ydl_opts) as ydl:
+    try:
+        print(json.dumps(extract(ydl, ARG_URL, max_entries)))
 
     except Exception as e:
         printerr("ERROR YT_DLP:")